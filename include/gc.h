@@ -4,9 +4,17 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 typedef void (*gc_trace_func)(void *object);
 
+// Tagged immediates: words with the low bit set (such as the interpreter's
+// fixnums) are values rather than heap references. GC allocations are always
+// at least pointer-aligned, so collectors and barriers can pass these through
+// without looking them up.
+#define GC_IS_IMMEDIATE(ptr) (((uintptr_t)(ptr) & 1u) != 0)
+
 enum {
     GC_GEN_UNKNOWN = 0,
     GC_GEN_NURSERY = 1,
@@ -21,9 +29,14 @@ enum {
     GC_TAG_VALUE_LAMBDA = 4,
     GC_TAG_VALUE_BUILTIN = 5,
     GC_TAG_VALUE_STRING = 6,
+    GC_TAG_VALUE_VECTOR = 7,
+    GC_TAG_VALUE_HASHTABLE = 8,
+    GC_TAG_VALUE_FUTURE = 9,
     GC_TAG_ENV = 10,
     GC_TAG_BINDING = 11,
-    GC_TAG_STRING = 12
+    GC_TAG_STRING = 12,
+    GC_TAG_HASH_BUCKETS = 13,
+    GC_TAG_CODE = 14
 };
 
 typedef struct {
@@ -69,10 +82,35 @@ typedef struct {
     double fragmentation_growth_rate; // Rate of fragmentation increase over time
 } GcStats;
 
-// Initialize the garbage collector. Must be called before any allocation.
+// Heaps ----------------------------------------------------------------------
+//
+// All collector state belongs to a GcHeap, so one process can run several
+// independent heaps, each with its own backend (one per thread, say). Every
+// other gc_* function acts on the calling thread's current heap (the tuning
+// setters, called while there is none, set the defaults for heaps created
+// later). A heap may move between threads but is current on at most one at
+// a time; the backend's own helper threads (parallel markers, the
+// background sweeper) are bound to it for the duration of their work.
+typedef struct GcHeap GcHeap;
+
+// Create a heap using the named backend (NULL: the GC_BACKEND environment
+// variable, else mark-sweep). The new heap is not entered.
+GcHeap *gc_heap_create(const char *backend);
+// Free `heap` and everything allocated from it. It must not be current on
+// any other thread; the caller leaves it if it was current there.
+void gc_heap_destroy(GcHeap *heap);
+// Make `heap` the calling thread's current heap (NULL: none) and return
+// the previous one.
+GcHeap *gc_heap_enter(GcHeap *heap);
+GcHeap *gc_heap_current(void);
+// The backend name `heap` was created with, as accepted by gc_heap_create.
+const char *gc_heap_backend_name(const GcHeap *heap);
+
+// Initialize the garbage collector: creates and enters a heap for the
+// calling thread when it has none. Must be called before any allocation.
 void gc_init(void);
 
-// Set the initial heap size (must be called before gc_init)
+// Set the initial heap size of heaps created from now on (process-wide).
 void gc_set_initial_heap_size(size_t size);
 
 // Get the configured initial heap size (returns 0 if not set)
@@ -81,6 +119,247 @@ size_t gc_get_initial_heap_size(void);
 // Allocate memory managed by the GC. Returns a pointer to a block of at least `size` bytes.
 void *gc_allocate(size_t size);
 
+// Inline allocation fast path ------------------------------------------------
+//
+// Bump-pointer backends (copying, the generational nursery) publish their
+// current allocation region in gc_alloc_region. Objects there start with a
+// GcBumpHeader, so gc_allocate_fast can carve and initialize one inline and
+// only calls gc_allocate_slow (the backend, through the vtable) when the
+// region is exhausted.
+typedef struct {
+    size_t size;          // aligned payload size
+    gc_trace_func trace;
+    void *forward;        // set while an object is being copied
+    unsigned char tag;
+    unsigned char age;    // collections survived (generational nursery)
+} GcBumpHeader;
+
+typedef struct {
+    unsigned char *cursor;
+    unsigned char *limit;
+    size_t allocated_bytes;  // requested bytes handed out inline; drained by the backend
+    unsigned char generation; // reported for objects carved from the region
+} GcAllocRegion;
+
+// Mark-sweep has no single region. It keeps its small size classes (one per
+// GC_SIZE_CLASS_GRANULE multiple) in gc_size_classes instead: a free list of
+// recycled blocks and a bump run of fresh ones per class. While `enabled`,
+// gc_allocate_fast pops or bumps a block itself, writes its GcBlockHeader and
+// sets its bit in the heap's object-start bitmap. Blocks at or past
+// `mark_from` start out marked, for the lazy sweeper. A class with neither
+// free blocks nor run left goes to gc_allocate_slow, which refills it; so
+// does every class while the backend has the state withdrawn.
+#define GC_SIZE_CLASS_GRANULE 16
+#define GC_SIZE_CLASS_COUNT 16
+
+typedef struct {
+    size_t size;          // user payload
+    size_t block_size;    // header + payload + padding
+    gc_trace_func trace;
+    unsigned char marked;
+    unsigned char tag;
+} GcBlockHeader;
+
+typedef struct GcFreeBlock {
+    size_t size;          // whole block
+    struct GcFreeBlock *next;
+} GcFreeBlock;
+
+typedef struct {
+    int enabled;
+    uintptr_t mark_from;
+    uint64_t *object_bits;   // one bit per pointer-sized granule from object_base
+    unsigned char *object_base;
+    // Indexed by block size / granule.
+    GcFreeBlock *free[GC_SIZE_CLASS_COUNT + 1];
+    unsigned char *cursor[GC_SIZE_CLASS_COUNT + 1];
+    unsigned char *limit[GC_SIZE_CLASS_COUNT + 1];
+    // Handed out inline; drained by the backend.
+    size_t allocated_bytes;  // requested
+    size_t block_bytes;
+    size_t objects;
+} GcSizeClasses;
+
+// Card-marking barrier fast path. A backend with a remembered old space
+// (generational) publishes a card table covering it: one byte per
+// GC_CARD_SIZE bytes, dirtied for the card holding the owner pointer
+// whenever the owner is stored into. The next minor collection re-traces
+// only the objects in dirty cards. Other backends leave the table empty and
+// the barrier does nothing.
+#define GC_CARD_SHIFT 9
+#define GC_CARD_SIZE ((uintptr_t)1 << GC_CARD_SHIFT)
+
+typedef struct {
+    unsigned char *cards;
+    uintptr_t base;
+    uintptr_t size;   // bytes covered; 0 when no card table is published
+} GcCardTable;
+
+// The per-heap fields the inline fast paths read. gc_fast_state points at
+// the current heap's copy (an empty one while no heap is current), and the
+// names below read it like plain globals, the way errno works.
+typedef struct {
+    GcAllocRegion alloc_region;
+    GcCardTable card_table;
+    int incremental_marking;  // see gc_write_barrier_fast
+    int heap_observed;        // see gc_heap_event
+    size_t move_epoch;
+    GcSizeClasses size_classes;
+} GcFastState;
+
+extern _Thread_local GcFastState *gc_fast_state;
+
+#define gc_alloc_region (gc_fast_state->alloc_region)
+#define gc_size_classes (gc_fast_state->size_classes)
+#define gc_card_table (gc_fast_state->card_table)
+#define gc_incremental_marking (gc_fast_state->incremental_marking)
+#define gc_heap_observed (gc_fast_state->heap_observed)
+// Bumped by every collection that may relocate objects. Tables that hash
+// heap objects by address rehash once it has changed since they were built.
+#define gc_move_epoch (gc_fast_state->move_epoch)
+
+#define GC_ALIGN_SIZE(size) (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+// Requests of at least this many bytes go to the large object space (their
+// own pages, never moved) instead of the backend's main heap.
+#define GC_LARGE_OBJECT_BYTES (8 * 1024)
+
+// Allocate a zeroed object with its trace function and tag already set.
+void *gc_allocate_slow(size_t size, gc_trace_func trace, unsigned char tag);
+// Like gc_allocate_slow, for objects expected to live long: backends with an
+// old generation place them there directly instead of the nursery. Old
+// objects must still go through the write barrier when they are mutated.
+void *gc_allocate_old(size_t size, gc_trace_func trace, unsigned char tag);
+
+// Heap event channel -----------------------------------------------------------
+//
+// Lets a heap visualizer follow the heap without re-walking it. Once
+// gc_heap_channel_open has been called, allocations, moves and frees are
+// appended to a ring of GC_HEAP_EVENT_WORDS-word entries, and the stats
+// block (laid out like gc_get_stats_flat) is republished after collections
+// and at eval boundaries. A reader remembers the last `sequence` it saw,
+// consumes the entries written since, and falls back to gc_heap_snapshot
+// when it is more than `capacity` events behind. Addresses are truncated to
+// 32 bits, which is the whole address on wasm32. Objects a lazy sweep has
+// not reached yet stay in the stream until it frees them. The native
+// background sweeper appends under the mark-sweep heap lock, so native
+// readers should not run alongside it.
+enum {
+    GC_EVENT_ALLOC = 1,       // addr, size, generation, tag
+    GC_EVENT_FREE = 2,        // addr
+    GC_EVENT_MOVE = 3,        // addr moved to `to`, now in `generation`
+    GC_EVENT_FREE_RANGE = 4,  // every object still in [addr, addr + size) died
+    GC_EVENT_RETAG = 5        // addr, tag
+};
+
+#define GC_HEAP_EVENT_WORDS 4
+#define GC_STATS_FLAT_COUNT 23
+
+// Entry layout: kind | generation << 8 | tag << 16, addr, size, to.
+typedef struct {
+    uint32_t sequence;        // events appended so far (wraps around)
+    uint32_t capacity;        // ring entries, a power of two
+    uint32_t stats_sequence;  // bumped whenever `stats` is republished
+    uint32_t event_words;     // GC_HEAP_EVENT_WORDS
+    double stats[GC_STATS_FLAT_COUNT];
+    uint32_t events[];
+} GcHeapChannel;
+
+// Open the channel with room for at least `capacity` events (returns the
+// existing one when already open), or NULL when out of memory.
+GcHeapChannel *gc_heap_channel_open(size_t capacity);
+void gc_heap_channel_close(void);
+// Refresh the channel's stats block.
+void gc_heap_channel_publish_stats(void);
+
+// gc_heap_observed is nonzero while heap events have a consumer (the
+// channel or the allocation profiler below); every event hook checks it
+// first.
+void gc_heap_event_record(unsigned kind, const void *addr, size_t size,
+                          unsigned generation, unsigned tag, const void *to);
+
+static inline void gc_heap_event(unsigned kind, const void *addr, size_t size,
+                                 unsigned generation, unsigned tag, const void *to) {
+    if (gc_heap_observed) gc_heap_event_record(kind, addr, size, generation, tag, to);
+}
+
+// Allocation profiling ---------------------------------------------------------
+//
+// Samples about one allocation per `sample_bytes` bytes allocated and
+// attributes it to the site id `site` returns. The callback runs inside the
+// allocator, so it must not allocate from the GC heap; ids are small and
+// dense, chosen by the caller. Sampled objects are then followed through
+// moves and frees, so each site also reports how much of what it allocated
+// is still live and how much was promoted to the old generation. Byte and
+// object counts are estimates scaled up from the samples.
+typedef uint32_t (*gc_alloc_site_func)(void);
+
+typedef struct {
+    size_t samples;
+    size_t allocated_bytes;
+    size_t allocated_objects;
+    size_t live_bytes;
+    size_t live_objects;
+    size_t promoted_bytes;
+    size_t promoted_objects;
+} GcAllocSiteStats;
+
+// Start a fresh profile, discarding the previous one.
+void gc_alloc_profile_start(size_t sample_bytes, gc_alloc_site_func site);
+// Stop sampling and following objects; the counters stay readable.
+void gc_alloc_profile_stop(void);
+int gc_alloc_profile_active(void);
+// One more than the highest site id seen so far.
+size_t gc_alloc_profile_site_count(void);
+void gc_alloc_profile_site_stats(uint32_t site, GcAllocSiteStats *out);
+
+static inline void *gc_allocate_fast(size_t size, gc_trace_func trace, unsigned char tag) {
+    size_t payload = GC_ALIGN_SIZE(size);
+    size_t total = sizeof(GcBumpHeader) + payload;
+    GcAllocRegion *region = &gc_alloc_region;
+    if ((size_t)(region->limit - region->cursor) >= total && size < GC_LARGE_OBJECT_BYTES) {
+        GcBumpHeader *header = (GcBumpHeader*)region->cursor;
+        region->cursor += total;
+        region->allocated_bytes += size;
+        header->size = payload;
+        header->trace = trace;
+        header->forward = NULL;
+        header->tag = tag;
+        header->age = 0;
+        void *payload_ptr = (void*)(header + 1);
+        memset(payload_ptr, 0, payload);
+        gc_heap_event(GC_EVENT_ALLOC, payload_ptr, payload, region->generation, tag, NULL);
+        return payload_ptr;
+    }
+    size_t cls = (GC_ALIGN_SIZE(sizeof(GcBlockHeader) + size) + GC_SIZE_CLASS_GRANULE - 1) / GC_SIZE_CLASS_GRANULE;
+    GcSizeClasses *classes = &gc_size_classes;
+    if (cls > GC_SIZE_CLASS_COUNT || !classes->enabled) return gc_allocate_slow(size, trace, tag);
+    size_t block_size = cls * GC_SIZE_CLASS_GRANULE;
+    GcBlockHeader *block = (GcBlockHeader*)classes->free[cls];
+    if (block) {
+        classes->free[cls] = classes->free[cls]->next;
+    } else if (classes->cursor[cls] != classes->limit[cls]) {
+        block = (GcBlockHeader*)classes->cursor[cls];
+        classes->cursor[cls] += block_size;
+    } else {
+        return gc_allocate_slow(size, trace, tag);
+    }
+    classes->allocated_bytes += size;
+    classes->block_bytes += block_size;
+    classes->objects++;
+    size_t index = (size_t)((unsigned char*)block - classes->object_base) / sizeof(void*);
+    classes->object_bits[index / 64] |= (uint64_t)1 << (index % 64);
+    block->size = size;
+    block->block_size = block_size;
+    block->trace = trace;
+    block->marked = (uintptr_t)block >= classes->mark_from;
+    block->tag = tag;
+    void *payload_ptr = (void*)(block + 1);
+    memset(payload_ptr, 0, size);
+    gc_heap_event(GC_EVENT_ALLOC, payload_ptr, size, GC_GEN_OLD, tag, NULL);
+    return payload_ptr;
+}
+
 // Assign a trace function to the allocation so the collector can follow references.
 void gc_set_trace(void *ptr, gc_trace_func trace);
 
@@ -94,9 +373,91 @@ void gc_set_tag(void *ptr, unsigned char tag);
 void gc_add_root(void **slot);
 void gc_remove_root(void **slot);
 
+// Register/unregister a shadow stack of roots. Each collection scans only the
+// live prefix base[0 .. *count), re-reading *count every cycle, and updates
+// moved pointers in place.
+void gc_add_root_range(void **base, const size_t *count);
+void gc_remove_root_range(void **base);
+
+// Register/unregister a weak root slot. Collections do not keep *slot alive:
+// they update it when the object moves and, once it has been collected, set
+// the slot to NULL and drop it (a slot holding NULL is dropped too), so it
+// needs no removal then. While an incremental cycle is marking, the slot may
+// still hold an object the cycle is about to clear; only store it into the
+// heap when the object is known to be reachable some other way.
+void gc_add_weak_root(void **slot);
+void gc_remove_weak_root(void **slot);
+
 // Inform the GC that `owner` now references `child` via `slot`.
 void gc_write_barrier(void *owner, void **slot, void *child);
 
+static inline void gc_card_mark(void *owner) {
+    uintptr_t offset = (uintptr_t)owner - gc_card_table.base;
+    if (offset < gc_card_table.size) gc_card_table.cards[offset >> GC_CARD_SHIFT] = 1;
+}
+
+// gc_incremental_marking is nonzero while an incremental marking cycle is in
+// progress. The barrier then also calls the backend, which records the value
+// about to be overwritten (snapshot-at-the-beginning) so marking cannot lose
+// it. Must run before the store so the backend can still read the old value.
+static inline void gc_write_barrier_fast(void *owner, void **slot, void *child) {
+    gc_card_mark(owner);
+    if (gc_incremental_marking) gc_write_barrier(owner, slot, child);
+}
+
+// Pause target for incremental collection, in milliseconds. Mark-sweep and
+// the generational old space then mark in slices of about this length,
+// interleaved with allocation, instead of in one stop-the-world pass.
+// 0 (the default) keeps collections stop-the-world. Falls back to the
+// GC_PAUSE_BUDGET_MS environment variable when never set.
+void gc_set_pause_budget_ms(double ms);
+double gc_get_pause_budget_ms(void);
+
+// Heap sizing goal. GC_GOAL_FIXED (the default) keeps the configured
+// geometry. The other goals resize the copying semispaces and the
+// generational nursery after each collection, and let the generational
+// backend tune its promotion age and major-collection growth factor from
+// survival statistics: GC_GOAL_THROUGHPUT grows the young space while
+// collections take more than a few percent of run time, GC_GOAL_LATENCY
+// shrinks it while young pauses exceed the pause budget (1 ms when none is
+// set). Falls back to the GC_HEAP_GOAL environment variable ("fixed",
+// "throughput" or "latency") when never set.
+enum {
+    GC_GOAL_FIXED = 0,
+    GC_GOAL_THROUGHPUT = 1,
+    GC_GOAL_LATENCY = 2
+};
+
+void gc_set_heap_goal(int goal);
+int gc_get_heap_goal(void);
+
+// Collection at interpreter eval boundaries (the end of each outermost
+// top-level evaluation; nested `load`/`eval` calls never collect there).
+// GC_EVAL_COLLECT_THRESHOLD (the default) collects only once half the GC
+// threshold has been allocated since the last collection; OFF leaves
+// collection to the allocator; IDLE also skips it and expects the host to
+// call gc_idle_collect when it has spare time; ALWAYS collects every time.
+// Falls back to the GC_EVAL_COLLECT environment variable ("off",
+// "threshold", "idle" or "always") when never set.
+enum {
+    GC_EVAL_COLLECT_OFF = 0,
+    GC_EVAL_COLLECT_THRESHOLD = 1,
+    GC_EVAL_COLLECT_IDLE = 2,
+    GC_EVAL_COLLECT_ALWAYS = 3
+};
+
+void gc_set_eval_collect_policy(int policy);
+int gc_get_eval_collect_policy(void);
+
+// Apply the eval-boundary policy. Called by the interpreter.
+void gc_eval_boundary(void);
+
+// Collect from an idle callback with about `budget_ms` to spare (0 means
+// no limit). Skips the collection when nothing was allocated since the last
+// one, or when the previous idle collection took longer than the budget.
+// Returns nonzero when a collection ran.
+int gc_idle_collect(double budget_ms);
+
 // Adjust/get the automatic GC threshold in bytes.
 void gc_set_threshold(size_t bytes);
 size_t gc_get_threshold(void);
@@ -104,6 +465,54 @@ size_t gc_get_threshold(void);
 // Get current GC statistics.
 void gc_get_stats(GcStats *out_stats);
 
+// Pause length at quantile `q` (0..1) over every pause so far, in
+// milliseconds, to within about 2%; 0 when nothing has paused yet.
+double gc_pause_percentile(double q);
+
+// Write the current statistics as one JSON object. gc_init registers an
+// exit handler doing this when GC_STATS_JSON names an output file, which
+// is how `make bench` collects results.
+void gc_write_stats_json(FILE *out);
+
+// Collection trace -----------------------------------------------------------
+//
+// Each heap keeps its most recent pauses in a ring, one event per
+// collection or incremental slice, with the bytes in use before and after
+// and the objects the pause scanned, copied and promoted. The ring holds
+// GC_TRACE_EVENTS events (default 4096; 0 turns tracing off) and grows to
+// that size only as events arrive. Under mark-sweep the sweep is lazy, so
+// bytes a collection frees show up in the bytes before later events.
+enum {
+    GC_TRACE_COLLECT = 0,      // whole stop-the-world collection
+    GC_TRACE_MINOR = 1,        // nursery collection
+    GC_TRACE_MAJOR = 2,        // old-generation collection
+    GC_TRACE_MARK_SLICE = 3,   // incremental marking step, or a cycle start
+    GC_TRACE_SWEEP_SLICE = 4   // incremental sweeping step
+};
+
+typedef struct {
+    double start_ms;           // gc_get_time_ms clock
+    double end_ms;
+    unsigned kind;
+    size_t bytes_before;
+    size_t bytes_after;
+    size_t objects_scanned;
+    size_t objects_copied;
+    size_t objects_promoted;
+} GcTraceEvent;
+
+// Events recorded so far, including those the ring has since dropped.
+size_t gc_trace_total(void);
+// Copy up to `capacity` of the retained events, oldest first; returns the
+// number written.
+size_t gc_trace_events(GcTraceEvent *out, size_t capacity);
+void gc_trace_clear(void);
+// The retained events in Chrome's trace event format, for chrome://tracing
+// or Perfetto: one complete event per pause plus a heap-size counter. The
+// text stays valid until the next call. GC_TRACE_JSON names a file that
+// gc_init arranges to receive it at exit.
+const char *gc_trace_json(void);
+
 // Helper getters for WASM binding
 double gc_get_collections_count(void);
 double gc_get_allocated_bytes(void);
@@ -113,6 +522,7 @@ double gc_get_current_bytes(void);
 // Snapshot current heap objects. Returns number of entries written.
 size_t gc_heap_snapshot(GcObjectInfo *out, size_t capacity);
 size_t gc_heap_snapshot_flat(uint32_t *out, size_t capacity);
+// Fills GC_STATS_FLAT_COUNT doubles.
 void gc_get_stats_flat(double *out_buffer, size_t buffer_size);
 size_t gc_heap_snapshot_entry_size(void);
 size_t gc_heap_snapshot_addr_offset(void);
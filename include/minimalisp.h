@@ -0,0 +1,24 @@
+// minimalisp.h - Embedding interface for independent interpreter instances
+#ifndef MINIMALISP_H
+#define MINIMALISP_H
+
+// A runtime is one interpreter with its own globals, symbols, compiled code
+// and GC heap. Runtimes share nothing, so any number of them can run in one
+// process, each on its own thread; a single runtime must only be used by
+// one thread at a time.
+typedef struct Runtime Runtime;
+
+// Create a runtime whose heap uses `backend` ("mark-sweep", "copying",
+// "generational" or "compact"; NULL means GC_BACKEND or mark-sweep) and load
+// the standard library into it. Returns NULL when out of memory.
+Runtime *runtime_create(const char *backend);
+void runtime_destroy(Runtime *runtime);
+
+// Evaluate `src` in `runtime` on the calling thread and return the printed
+// result, or "Error". The text stays valid until the runtime's next eval.
+const char *runtime_eval(Runtime *runtime, const char *src);
+
+// Evaluate in the calling thread's default runtime, created on first use.
+const char *eval(const char *src);
+
+#endif
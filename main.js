@@ -22,6 +22,8 @@ Module.onRuntimeInitialized = function () {
     getFreed = Module.cwrap('gc_get_freed_bytes', 'number', []);
     getCurrent = Module.cwrap('gc_get_current_bytes', 'number', []);
     checkInput = Module.cwrap('form_needs_more_input', 'number', ['string']);
+    // Keep incremental collection slices well inside a 60 fps frame.
+    Module.cwrap('gc_set_pause_budget_ms', null, ['number'])(4);
 
     document.getElementById('status').textContent = 'Status: WASM Loaded';
     initCharts();
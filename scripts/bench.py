@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""
+bench.py - Repeatable GC benchmark driver (used by `make bench`)
+Runs every benchmarks/*.lisp under every GC backend, after warm-up runs,
+and writes machine-readable JSON. Optionally compares the medians against
+a stored baseline and exits nonzero on regressions.
+"""
+
+import argparse
+import json
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+BACKENDS = ["mark-sweep", "copying", "generational", "compact"]
+
+# Heap sizes matching scripts/run-gc-benchmarks.sh.
+BACKEND_ENV = {
+    "copying": {"GC_INITIAL_HEAP_SIZE": "33554432"},
+    "generational": {"GC_INITIAL_HEAP_SIZE": "16777216"},
+}
+
+# Metrics gated against the baseline: lower is better for all of them.
+GATED_METRICS = ["wall_ms", "gc_ms", "pause_p99_ms", "peak_rss_kb"]
+
+# Time differences below this many milliseconds are noise, not regressions.
+MIN_TIME_DELTA_MS = 1.0
+
+
+def run_once(interpreter, benchmark, backend):
+    """Run one benchmark process and return its measurements."""
+    env = dict(os.environ)
+    env["GC_BACKEND"] = backend
+    if "GC_HEAP_GOAL" not in env:
+        for key, value in BACKEND_ENV.get(backend, {}).items():
+            env.setdefault(key, value)
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as handle:
+        stats_path = handle.name
+    env["GC_STATS_JSON"] = stats_path
+    try:
+        with tempfile.TemporaryFile() as errors:
+            start = time.perf_counter()
+            proc = subprocess.Popen([interpreter, "-f", str(benchmark)], env=env,
+                                    stdout=subprocess.DEVNULL, stderr=errors)
+            # wait4 reports the child's own peak RSS.
+            _, status, usage = os.wait4(proc.pid, 0)
+            wall_ms = (time.perf_counter() - start) * 1000.0
+            proc.returncode = os.waitstatus_to_exitcode(status)
+            if proc.returncode != 0:
+                errors.seek(0)
+                message = errors.read().decode(errors="replace").strip()
+                raise RuntimeError(f"{backend} {benchmark.name} exited with {proc.returncode}: {message}")
+        with open(stats_path) as stats_file:
+            stats = json.load(stats_file)
+    finally:
+        os.unlink(stats_path)
+
+    gc_ms = stats["total_gc_time_ms"]
+    # ru_maxrss is in kilobytes on Linux and in bytes on macOS.
+    peak_rss_kb = usage.ru_maxrss / 1024 if sys.platform == "darwin" else usage.ru_maxrss
+    seconds = wall_ms / 1000.0
+    return {
+        "wall_ms": wall_ms,
+        "gc_ms": gc_ms,
+        "mutator_ms": max(wall_ms - gc_ms, 0.0),
+        "pause_p50_ms": stats["pause_p50_ms"],
+        "pause_p99_ms": stats["pause_p99_ms"],
+        "pause_max_ms": stats["max_gc_pause_ms"],
+        "pauses": stats["pauses"],
+        "collections": stats["collections"],
+        "allocated_bytes": stats["allocated_bytes"],
+        "alloc_rate_mb_s": stats["allocated_bytes"] / (1024 * 1024) / seconds if seconds > 0 else 0.0,
+        "peak_rss_kb": peak_rss_kb,
+    }
+
+
+def summarize(runs):
+    """Median of every metric across runs, plus the wall-time spread."""
+    summary = {key: statistics.median(run[key] for run in runs) for key in runs[0]}
+    summary["wall_ms_min"] = min(run["wall_ms"] for run in runs)
+    summary["wall_ms_max"] = max(run["wall_ms"] for run in runs)
+    return summary
+
+
+def compare(results, baseline, tolerance):
+    """Return a list of regression messages against the baseline results."""
+    previous = {(entry["backend"], entry["benchmark"]): entry["median"] for entry in baseline["results"]}
+    regressions = []
+    for entry in results:
+        key = (entry["backend"], entry["benchmark"])
+        if key not in previous:
+            continue
+        for metric in GATED_METRICS:
+            old = previous[key].get(metric)
+            new = entry["median"][metric]
+            if old is None or new <= old * (1.0 + tolerance):
+                continue
+            if metric.endswith("_ms") and new - old < MIN_TIME_DELTA_MS:
+                continue
+            change = (new / old - 1.0) * 100.0 if old > 0 else float("inf")
+            regressions.append(f"{key[0]}/{key[1]}: {metric} {old:.3f} -> {new:.3f} (+{change:.1f}%)")
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the GC benchmarks and emit JSON results.")
+    parser.add_argument("--interpreter", default="./interpreter")
+    parser.add_argument("--runs", type=int, default=5, help="measured runs per benchmark and backend")
+    parser.add_argument("--warmup", type=int, default=1, help="discarded runs before measuring")
+    parser.add_argument("--backends", default=",".join(BACKENDS), help="comma-separated backend names")
+    parser.add_argument("--benchmarks", default="benchmarks", help="directory of *.lisp benchmarks")
+    parser.add_argument("--output", default="results/bench.json")
+    parser.add_argument("--baseline", help="results JSON to compare the medians against")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="allowed relative slowdown before a metric counts as a regression")
+    args = parser.parse_args()
+
+    benchmarks = sorted(Path(args.benchmarks).glob("*.lisp"))
+    backends = [name for name in args.backends.split(",") if name]
+    if not benchmarks:
+        print(f"Error: no benchmarks found in '{args.benchmarks}'")
+        return 2
+
+    results = []
+    for backend in backends:
+        for benchmark in benchmarks:
+            for _ in range(args.warmup):
+                run_once(args.interpreter, benchmark, backend)
+            runs = [run_once(args.interpreter, benchmark, backend) for _ in range(max(args.runs, 1))]
+            median = summarize(runs)
+            results.append({"backend": backend, "benchmark": benchmark.stem, "runs": runs, "median": median})
+            print(f"{backend:<13} {benchmark.stem:<18} wall {median['wall_ms']:9.2f} ms  "
+                  f"gc {median['gc_ms']:8.2f} ms  p99 {median['pause_p99_ms']:7.3f} ms  "
+                  f"rss {median['peak_rss_kb'] / 1024:7.1f} MB")
+
+    report = {
+        "meta": {
+            "runs": args.runs,
+            "warmup": args.warmup,
+            "machine": platform.machine(),
+            "system": platform.system(),
+            "time": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        },
+        "results": results,
+    }
+    output = Path(args.output)
+    output.parent.mkdir(parents=True, exist_ok=True)
+    output.write_text(json.dumps(report, indent=2) + "\n")
+    print(f"Results saved to: {output}")
+
+    if args.baseline:
+        baseline = json.loads(Path(args.baseline).read_text())
+        regressions = compare(results, baseline, args.tolerance)
+        if regressions:
+            print(f"Regressions beyond {args.tolerance * 100:.0f}% of {args.baseline}:")
+            for message in regressions:
+                print(f"  {message}")
+            return 1
+        print(f"No regressions beyond {args.tolerance * 100:.0f}% of {args.baseline}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
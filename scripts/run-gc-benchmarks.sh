@@ -31,8 +31,12 @@ for backend in "${BACKENDS[@]}"; do
         # Set output file
         output_file="$RESULTS_DIR/${backend}_${benchmark}.log"
         
-        # Run benchmark with appropriate backend
-        if [[ "$backend" = "mark-sweep" ]]; then
+        # Run benchmark with appropriate backend. With GC_HEAP_GOAL set
+        # (throughput or latency) the collectors size themselves, so the
+        # hand-tuned heap sizes are skipped.
+        if [[ -n "$GC_HEAP_GOAL" ]]; then
+            GC_BACKEND=$backend $INTERPRETER -f "benchmarks/${benchmark}.lisp" > "$output_file" 2>&1
+        elif [[ "$backend" = "mark-sweep" ]]; then
             $INTERPRETER -f "benchmarks/${benchmark}.lisp" > "$output_file" 2>&1
         elif [[ "$backend" = "copying" ]]; then
             GC_INITIAL_HEAP_SIZE=33554432 GC_BACKEND=$backend $INTERPRETER -f "benchmarks/${benchmark}.lisp" > "$output_file" 2>&1
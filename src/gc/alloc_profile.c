@@ -0,0 +1,283 @@
+// alloc_profile.c - Sampling allocation-site profiler fed by heap events
+#include "gc_backend.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+// Allocations are sampled at exponentially distributed byte intervals with
+// mean `interval`, so periodic allocation patterns cannot alias with
+// the sampling period. A sample of `size` bytes then stands for
+// 1 / (1 - e^(-size/interval)) objects of that size, the same unbiasing
+// pprof's heap profiler uses. Sampled objects are kept in an address-keyed
+// table and followed through moves and frees to give live and promoted
+// counts per site.
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#endif
+
+typedef struct {
+    uintptr_t addr;      // 0 = empty slot, PROFILE_TOMBSTONE = deleted
+    size_t bytes;        // estimated bytes this sample stands for
+    size_t objects;      // estimated objects this sample stands for
+    uint32_t site;
+    unsigned char generation;
+} ProfileSample;
+
+#define PROFILE_TOMBSTONE ((uintptr_t)1)
+
+struct GcAllocProfile {
+#ifndef __EMSCRIPTEN__
+    // The background sweeper reports frees from its own thread.
+    pthread_mutex_t mutex;
+#endif
+    gc_alloc_site_func site;
+    size_t interval;
+    double countdown;
+    uint64_t random;
+
+    ProfileSample *samples;
+    size_t samples_capacity;  // power of two
+    size_t samples_used;      // live entries plus tombstones
+    size_t samples_live;
+
+    GcAllocSiteStats *sites;
+    size_t sites_capacity;
+    size_t sites_count;
+};
+
+#define PROFILE (gc_heap->profile)
+
+#ifndef __EMSCRIPTEN__
+static void profile_lock(void) { pthread_mutex_lock(&PROFILE->mutex); }
+static void profile_unlock(void) { pthread_mutex_unlock(&PROFILE->mutex); }
+#else
+static void profile_lock(void) {}
+static void profile_unlock(void) {}
+#endif
+
+static double profile_next_interval(void) {
+    // xorshift64*, mapped to (0, 1].
+    PROFILE->random ^= PROFILE->random >> 12;
+    PROFILE->random ^= PROFILE->random << 25;
+    PROFILE->random ^= PROFILE->random >> 27;
+    uint64_t bits = (PROFILE->random * 0x2545f4914f6cdd1dULL) >> 11;
+    double uniform = ((double)bits + 1.0) / 9007199254740992.0;
+    return -log(uniform) * (double)PROFILE->interval;
+}
+
+static size_t sample_slot(uintptr_t addr) {
+    uint64_t h = (uint64_t)addr * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h >> 17) & (PROFILE->samples_capacity - 1);
+}
+
+static ProfileSample *sample_find(uintptr_t addr) {
+    if (!PROFILE->samples_capacity) return NULL;
+    for (size_t i = sample_slot(addr);; i = (i + 1) & (PROFILE->samples_capacity - 1)) {
+        if (PROFILE->samples[i].addr == addr) return &PROFILE->samples[i];
+        if (PROFILE->samples[i].addr == 0) return NULL;
+    }
+}
+
+static int samples_grow(void) {
+    size_t capacity = PROFILE->samples_capacity ? PROFILE->samples_capacity : 256;
+    // Only grow for live entries; a table full of tombstones is rebuilt in place.
+    if ((PROFILE->samples_live + 1) * 2 > capacity) capacity *= 2;
+    ProfileSample *table = calloc(capacity, sizeof(ProfileSample));
+    if (!table) return 0;
+    ProfileSample *old = PROFILE->samples;
+    size_t old_capacity = PROFILE->samples_capacity;
+    PROFILE->samples = table;
+    PROFILE->samples_capacity = capacity;
+    PROFILE->samples_used = PROFILE->samples_live;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].addr <= PROFILE_TOMBSTONE) continue;
+        size_t j = sample_slot(old[i].addr);
+        while (PROFILE->samples[j].addr) j = (j + 1) & (capacity - 1);
+        PROFILE->samples[j] = old[i];
+    }
+    free(old);
+    return 1;
+}
+
+static GcAllocSiteStats *site_stats(uint32_t site) {
+    if (site >= PROFILE->sites_capacity) {
+        size_t capacity = PROFILE->sites_capacity ? PROFILE->sites_capacity : 64;
+        while (capacity <= site) capacity *= 2;
+        GcAllocSiteStats *grown = realloc(PROFILE->sites, capacity * sizeof(GcAllocSiteStats));
+        if (!grown) return NULL;
+        memset(grown + PROFILE->sites_capacity, 0, (capacity - PROFILE->sites_capacity) * sizeof(GcAllocSiteStats));
+        PROFILE->sites = grown;
+        PROFILE->sites_capacity = capacity;
+    }
+    if (site >= PROFILE->sites_count) PROFILE->sites_count = (size_t)site + 1;
+    return &PROFILE->sites[site];
+}
+
+static void sample_died(ProfileSample *sample) {
+    GcAllocSiteStats *stats = &PROFILE->sites[sample->site];
+    stats->live_bytes -= sample->bytes;
+    stats->live_objects -= sample->objects;
+    sample->addr = PROFILE_TOMBSTONE;
+    PROFILE->samples_live--;
+}
+
+static void sample_insert(const ProfileSample *sample) {
+    // Whatever was tracked at this address is gone: the memory was reused.
+    ProfileSample *stale = sample_find(sample->addr);
+    if (stale) sample_died(stale);
+    if ((PROFILE->samples_used + 1) * 2 > PROFILE->samples_capacity && !samples_grow()) {
+        // Untracked from here on, so it no longer counts as live.
+        PROFILE->sites[sample->site].live_bytes -= sample->bytes;
+        PROFILE->sites[sample->site].live_objects -= sample->objects;
+        return;
+    }
+    size_t i = sample_slot(sample->addr);
+    while (PROFILE->samples[i].addr > PROFILE_TOMBSTONE) i = (i + 1) & (PROFILE->samples_capacity - 1);
+    if (PROFILE->samples[i].addr == 0) PROFILE->samples_used++;
+    PROFILE->samples[i] = *sample;
+    PROFILE->samples_live++;
+}
+
+static void profile_alloc(const void *addr, size_t size, unsigned generation) {
+    PROFILE->countdown -= (double)size;
+    if (PROFILE->countdown > 0.0) return;
+    PROFILE->countdown = profile_next_interval();
+    if (!size) return;
+    uint32_t site = PROFILE->site ? PROFILE->site() : 0;
+
+    double objects = 1.0 / (1.0 - exp(-(double)size / (double)PROFILE->interval));
+    ProfileSample sample;
+    sample.addr = (uintptr_t)addr;
+    sample.objects = (size_t)(objects + 0.5);
+    if (!sample.objects) sample.objects = 1;
+    sample.bytes = (size_t)(objects * (double)size + 0.5);
+    sample.site = site;
+    sample.generation = (unsigned char)generation;
+
+    profile_lock();
+    GcAllocSiteStats *stats = site_stats(site);
+    if (stats) {
+        stats->samples++;
+        stats->allocated_bytes += sample.bytes;
+        stats->allocated_objects += sample.objects;
+        stats->live_bytes += sample.bytes;
+        stats->live_objects += sample.objects;
+        sample_insert(&sample);
+    }
+    profile_unlock();
+}
+
+static void profile_move(const void *from, const void *to, unsigned generation) {
+    profile_lock();
+    ProfileSample *tracked = sample_find((uintptr_t)from);
+    if (tracked) {
+        ProfileSample sample = *tracked;
+        tracked->addr = PROFILE_TOMBSTONE;
+        PROFILE->samples_live--;
+        if (sample.generation == GC_GEN_NURSERY && generation == GC_GEN_OLD) {
+            PROFILE->sites[sample.site].promoted_bytes += sample.bytes;
+            PROFILE->sites[sample.site].promoted_objects += sample.objects;
+        }
+        if (generation != GC_GEN_UNKNOWN) sample.generation = (unsigned char)generation;
+        sample.addr = (uintptr_t)to;
+        sample_insert(&sample);
+    } else {
+        ProfileSample *stale = sample_find((uintptr_t)to);
+        if (stale) sample_died(stale);
+    }
+    profile_unlock();
+}
+
+static void profile_free(const void *addr) {
+    profile_lock();
+    ProfileSample *tracked = sample_find((uintptr_t)addr);
+    if (tracked) sample_died(tracked);
+    profile_unlock();
+}
+
+static void profile_free_range(const void *start, size_t length) {
+    uintptr_t low = (uintptr_t)start;
+    profile_lock();
+    for (size_t i = 0; i < PROFILE->samples_capacity; i++) {
+        uintptr_t addr = PROFILE->samples[i].addr;
+        if (addr > PROFILE_TOMBSTONE && addr - low < length) sample_died(&PROFILE->samples[i]);
+    }
+    profile_unlock();
+}
+
+void gc_alloc_profile_event(unsigned kind, const void *addr, size_t size, unsigned generation, const void *to) {
+    switch (kind) {
+        case GC_EVENT_ALLOC: profile_alloc(addr, size, generation); break;
+        case GC_EVENT_MOVE: profile_move(addr, to, generation); break;
+        case GC_EVENT_FREE: profile_free(addr); break;
+        case GC_EVENT_FREE_RANGE: profile_free_range(addr, size); break;
+        default: break;
+    }
+}
+
+void gc_alloc_profile_start(size_t sample_bytes, gc_alloc_site_func site) {
+    if (!gc_heap) gc_init();
+    gc_alloc_profile_stop();
+    if (!PROFILE) {
+        PROFILE = (GcAllocProfile*)calloc(1, sizeof(GcAllocProfile));
+        if (!PROFILE) return;
+#ifndef __EMSCRIPTEN__
+        pthread_mutex_init(&PROFILE->mutex, NULL);
+#endif
+        PROFILE->random = 0x9e3779b97f4a7c15ULL;
+    }
+    profile_lock();
+    free(PROFILE->samples);
+    PROFILE->samples = NULL;
+    PROFILE->samples_capacity = PROFILE->samples_used = PROFILE->samples_live = 0;
+    if (PROFILE->sites) memset(PROFILE->sites, 0, PROFILE->sites_capacity * sizeof(GcAllocSiteStats));
+    PROFILE->sites_count = 0;
+    PROFILE->interval = sample_bytes ? sample_bytes : 1;
+    PROFILE->site = site;
+    PROFILE->countdown = profile_next_interval();
+    profile_unlock();
+    gc_heap_observed |= GC_OBSERVE_PROFILE;
+}
+
+void gc_alloc_profile_stop(void) {
+    if (!gc_heap || !PROFILE) return;
+    gc_heap_observed &= ~GC_OBSERVE_PROFILE;
+    profile_lock();
+    free(PROFILE->samples);
+    PROFILE->samples = NULL;
+    PROFILE->samples_capacity = PROFILE->samples_used = PROFILE->samples_live = 0;
+    profile_unlock();
+}
+
+int gc_alloc_profile_active(void) {
+    return (gc_heap_observed & GC_OBSERVE_PROFILE) != 0;
+}
+
+size_t gc_alloc_profile_site_count(void) {
+    return gc_heap && PROFILE ? PROFILE->sites_count : 0;
+}
+
+void gc_alloc_profile_site_stats(uint32_t site, GcAllocSiteStats *out) {
+    if (!out) return;
+    if (!gc_heap || !PROFILE) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    profile_lock();
+    if (site < PROFILE->sites_count) *out = PROFILE->sites[site];
+    else memset(out, 0, sizeof(*out));
+    profile_unlock();
+}
+
+void gc_alloc_profile_destroy(void) {
+    if (!PROFILE) return;
+    gc_heap_observed &= ~GC_OBSERVE_PROFILE;
+    free(PROFILE->samples);
+    free(PROFILE->sites);
+#ifndef __EMSCRIPTEN__
+    pthread_mutex_destroy(&PROFILE->mutex);
+#endif
+    free(PROFILE);
+    PROFILE = NULL;
+}
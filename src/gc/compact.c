@@ -0,0 +1,469 @@
+// compact.c - Sliding mark-compact GC backend
+#include "gc_backend.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Lisp-2 style mark-compact collector over a single contiguous heap. Objects
+// are bump-allocated, so live data after a collection is one dense prefix and
+// the free space is one block: no fragmentation, and no second semispace.
+// A collection runs in four passes over the heap:
+//   1. mark everything reachable from the roots (bounded mark stack);
+//   2. walk the heap in address order and give every marked object its
+//      forwarding address, packing survivors towards the heap start;
+//   3. re-run the trace hooks with gc_mark_ptr returning forwarding
+//      addresses, so every slot (and every root) is updated in place;
+//   4. slide the survivors down to their new addresses.
+// Step 3 is the same slot-updating contract the copying collector relies on.
+#define DEFAULT_COMPACT_HEAP (4 * 1024 * 1024)
+
+// Objects use the shared bump header so gc_allocate_fast allocates inline.
+// `forward` holds the new address during a collection and `age` is reused as
+// the mark byte.
+typedef GcBumpHeader CompactHeader;
+
+typedef struct {
+    void **slot;
+} CompactRoot;
+
+enum {
+    COMPACT_IDLE = 0,
+    COMPACT_MARKING,
+    COMPACT_UPDATING
+};
+
+typedef struct {
+    unsigned char *heap_start;
+    size_t heap_size;
+    int initialized;
+    int phase;
+    CompactRoot *roots;
+    size_t root_count;
+    size_t root_capacity;
+    GcMarkStack mark_stack;
+    GcStats stats;
+} CompactState;
+
+#define CS GC_BACKEND_STATE(CompactState)
+// The free tail of the heap is published in gc_alloc_region.
+#define alloc_ptr (gc_alloc_region.cursor)
+#define alloc_end (gc_alloc_region.limit)
+
+static size_t align_size(size_t size) {
+    size_t align = sizeof(void*);
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Helpers --------------------------------------------------------------
+
+static int pointer_in_heap(void *ptr) {
+    return ptr && (unsigned char*)ptr > CS->heap_start && (unsigned char*)ptr < alloc_ptr;
+}
+
+static CompactHeader *compact_header_for(void *ptr) {
+    return ((CompactHeader*)ptr) - 1;
+}
+
+static size_t compact_object_size(const CompactHeader *header) {
+    return sizeof(CompactHeader) + header->size;
+}
+
+static void compact_init(void) {
+    if (CS->initialized) return;
+    CS->heap_size = DEFAULT_COMPACT_HEAP;
+    size_t configured_size = gc_get_initial_heap_size();
+    if (configured_size > 0) CS->heap_size = align_size(configured_size);
+    CS->heap_start = (unsigned char*)malloc(CS->heap_size);
+    if (!CS->heap_start) {
+        fprintf(stderr, "Compact GC: failed to allocate heap (%zu bytes)\n", CS->heap_size);
+        exit(1);
+    }
+    alloc_ptr = CS->heap_start;
+    alloc_end = CS->heap_start + CS->heap_size;
+    gc_alloc_region.generation = GC_GEN_OLD;
+    memset(&CS->stats, 0, sizeof(CS->stats));
+    CS->initialized = 1;
+}
+
+static void compact_roots_reserve(size_t needed) {
+    if (CS->root_capacity >= needed) return;
+    size_t new_cap = CS->root_capacity ? CS->root_capacity * 2 : 32;
+    while (new_cap < needed) new_cap *= 2;
+    CompactRoot *roots = (CompactRoot*)realloc(CS->roots, new_cap * sizeof(CompactRoot));
+    if (!roots) {
+        fprintf(stderr, "Compact GC: failed to grow root set\n");
+        exit(1);
+    }
+    CS->roots = roots;
+    CS->root_capacity = new_cap;
+}
+
+static void compact_add_root(void **slot) {
+    if (!slot) return;
+    compact_roots_reserve(CS->root_count + 1);
+    CS->roots[CS->root_count++].slot = slot;
+}
+
+static void compact_remove_root(void **slot) {
+    if (!slot) return;
+    for (size_t i = 0; i < CS->root_count; ++i) {
+        if (CS->roots[i].slot == slot) {
+            CS->roots[i] = CS->roots[CS->root_count - 1];
+            CS->root_count--;
+            return;
+        }
+    }
+}
+
+// Allocation/trace API -------------------------------------------------
+
+static void compact_collect(void);
+
+// Fold bytes handed out by the inline fast path into the stats.
+static void compact_sync_stats(void) {
+    CS->stats.allocated_bytes += gc_alloc_region.allocated_bytes;
+    gc_alloc_region.allocated_bytes = 0;
+    if (CS->heap_start) CS->stats.current_bytes = (size_t)(alloc_ptr - CS->heap_start) + gc_los_bytes();
+}
+
+// Large objects live in the shared LOS and are never slid. It is collected
+// with the heap once it has grown by a heap's worth since the last sweep.
+static void *compact_allocate_large(size_t size, gc_trace_func trace, unsigned char tag) {
+    if (gc_los_allocated_since_sweep() > CS->heap_size) compact_collect();
+    void *payload = gc_los_allocate(size, trace, tag, 0);
+    if (!payload) {
+        compact_collect();
+        payload = gc_los_allocate(size, trace, tag, 0);
+        if (!payload) {
+            fprintf(stderr, "Compact GC: out of memory (large object of %zu bytes)\n", size);
+            exit(1);
+        }
+    }
+    CS->stats.allocated_bytes += size;
+    CS->stats.current_bytes += size;
+    return payload;
+}
+
+static void *compact_allocate_typed(size_t size, gc_trace_func trace, unsigned char tag) {
+    if (!CS->initialized) compact_init();
+    if (size >= GC_LARGE_OBJECT_BYTES) return compact_allocate_large(size, trace, tag);
+    size_t payload = align_size(size);
+    size_t total = sizeof(CompactHeader) + payload;
+    if ((size_t)(alloc_end - alloc_ptr) < total) {
+        compact_collect();
+        if ((size_t)(alloc_end - alloc_ptr) < total) {
+            fprintf(stderr, "Compact GC: out of memory (requested %zu bytes). Increase GC_INITIAL_HEAP_SIZE.\n", size);
+            exit(1);
+        }
+    }
+    CompactHeader *header = (CompactHeader*)alloc_ptr;
+    alloc_ptr += total;
+    header->size = payload;
+    header->trace = trace;
+    header->forward = NULL;
+    header->tag = tag;
+    header->age = 0;
+    void *payload_ptr = (void*)(header + 1);
+    memset(payload_ptr, 0, payload);
+    gc_event_alloc(payload_ptr, payload, GC_GEN_OLD, tag);
+    CS->stats.allocated_bytes += size;
+    CS->stats.current_bytes = (size_t)(alloc_ptr - CS->heap_start) + gc_los_bytes();
+    return payload_ptr;
+}
+
+static void *compact_allocate(size_t size) {
+    return compact_allocate_typed(size, NULL, GC_TAG_UNKNOWN);
+}
+
+static void compact_set_trace(void *ptr, gc_trace_func trace) {
+    GcLargeObject *large = pointer_in_heap(ptr) ? NULL : gc_los_find(ptr);
+    if (pointer_in_heap(ptr)) compact_header_for(ptr)->trace = trace;
+    else if (large) large->trace = trace;
+}
+
+static void compact_set_tag(void *ptr, unsigned char tag) {
+    GcLargeObject *large = pointer_in_heap(ptr) ? NULL : gc_los_find(ptr);
+    if (pointer_in_heap(ptr)) compact_header_for(ptr)->tag = tag;
+    else if (large) large->tag = tag;
+    gc_event_retag(ptr, tag);
+}
+
+static void compact_write_barrier(void *owner, void **slot, void *child) {
+    (void)owner;
+    (void)slot;
+    (void)child;
+}
+
+// While marking, set the mark and queue the object; while updating, answer
+// the forwarding address. Pointers outside the heap are returned unchanged;
+// large objects are marked but never move.
+static void *compact_mark_ptr(void *ptr) {
+    if (!ptr || GC_IS_IMMEDIATE(ptr)) return ptr;
+    if (!pointer_in_heap(ptr)) {
+        GcLargeObject *large = CS->phase == COMPACT_MARKING ? gc_los_find(ptr) : NULL;
+        if (large && gc_mark_claim(&large->marked) && large->trace) {
+            gc_mark_push(&CS->mark_stack, ptr, large->trace);
+        }
+        return ptr;
+    }
+    CompactHeader *header = compact_header_for(ptr);
+    if (CS->phase == COMPACT_UPDATING) return header->forward;
+    if (CS->phase == COMPACT_MARKING && gc_mark_claim(&header->age) && header->trace) {
+        gc_mark_push(&CS->mark_stack, ptr, header->trace);
+    }
+    return ptr;
+}
+
+// Apply `visit` to every root slot, static or shadow-stack.
+static void compact_visit_roots(void *(*visit)(void *ptr)) {
+    for (size_t i = 0; i < CS->root_count; ++i) {
+        void **slot = CS->roots[i].slot;
+        if (slot && *slot) *slot = visit(*slot);
+    }
+    const GcRootRange *ranges = gc_root_ranges();
+    for (size_t r = 0; r < gc_root_range_count(); ++r) {
+        void **base = ranges[r].base;
+        size_t count = *ranges[r].count;
+        for (size_t i = 0; i < count; ++i) {
+            if (base[i]) base[i] = visit(base[i]);
+        }
+    }
+}
+
+// Pass 1. After a mark stack overflow, rescan the heap and re-trace marked
+// objects so children that never made it onto the stack are still reached.
+static void compact_mark(void) {
+    CS->phase = COMPACT_MARKING;
+    CS->mark_stack.top = 0;
+    CS->mark_stack.overflowed = 0;
+    compact_visit_roots(compact_mark_ptr);
+    gc_parallel_mark_drain(&CS->mark_stack);
+    while (CS->mark_stack.overflowed) {
+        CS->mark_stack.overflowed = 0;
+        for (unsigned char *scan = CS->heap_start; scan < alloc_ptr; ) {
+            CompactHeader *header = (CompactHeader*)scan;
+            if (header->age && header->trace) {
+                header->trace(header + 1);
+                if (CS->mark_stack.top > GC_MARK_STACK_CAPACITY / 2) gc_parallel_mark_drain(&CS->mark_stack);
+            }
+            scan += compact_object_size(header);
+        }
+        gc_los_trace_marked();
+        gc_parallel_mark_drain(&CS->mark_stack);
+    }
+}
+
+// Pass 2. Returns the new end of the live prefix.
+static unsigned char *compact_compute_forwarding(size_t *scanned, size_t *live) {
+    unsigned char *free_ptr = CS->heap_start;
+    for (unsigned char *scan = CS->heap_start; scan < alloc_ptr; ) {
+        CompactHeader *header = (CompactHeader*)scan;
+        size_t total = compact_object_size(header);
+        (*scanned)++;
+        if (header->age) {
+            header->forward = (CompactHeader*)free_ptr + 1;
+            free_ptr += total;
+            (*live)++;
+        } else {
+            gc_event_free(header + 1);
+        }
+        scan += total;
+    }
+    return free_ptr;
+}
+
+// Pass 3. Objects have not moved yet, so trace hooks still read valid data.
+static void compact_update_references(void) {
+    CS->phase = COMPACT_UPDATING;
+    compact_visit_roots(compact_mark_ptr);
+    for (unsigned char *scan = CS->heap_start; scan < alloc_ptr; ) {
+        CompactHeader *header = (CompactHeader*)scan;
+        if (header->age && header->trace) header->trace(header + 1);
+        scan += compact_object_size(header);
+    }
+    gc_los_trace_marked();
+}
+
+// Pass 4. Destinations never pass an object's own start, so moving in address
+// order cannot clobber a survivor that has not been moved yet.
+static void compact_slide(void) {
+    for (unsigned char *scan = CS->heap_start; scan < alloc_ptr; ) {
+        CompactHeader *header = (CompactHeader*)scan;
+        size_t total = compact_object_size(header);
+        if (header->age) {
+            CompactHeader *dest = compact_header_for(header->forward);
+            if (dest != header) {
+                memmove(dest, header, total);
+                gc_event_move(header + 1, dest + 1, GC_GEN_OLD);
+            }
+            dest->age = 0;
+            dest->forward = NULL;
+        }
+        scan += total;
+    }
+}
+
+// Between passes 2 and 3: survivors answer their forwarding address.
+static void *compact_weak_resolve(void *ptr) {
+    if (pointer_in_heap(ptr)) {
+        CompactHeader *header = compact_header_for(ptr);
+        return header->age ? header->forward : NULL;
+    }
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) return large->marked ? ptr : NULL;
+    return ptr;
+}
+
+static void compact_collect(void) {
+    if (!CS->initialized || CS->phase != COMPACT_IDLE) return;
+    double start_time = gc_get_time_ms();
+
+    compact_sync_stats();
+    size_t before = CS->stats.current_bytes;
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_COLLECT, start_time, &CS->stats);
+    CS->stats.collections++;
+    gc_move_epoch++;
+
+    compact_mark();
+    size_t scanned = 0;
+    size_t live = 0;
+    unsigned char *new_end = compact_compute_forwarding(&scanned, &live);
+    gc_weak_roots_update(compact_weak_resolve);
+    compact_update_references();
+    compact_slide();
+    CS->phase = COMPACT_IDLE;
+    alloc_ptr = new_end;
+    gc_los_sweep(&scanned, &live);
+
+    // Keep as much free space resident past the live prefix as is live.
+    size_t after = alloc_ptr - CS->heap_start;
+    size_t keep = after;
+    gc_trim_block(&keep, alloc_ptr, (size_t)(alloc_end - alloc_ptr));
+    after += gc_los_bytes();
+    CS->stats.current_bytes = after;
+    if (before > after) CS->stats.freed_bytes += before - after;
+    CS->stats.objects_scanned += scanned;
+    CS->stats.objects_copied += live;
+    if (scanned > 0) CS->stats.survival_rate = (double)live / (double)scanned;
+    CS->stats.metadata_bytes = live * sizeof(CompactHeader);
+
+    double end_time = gc_get_time_ms();
+    double elapsed = end_time - start_time;
+    gc_trace_end(&span, end_time, &CS->stats);
+    gc_note_pause(elapsed);
+    CS->stats.last_gc_pause_ms = elapsed;
+    CS->stats.total_gc_time_ms += elapsed;
+    if (elapsed > CS->stats.max_gc_pause_ms) {
+        CS->stats.max_gc_pause_ms = elapsed;
+    }
+    CS->stats.avg_gc_pause_ms = CS->stats.total_gc_time_ms / CS->stats.collections;
+}
+
+static void compact_free(void *ptr) {
+    // Heap objects are reclaimed during collection.
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) {
+        CS->stats.freed_bytes += large->size;
+        CS->stats.current_bytes -= large->size;
+        gc_los_free(large);
+    }
+}
+
+static void compact_set_threshold(size_t bytes) {
+    (void)bytes;
+    // Collections run when the heap is full.
+}
+
+static size_t compact_get_threshold(void) {
+    return CS->heap_size;
+}
+
+static void compact_get_stats(GcStats *out_stats) {
+    if (!out_stats) return;
+    compact_sync_stats();
+    *out_stats = CS->stats;
+
+    // The free space is always the single block at the end of the heap.
+    size_t free_mem = 0;
+    if (alloc_end && alloc_ptr) free_mem = alloc_end - alloc_ptr;
+    out_stats->largest_free_block = free_mem;
+    out_stats->total_free_memory = free_mem;
+    out_stats->free_blocks_count = (free_mem > 0) ? 1 : 0;
+    out_stats->average_free_block_size = (double)free_mem;
+    out_stats->fragmentation_index = 0.0;
+
+    size_t wasted = 0;
+    size_t obj_count = 0;
+    if (CS->heap_start) {
+        for (unsigned char *scan = CS->heap_start; scan < alloc_ptr; ) {
+            CompactHeader *header = (CompactHeader*)scan;
+            wasted += sizeof(CompactHeader);
+            obj_count++;
+            scan += compact_object_size(header);
+        }
+    }
+    out_stats->wasted_bytes = wasted;
+    size_t in_use = CS->heap_start ? (size_t)(alloc_ptr - CS->heap_start) : 0;
+    out_stats->internal_fragmentation_ratio = in_use > 0 ? (double)wasted / (double)in_use : 0.0;
+    out_stats->average_padding_per_object = obj_count > 0 ? (double)wasted / (double)obj_count : 0.0;
+    out_stats->peak_fragmentation_index = 0.0;
+    out_stats->fragmentation_growth_rate = 0.0;
+}
+
+static double compact_get_collections_count(void) { return (double)CS->stats.collections; }
+static double compact_get_allocated_bytes(void) { compact_sync_stats(); return (double)CS->stats.allocated_bytes; }
+static double compact_get_freed_bytes(void) { return (double)CS->stats.freed_bytes; }
+static double compact_get_current_bytes(void) { compact_sync_stats(); return (double)CS->stats.current_bytes; }
+
+static size_t compact_heap_snapshot(GcObjectInfo *out, size_t capacity) {
+    size_t count = 0;
+    if (!CS->heap_start) return 0;
+    for (unsigned char *scan = CS->heap_start; scan < alloc_ptr && count < capacity; ) {
+        CompactHeader *header = (CompactHeader*)scan;
+        out[count].addr = (uintptr_t)(header + 1);
+        out[count].size = header->size;
+        out[count].generation = GC_GEN_OLD;
+        out[count].tag = header->tag;
+        count++;
+        scan += compact_object_size(header);
+    }
+    count += gc_los_snapshot(out + count, capacity - count);
+    return count;
+}
+
+static void compact_destroy(void) {
+    free(CS->heap_start);
+    free(CS->roots);
+    alloc_ptr = alloc_end = NULL;
+}
+
+const GcBackend *gc_compact_backend(void) {
+    static const GcBackend backend = {
+        compact_init,
+        compact_allocate,
+        compact_set_trace,
+        compact_mark_ptr,
+        compact_set_tag,
+        compact_add_root,
+        compact_remove_root,
+        compact_write_barrier,
+        compact_collect,
+        compact_free,
+        compact_set_threshold,
+        compact_get_threshold,
+        compact_get_stats,
+        compact_get_collections_count,
+        compact_get_allocated_bytes,
+        compact_get_freed_bytes,
+        compact_get_current_bytes,
+        compact_heap_snapshot,
+        compact_allocate_typed,
+        NULL,
+        compact_destroy,
+        sizeof(CompactState),
+        "compact"
+    };
+    return &backend;
+}
@@ -8,15 +8,17 @@
 // Simple semi-space copying collector: allocations occur in the active space,
 // collections copy reachable objects into the inactive space, then swap.
 #define DEFAULT_COPY_HEAP (2 * 1024 * 1024)
+// With a heap goal other than fixed, the semispaces are resized between
+// collections within [configured / COPY_SHRINK_LIMIT, configured *
+// COPY_GROWTH_LIMIT], and always grown while survivors fill more than
+// half of one.
+#define COPY_GROWTH_LIMIT 16
+#define COPY_SHRINK_LIMIT 8
 
 // Each object is tagged with a payload size, trace hook, and forwarding pointer
-// (used during the copy phase to avoid duplicating an object).
-typedef struct CopyHeader {
-    size_t size;
-    gc_trace_func trace;
-    void *forward;
-    unsigned char tag;
-} CopyHeader;
+// (used during the copy phase to avoid duplicating an object). The layout is
+// the shared bump header so gc_allocate_fast can create objects inline.
+typedef GcBumpHeader CopyHeader;
 
 // Roots are stored as addresses of Value/Env/Tokens so we can update slots
 // in place when objects move to the new semi-space.
@@ -24,19 +26,37 @@ typedef struct {
     void **slot;
 } CopyRoot;
 
-// Global copying-collector state. We keep two semi-spaces of equal size and
+// Copying-collector state. We keep two semi-spaces of equal size and
 // alternate between them whenever a collection occurs.
-static unsigned char *active_space = NULL;
-static unsigned char *inactive_space = NULL;
-static size_t semi_space_size = DEFAULT_COPY_HEAP;
-static unsigned char *alloc_ptr = NULL;
-static unsigned char *alloc_end = NULL;
-static int copying_initialized = 0;
-static int copying_collecting = 0;
-static CopyRoot *copy_roots = NULL;
-static size_t copy_root_count = 0;
-static size_t copy_root_capacity = 0;
-static GcStats copy_stats = {0, 0, 0, 0};
+typedef struct {
+    unsigned char *active_space;
+    unsigned char *inactive_space;
+    // semi_space_size is the target; each space keeps the size it was
+    // allocated with until it is next free to be replaced (right after a
+    // collection).
+    size_t semi_space_size;
+    size_t configured_space_size;
+    size_t active_space_size;
+    size_t inactive_space_size;
+    double last_collection_end_ms;
+    int initialized;
+    int collecting;
+    CopyRoot *roots;
+    size_t root_count;
+    size_t root_capacity;
+    GcStats stats;
+    // Large objects stay put in the shared LOS; the ones marked during a
+    // collection wait here until the Cheney scan traces them.
+    GcLargeObject **large_pending;
+    size_t large_pending_count;
+    size_t large_pending_capacity;
+} CopyState;
+
+#define CP GC_BACKEND_STATE(CopyState)
+// The active semispace's bump pointer and limit live in gc_alloc_region so
+// the inline fast path in gc.h allocates from it directly.
+#define alloc_ptr (gc_alloc_region.cursor)
+#define alloc_end (gc_alloc_region.limit)
 
 static size_t align_size(size_t size) {
     size_t align = sizeof(void*);
@@ -46,41 +66,47 @@ static size_t align_size(size_t size) {
 // Helpers --------------------------------------------------------------
 
 static int pointer_in_space(unsigned char *space, void *ptr) {
-    return ptr && (unsigned char*)ptr > space && (unsigned char*)ptr < space + semi_space_size;
+    size_t size = space == CP->active_space ? CP->active_space_size : CP->inactive_space_size;
+    return ptr && (unsigned char*)ptr > space && (unsigned char*)ptr < space + size;
 }
 
 static void copy_reset_roots(void) {
-    copy_root_count = 0;
-    copy_root_capacity = 0;
-    free(copy_roots);
-    copy_roots = NULL;
+    CP->root_count = 0;
+    CP->root_capacity = 0;
+    free(CP->roots);
+    CP->roots = NULL;
 }
 
 static void copy_alloc_spaces(size_t size) {
-    if (active_space) free(active_space);
-    if (inactive_space) free(inactive_space);
-    semi_space_size = size ? align_size(size) : DEFAULT_COPY_HEAP;
-    active_space = (unsigned char*)malloc(semi_space_size);
-    inactive_space = (unsigned char*)malloc(semi_space_size);
-    if (!active_space || !inactive_space) {
-        fprintf(stderr, "Copying GC: failed to allocate heap (%zu bytes)\n", semi_space_size);
+    if (CP->active_space) free(CP->active_space);
+    if (CP->inactive_space) free(CP->inactive_space);
+    CP->semi_space_size = size ? align_size(size) : DEFAULT_COPY_HEAP;
+    CP->active_space = (unsigned char*)malloc(CP->semi_space_size);
+    CP->inactive_space = (unsigned char*)malloc(CP->semi_space_size);
+    if (!CP->active_space || !CP->inactive_space) {
+        fprintf(stderr, "Copying GC: failed to allocate heap (%zu bytes)\n", CP->semi_space_size);
         exit(1);
     }
-    alloc_ptr = active_space;
-    alloc_end = active_space + semi_space_size;
+    CP->active_space_size = CP->inactive_space_size = CP->semi_space_size;
+    alloc_ptr = CP->active_space;
+    alloc_end = CP->active_space + CP->semi_space_size;
+    gc_alloc_region.generation = GC_GEN_NURSERY;
 }
 
 static void copy_init(void) {
-    if (copying_initialized) return;
+    if (CP->initialized) return;
+    CP->semi_space_size = DEFAULT_COPY_HEAP;
     size_t configured_size = gc_get_initial_heap_size();
     if (configured_size > 0) {
-        semi_space_size = align_size(configured_size);
+        CP->semi_space_size = align_size(configured_size);
     }
-    copy_alloc_spaces(semi_space_size);
+    CP->configured_space_size = CP->semi_space_size;
+    copy_alloc_spaces(CP->semi_space_size);
     copy_reset_roots();
-    memset(&copy_stats, 0, sizeof(copy_stats));
+    memset(&CP->stats, 0, sizeof(CP->stats));
+    CP->last_collection_end_ms = gc_get_time_ms();
     // Timing fields are zero-initialized by memset
-    copying_initialized = 1;
+    CP->initialized = 1;
 }
 
 static CopyHeader *copy_header_for(void *ptr) {
@@ -89,30 +115,30 @@ static CopyHeader *copy_header_for(void *ptr) {
 }
 
 static void copy_roots_reserve(size_t needed) {
-    if (copy_root_capacity >= needed) return;
-    size_t new_cap = copy_root_capacity ? copy_root_capacity * 2 : 32;
+    if (CP->root_capacity >= needed) return;
+    size_t new_cap = CP->root_capacity ? CP->root_capacity * 2 : 32;
     while (new_cap < needed) new_cap *= 2;
-    CopyRoot *roots = (CopyRoot*)realloc(copy_roots, new_cap * sizeof(CopyRoot));
+    CopyRoot *roots = (CopyRoot*)realloc(CP->roots, new_cap * sizeof(CopyRoot));
     if (!roots) {
         fprintf(stderr, "Copying GC: failed to grow root set\n");
         exit(1);
     }
-    copy_roots = roots;
-    copy_root_capacity = new_cap;
+    CP->roots = roots;
+    CP->root_capacity = new_cap;
 }
 
 static void copy_add_root(void **slot) {
     if (!slot) return;
-    copy_roots_reserve(copy_root_count + 1);
-    copy_roots[copy_root_count++].slot = slot;
+    copy_roots_reserve(CP->root_count + 1);
+    CP->roots[CP->root_count++].slot = slot;
 }
 
 static void copy_remove_root(void **slot) {
     if (!slot) return;
-    for (size_t i = 0; i < copy_root_count; ++i) {
-        if (copy_roots[i].slot == slot) {
-            copy_roots[i] = copy_roots[copy_root_count - 1];
-            copy_root_count--;
+    for (size_t i = 0; i < CP->root_count; ++i) {
+        if (CP->roots[i].slot == slot) {
+            CP->roots[i] = CP->roots[CP->root_count - 1];
+            CP->root_count--;
             return;
         }
     }
@@ -123,12 +149,38 @@ static void copy_remove_root(void **slot) {
 static void copy_collect(void);
 static void *copy_copy_ptr(void *ptr);
 
-static void *copy_allocate(size_t size) {
-    if (!copying_initialized) copy_init();
+// Fold bytes handed out by the inline fast path into the stats.
+static void copy_sync_stats(void) {
+    CP->stats.allocated_bytes += gc_alloc_region.allocated_bytes;
+    gc_alloc_region.allocated_bytes = 0;
+    if (CP->active_space && alloc_ptr) CP->stats.current_bytes = (size_t)(alloc_ptr - CP->active_space) + gc_los_bytes();
+}
+
+static void *copy_allocate_large(size_t size, gc_trace_func trace, unsigned char tag) {
+    if (gc_los_allocated_since_sweep() > CP->semi_space_size) copy_collect();
+    void *payload = gc_los_allocate(size, trace, tag, 0);
+    if (!payload) {
+        copy_collect();
+        payload = gc_los_allocate(size, trace, tag, 0);
+        if (!payload) {
+            fprintf(stderr, "Copying GC: out of memory (large object of %zu bytes)\n", size);
+            exit(1);
+        }
+    }
+    CP->stats.allocated_bytes += size;
+    CP->stats.current_bytes += size;
+    return payload;
+}
+
+static void *copy_allocate_typed(size_t size, gc_trace_func trace, unsigned char tag) {
+    if (!CP->initialized) copy_init();
+    if (size >= GC_LARGE_OBJECT_BYTES) return copy_allocate_large(size, trace, tag);
     size_t payload = align_size(size);
     size_t total = sizeof(CopyHeader) + payload;
     if (alloc_ptr + total > alloc_end) {
         copy_collect();
+        // A grown to-space was only just allocated; flip into it.
+        if (alloc_ptr + total > alloc_end && CP->inactive_space_size > CP->active_space_size) copy_collect();
         if (alloc_ptr + total > alloc_end) {
             fprintf(stderr, "Copying GC: out of memory (requested %zu bytes). Increase gc-threshold.\n", size);
             exit(1);
@@ -137,27 +189,42 @@ static void *copy_allocate(size_t size) {
     CopyHeader *header = (CopyHeader*)alloc_ptr;
     alloc_ptr += total;
     header->size = payload;
-    header->trace = NULL;
+    header->trace = trace;
     header->forward = NULL;
-    header->tag = GC_TAG_UNKNOWN;
+    header->tag = tag;
+    header->age = 0;
     void *payload_ptr = (void*)(header + 1);
     memset(payload_ptr, 0, payload);
-    copy_stats.allocated_bytes += size;
-    copy_stats.current_bytes = alloc_ptr - active_space;
+    gc_event_alloc(payload_ptr, payload, GC_GEN_NURSERY, tag);
+    CP->stats.allocated_bytes += size;
+    CP->stats.current_bytes = (size_t)(alloc_ptr - CP->active_space) + gc_los_bytes();
     return payload_ptr;
 }
 
+static void *copy_allocate(size_t size) {
+    return copy_allocate_typed(size, NULL, GC_TAG_UNKNOWN);
+}
+
 static void copy_set_trace(void *ptr, gc_trace_func trace) {
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) {
+        large->trace = trace;
+        return;
+    }
     CopyHeader *header = copy_header_for(ptr);
     if (header) header->trace = trace;
 }
 
 static void copy_set_tag(void *ptr, unsigned char tag) {
     if (!ptr) return;
-    if (pointer_in_space(active_space, ptr) || pointer_in_space(inactive_space, ptr)) {
+    if (pointer_in_space(CP->active_space, ptr) || pointer_in_space(CP->inactive_space, ptr)) {
         CopyHeader *header = copy_header_for(ptr);
         if (header) header->tag = tag;
+    } else {
+        GcLargeObject *large = gc_los_find(ptr);
+        if (large) large->tag = tag;
     }
+    gc_event_retag(ptr, tag);
 }
 
 static void copy_write_barrier(void *owner, void **slot, void *child) {
@@ -167,26 +234,79 @@ static void copy_write_barrier(void *owner, void **slot, void *child) {
 }
 
 static void swap_spaces(void) {
-    unsigned char *tmp = inactive_space;
-    inactive_space = active_space;
-    active_space = tmp;
-    alloc_ptr = active_space;
-    alloc_end = active_space + semi_space_size;
+    unsigned char *tmp = CP->inactive_space;
+    CP->inactive_space = CP->active_space;
+    CP->active_space = tmp;
+    size_t tmp_size = CP->inactive_space_size;
+    CP->inactive_space_size = CP->active_space_size;
+    CP->active_space_size = tmp_size;
+    alloc_ptr = CP->active_space;
+    alloc_end = CP->active_space + CP->active_space_size;
+}
+
+// Replace the (empty) inactive space with one of `size` bytes.
+static void resize_inactive_space(size_t size) {
+    free(CP->inactive_space);
+    CP->inactive_space = (unsigned char*)malloc(size);
+    if (!CP->inactive_space) {
+        fprintf(stderr, "Copying GC: failed to resize semispace (%zu bytes)\n", size);
+        exit(1);
+    }
+    CP->inactive_space_size = size;
+}
+
+// Pick the next semispace size from the pause that just ended and the
+// mutator time before it. The inactive space is resized now; the active
+// one follows after the next collection.
+static void copy_adapt_spaces(double start_time, double pause_ms, size_t live) {
+    int goal = gc_get_heap_goal();
+    if (goal != GC_GOAL_FIXED) {
+        double scale = gc_sizing_scale(goal, pause_ms, start_time - CP->last_collection_end_ms);
+        size_t min_size = CP->configured_space_size / COPY_SHRINK_LIMIT;
+        if (min_size < GC_SIZING_MIN_BYTES) min_size = GC_SIZING_MIN_BYTES;
+        size_t max_size = CP->configured_space_size * COPY_GROWTH_LIMIT;
+        size_t target = gc_sizing_apply(CP->semi_space_size, scale, min_size, max_size);
+        // Thrashing: survivors alone would fill most of the next to-space.
+        while (target < live * 2 && target < max_size) target = gc_sizing_apply(target, 2.0, min_size, max_size);
+        if (target < live * 2) target = GC_ALIGN_SIZE(live * 2);
+        CP->semi_space_size = target;
+    }
+    if (CP->inactive_space_size != CP->semi_space_size) resize_inactive_space(CP->semi_space_size);
 }
 
 // Copy helpers ---------------------------------------------------------
 
+static void copy_push_large(GcLargeObject *large) {
+    if (CP->large_pending_count == CP->large_pending_capacity) {
+        size_t capacity = CP->large_pending_capacity ? CP->large_pending_capacity * 2 : 64;
+        GcLargeObject **grown = (GcLargeObject**)realloc(CP->large_pending, capacity * sizeof(GcLargeObject*));
+        if (!grown) {
+            fprintf(stderr, "Copying GC: failed to grow large object stack\n");
+            exit(1);
+        }
+        CP->large_pending = grown;
+        CP->large_pending_capacity = capacity;
+    }
+    CP->large_pending[CP->large_pending_count++] = large;
+}
+
 static void *copy_copy_ptr(void *ptr) {
     if (!ptr) return NULL;
+    if (GC_IS_IMMEDIATE(ptr)) return ptr;
     CopyHeader *old_header = copy_header_for(ptr);
     if (!old_header) return NULL;
-    if (!pointer_in_space(inactive_space, old_header + 1)) {
-        return ptr; // already in to-space
+    if (!pointer_in_space(CP->inactive_space, old_header + 1)) {
+        GcLargeObject *large = gc_los_find(ptr);
+        if (large && !large->marked) {
+            large->marked = 1;
+            if (large->trace) copy_push_large(large);
+        }
+        return ptr; // already in to-space, or never moves
     }
     if (old_header->forward) return old_header->forward;
     size_t total = sizeof(CopyHeader) + old_header->size;
     if (alloc_ptr + total > alloc_end) {
-        fprintf(stderr, "Copying GC: insufficient semispace (current %zu bytes). Increase gc-threshold.\n", semi_space_size);
+        fprintf(stderr, "Copying GC: insufficient semispace (current %zu bytes). Increase gc-threshold.\n", CP->inactive_space_size);
         exit(1);
     }
     CopyHeader *new_header = (CopyHeader*)alloc_ptr;
@@ -195,86 +315,130 @@ static void *copy_copy_ptr(void *ptr) {
     new_header->trace = old_header->trace;
     new_header->forward = NULL;
     new_header->tag = old_header->tag;
+    new_header->age = 0;
     memcpy(new_header + 1, old_header + 1, old_header->size);
     old_header->forward = new_header + 1;
-    copy_stats.objects_copied++;  // Track copied objects
+    gc_event_move(old_header + 1, new_header + 1, GC_GEN_NURSERY);
+    CP->stats.objects_copied++;  // Track copied objects
     return old_header->forward;
 }
 
 static void scan_active_space(void) {
-    unsigned char *scan = active_space;
+    unsigned char *scan = CP->active_space;
     size_t scanned = 0;
-    while (scan < alloc_ptr) {
-        CopyHeader *header = (CopyHeader*)scan;
-        void *obj = (void*)(header + 1);
-        scanned++;
-        if (header->trace) header->trace(obj);
-        scan += sizeof(CopyHeader) + header->size;
-    }
-    copy_stats.objects_scanned += scanned;
+    do {
+        while (scan < alloc_ptr) {
+            CopyHeader *header = (CopyHeader*)scan;
+            void *obj = (void*)(header + 1);
+            scanned++;
+            if (header->trace) header->trace(obj);
+            scan += sizeof(CopyHeader) + header->size;
+        }
+        while (CP->large_pending_count > 0) {
+            GcLargeObject *large = CP->large_pending[--CP->large_pending_count];
+            scanned++;
+            large->trace(gc_los_payload(large));
+        }
+    } while (scan < alloc_ptr);
+    CP->stats.objects_scanned += scanned;
+}
+
+// After the scan, a from-space object survived exactly when it was copied.
+static void *copy_weak_resolve(void *ptr) {
+    if (pointer_in_space(CP->inactive_space, ptr)) return copy_header_for(ptr)->forward;
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) return large->marked ? ptr : NULL;
+    return ptr;
 }
 
 static void copy_collect(void) {
-    if (!copying_initialized || copying_collecting) return;
-    copying_collecting = 1;
+    if (!CP->initialized || CP->collecting) return;
+    CP->collecting = 1;
     
     // Start timing
     double start_time = gc_get_time_ms();
     
-    size_t before = copy_stats.current_bytes;
-    copy_stats.collections++;
+    copy_sync_stats();
+    size_t before = CP->stats.current_bytes;
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_COLLECT, start_time, &CP->stats);
+    CP->stats.collections++;
+    gc_move_epoch++;
     
     // Track objects before collection for survival rate
-    size_t objects_before_copy = copy_stats.objects_copied;
-    
+    size_t objects_before_copy = CP->stats.objects_copied;
+
+    // A shrunken to-space must still fit everything in the from-space.
+    if (CP->inactive_space_size < (size_t)(alloc_ptr - CP->active_space)) resize_inactive_space(CP->active_space_size);
     swap_spaces();
-    for (size_t i = 0; i < copy_root_count; ++i) {
-        void **slot = copy_roots[i].slot;
+    for (size_t i = 0; i < CP->root_count; ++i) {
+        void **slot = CP->roots[i].slot;
         if (slot && *slot) {
             *slot = copy_copy_ptr(*slot);
         }
     }
+    const GcRootRange *ranges = gc_root_ranges();
+    for (size_t r = 0; r < gc_root_range_count(); ++r) {
+        void **base = ranges[r].base;
+        size_t count = *ranges[r].count;
+        for (size_t i = 0; i < count; ++i) {
+            if (base[i]) base[i] = copy_copy_ptr(base[i]);
+        }
+    }
     scan_active_space();
-    size_t after = alloc_ptr - active_space;
-    copy_stats.current_bytes = after;
-    if (before > after) copy_stats.freed_bytes += before - after;
+    gc_weak_roots_update(copy_weak_resolve);
+    gc_event_free_range(CP->inactive_space, CP->inactive_space_size);
+    gc_los_sweep(NULL, NULL);
+    size_t after = alloc_ptr - CP->active_space;
+    CP->stats.current_bytes = after + gc_los_bytes();
+    if (before > CP->stats.current_bytes) CP->stats.freed_bytes += before - CP->stats.current_bytes;
     
     // Calculate survival rate (copied objects / scanned objects)
-    size_t objects_copied_this_cycle = copy_stats.objects_copied - objects_before_copy;
-    if (copy_stats.objects_scanned > 0) {
-        copy_stats.survival_rate = (double)objects_copied_this_cycle / (double)copy_stats.objects_scanned;
+    size_t objects_copied_this_cycle = CP->stats.objects_copied - objects_before_copy;
+    if (CP->stats.objects_scanned > 0) {
+        CP->stats.survival_rate = (double)objects_copied_this_cycle / (double)CP->stats.objects_scanned;
     }
     
     // Calculate metadata overhead: count live objects in active space
     size_t live_objects = 0;
-    unsigned char *scan = active_space;
+    unsigned char *scan = CP->active_space;
     while (scan < alloc_ptr) {
         CopyHeader *header = (CopyHeader*)scan;
         live_objects++;
         scan += sizeof(CopyHeader) + header->size;
     }
-    copy_stats.metadata_bytes = live_objects * sizeof(CopyHeader);
+    CP->stats.metadata_bytes = live_objects * sizeof(CopyHeader);
     
     // End timing and update stats
-    double elapsed = gc_get_time_ms() - start_time;
-    copy_stats.last_gc_pause_ms = elapsed;
-    copy_stats.total_gc_time_ms += elapsed;
-    if (elapsed > copy_stats.max_gc_pause_ms) {
-        copy_stats.max_gc_pause_ms = elapsed;
+    double end_time = gc_get_time_ms();
+    double elapsed = end_time - start_time;
+    gc_trace_end(&span, end_time, &CP->stats);
+    gc_note_pause(elapsed);
+    CP->stats.last_gc_pause_ms = elapsed;
+    CP->stats.total_gc_time_ms += elapsed;
+    if (elapsed > CP->stats.max_gc_pause_ms) {
+        CP->stats.max_gc_pause_ms = elapsed;
     }
-    copy_stats.avg_gc_pause_ms = copy_stats.total_gc_time_ms / copy_stats.collections;
-    
-    copying_collecting = 0;
+    CP->stats.avg_gc_pause_ms = CP->stats.total_gc_time_ms / CP->stats.collections;
+
+    copy_adapt_spaces(start_time, elapsed, after);
+    CP->last_collection_end_ms = gc_get_time_ms();
+    CP->collecting = 0;
 }
 
 static void *copy_mark_ptr(void *ptr) {
-    if (!copying_collecting) return ptr;
+    if (!CP->collecting) return ptr;
     return copy_copy_ptr(ptr);
 }
 
 static void copy_free(void *ptr) {
-    (void)ptr;
-    // No-op; objects are reclaimed during collection.
+    // Objects in the semispaces are reclaimed during collection.
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) {
+        CP->stats.freed_bytes += large->size;
+        CP->stats.current_bytes -= large->size;
+        gc_los_free(large);
+    }
 }
 
 static void copy_set_threshold(size_t bytes) {
@@ -283,11 +447,12 @@ static void copy_set_threshold(size_t bytes) {
 }
 
 static size_t copy_get_threshold(void) {
-    return semi_space_size;
+    return CP->semi_space_size;
 }
 
 static void copy_get_stats(GcStats *out_stats) {
-    if (out_stats) *out_stats = copy_stats;
+    copy_sync_stats();
+    if (out_stats) *out_stats = CP->stats;
 
     // Derived metrics
     size_t free_mem = 0;
@@ -302,8 +467,8 @@ static void copy_get_stats(GcStats *out_stats) {
     // Internal fragmentation
     size_t wasted = 0;
     size_t obj_count = 0;
-    if (active_space && alloc_ptr) {
-        unsigned char *scan = active_space;
+    if (CP->active_space && alloc_ptr) {
+        unsigned char *scan = CP->active_space;
         while (scan < alloc_ptr) {
             CopyHeader *h = (CopyHeader*)scan;
             wasted += sizeof(CopyHeader);
@@ -314,7 +479,7 @@ static void copy_get_stats(GcStats *out_stats) {
     out_stats->wasted_bytes = wasted;
     
     // Internal fragmentation ratio
-    size_t payload = (alloc_ptr - active_space) - wasted;
+    size_t payload = (alloc_ptr - CP->active_space) - wasted;
     size_t total_allocated = payload + wasted;
     
     if (total_allocated > 0) {
@@ -333,14 +498,14 @@ static void copy_get_stats(GcStats *out_stats) {
     out_stats->fragmentation_growth_rate = 0.0;
 }
 
-static double copy_get_collections_count(void) { return (double)copy_stats.collections; }
-static double copy_get_allocated_bytes(void) { return (double)copy_stats.allocated_bytes; }
-static double copy_get_freed_bytes(void) { return (double)copy_stats.freed_bytes; }
-static double copy_get_current_bytes(void) { return (double)copy_stats.current_bytes; }
+static double copy_get_collections_count(void) { return (double)CP->stats.collections; }
+static double copy_get_allocated_bytes(void) { copy_sync_stats(); return (double)CP->stats.allocated_bytes; }
+static double copy_get_freed_bytes(void) { return (double)CP->stats.freed_bytes; }
+static double copy_get_current_bytes(void) { copy_sync_stats(); return (double)CP->stats.current_bytes; }
 
 static size_t copy_heap_snapshot(GcObjectInfo *out, size_t capacity) {
     size_t count = 0;
-    unsigned char *scan = active_space;
+    unsigned char *scan = CP->active_space;
     while (scan < alloc_ptr && count < capacity) {
         CopyHeader *header = (CopyHeader*)scan;
         out[count].addr = (uintptr_t)(header + 1);
@@ -350,9 +515,18 @@ static size_t copy_heap_snapshot(GcObjectInfo *out, size_t capacity) {
         count++;
         scan += sizeof(CopyHeader) + header->size;
     }
+    count += gc_los_snapshot(out + count, capacity - count);
     return count;
 }
 
+static void copy_destroy(void) {
+    free(CP->active_space);
+    free(CP->inactive_space);
+    free(CP->roots);
+    free(CP->large_pending);
+    alloc_ptr = alloc_end = NULL;
+}
+
 const GcBackend *gc_copying_backend(void) {
     static const GcBackend backend = {
         copy_init,
@@ -372,7 +546,12 @@ const GcBackend *gc_copying_backend(void) {
         copy_get_allocated_bytes,
         copy_get_freed_bytes,
         copy_get_current_bytes,
-        copy_heap_snapshot
+        copy_heap_snapshot,
+        copy_allocate_typed,
+        NULL,
+        copy_destroy,
+        sizeof(CopyState),
+        "copying"
     };
     return &backend;
 }
@@ -2,6 +2,8 @@
 #define GC_BACKEND_H
 
 #include "gc.h"
+#include <stdio.h>
+#include <stdlib.h>
 
 // Timing utilities for GC performance measurement
 #ifdef __EMSCRIPTEN__
@@ -37,10 +39,437 @@ typedef struct GcBackend {
     double (*get_freed_bytes)(void);
     double (*get_current_bytes)(void);
     size_t (*heap_snapshot)(GcObjectInfo *out, size_t capacity);
+    // Allocate with trace/tag set in one call (slow path of gc_allocate_fast).
+    void *(*allocate_typed)(size_t size, gc_trace_func trace, unsigned char tag);
+    // Pretenured allocation (gc_allocate_old); NULL when the backend has no
+    // old generation.
+    void *(*allocate_old)(size_t size, gc_trace_func trace, unsigned char tag);
+    // Release everything the backend holds for the current heap.
+    void (*destroy)(void);
+    // Bytes of backend state kept after each GcHeap (GC_BACKEND_STATE).
+    size_t state_size;
+    // Name accepted by gc_heap_create.
+    const char *name;
 } GcBackend;
 
+// Shadow-stack root ranges are kept by the runtime shim and shared by every
+// backend; collectors scan them alongside their own root slots.
+typedef struct {
+    void **base;
+    const size_t *count;
+} GcRootRange;
+
+#define GC_MAX_ROOT_RANGES 16
+
+// Pause lengths are counted in log-scale buckets, 16 per doubling (about 4%
+// apart) from 2^-10 ms (1 us) to 2^18 ms; [0] holds anything shorter and
+// the last bucket anything longer.
+#define GC_PAUSE_BUCKETS_PER_OCTAVE 16
+#define GC_PAUSE_MIN_EXP (-10)
+#define GC_PAUSE_OCTAVES 28
+#define GC_PAUSE_BUCKETS (GC_PAUSE_OCTAVES * GC_PAUSE_BUCKETS_PER_OCTAVE + 2)
+
+size_t gc_root_range_count(void);
+const GcRootRange *gc_root_ranges(void);
+
+// Weak roots are kept by the shim as well. Once marking is complete, and
+// before any dead object is reused, a collector calls gc_weak_roots_update
+// with a function answering an object's current address, or NULL when it
+// died; pointers the collector does not manage come back unchanged.
+void gc_weak_roots_update(void *(*resolve)(void *ptr));
+
+// Large object space bookkeeping (large_objects.c), one per heap.
+typedef struct GcLargeObject GcLargeObject;
+
+typedef struct {
+    GcLargeObject *objects;
+    GcLargeObject **hash;
+    size_t hash_capacity;
+    size_t count;
+    size_t bytes;                  // payload bytes of live large objects
+    size_t mapped_bytes;
+    size_t allocated_since_sweep;
+} GcLargeObjectSpace;
+
+typedef struct GcAllocProfile GcAllocProfile;
+
+// Everything the runtime shim keeps per heap. The fast-path fields come first
+// so gc_fast_state can point into the heap, and the backend's own state
+// follows the struct in the same allocation.
+struct GcHeap {
+    GcFastState fast;
+    const GcBackend *backend;
+    double pause_budget_ms;
+    int pause_budget_set;
+    int heap_goal;
+    int heap_goal_set;
+    int eval_collect_policy;
+    int eval_collect_policy_set;
+    // Allocation counter at the last collection the runtime has seen, and
+    // the duration of the last idle collection.
+    double collect_mark_allocated;
+    double collect_mark_count;
+    double idle_pause_ms;
+    GcRootRange root_ranges[GC_MAX_ROOT_RANGES];
+    size_t root_range_count;
+    void ***weak_roots;
+    size_t weak_root_count;
+    size_t weak_root_capacity;
+    GcHeapChannel *channel;
+    // Collection count when the channel's stats were last published.
+    double channel_stats_collections;
+    // Every pause so far, for percentiles; the count and bounds are exact.
+    size_t pause_histogram[GC_PAUSE_BUCKETS];
+    size_t pause_count;
+    double pause_min;
+    double pause_max;
+    GcLargeObjectSpace los;
+    GcAllocProfile *profile;    // NULL until profiling first starts
+    // Collection trace ring; `trace_total % trace_allocated` is the next slot
+    // once all of it is in use.
+    GcTraceEvent *trace;
+    size_t trace_capacity;
+    size_t trace_allocated;
+    size_t trace_total;
+    char *trace_json;
+};
+
+// The calling thread's current heap (NULL when none).
+extern _Thread_local GcHeap *gc_heap;
+
+#define GC_BACKEND_STATE(type) ((type*)(gc_heap + 1))
+
+// Free the per-heap parts of the shared modules.
+void gc_los_destroy(void);
+void gc_alloc_profile_destroy(void);
+
+// Every pause (a whole stop-the-world collection, or one incremental slice)
+// is also counted by the runtime for gc_pause_percentile.
+void gc_note_pause(double ms);
+
+// Collectors bracket each pause with these to add it to the trace ring. The
+// span takes its counts from the backend's cumulative stats.
+typedef struct {
+    double start_ms;
+    unsigned kind;
+    size_t bytes;
+    size_t scanned;
+    size_t copied;
+    size_t promoted;
+} GcTraceSpan;
+
+static inline void gc_trace_begin(GcTraceSpan *span, unsigned kind, double start_ms, const GcStats *stats) {
+    span->start_ms = start_ms;
+    span->kind = kind;
+    span->bytes = stats->current_bytes;
+    span->scanned = stats->objects_scanned;
+    span->copied = stats->objects_copied;
+    span->promoted = stats->objects_promoted;
+}
+
+void gc_trace_end(const GcTraceSpan *span, double end_ms, const GcStats *stats);
+
+// Bounded mark stack for the marking collectors. mark_ptr sets the mark bit
+// and pushes the object instead of calling its trace hook, so marking depth
+// no longer follows the C stack. When the stack is full the object stays
+// marked but untraced and `overflowed` is set; the collector then rescans
+// its heap for marked objects and re-traces them until no overflow remains.
+#define GC_MARK_STACK_CAPACITY 4096
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GC_PREFETCH(addr) __builtin_prefetch(addr)
+#define GC_CTZ64(x) __builtin_ctzll(x)
+#else
+#define GC_PREFETCH(addr) ((void)(addr))
+static inline int gc_ctz64(uint64_t x) {
+    int n = 0;
+    while (!(x & 1)) { x >>= 1; n++; }
+    return n;
+}
+#define GC_CTZ64(x) gc_ctz64(x)
+#endif
+
+typedef struct {
+    void *obj;
+    gc_trace_func trace;
+} GcMarkEntry;
+
+typedef struct {
+    GcMarkEntry entries[GC_MARK_STACK_CAPACITY];
+    size_t top;
+    int overflowed;
+} GcMarkStack;
+
+static inline void gc_mark_stack_push(GcMarkStack *stack, void *obj, gc_trace_func trace) {
+    if (stack->top == GC_MARK_STACK_CAPACITY) {
+        stack->overflowed = 1;
+        return;
+    }
+    // The payload is read when the entry is popped; start fetching it now.
+    GC_PREFETCH(obj);
+    stack->entries[stack->top].obj = obj;
+    stack->entries[stack->top].trace = trace;
+    stack->top++;
+}
+
+static inline void gc_mark_stack_drain(GcMarkStack *stack) {
+    while (stack->top > 0) {
+        GcMarkEntry entry = stack->entries[--stack->top];
+        entry.trace(entry.obj);
+    }
+}
+
+// Parallel marking (parallel_mark.c). With GC_THREADS=n on native builds, a
+// full drain runs on n threads: the pushed roots are dealt out across the
+// workers, each worker marks from a private GcMarkStack, spills the older
+// half to its shared deque when that stack fills, and steals from other
+// workers' deques when it runs dry. Mark bits are claimed atomically so each
+// object is traced by exactly one worker.
+extern _Thread_local GcMarkStack *gc_mark_local_stack; // set on marker threads
+size_t gc_mark_thread_count(void);
+void gc_mark_spill(GcMarkStack *local);
+void gc_parallel_mark_drain(GcMarkStack *seed);
+
+// Push onto the calling marker thread's stack, or onto `stack` when the
+// caller is not a parallel marker.
+static inline void gc_mark_push(GcMarkStack *stack, void *obj, gc_trace_func trace) {
+    GcMarkStack *local = gc_mark_local_stack;
+    if (local) {
+        if (local->top == GC_MARK_STACK_CAPACITY) gc_mark_spill(local);
+        stack = local;
+    }
+    gc_mark_stack_push(stack, obj, trace);
+}
+
+// Set a mark byte; nonzero when this caller set it first.
+static inline int gc_mark_claim(unsigned char *mark) {
+#if defined(__GNUC__) || defined(__clang__)
+    if (__atomic_load_n(mark, __ATOMIC_RELAXED)) return 0;
+    return !__atomic_exchange_n(mark, 1, __ATOMIC_RELAXED);
+#else
+    if (*mark) return 0;
+    *mark = 1;
+    return 1;
+#endif
+}
+
+// Incremental marking: drain until the stack is empty or `deadline` (in
+// gc_get_time_ms units) has passed, reading the clock every
+// GC_MARK_SLICE_CHECK objects. Returns nonzero once the stack is empty.
+#define GC_MARK_SLICE_CHECK 64
+
+static inline int gc_mark_stack_drain_until(GcMarkStack *stack, double deadline) {
+    size_t traced = 0;
+    while (stack->top > 0) {
+        GcMarkEntry entry = stack->entries[--stack->top];
+        entry.trace(entry.obj);
+        if (++traced % GC_MARK_SLICE_CHECK == 0 && gc_get_time_ms() >= deadline) {
+            return stack->top == 0;
+        }
+    }
+    return 1;
+}
+
+// Adaptive young-space sizing (gc_get_heap_goal). After a collection that
+// paused `pause_ms` following `mutator_ms` of mutator time, returns the
+// factor to scale the space by: 2 to grow, 0.5 to shrink, 1 to keep.
+#define GC_SIZING_GC_SHARE 0.05           // collector share of run time worth growing for
+#define GC_SIZING_LATENCY_TARGET_MS 1.0   // pause target when no budget is set
+#define GC_SIZING_MIN_BYTES (64 * 1024)
+
+static inline double gc_sizing_scale(int goal, double pause_ms, double mutator_ms) {
+    double total = pause_ms + mutator_ms;
+    double share = total > 0.0 ? pause_ms / total : 0.0;
+    if (goal == GC_GOAL_THROUGHPUT) {
+        return share > GC_SIZING_GC_SHARE ? 2.0 : 1.0;
+    }
+    if (goal == GC_GOAL_LATENCY) {
+        double target = gc_get_pause_budget_ms();
+        if (target <= 0.0) target = GC_SIZING_LATENCY_TARGET_MS;
+        if (pause_ms > target) return 0.5;
+        if (pause_ms < target / 4 && share > GC_SIZING_GC_SHARE) return 2.0;
+    }
+    return 1.0;
+}
+
+// Scale `size` and keep it within [min_size, max_size], pointer-aligned.
+static inline size_t gc_sizing_apply(size_t size, double scale, size_t min_size, size_t max_size) {
+    double scaled = (double)size * scale;
+    size_t next = scaled > (double)max_size ? max_size : (size_t)scaled;
+    if (next < min_size) next = min_size;
+    if (next > max_size) next = max_size;
+    return GC_ALIGN_SIZE(next);
+}
+
+// Object-start bitmap for a contiguous free-list heap: one bit per
+// GC_OBJECT_MAP_GRANULE bytes, set at the first byte of every allocated
+// block. Checking that a pointer is managed (and therefore that its header
+// sits right before it) is a bounds check plus a bit test, and sweeping
+// walks set bits instead of a per-object list.
+#define GC_OBJECT_MAP_GRANULE sizeof(void*)
+
+typedef struct {
+    uint8_t *base;
+    size_t limit;    // bytes covered
+    size_t words;
+    uint64_t *bits;
+} GcObjectMap;
+
+static inline void gc_object_map_init(GcObjectMap *map, void *base, size_t size) {
+    size_t granules = size / GC_OBJECT_MAP_GRANULE;
+    map->base = (uint8_t*)base;
+    map->limit = size;
+    map->words = (granules + 63) / 64;
+    map->bits = (uint64_t*)calloc(map->words ? map->words : 1, sizeof(uint64_t));
+    if (!map->bits) {
+        fprintf(stderr, "GC: failed to allocate object bitmap\n");
+        exit(1);
+    }
+}
+
+static inline void gc_object_map_set(GcObjectMap *map, void *block) {
+    size_t index = (size_t)((uint8_t*)block - map->base) / GC_OBJECT_MAP_GRANULE;
+    map->bits[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+static inline void gc_object_map_clear(GcObjectMap *map, void *block) {
+    size_t index = (size_t)((uint8_t*)block - map->base) / GC_OBJECT_MAP_GRANULE;
+    map->bits[index / 64] &= ~((uint64_t)1 << (index % 64));
+}
+
+// Nonzero when `block` is the start of an allocated block in the map.
+static inline int gc_object_map_test(const GcObjectMap *map, const void *block) {
+    const uint8_t *p = (const uint8_t*)block;
+    if (p < map->base || p >= map->base + map->limit) return 0;
+    size_t offset = (size_t)(p - map->base);
+    if (offset % GC_OBJECT_MAP_GRANULE) return 0;
+    size_t index = offset / GC_OBJECT_MAP_GRANULE;
+    return (int)((map->bits[index / 64] >> (index % 64)) & 1);
+}
+
+// First allocated block in [from, to), or NULL. Bounding the search keeps
+// page-at-a-time walks from scanning the rest of a mostly empty heap.
+static inline void *gc_object_map_find_before(const GcObjectMap *map, const void *from, const void *to) {
+    size_t index = (size_t)((const uint8_t*)from - map->base + GC_OBJECT_MAP_GRANULE - 1) / GC_OBJECT_MAP_GRANULE;
+    size_t end = (size_t)((const uint8_t*)to - map->base + GC_OBJECT_MAP_GRANULE - 1) / GC_OBJECT_MAP_GRANULE;
+    size_t word = index / 64;
+    size_t end_word = (end + 63) / 64;
+    if (end_word > map->words) end_word = map->words;
+    if (word >= end_word) return NULL;
+    uint64_t bits = map->bits[word] & (~(uint64_t)0 << (index % 64));
+    while (!bits) {
+        if (++word >= end_word) return NULL;
+        bits = map->bits[word];
+    }
+    index = word * 64 + (size_t)GC_CTZ64(bits);
+    if (index >= end) return NULL;
+    return map->base + index * GC_OBJECT_MAP_GRANULE;
+}
+
+// First allocated block at or after `from`, or NULL.
+static inline void *gc_object_map_find(const GcObjectMap *map, const void *from) {
+    return gc_object_map_find_before(map, from, map->base + map->limit);
+}
+
+// First allocated block after `after` (or the first one when NULL). Blocks
+// may be freed while iterating: the cursor only depends on the address.
+static inline void *gc_object_map_next(const GcObjectMap *map, const void *after) {
+    if (!after) return gc_object_map_find(map, map->base);
+    return gc_object_map_find(map, (const uint8_t*)after + GC_OBJECT_MAP_GRANULE);
+}
+
+// Large object space (large_objects.c). Allocations of at least
+// GC_LARGE_OBJECT_BYTES get their own page-aligned mapping and are never
+// moved. Backends mark them from mark_ptr (gc_los_find, then claim the mark
+// byte and push the object like any other), sweep the space with
+// gc_los_sweep once marking is complete, and collect when
+// gc_los_allocated_since_sweep grows past a share of their heap. The generational
+// backend only puts leaf objects (no trace hook) there, since the space has
+// no card table.
+struct GcLargeObject {
+    struct GcLargeObject *next;
+    size_t size;     // payload bytes
+    size_t mapped;   // bytes mapped, header included
+    gc_trace_func trace;
+    unsigned char marked;
+    unsigned char tag;
+};
+
+// Returns NULL when the mapping fails. `marked` allocates black, for
+// objects created while a cycle is marking.
+void *gc_los_allocate(size_t size, gc_trace_func trace, unsigned char tag, int marked);
+GcLargeObject *gc_los_find(const void *ptr);
+void *gc_los_payload(GcLargeObject *obj);
+// Unmap unmarked objects and clear the marks of the rest. Returns the
+// payload bytes freed; counts objects visited and kept when asked.
+size_t gc_los_sweep(size_t *scanned, size_t *survived);
+void gc_los_free(GcLargeObject *obj);
+// Run the trace hook of every marked large object (used by the moving
+// collectors to update the slots they hold).
+void gc_los_trace_marked(void);
+size_t gc_los_bytes(void);
+size_t gc_los_mapped_bytes(void);
+size_t gc_los_count(void);
+size_t gc_los_allocated_since_sweep(void);
+size_t gc_los_snapshot(GcObjectInfo *out, size_t capacity);
+
+// Heap trimming: hand the whole pages inside [start, start + length) back
+// to the OS (madvise(MADV_DONTNEED); a no-op where unsupported). The range
+// must be free memory whose contents are no longer needed; it reads back as
+// zeroes. After a collection that shrank the heap, the backends release
+// free blocks of GC_TRIM_MIN_BYTES or more beyond what is live, keeping the
+// lowest addresses resident for the allocator.
+#define GC_TRIM_MIN_BYTES (256 * 1024)
+void gc_release_pages(void *start, size_t length);
+
+// One step of a trim pass over an address-ordered free list: `*keep` bytes
+// of free memory stay resident, lowest addresses first; whatever is left of
+// a large enough block past them is released.
+static inline void gc_trim_block(size_t *keep, void *start, size_t length) {
+    if (length < GC_TRIM_MIN_BYTES) return;
+    if (*keep >= length) {
+        *keep -= length;
+        return;
+    }
+    gc_release_pages((uint8_t*)start + *keep, length - *keep);
+    *keep = 0;
+}
+
+// Consumers of heap events, as bits of gc_heap_observed.
+enum {
+    GC_OBSERVE_CHANNEL = 1,
+    GC_OBSERVE_PROFILE = 2
+};
+
+// Feed one heap event to the allocation profiler (alloc_profile.c).
+void gc_alloc_profile_event(unsigned kind, const void *addr, size_t size, unsigned generation, const void *to);
+
+// Heap event hooks (gc_heap_event in gc.h); each is a single branch while
+// nothing observes the heap.
+static inline void gc_event_alloc(const void *obj, size_t size, unsigned generation, unsigned tag) {
+    gc_heap_event(GC_EVENT_ALLOC, obj, size, generation, tag, NULL);
+}
+
+static inline void gc_event_free(const void *obj) {
+    gc_heap_event(GC_EVENT_FREE, obj, 0, GC_GEN_UNKNOWN, GC_TAG_UNKNOWN, NULL);
+}
+
+static inline void gc_event_move(const void *from, const void *to, unsigned generation) {
+    gc_heap_event(GC_EVENT_MOVE, from, 0, generation, GC_TAG_UNKNOWN, to);
+}
+
+static inline void gc_event_retag(const void *obj, unsigned tag) {
+    gc_heap_event(GC_EVENT_RETAG, obj, 0, GC_GEN_UNKNOWN, tag, NULL);
+}
+
+// Every object in [start, start + length) that has not moved out died.
+static inline void gc_event_free_range(const void *start, size_t length) {
+    gc_heap_event(GC_EVENT_FREE_RANGE, start, length, GC_GEN_UNKNOWN, GC_TAG_UNKNOWN, NULL);
+}
+
 const GcBackend *gc_mark_sweep_backend(void);
 const GcBackend *gc_copying_backend(void);
 const GcBackend *gc_generational_backend(void);
+const GcBackend *gc_compact_backend(void);
 
 #endif
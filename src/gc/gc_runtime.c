@@ -2,16 +2,38 @@
 #include "gc_backend.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #endif
 
-static const GcBackend *gc_backend = NULL;
+// Fast-path state of threads that have not entered a heap: an empty
+// allocation region sends every allocation to the slow path, which creates one.
+static GcFastState detached_state = {{NULL, NULL, 0, GC_GEN_UNKNOWN}, {NULL, 0, 0}, 0, 0, 0};
+_Thread_local GcFastState *gc_fast_state = &detached_state;
+_Thread_local GcHeap *gc_heap = NULL;
+
+// Process-wide settings, shared by every heap.
 static char backend_override[32];
 static int backend_override_set = 0;
 static size_t initial_heap_size = 0;
+static char stats_json_path[4096];
+static char trace_json_path[4096];
+
+#define GC_TRACE_DEFAULT_EVENTS 4096
+
+// Tuning set while no heap is current, copied into every heap created later.
+static GcHeap heap_defaults = {.heap_goal = GC_GOAL_FIXED, .eval_collect_policy = GC_EVAL_COLLECT_THRESHOLD};
+
+static GcHeap *settings_heap(void) {
+    return gc_heap ? gc_heap : &heap_defaults;
+}
+
+static void ensure_heap(void);
 
 void gc_set_initial_heap_size(size_t size) {
     initial_heap_size = size;
@@ -26,13 +48,43 @@ size_t gc_get_initial_heap_size(void) {
     return 0;
 }
 
-static const GcBackend *select_backend(void) {
-    const char *env = NULL;
-    if (backend_override_set) {
-        env = backend_override;
-    } else {
-        env = getenv("GC_BACKEND");
+void gc_set_pause_budget_ms(double ms) {
+    GcHeap *heap = settings_heap();
+    heap->pause_budget_ms = ms > 0.0 ? ms : 0.0;
+    heap->pause_budget_set = 1;
+}
+
+double gc_get_pause_budget_ms(void) {
+    const GcHeap *heap = settings_heap();
+    if (heap->pause_budget_set) return heap->pause_budget_ms;
+    const char *env = getenv("GC_PAUSE_BUDGET_MS");
+    if (env) {
+        double ms = atof(env);
+        return ms > 0.0 ? ms : 0.0;
     }
+    return 0.0;
+}
+
+void gc_set_heap_goal(int goal) {
+    GcHeap *heap = settings_heap();
+    heap->heap_goal = (goal == GC_GOAL_THROUGHPUT || goal == GC_GOAL_LATENCY) ? goal : GC_GOAL_FIXED;
+    heap->heap_goal_set = 1;
+}
+
+int gc_get_heap_goal(void) {
+    const GcHeap *heap = settings_heap();
+    if (heap->heap_goal_set) return heap->heap_goal;
+    const char *env = getenv("GC_HEAP_GOAL");
+    if (env) {
+        if (strcmp(env, "throughput") == 0) return GC_GOAL_THROUGHPUT;
+        if (strcmp(env, "latency") == 0) return GC_GOAL_LATENCY;
+    }
+    return GC_GOAL_FIXED;
+}
+
+static const GcBackend *select_backend(const char *name) {
+    const char *env = name;
+    if (!env) env = backend_override_set ? backend_override : getenv("GC_BACKEND");
     if (env) {
         if (strcmp(env, "copy") == 0 || strcmp(env, "copying") == 0 || strcmp(env, "semispace") == 0) {
             return gc_copying_backend();
@@ -40,82 +92,344 @@ static const GcBackend *select_backend(void) {
         if (strcmp(env, "gen") == 0 || strcmp(env, "generational") == 0) {
             return gc_generational_backend();
         }
+        if (strcmp(env, "compact") == 0 || strcmp(env, "mark-compact") == 0) {
+            return gc_compact_backend();
+        }
     }
     return gc_mark_sweep_backend();
 }
 
-static void ensure_backend(void) {
-    if (!gc_backend) {
-        gc_backend = select_backend();
+GcHeap *gc_heap_create(const char *backend) {
+    const GcBackend *selected = select_backend(backend);
+    GcHeap *heap = (GcHeap*)calloc(1, sizeof(GcHeap) + selected->state_size);
+    if (!heap) return NULL;
+    heap->fast.alloc_region.generation = GC_GEN_UNKNOWN;
+    heap->backend = selected;
+    heap->pause_budget_ms = heap_defaults.pause_budget_ms;
+    heap->pause_budget_set = heap_defaults.pause_budget_set;
+    heap->heap_goal = heap_defaults.heap_goal;
+    heap->heap_goal_set = heap_defaults.heap_goal_set;
+    heap->eval_collect_policy = heap_defaults.eval_collect_policy;
+    heap->eval_collect_policy_set = heap_defaults.eval_collect_policy_set;
+    heap->collect_mark_count = -1.0;
+    heap->channel_stats_collections = -1.0;
+    const char *trace_events = getenv("GC_TRACE_EVENTS");
+    heap->trace_capacity = trace_events ? (size_t)atol(trace_events) : GC_TRACE_DEFAULT_EVENTS;
+    GcHeap *previous = gc_heap_enter(heap);
+    selected->init();
+    gc_heap_enter(previous);
+    return heap;
+}
+
+void gc_heap_destroy(GcHeap *heap) {
+    if (!heap) return;
+    GcHeap *previous = gc_heap_enter(heap);
+    heap->backend->destroy();
+    gc_los_destroy();
+    gc_alloc_profile_destroy();
+    free(heap->channel);
+    free(heap->weak_roots);
+    free(heap->trace);
+    free(heap->trace_json);
+    gc_heap_enter(previous == heap ? NULL : previous);
+    free(heap);
+}
+
+GcHeap *gc_heap_enter(GcHeap *heap) {
+    GcHeap *previous = gc_heap;
+    gc_heap = heap;
+    gc_fast_state = heap ? &heap->fast : &detached_state;
+    return previous;
+}
+
+GcHeap *gc_heap_current(void) {
+    return gc_heap;
+}
+
+const char *gc_heap_backend_name(const GcHeap *heap) {
+    return heap->backend->name;
+}
+
+// Threads that never entered a heap get their own on first use.
+static void ensure_heap(void) {
+    if (!gc_heap) {
+        GcHeap *heap = gc_heap_create(NULL);
+        if (!heap) {
+            fprintf(stderr, "GC: cannot create heap\n");
+            exit(1);
+        }
+        gc_heap_enter(heap);
+    }
+}
+
+static void write_stats_json_at_exit(void) {
+    if (!gc_heap) return;
+    FILE *out = fopen(stats_json_path, "w");
+    if (!out) {
+        fprintf(stderr, "GC: cannot write stats to %s\n", stats_json_path);
+        return;
     }
+    gc_write_stats_json(out);
+    fclose(out);
+}
+
+static void write_trace_json_at_exit(void) {
+    if (!gc_heap) return;
+    FILE *out = fopen(trace_json_path, "w");
+    if (!out) {
+        fprintf(stderr, "GC: cannot write trace to %s\n", trace_json_path);
+        return;
+    }
+    const char *json = gc_trace_json();
+    if (json) fputs(json, out);
+    fclose(out);
 }
 
 void gc_init(void) {
-    ensure_backend();
-    gc_backend->init();
+    ensure_heap();
+    const char *path = getenv("GC_STATS_JSON");
+    if (path && *path && !stats_json_path[0] && strlen(path) < sizeof(stats_json_path)) {
+        strcpy(stats_json_path, path);
+        atexit(write_stats_json_at_exit);
+    }
+    path = getenv("GC_TRACE_JSON");
+    if (path && *path && !trace_json_path[0] && strlen(path) < sizeof(trace_json_path)) {
+        strcpy(trace_json_path, path);
+        atexit(write_trace_json_at_exit);
+    }
 }
 
 void *gc_allocate(size_t size) {
-    ensure_backend();
-    return gc_backend->allocate(size);
+    ensure_heap();
+    return gc_heap->backend->allocate(size);
+}
+
+// Republish the channel's stats when the backend collected on its own.
+static void channel_note_collections(void) {
+    if (gc_heap->channel && gc_get_collections_count() != gc_heap->channel_stats_collections) {
+        gc_heap_channel_publish_stats();
+    }
+}
+
+void *gc_allocate_slow(size_t size, gc_trace_func trace, unsigned char tag) {
+    ensure_heap();
+    void *ptr;
+    if (gc_heap->backend->allocate_typed) {
+        ptr = gc_heap->backend->allocate_typed(size, trace, tag);
+    } else {
+        ptr = gc_heap->backend->allocate(size);
+        gc_heap->backend->set_trace(ptr, trace);
+        if (gc_heap->backend->set_tag) gc_heap->backend->set_tag(ptr, tag);
+    }
+    channel_note_collections();
+    return ptr;
+}
+
+void *gc_allocate_old(size_t size, gc_trace_func trace, unsigned char tag) {
+    ensure_heap();
+    if (!gc_heap->backend->allocate_old) return gc_allocate_slow(size, trace, tag);
+    void *ptr = gc_heap->backend->allocate_old(size, trace, tag);
+    channel_note_collections();
+    return ptr;
 }
 
 void gc_set_trace(void *ptr, gc_trace_func trace) {
-    ensure_backend();
-    gc_backend->set_trace(ptr, trace);
+    ensure_heap();
+    gc_heap->backend->set_trace(ptr, trace);
 }
 
 void *gc_mark_ptr(void *ptr) {
-    ensure_backend();
-    return gc_backend->mark_ptr(ptr);
+    ensure_heap();
+    return gc_heap->backend->mark_ptr(ptr);
 }
 
 void gc_set_tag(void *ptr, unsigned char tag) {
-    ensure_backend();
-    if (gc_backend->set_tag) gc_backend->set_tag(ptr, tag);
+    ensure_heap();
+    if (gc_heap->backend->set_tag) gc_heap->backend->set_tag(ptr, tag);
 }
 
 void gc_add_root(void **slot) {
-    ensure_backend();
-    gc_backend->add_root(slot);
+    ensure_heap();
+    gc_heap->backend->add_root(slot);
 }
 
 void gc_remove_root(void **slot) {
-    ensure_backend();
-    gc_backend->remove_root(slot);
+    ensure_heap();
+    gc_heap->backend->remove_root(slot);
+}
+
+void gc_add_root_range(void **base, const size_t *count) {
+    ensure_heap();
+    if (!base || !count) return;
+    for (size_t i = 0; i < gc_heap->root_range_count; ++i) {
+        if (gc_heap->root_ranges[i].base == base) {
+            gc_heap->root_ranges[i].count = count;
+            return;
+        }
+    }
+    if (gc_heap->root_range_count >= GC_MAX_ROOT_RANGES) {
+        fprintf(stderr, "GC: too many root ranges\n");
+        exit(1);
+    }
+    gc_heap->root_ranges[gc_heap->root_range_count].base = base;
+    gc_heap->root_ranges[gc_heap->root_range_count].count = count;
+    gc_heap->root_range_count++;
+}
+
+void gc_remove_root_range(void **base) {
+    if (!gc_heap) return;
+    for (size_t i = 0; i < gc_heap->root_range_count; ++i) {
+        if (gc_heap->root_ranges[i].base == base) {
+            gc_heap->root_ranges[i] = gc_heap->root_ranges[--gc_heap->root_range_count];
+            return;
+        }
+    }
+}
+
+void gc_add_weak_root(void **slot) {
+    ensure_heap();
+    if (!slot) return;
+    if (gc_heap->weak_root_count == gc_heap->weak_root_capacity) {
+        size_t capacity = gc_heap->weak_root_capacity ? gc_heap->weak_root_capacity * 2 : 16;
+        void ***grown = (void***)realloc(gc_heap->weak_roots, capacity * sizeof(void**));
+        if (!grown) {
+            fprintf(stderr, "GC: out of memory for weak roots\n");
+            exit(1);
+        }
+        gc_heap->weak_roots = grown;
+        gc_heap->weak_root_capacity = capacity;
+    }
+    gc_heap->weak_roots[gc_heap->weak_root_count++] = slot;
+}
+
+void gc_remove_weak_root(void **slot) {
+    if (!gc_heap) return;
+    // Newer slots are the likelier ones to go first.
+    for (size_t i = gc_heap->weak_root_count; i > 0; --i) {
+        if (gc_heap->weak_roots[i - 1] == slot) {
+            gc_heap->weak_roots[i - 1] = gc_heap->weak_roots[--gc_heap->weak_root_count];
+            return;
+        }
+    }
+}
+
+void gc_weak_roots_update(void *(*resolve)(void *ptr)) {
+    size_t kept = 0;
+    for (size_t i = 0; i < gc_heap->weak_root_count; ++i) {
+        void **slot = gc_heap->weak_roots[i];
+        if (*slot && !GC_IS_IMMEDIATE(*slot)) *slot = resolve(*slot);
+        if (*slot) gc_heap->weak_roots[kept++] = slot;
+    }
+    gc_heap->weak_root_count = kept;
+}
+
+size_t gc_root_range_count(void) {
+    return gc_heap->root_range_count;
+}
+
+const GcRootRange *gc_root_ranges(void) {
+    return gc_heap->root_ranges;
 }
 
 void gc_write_barrier(void *owner, void **slot, void *child) {
-    ensure_backend();
-    if (gc_backend->write_barrier) {
-        gc_backend->write_barrier(owner, slot, child);
+    ensure_heap();
+    if (gc_heap->backend->write_barrier) {
+        gc_heap->backend->write_barrier(owner, slot, child);
     }
 }
 
 void gc_collect(void) {
-    ensure_backend();
-    gc_backend->collect();
+    ensure_heap();
+    gc_heap->backend->collect();
+    if (gc_heap->channel) gc_heap_channel_publish_stats();
+}
+
+void gc_set_eval_collect_policy(int policy) {
+    GcHeap *heap = settings_heap();
+    heap->eval_collect_policy = (policy >= GC_EVAL_COLLECT_OFF && policy <= GC_EVAL_COLLECT_ALWAYS)
+        ? policy : GC_EVAL_COLLECT_THRESHOLD;
+    heap->eval_collect_policy_set = 1;
+}
+
+int gc_get_eval_collect_policy(void) {
+    const GcHeap *heap = settings_heap();
+    if (heap->eval_collect_policy_set) return heap->eval_collect_policy;
+    const char *env = getenv("GC_EVAL_COLLECT");
+    if (env) {
+        if (strcmp(env, "off") == 0) return GC_EVAL_COLLECT_OFF;
+        if (strcmp(env, "idle") == 0) return GC_EVAL_COLLECT_IDLE;
+        if (strcmp(env, "always") == 0) return GC_EVAL_COLLECT_ALWAYS;
+    }
+    return GC_EVAL_COLLECT_THRESHOLD;
+}
+
+// Bytes allocated since the last collection. Collections triggered inside
+// the backend are only noticed here afterwards, so the count restarts from
+// that point; this errs on the side of not collecting.
+static double bytes_since_collection(void) {
+    double count = gc_get_collections_count();
+    double allocated = gc_get_allocated_bytes();
+    if (count != gc_heap->collect_mark_count) {
+        gc_heap->collect_mark_count = count;
+        gc_heap->collect_mark_allocated = allocated;
+    }
+    return allocated - gc_heap->collect_mark_allocated;
+}
+
+static void collect_and_mark(void) {
+    gc_collect();
+    gc_heap->collect_mark_count = gc_get_collections_count();
+    gc_heap->collect_mark_allocated = gc_get_allocated_bytes();
+}
+
+void gc_eval_boundary(void) {
+    ensure_heap();
+    switch (gc_get_eval_collect_policy()) {
+        case GC_EVAL_COLLECT_ALWAYS:
+            collect_and_mark();
+            break;
+        case GC_EVAL_COLLECT_THRESHOLD:
+            if (bytes_since_collection() >= (double)gc_get_threshold() / 2) collect_and_mark();
+            break;
+        default:
+            break;
+    }
+    if (gc_heap->channel) gc_heap_channel_publish_stats();
+}
+
+int gc_idle_collect(double budget_ms) {
+    ensure_heap();
+    if (bytes_since_collection() <= 0.0) return 0;
+    if (budget_ms > 0.0 && gc_heap->idle_pause_ms > budget_ms) {
+        // Retry with a lower estimate later; the heap has changed since.
+        gc_heap->idle_pause_ms /= 2;
+        return 0;
+    }
+    double start = gc_get_time_ms();
+    collect_and_mark();
+    gc_heap->idle_pause_ms = gc_get_time_ms() - start;
+    return 1;
 }
 
 void gc_free(void *ptr) {
-    ensure_backend();
-    gc_backend->free(ptr);
+    ensure_heap();
+    gc_heap->backend->free(ptr);
 }
 
 void gc_set_threshold(size_t bytes) {
-    ensure_backend();
-    gc_backend->set_threshold(bytes);
+    ensure_heap();
+    gc_heap->backend->set_threshold(bytes);
 }
 
 size_t gc_get_threshold(void) {
-    ensure_backend();
-    return gc_backend->get_threshold();
+    ensure_heap();
+    return gc_heap->backend->get_threshold();
 }
 
 void gc_get_stats(GcStats *out_stats) {
-    ensure_backend();
-    if (gc_backend->get_stats) {
-        gc_backend->get_stats(out_stats);
+    ensure_heap();
+    if (gc_heap->backend->get_stats) {
+        gc_heap->backend->get_stats(out_stats);
     } else if (out_stats) {
         out_stats->collections = 0;
         out_stats->allocated_bytes = 0;
@@ -125,38 +439,38 @@ void gc_get_stats(GcStats *out_stats) {
 }
 
 double gc_get_collections_count(void) {
-    ensure_backend();
-    return gc_backend->get_collections_count ? gc_backend->get_collections_count() : 0.0;
+    ensure_heap();
+    return gc_heap->backend->get_collections_count ? gc_heap->backend->get_collections_count() : 0.0;
 }
 
 double gc_get_allocated_bytes(void) {
-    ensure_backend();
-    return gc_backend->get_allocated_bytes ? gc_backend->get_allocated_bytes() : 0.0;
+    ensure_heap();
+    return gc_heap->backend->get_allocated_bytes ? gc_heap->backend->get_allocated_bytes() : 0.0;
 }
 
 double gc_get_freed_bytes(void) {
-    ensure_backend();
-    return gc_backend->get_freed_bytes ? gc_backend->get_freed_bytes() : 0.0;
+    ensure_heap();
+    return gc_heap->backend->get_freed_bytes ? gc_heap->backend->get_freed_bytes() : 0.0;
 }
 
 double gc_get_current_bytes(void) {
-    ensure_backend();
-    return gc_backend->get_current_bytes ? gc_backend->get_current_bytes() : 0.0;
+    ensure_heap();
+    return gc_heap->backend->get_current_bytes ? gc_heap->backend->get_current_bytes() : 0.0;
 }
 
 size_t gc_heap_snapshot(GcObjectInfo *out, size_t capacity) {
-    ensure_backend();
-    if (!gc_backend->heap_snapshot) return 0;
-    return gc_backend->heap_snapshot(out, capacity);
+    ensure_heap();
+    if (!gc_heap->backend->heap_snapshot) return 0;
+    return gc_heap->backend->heap_snapshot(out, capacity);
 }
 
 size_t gc_heap_snapshot_flat(uint32_t *out, size_t capacity) {
-    ensure_backend();
-    if (!gc_backend->heap_snapshot || !out || capacity == 0) return 0;
+    ensure_heap();
+    if (!gc_heap->backend->heap_snapshot || !out || capacity == 0) return 0;
     size_t entry_count = capacity;
     GcObjectInfo *buffer = (GcObjectInfo*)malloc(sizeof(GcObjectInfo) * entry_count);
     if (!buffer) return 0;
-    size_t written = gc_backend->heap_snapshot(buffer, entry_count);
+    size_t written = gc_heap->backend->heap_snapshot(buffer, entry_count);
     for (size_t i = 0; i < written; ++i) {
         out[i * 4 + 0] = (uint32_t)buffer[i].addr;
         out[i * 4 + 1] = (uint32_t)buffer[i].size;
@@ -168,7 +482,7 @@ size_t gc_heap_snapshot_flat(uint32_t *out, size_t capacity) {
 }
 
 void gc_get_stats_flat(double *out, size_t size) {
-    if (!out || size < 23) return;
+    if (!out || size < GC_STATS_FLAT_COUNT) return;
     GcStats stats;
     gc_get_stats(&stats);
     
@@ -197,6 +511,218 @@ void gc_get_stats_flat(double *out, size_t size) {
     out[22] = stats.fragmentation_growth_rate;
 }
 
+static size_t pause_bucket(double ms) {
+    double octaves = log2(ms) - GC_PAUSE_MIN_EXP;
+    if (!(octaves >= 0.0)) return 0;
+    double bucket = 1.0 + octaves * GC_PAUSE_BUCKETS_PER_OCTAVE;
+    if (bucket >= GC_PAUSE_BUCKETS - 1) return GC_PAUSE_BUCKETS - 1;
+    return (size_t)bucket;
+}
+
+void gc_note_pause(double ms) {
+    gc_heap->pause_histogram[pause_bucket(ms)]++;
+    if (gc_heap->pause_count++ == 0 || ms < gc_heap->pause_min) gc_heap->pause_min = ms;
+    if (ms > gc_heap->pause_max) gc_heap->pause_max = ms;
+}
+
+double gc_pause_percentile(double q) {
+    ensure_heap();
+    if (gc_heap->pause_count == 0) return 0.0;
+    if (q < 0.0) q = 0.0;
+    if (q > 1.0) q = 1.0;
+    size_t rank = (size_t)(q * (double)(gc_heap->pause_count - 1) + 0.5);
+    if (rank == 0) return gc_heap->pause_min;
+    if (rank == gc_heap->pause_count - 1) return gc_heap->pause_max;
+    size_t seen = 0, bucket = 0;
+    for (; bucket < GC_PAUSE_BUCKETS - 1; ++bucket) {
+        seen += gc_heap->pause_histogram[bucket];
+        if (seen > rank) break;
+    }
+    // The middle of the bucket (geometrically), kept within the exact bounds.
+    if (bucket == GC_PAUSE_BUCKETS - 1) return gc_heap->pause_max;
+    double ms = bucket == 0 ? 0.0 : exp2(GC_PAUSE_MIN_EXP + (bucket - 0.5) / GC_PAUSE_BUCKETS_PER_OCTAVE);
+    if (ms < gc_heap->pause_min) return gc_heap->pause_min;
+    return ms < gc_heap->pause_max ? ms : gc_heap->pause_max;
+}
+
+void gc_write_stats_json(FILE *out) {
+    GcStats stats;
+    memset(&stats, 0, sizeof(stats));
+    gc_get_stats(&stats);
+    fprintf(out, "{\"collections\": %zu, \"allocated_bytes\": %zu, \"freed_bytes\": %zu, "
+                 "\"current_bytes\": %zu,\n", stats.collections, stats.allocated_bytes,
+            stats.freed_bytes, stats.current_bytes);
+    fprintf(out, " \"total_gc_time_ms\": %.6f, \"max_gc_pause_ms\": %.6f, \"avg_gc_pause_ms\": %.6f,\n",
+            stats.total_gc_time_ms, stats.max_gc_pause_ms, stats.avg_gc_pause_ms);
+    fprintf(out, " \"pauses\": %zu, \"pause_p50_ms\": %.6f, \"pause_p90_ms\": %.6f, \"pause_p99_ms\": %.6f,\n",
+            gc_heap->pause_count, gc_pause_percentile(0.5), gc_pause_percentile(0.9), gc_pause_percentile(0.99));
+    fprintf(out, " \"objects_scanned\": %zu, \"objects_copied\": %zu, \"objects_promoted\": %zu, "
+                 "\"survival_rate\": %.6f,\n", stats.objects_scanned, stats.objects_copied,
+            stats.objects_promoted, stats.survival_rate);
+    fprintf(out, " \"metadata_bytes\": %zu, \"wasted_bytes\": %zu, \"fragmentation_index\": %.6f, "
+                 "\"peak_fragmentation_index\": %.6f}\n", stats.metadata_bytes, stats.wasted_bytes,
+            stats.fragmentation_index, stats.peak_fragmentation_index);
+}
+
+void gc_trace_end(const GcTraceSpan *span, double end_ms, const GcStats *stats) {
+    if (gc_heap->trace_allocated < gc_heap->trace_capacity &&
+        gc_heap->trace_total == gc_heap->trace_allocated) {
+        size_t capacity = gc_heap->trace_allocated ? gc_heap->trace_allocated * 2 : 64;
+        if (capacity > gc_heap->trace_capacity) capacity = gc_heap->trace_capacity;
+        GcTraceEvent *grown = (GcTraceEvent*)realloc(gc_heap->trace, capacity * sizeof(GcTraceEvent));
+        if (grown) {
+            gc_heap->trace = grown;
+            gc_heap->trace_allocated = capacity;
+        }
+    }
+    if (!gc_heap->trace_allocated) return;
+    GcTraceEvent *event = &gc_heap->trace[gc_heap->trace_total % gc_heap->trace_allocated];
+    event->start_ms = span->start_ms;
+    event->end_ms = end_ms;
+    event->kind = span->kind;
+    event->bytes_before = span->bytes;
+    event->bytes_after = stats->current_bytes;
+    event->objects_scanned = stats->objects_scanned - span->scanned;
+    event->objects_copied = stats->objects_copied - span->copied;
+    event->objects_promoted = stats->objects_promoted - span->promoted;
+    gc_heap->trace_total++;
+}
+
+size_t gc_trace_total(void) {
+    return gc_heap ? gc_heap->trace_total : 0;
+}
+
+size_t gc_trace_events(GcTraceEvent *out, size_t capacity) {
+    if (!gc_heap || !out) return 0;
+    size_t kept = gc_heap->trace_total < gc_heap->trace_allocated ? gc_heap->trace_total : gc_heap->trace_allocated;
+    size_t first = gc_heap->trace_total - kept;
+    size_t count = kept < capacity ? kept : capacity;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = gc_heap->trace[(first + i) % gc_heap->trace_allocated];
+    }
+    return count;
+}
+
+void gc_trace_clear(void) {
+    if (gc_heap) gc_heap->trace_total = 0;
+}
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} TraceText;
+
+static void trace_printf(TraceText *text, const char *format, ...) {
+    if (text->failed) return;
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int needed = vsnprintf(text->data + text->length, text->capacity - text->length, format, args);
+        va_end(args);
+        if (needed < 0) {
+            text->failed = 1;
+            return;
+        }
+        if (text->length + (size_t)needed < text->capacity) {
+            text->length += (size_t)needed;
+            return;
+        }
+        size_t capacity = text->capacity * 2;
+        while (capacity <= text->length + (size_t)needed) capacity *= 2;
+        char *grown = (char*)realloc(text->data, capacity);
+        if (!grown) {
+            text->failed = 1;
+            return;
+        }
+        text->data = grown;
+        text->capacity = capacity;
+    }
+}
+
+static const char *const trace_kind_names[] = {"collect", "minor", "major", "mark-slice", "sweep-slice"};
+
+const char *gc_trace_json(void) {
+    ensure_heap();
+    TraceText text = {(char*)malloc(4096), 0, 4096, 0};
+    if (!text.data) return NULL;
+    text.data[0] = '\0';
+    trace_printf(&text, "{\"traceEvents\":[\n");
+    size_t kept = gc_heap->trace_total < gc_heap->trace_allocated ? gc_heap->trace_total : gc_heap->trace_allocated;
+    size_t first = gc_heap->trace_total - kept;
+    for (size_t i = 0; i < kept; i++) {
+        const GcTraceEvent *event = &gc_heap->trace[(first + i) % gc_heap->trace_allocated];
+        const char *name = event->kind < sizeof(trace_kind_names) / sizeof(trace_kind_names[0])
+                               ? trace_kind_names[event->kind] : "gc";
+        // The trace format counts in microseconds.
+        double ts = event->start_ms * 1000.0;
+        double dur = (event->end_ms - event->start_ms) * 1000.0;
+        trace_printf(&text, "{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"pid\":1,\"tid\":1,\"args\":{\"bytes_before\":%zu,\"bytes_after\":%zu,"
+                     "\"scanned\":%zu,\"copied\":%zu,\"promoted\":%zu}},\n",
+                     name, ts, dur, event->bytes_before, event->bytes_after,
+                     event->objects_scanned, event->objects_copied, event->objects_promoted);
+        trace_printf(&text, "{\"name\":\"heap\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"bytes\":%zu}},\n"
+                     "{\"name\":\"heap\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"bytes\":%zu}}%s\n",
+                     ts, event->bytes_before, ts + dur, event->bytes_after, i + 1 < kept ? "," : "");
+    }
+    trace_printf(&text, "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"backend\":\"%s\",\"events\":%zu,"
+                 "\"dropped\":%zu}}\n", gc_heap->backend->name, kept, first);
+    if (text.failed) {
+        free(text.data);
+        return NULL;
+    }
+    free(gc_heap->trace_json);
+    gc_heap->trace_json = text.data;
+    return text.data;
+}
+
+void gc_heap_event_record(unsigned kind, const void *addr, size_t size,
+                          unsigned generation, unsigned tag, const void *to) {
+    GcHeapChannel *channel = gc_heap->channel;
+    if (channel) {
+        uint32_t *entry = channel->events + (size_t)(channel->sequence & (channel->capacity - 1)) * GC_HEAP_EVENT_WORDS;
+        entry[0] = (uint32_t)(kind | generation << 8 | tag << 16);
+        entry[1] = (uint32_t)(uintptr_t)addr;
+        entry[2] = (uint32_t)size;
+        entry[3] = (uint32_t)(uintptr_t)to;
+        channel->sequence++;
+    }
+    if (gc_heap_observed & GC_OBSERVE_PROFILE) gc_alloc_profile_event(kind, addr, size, generation, to);
+}
+
+GcHeapChannel *gc_heap_channel_open(size_t capacity) {
+    ensure_heap();
+    if (gc_heap->channel) return gc_heap->channel;
+    size_t entries = 64;
+    while (entries < capacity && entries < ((size_t)1 << 24)) entries *= 2;
+    GcHeapChannel *channel = (GcHeapChannel*)calloc(1, sizeof(GcHeapChannel) +
+                                                       entries * GC_HEAP_EVENT_WORDS * sizeof(uint32_t));
+    if (!channel) return NULL;
+    channel->capacity = (uint32_t)entries;
+    channel->event_words = GC_HEAP_EVENT_WORDS;
+    gc_heap->channel = channel;
+    gc_heap_observed |= GC_OBSERVE_CHANNEL;
+    gc_heap_channel_publish_stats();
+    return channel;
+}
+
+void gc_heap_channel_close(void) {
+    if (!gc_heap) return;
+    gc_heap_observed &= ~GC_OBSERVE_CHANNEL;
+    free(gc_heap->channel);
+    gc_heap->channel = NULL;
+}
+
+void gc_heap_channel_publish_stats(void) {
+    if (!gc_heap) return;
+    if (!gc_heap->channel) return;
+    gc_get_stats_flat(gc_heap->channel->stats, GC_STATS_FLAT_COUNT);
+    gc_heap->channel_stats_collections = gc_get_collections_count();
+    gc_heap->channel->stats_sequence++;
+}
+
 size_t gc_heap_snapshot_entry_size(void) {
     return sizeof(GcObjectInfo);
 }
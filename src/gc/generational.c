@@ -10,24 +10,47 @@
 #define DEFAULT_NURSERY_SIZE (512 * 1024)
 #define PROMOTE_AGE 2
 #define OLD_GROWTH_FACTOR 2.0
-
-// Headers stored in the nursery (copying semi-space).
-typedef struct NurseryHeader {
-    size_t size;
-    gc_trace_func trace;
-    void *forward;
-    unsigned char age;
-    unsigned char tag;
-} NurseryHeader;
-
-// Headers stored in the old generation (mark-sweep list).
+// With a heap goal other than fixed (gc_get_heap_goal), the nursery is
+// resized after each minor collection within [configured /
+// NURSERY_SHRINK_LIMIT, configured * NURSERY_GROWTH_LIMIT] and never past a
+// quarter of the old generation, the promotion age moves within
+// [1, MAX_PROMOTE_AGE] and the growth factor within
+// [OLD_GROWTH_MIN, OLD_GROWTH_MAX].
+#define NURSERY_GROWTH_LIMIT 16
+#define NURSERY_SHRINK_LIMIT 8
+#define MAX_PROMOTE_AGE 8
+#define OLD_GROWTH_MIN 1.5
+#define OLD_GROWTH_MAX 4.0
+// With a pause budget the old generation is marked incrementally, one slice
+// after each minor collection. A cycle starts past the old threshold or once
+// this fraction of the old heap is in use, so it can finish before the
+// headroom check forces a stop-the-world major collection.
+#define INCREMENTAL_START 0.6
+// The old generation is swept lazily after marking: a few SWEEP_PAGE_BYTES
+// pages after each minor collection, and on demand when promotion finds no
+// free block.
+#define SWEEP_PAGE_BYTES (16 * 1024)
+#define SWEEP_PAGES_PER_MINOR 8
+#define SWEEP_PAGES_PER_REFILL 4
+// A stop-the-world major collection slides the live old objects together
+// instead of sweeping once the old free space is this fragmented
+// (1 - largest free block / total free).
+#define OLD_COMPACT_FRAGMENTATION 0.5
+
+// Headers stored in the nursery (copying semi-space). The layout is the
+// shared bump header so gc_allocate_fast can create objects inline.
+typedef GcBumpHeader NurseryHeader;
+
+// Headers stored in the old generation (mark-sweep, found through the
+// object-start bitmap).
 typedef struct OldHeader {
-    struct OldHeader *prev;
-    struct OldHeader *next;
     size_t size;
-    size_t block_size; // Total size of the block (header + payload + padding)
-    int marked;
+    union {
+        size_t block_size; // Total size of the block (header + payload + padding)
+        void *forward;     // New payload address while the old space is compacted
+    };
     gc_trace_func trace;
+    unsigned char marked;
     unsigned char tag;
 } OldHeader;
 
@@ -41,9 +64,93 @@ typedef struct {
     size_t index; // Index in roots array
 } RootHashEntry;
 
-static RootHashEntry *root_hash = NULL;
-static size_t root_hash_capacity = 0;
-static size_t root_hash_count = 0;
+// Free List Allocator for Old Generation
+#define ALIGNMENT sizeof(void*)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
+#define MIN_BLOCK_SIZE (sizeof(FreeHeader))
+
+// Small old-generation blocks come from segregated per-size free lists (see
+// mark_sweep.c); larger ones use the address-ordered coalescing list.
+#define SIZE_CLASS_GRANULE 16
+#define SMALL_BLOCK_MAX 256
+#define SIZE_CLASS_COUNT (SMALL_BLOCK_MAX / SIZE_CLASS_GRANULE)
+#define SIZE_CLASS_INDEX(size) (((size) + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE)
+#define SIZE_CLASS_REFILL_BYTES 4096
+
+typedef struct FreeHeader {
+    size_t size;
+    struct FreeHeader *next;
+} FreeHeader;
+
+typedef struct {
+    RootHashEntry *root_hash;
+    size_t root_hash_capacity;
+    size_t root_hash_count;
+
+    unsigned char *nursery_active;
+    unsigned char *nursery_inactive;
+    // nursery_size is the target; each semispace keeps the size it was
+    // allocated with until it is next empty (right after a minor collection).
+    size_t nursery_size;
+    size_t configured_nursery_size;
+    size_t nursery_active_size;
+    size_t nursery_inactive_size;
+    unsigned char promote_age;
+    double old_growth_factor;
+    double last_minor_end_ms;
+    int initialized;
+    int minor_collecting;
+    int major_collecting;
+
+    RootSlot *roots;
+    size_t root_count;
+    size_t root_capacity;
+
+    GcObjectMap old_object_map;
+    size_t old_object_count;
+    size_t old_bytes_allocated;
+    size_t old_block_bytes; // heap bytes held by live old blocks
+    size_t old_next_threshold;
+    GcStats stats;
+    GcMarkStack mark_stack;
+    size_t pause_count;
+    double peak_fragmentation;
+    // Incremental old-generation marking. Objects promoted while marking start
+    // out marked and the write barrier marks overwritten old references, so
+    // everything reachable when the cycle started survives it.
+    int old_marking;
+    double slice_budget_ms;
+    // Lazy sweep state: old objects below old_sweep_cursor have been swept.
+    int old_sweeping;
+    uint8_t *old_sweep_cursor;
+    // Old bytes when the current cycle began marking, and bytes its sweep (or
+    // compaction) has freed so far; their ratio drives the adaptive policy.
+    size_t old_cycle_start_bytes;
+    size_t old_cycle_freed;
+    size_t old_trim_peak;
+    // Set while references are rewritten to compacted old addresses.
+    int old_compacting;
+
+    uint8_t *old_heap_start;
+    size_t old_heap_size;
+    FreeHeader *old_free_list;
+    FreeHeader *old_size_class_free[SIZE_CLASS_COUNT + 1];
+
+    // Promotion stack for iterative deep promotion
+    void **promotion_stack;
+    size_t promotion_sp;
+    size_t promotion_cap;
+    int tracing_promoted;
+    // Set when a child traced during a minor collection stays in the nursery,
+    // so the old object being traced must keep its card dirty.
+    int traced_young_child;
+} GenState;
+
+#define GS GC_BACKEND_STATE(GenState)
+// The nursery's bump pointer and limit live in gc_alloc_region so the inline
+// fast path in gc.h allocates from it directly.
+#define nursery_alloc (gc_alloc_region.cursor)
+#define nursery_end (gc_alloc_region.limit)
 
 // Hash function
 static size_t hash_ptr(void *ptr) {
@@ -54,12 +161,12 @@ static size_t hash_ptr(void *ptr) {
 static void root_hash_insert(void **slot, size_t index);
 
 static void root_hash_resize(size_t new_capacity) {
-    RootHashEntry *old_hash = root_hash;
-    size_t old_capacity = root_hash_capacity;
+    RootHashEntry *old_hash = GS->root_hash;
+    size_t old_capacity = GS->root_hash_capacity;
 
-    root_hash_capacity = new_capacity;
-    root_hash = (RootHashEntry *)calloc(root_hash_capacity, sizeof(RootHashEntry));
-    root_hash_count = 0;
+    GS->root_hash_capacity = new_capacity;
+    GS->root_hash = (RootHashEntry *)calloc(GS->root_hash_capacity, sizeof(RootHashEntry));
+    GS->root_hash_count = 0;
 
     if (old_hash) {
         for (size_t i = 0; i < old_capacity; ++i) {
@@ -72,91 +179,66 @@ static void root_hash_resize(size_t new_capacity) {
 }
 
 static void root_hash_insert(void **slot, size_t index) {
-    if (root_hash_count * 2 >= root_hash_capacity) {
-        root_hash_resize(root_hash_capacity ? root_hash_capacity * 2 : 1024);
+    if (GS->root_hash_count * 2 >= GS->root_hash_capacity) {
+        root_hash_resize(GS->root_hash_capacity ? GS->root_hash_capacity * 2 : 1024);
     }
     
-    size_t h = hash_ptr(slot) & (root_hash_capacity - 1);
-    while (root_hash[h].slot) {
-        if (root_hash[h].slot == slot) {
-            root_hash[h].index = index; // Update index
+    size_t h = hash_ptr(slot) & (GS->root_hash_capacity - 1);
+    while (GS->root_hash[h].slot) {
+        if (GS->root_hash[h].slot == slot) {
+            GS->root_hash[h].index = index; // Update index
             return;
         }
-        h = (h + 1) & (root_hash_capacity - 1);
+        h = (h + 1) & (GS->root_hash_capacity - 1);
     }
-    root_hash[h].slot = slot;
-    root_hash[h].index = index;
-    root_hash_count++;
+    GS->root_hash[h].slot = slot;
+    GS->root_hash[h].index = index;
+    GS->root_hash_count++;
 }
 
 static size_t root_hash_find(void **slot, int *found) {
-    if (!root_hash) {
+    if (!GS->root_hash) {
         *found = 0;
         return 0;
     }
-    size_t h = hash_ptr(slot) & (root_hash_capacity - 1);
-    while (root_hash[h].slot) {
-        if (root_hash[h].slot == slot) {
+    size_t h = hash_ptr(slot) & (GS->root_hash_capacity - 1);
+    while (GS->root_hash[h].slot) {
+        if (GS->root_hash[h].slot == slot) {
             *found = 1;
-            return root_hash[h].index;
+            return GS->root_hash[h].index;
         }
-        h = (h + 1) & (root_hash_capacity - 1);
+        h = (h + 1) & (GS->root_hash_capacity - 1);
     }
     *found = 0;
     return 0;
 }
 
 static void root_hash_delete(void **slot) {
-    if (!root_hash) return;
-    size_t h = hash_ptr(slot) & (root_hash_capacity - 1);
-    while (root_hash[h].slot) {
-        if (root_hash[h].slot == slot) {
-            root_hash[h].slot = NULL;
-            root_hash_count--;
+    if (!GS->root_hash) return;
+    size_t h = hash_ptr(slot) & (GS->root_hash_capacity - 1);
+    while (GS->root_hash[h].slot) {
+        if (GS->root_hash[h].slot == slot) {
+            GS->root_hash[h].slot = NULL;
+            GS->root_hash_count--;
             
             // Rehash subsequent entries in the cluster
-            size_t i = (h + 1) & (root_hash_capacity - 1);
-            while (root_hash[i].slot) {
-                void **s = root_hash[i].slot;
-                size_t idx = root_hash[i].index;
-                root_hash[i].slot = NULL;
-                root_hash_count--;
+            size_t i = (h + 1) & (GS->root_hash_capacity - 1);
+            while (GS->root_hash[i].slot) {
+                void **s = GS->root_hash[i].slot;
+                size_t idx = GS->root_hash[i].index;
+                GS->root_hash[i].slot = NULL;
+                GS->root_hash_count--;
                 root_hash_insert(s, idx);
-                i = (i + 1) & (root_hash_capacity - 1);
+                i = (i + 1) & (GS->root_hash_capacity - 1);
             }
             return;
         }
-        h = (h + 1) & (root_hash_capacity - 1);
+        h = (h + 1) & (GS->root_hash_capacity - 1);
     }
 }
 
-typedef struct {
-    void **slot;
-} RememberedSlot;
-
-// Global state --------------------------------------------------------------
-
-static unsigned char *nursery_active = NULL;
-static unsigned char *nursery_inactive = NULL;
-static unsigned char *nursery_alloc = NULL;
-static unsigned char *nursery_end = NULL;
-static size_t nursery_size = DEFAULT_NURSERY_SIZE;
-static int generational_initialized = 0;
-static int minor_collecting = 0;
-static int major_collecting = 0;
-
-static RootSlot *roots = NULL;
-static size_t root_count = 0;
-static size_t root_capacity = 0;
-
-static RememberedSlot *remembered = NULL;
-static size_t remembered_count = 0;
-static size_t remembered_capacity = 0;
-
-static OldHeader *old_objects = NULL;
-static size_t old_bytes_allocated = 0;
-static size_t old_next_threshold = DEFAULT_NURSERY_SIZE * 2;
-static GcStats gc_stats = {0, 0, 0, 0};
+static void old_sweep_page(void);
+static void old_finish_sweep(void);
 
 static size_t align_size(size_t size) {
     size_t align = sizeof(void*);
@@ -164,67 +246,47 @@ static size_t align_size(size_t size) {
 }
 
 static int pointer_in_space(unsigned char *space, void *ptr) {
-    return ptr && (unsigned char*)ptr >= space && (unsigned char*)ptr < space + nursery_size;
+    size_t size = space == GS->nursery_active ? GS->nursery_active_size : GS->nursery_inactive_size;
+    return ptr && (unsigned char*)ptr >= space && (unsigned char*)ptr < space + size;
 }
 
 static void ensure_root_capacity(size_t needed) {
-    if (root_capacity >= needed) return;
-    size_t new_cap = root_capacity ? root_capacity * 2 : 32;
+    if (GS->root_capacity >= needed) return;
+    size_t new_cap = GS->root_capacity ? GS->root_capacity * 2 : 32;
     while (new_cap < needed) new_cap *= 2;
-    RootSlot *new_roots = (RootSlot*)realloc(roots, new_cap * sizeof(RootSlot));
+    RootSlot *new_roots = (RootSlot*)realloc(GS->roots, new_cap * sizeof(RootSlot));
     if (!new_roots) {
         fprintf(stderr, "Generational GC: failed to grow root set\n");
         exit(1);
     }
-    roots = new_roots;
-    root_capacity = new_cap;
+    GS->roots = new_roots;
+    GS->root_capacity = new_cap;
 }
 
-static void ensure_remembered_capacity(size_t needed) {
-    if (remembered_capacity >= needed) return;
-    size_t new_cap = remembered_capacity ? remembered_capacity * 2 : 32;
-    while (new_cap < needed) new_cap *= 2;
-    RememberedSlot *new_slots = (RememberedSlot*)realloc(remembered, new_cap * sizeof(RememberedSlot));
-    if (!new_slots) {
-        fprintf(stderr, "Generational GC: failed to grow remembered set\n");
+static void old_heap_init(size_t size) {
+    GS->old_heap_size = size;
+    GS->old_heap_start = (uint8_t*)malloc(GS->old_heap_size);
+    if (!GS->old_heap_start) {
+        fprintf(stderr, "Generational GC: failed to allocate old generation heap (%zu bytes)\n", GS->old_heap_size);
         exit(1);
     }
-    remembered = new_slots;
-    remembered_capacity = new_cap;
-}
-
-// Free List Allocator for Old Generation
-#define ALIGNMENT sizeof(void*)
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
-#define MIN_BLOCK_SIZE (sizeof(FreeHeader))
-
-typedef struct FreeHeader {
-    size_t size;
-    struct FreeHeader *next;
-} FreeHeader;
-
-static uint8_t *old_heap_start = NULL;
-static size_t old_heap_size = 0;
-static FreeHeader *old_free_list = NULL;
-
-static void old_heap_init(size_t size) {
-    old_heap_size = size;
-    old_heap_start = (uint8_t*)malloc(old_heap_size);
-    if (!old_heap_start) {
-        fprintf(stderr, "Generational GC: failed to allocate old generation heap (%zu bytes)\n", old_heap_size);
+    gc_object_map_init(&GS->old_object_map, GS->old_heap_start, GS->old_heap_size);
+    gc_card_table.cards = (unsigned char*)calloc((GS->old_heap_size >> GC_CARD_SHIFT) + 1, 1);
+    if (!gc_card_table.cards) {
+        fprintf(stderr, "Generational GC: failed to allocate card table\n");
         exit(1);
     }
-    old_free_list = (FreeHeader*)old_heap_start;
-    old_free_list->size = old_heap_size;
-    old_free_list->next = NULL;
+    gc_card_table.base = (uintptr_t)GS->old_heap_start;
+    gc_card_table.size = GS->old_heap_size;
+    GS->old_free_list = (FreeHeader*)GS->old_heap_start;
+    GS->old_free_list->size = GS->old_heap_size;
+    GS->old_free_list->next = NULL;
+    memset(GS->old_size_class_free, 0, sizeof(GS->old_size_class_free));
 }
 
-static void *old_heap_alloc(size_t size) {
-    size_t needed = ALIGN(size);
-    if (needed < MIN_BLOCK_SIZE) needed = MIN_BLOCK_SIZE;
-    
+static void *old_heap_alloc_fit(size_t needed) {
     FreeHeader *prev = NULL;
-    FreeHeader *curr = old_free_list;
+    FreeHeader *curr = GS->old_free_list;
     
     while (curr) {
         if (curr->size >= needed) {
@@ -233,11 +295,11 @@ static void *old_heap_alloc(size_t size) {
                 remaining->size = curr->size - needed;
                 remaining->next = curr->next;
                 if (prev) prev->next = remaining;
-                else old_free_list = remaining;
+                else GS->old_free_list = remaining;
                 curr->size = needed;
             } else {
                 if (prev) prev->next = curr->next;
-                else old_free_list = curr->next;
+                else GS->old_free_list = curr->next;
             }
             return (void*)curr;
         }
@@ -247,13 +309,12 @@ static void *old_heap_alloc(size_t size) {
     return NULL;
 }
 
-static void old_heap_free(void *ptr, size_t size) {
-    if (!ptr) return;
+static void old_heap_free_fit(void *ptr, size_t size) {
     FreeHeader *block = (FreeHeader*)ptr;
     block->size = size;
     
     FreeHeader *prev = NULL;
-    FreeHeader *curr = old_free_list;
+    FreeHeader *curr = GS->old_free_list;
     
     while (curr && curr < block) {
         prev = curr;
@@ -262,7 +323,7 @@ static void old_heap_free(void *ptr, size_t size) {
     
     block->next = curr;
     if (prev) prev->next = block;
-    else old_free_list = block;
+    else GS->old_free_list = block;
     
     if (curr && (uint8_t*)block + block->size == (uint8_t*)curr) {
         block->size += curr->size;
@@ -274,30 +335,158 @@ static void old_heap_free(void *ptr, size_t size) {
     }
 }
 
+// Carve a run of blocks for an empty size class out of the coalescing list.
+static int old_refill_size_class(size_t cls) {
+    size_t block_size = cls * SIZE_CLASS_GRANULE;
+    size_t run = block_size * (SIZE_CLASS_REFILL_BYTES / block_size);
+    uint8_t *chunk = (uint8_t*)old_heap_alloc_fit(run);
+    if (!chunk) return 0;
+    size_t avail = ((FreeHeader*)chunk)->size;
+    FreeHeader *last = NULL;
+    while (avail >= block_size) {
+        FreeHeader *block = (FreeHeader*)chunk;
+        block->size = block_size;
+        block->next = GS->old_size_class_free[cls];
+        GS->old_size_class_free[cls] = block;
+        last = block;
+        chunk += block_size;
+        avail -= block_size;
+    }
+    if (avail >= MIN_BLOCK_SIZE) {
+        old_heap_free_fit(chunk, avail);
+    } else if (avail > 0) {
+        // Too small to list on its own; return it with the last carved block.
+        GS->old_size_class_free[cls] = last->next;
+        old_heap_free_fit(last, block_size + avail);
+    }
+    return GS->old_size_class_free[cls] != NULL;
+}
+
+static void *old_heap_alloc(size_t size) {
+    size_t needed = ALIGN(size);
+    if (needed < MIN_BLOCK_SIZE) needed = MIN_BLOCK_SIZE;
+
+    if (needed <= SMALL_BLOCK_MAX) {
+        size_t cls = SIZE_CLASS_INDEX(needed);
+        // Recycle swept blocks before carving fresh memory.
+        for (int i = 0; i < SWEEP_PAGES_PER_REFILL && GS->old_sweeping && !GS->old_size_class_free[cls]; ++i) {
+            old_sweep_page();
+        }
+        if (!GS->old_size_class_free[cls] && !old_refill_size_class(cls)) {
+            return old_heap_alloc_fit(cls * SIZE_CLASS_GRANULE);
+        }
+        FreeHeader *block = GS->old_size_class_free[cls];
+        GS->old_size_class_free[cls] = block->next;
+        return (void*)block;
+    }
+    void *block = old_heap_alloc_fit(needed);
+    while (!block && GS->old_sweeping) {
+        old_sweep_page();
+        block = old_heap_alloc_fit(needed);
+    }
+    return block;
+}
+
+// Block size old_heap_alloc hands out for a `size`-byte request.
+static size_t old_block_size_for(size_t size) {
+    size_t needed = ALIGN(size);
+    if (needed < MIN_BLOCK_SIZE) needed = MIN_BLOCK_SIZE;
+    if (needed <= SMALL_BLOCK_MAX) needed = SIZE_CLASS_INDEX(needed) * SIZE_CLASS_GRANULE;
+    return needed;
+}
+
+static void old_heap_free(void *ptr, size_t size) {
+    if (!ptr) return;
+    if (size <= SMALL_BLOCK_MAX && size % SIZE_CLASS_GRANULE == 0) {
+        size_t cls = SIZE_CLASS_INDEX(size);
+        FreeHeader *block = (FreeHeader*)ptr;
+        block->size = size;
+        block->next = GS->old_size_class_free[cls];
+        GS->old_size_class_free[cls] = block;
+        return;
+    }
+    old_heap_free_fit(ptr, size);
+}
+
+static int old_compare_blocks(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(FreeHeader * const *)a;
+    uintptr_t y = (uintptr_t)*(FreeHeader * const *)b;
+    return (x > y) - (x < y);
+}
+
+// Last resort before reporting OOM: move every size-class block back into the
+// coalescing list so memory cached for one size can serve another.
+static void old_release_size_classes(void) {
+    size_t count = 0;
+    for (FreeHeader *b = GS->old_free_list; b; b = b->next) count++;
+    for (size_t cls = 0; cls <= SIZE_CLASS_COUNT; ++cls) {
+        for (FreeHeader *b = GS->old_size_class_free[cls]; b; b = b->next) count++;
+    }
+    if (count == 0) return;
+    FreeHeader **blocks = (FreeHeader**)malloc(count * sizeof(FreeHeader*));
+    if (!blocks) return;
+    size_t n = 0;
+    for (FreeHeader *b = GS->old_free_list; b; b = b->next) blocks[n++] = b;
+    for (size_t cls = 0; cls <= SIZE_CLASS_COUNT; ++cls) {
+        for (FreeHeader *b = GS->old_size_class_free[cls]; b; b = b->next) blocks[n++] = b;
+        GS->old_size_class_free[cls] = NULL;
+    }
+    qsort(blocks, n, sizeof(FreeHeader*), old_compare_blocks);
+    GS->old_free_list = NULL;
+    FreeHeader *tail = NULL;
+    for (size_t i = 0; i < n; ++i) {
+        FreeHeader *b = blocks[i];
+        if (tail && (uint8_t*)tail + tail->size == (uint8_t*)b) {
+            tail->size += b->size;
+            continue;
+        }
+        b->next = NULL;
+        if (tail) tail->next = b;
+        else GS->old_free_list = b;
+        tail = b;
+    }
+    free(blocks);
+}
+
 static void major_collect(void);
 
 // Old generation helpers (mark-sweep like)
 static OldHeader *old_find_header(void *ptr) {
-    if (!ptr) return NULL;
-    // Simple bounds check
-    if ((uint8_t*)ptr < old_heap_start || (uint8_t*)ptr >= old_heap_start + old_heap_size) return NULL;
-    return ((OldHeader*)ptr) - 1;
+    if (!ptr || !GS->old_heap_start) return NULL;
+    OldHeader *header = ((OldHeader*)ptr) - 1;
+    if (!gc_object_map_test(&GS->old_object_map, header)) return NULL;
+    return header;
+}
+
+static OldHeader *old_next_object(OldHeader *after) {
+    if (!GS->old_heap_start) return NULL;
+    return (OldHeader*)gc_object_map_next(&GS->old_object_map, after);
+}
+
+// Unmarked objects at or past the sweep cursor died in the last cycle.
+static int old_unswept_dead(OldHeader *obj) {
+    return GS->old_sweeping && (uint8_t*)obj >= GS->old_sweep_cursor && !obj->marked;
+}
+
+// Old gen heap size: the configured heap size, default 4MB.
+static size_t old_heap_default_size(void) {
+    size_t initial = gc_get_initial_heap_size();
+    return initial ? initial : 4 * 1024 * 1024;
 }
 
 static void *old_allocate(size_t size, gc_trace_func trace) {
-    if (!old_heap_start) {
-        // Initialize old gen heap (default 4MB if not set)
-        size_t initial = gc_get_initial_heap_size();
-        if (initial == 0) initial = 4 * 1024 * 1024;
-        old_heap_init(initial);
-    }
+    if (!GS->old_heap_start) old_heap_init(old_heap_default_size());
 
     size_t total_size = sizeof(OldHeader) + size;
     void *block = old_heap_alloc(total_size);
     
     if (!block) {
-        // Try collecting major
-        major_collect();
+        // Promotion runs inside a minor collection, where the old generation
+        // cannot be marked, so no major collection is possible here.
+        // gen_allocate_typed collects the old generation up front when its
+        // headroom can no longer absorb a full nursery.
+        old_finish_sweep();
+        old_release_size_classes();
         block = old_heap_alloc(total_size);
         if (!block) {
             fprintf(stderr, "Generational GC: old-generation allocation failed (OOM)\n");
@@ -309,21 +498,20 @@ static void *old_allocate(size_t size, gc_trace_func trace) {
     size_t actual_block_size = ((FreeHeader*)block)->size;
 
     OldHeader *header = (OldHeader*)block;
-    header->prev = NULL;
-    header->next = old_objects;
-    if (old_objects) old_objects->prev = header;
-    old_objects = header;
+    gc_object_map_set(&GS->old_object_map, header);
+    GS->old_object_count++;
     
     header->size = size;
     header->block_size = actual_block_size;
     
-    header->marked = 0;
+    header->marked = (unsigned char)(GS->old_marking || (GS->old_sweeping && (uint8_t*)header >= GS->old_sweep_cursor));
     header->trace = trace;
     void *payload = (void*)(header + 1);
     memset(payload, 0, size);
     header->tag = GC_TAG_UNKNOWN;
     
-    old_bytes_allocated += size;
+    GS->old_bytes_allocated += size;
+    GS->old_block_bytes += actual_block_size;
     // Track wasted bytes for internal fragmentation
     // We need a global tracker for this? Or calculate on demand?
     // Mark-Sweep tracked it incrementally. Let's do that.
@@ -339,12 +527,13 @@ static void *old_allocate(size_t size, gc_trace_func trace) {
 }
 
 static void old_remove(OldHeader *header) {
-    if (header->prev) header->prev->next = header->next;
-    else old_objects = header->next;
-    if (header->next) header->next->prev = header->prev;
-    
-    old_bytes_allocated -= header->size;
-    gc_stats.freed_bytes += header->size;
+    gc_event_free(header + 1);
+    gc_object_map_clear(&GS->old_object_map, header);
+    GS->old_object_count--;
+    GS->old_bytes_allocated -= header->size;
+    GS->old_block_bytes -= header->block_size;
+    GS->stats.freed_bytes += header->size;
+    GS->old_cycle_freed += header->size;
     
     old_heap_free(header, header->block_size);
 }
@@ -358,64 +547,80 @@ static NurseryHeader *nursery_header_for(void *ptr) {
 }
 
 static void swap_nursery_spaces(void) {
-    unsigned char *tmp = nursery_inactive;
-    nursery_inactive = nursery_active;
-    nursery_active = tmp;
-    nursery_alloc = nursery_active;
-    nursery_end = nursery_active + nursery_size;
+    unsigned char *tmp = GS->nursery_inactive;
+    GS->nursery_inactive = GS->nursery_active;
+    GS->nursery_active = tmp;
+    size_t tmp_size = GS->nursery_inactive_size;
+    GS->nursery_inactive_size = GS->nursery_active_size;
+    GS->nursery_active_size = tmp_size;
+    nursery_alloc = GS->nursery_active;
+    nursery_end = GS->nursery_active + GS->nursery_active_size;
+}
+
+// Replace the (empty) inactive semispace with one of `size` bytes.
+static void resize_inactive_nursery(size_t size) {
+    free(GS->nursery_inactive);
+    GS->nursery_inactive = (unsigned char*)malloc(size);
+    if (!GS->nursery_inactive) {
+        fprintf(stderr, "Generational GC: failed to resize nursery (%zu bytes)\n", size);
+        exit(1);
+    }
+    GS->nursery_inactive_size = size;
 }
 
 static void generational_init(void) {
-    if (generational_initialized) return;
+    if (GS->initialized) return;
+    GS->nursery_size = DEFAULT_NURSERY_SIZE;
     size_t configured_size = gc_get_initial_heap_size();
     if (configured_size > 0) {
-        nursery_size = align_size(configured_size);
+        GS->nursery_size = align_size(configured_size);
     }
-    nursery_active = (unsigned char*)malloc(nursery_size);
-    nursery_inactive = (unsigned char*)malloc(nursery_size);
-    if (!nursery_active || !nursery_inactive) {
-        fprintf(stderr, "Generational GC: failed to allocate nursery (%zu bytes)\n", nursery_size);
+    GS->nursery_active = (unsigned char*)malloc(GS->nursery_size);
+    GS->nursery_inactive = (unsigned char*)malloc(GS->nursery_size);
+    if (!GS->nursery_active || !GS->nursery_inactive) {
+        fprintf(stderr, "Generational GC: failed to allocate nursery (%zu bytes)\n", GS->nursery_size);
         exit(1);
     }
-    nursery_alloc = nursery_active;
-    nursery_end = nursery_active + nursery_size;
-    root_count = root_capacity = 0;
-    remembered_count = remembered_capacity = 0;
-    free(roots); roots = NULL;
+    nursery_alloc = GS->nursery_active;
+    nursery_end = GS->nursery_active + GS->nursery_size;
+    gc_alloc_region.generation = GC_GEN_NURSERY;
+    GS->configured_nursery_size = GS->nursery_active_size = GS->nursery_inactive_size = GS->nursery_size;
+    GS->promote_age = PROMOTE_AGE;
+    GS->old_growth_factor = OLD_GROWTH_FACTOR;
+    GS->last_minor_end_ms = gc_get_time_ms();
+    GS->root_count = GS->root_capacity = 0;
+    free(GS->roots); GS->roots = NULL;
     
-    if (root_hash) {
-        free(root_hash);
-        root_hash = NULL;
-        root_hash_capacity = 0;
-        root_hash_count = 0;
+    if (GS->root_hash) {
+        free(GS->root_hash);
+        GS->root_hash = NULL;
+        GS->root_hash_capacity = 0;
+        GS->root_hash_count = 0;
     }
-    free(remembered); remembered = NULL;
-    memset(&gc_stats, 0, sizeof(gc_stats));
+    memset(&GS->stats, 0, sizeof(GS->stats));
     // Timing fields are zero-initialized by memset
-    old_objects = NULL;
-    old_bytes_allocated = 0;
-    old_next_threshold = nursery_size * 2;
-    generational_initialized = 1;
+    GS->old_object_count = 0;
+    GS->old_bytes_allocated = 0;
+    GS->old_block_bytes = 0;
+    GS->old_next_threshold = GS->nursery_size * 2;
+    GS->pause_count = 0;
+    GS->old_marking = 0;
+    GS->old_sweeping = 0;
+    GS->initialized = 1;
 }
 
-// Promotion stack for iterative deep promotion
-static void **promotion_stack = NULL;
-static size_t promotion_sp = 0;
-static size_t promotion_cap = 0;
-static int tracing_promoted = 0;
-
 static void push_promotion(void *obj) {
-    if (promotion_sp >= promotion_cap) {
-        size_t new_cap = promotion_cap ? promotion_cap * 2 : 1024;
-        void **new_stack = (void**)realloc(promotion_stack, new_cap * sizeof(void*));
+    if (GS->promotion_sp >= GS->promotion_cap) {
+        size_t new_cap = GS->promotion_cap ? GS->promotion_cap * 2 : 1024;
+        void **new_stack = (void**)realloc(GS->promotion_stack, new_cap * sizeof(void*));
         if (!new_stack) {
             fprintf(stderr, "Generational GC: failed to grow promotion stack\n");
             exit(1);
         }
-        promotion_stack = new_stack;
-        promotion_cap = new_cap;
+        GS->promotion_stack = new_stack;
+        GS->promotion_cap = new_cap;
     }
-    promotion_stack[promotion_sp++] = obj;
+    GS->promotion_stack[GS->promotion_sp++] = obj;
 }
 
 static void *promote_object(NurseryHeader *header, void *payload) {
@@ -425,7 +630,8 @@ static void *promote_object(NurseryHeader *header, void *payload) {
     if (old_header) old_header->tag = header->tag;
     
     header->forward = old_obj;
-    gc_stats.objects_promoted++;
+    gc_event_move(payload, old_obj, GC_GEN_OLD);
+    GS->stats.objects_promoted++;
     
     // Push to stack for deferred tracing (iterative deep promotion)
     if (header->trace) {
@@ -435,9 +641,16 @@ static void *promote_object(NurseryHeader *header, void *payload) {
     return old_obj;
 }
 
+// After a minor collection's trace, an evacuated object survived exactly
+// when it was copied or promoted; older objects are not collected here.
+static void *minor_weak_resolve(void *ptr) {
+    if (pointer_in_space(GS->nursery_inactive, ptr)) return nursery_header_for(ptr)->forward;
+    return ptr;
+}
+
 static void *copy_young_object(void *ptr) {
     if (!ptr) return NULL;
-    if (!pointer_in_space(nursery_inactive, ptr)) {
+    if (!pointer_in_space(GS->nursery_inactive, ptr)) {
         return ptr;
     }
     NurseryHeader *old_header = nursery_header_for(ptr);
@@ -446,7 +659,7 @@ static void *copy_young_object(void *ptr) {
     }
     
     // Promote if age threshold reached OR if we are tracing a promoted object (Deep Promotion)
-    if (tracing_promoted || old_header->age + 1 >= PROMOTE_AGE) {
+    if (GS->tracing_promoted || old_header->age + 1 >= GS->promote_age) {
         return promote_object(old_header, ptr);
     }
     
@@ -465,44 +678,90 @@ static void *copy_young_object(void *ptr) {
     void *payload = (void*)(new_header + 1);
     memcpy(payload, old_header + 1, old_header->size);
     old_header->forward = payload;
-    gc_stats.objects_copied++;
+    gc_event_move(ptr, payload, GC_GEN_NURSERY);
+    GS->stats.objects_copied++;
     return payload;
 }
 
-static void remembered_cleanup(void) {
-    size_t write = 0;
-    for (size_t i = 0; i < remembered_count; ++i) {
-        void **slot = remembered[i].slot;
-        void *value = slot ? *slot : NULL;
-        if (value && pointer_in_space(nursery_active, value)) {
-            remembered[write++] = remembered[i];
-        }
-    }
-    remembered_count = write;
+// Cards are keyed by the object (payload) address the barrier sees, not by
+// the header in front of it.
+static void dirty_card_for(OldHeader *header) {
+    gc_card_table.cards[((uint8_t*)(header + 1) - GS->old_heap_start) >> GC_CARD_SHIFT] = 1;
 }
 
 static void trace_roots_for_minor(void);
-static void scan_nursery(void);
 static void *gen_mark_ptr(void *ptr);
 static void major_collect(void);
+static void old_collection_step(void);
+
+static void gen_sync_stats(void);
+
+// Returns the pause length in milliseconds.
+static double record_pause(const GcTraceSpan *span) {
+    double end_time = gc_get_time_ms();
+    double elapsed = end_time - span->start_ms;
+    gen_sync_stats();
+    gc_trace_end(span, end_time, &GS->stats);
+    gc_note_pause(elapsed);
+    GS->pause_count++;
+    GS->stats.last_gc_pause_ms = elapsed;
+    GS->stats.total_gc_time_ms += elapsed;
+    if (elapsed > GS->stats.max_gc_pause_ms) GS->stats.max_gc_pause_ms = elapsed;
+    GS->stats.avg_gc_pause_ms = GS->stats.total_gc_time_ms / GS->pause_count;
+    return elapsed;
+}
+
+// Fold bytes handed out by the inline fast path into the stats.
+static void gen_sync_stats(void) {
+    GS->stats.allocated_bytes += gc_alloc_region.allocated_bytes;
+    gc_alloc_region.allocated_bytes = 0;
+    if (GS->nursery_active && nursery_alloc) {
+        GS->stats.current_bytes = (nursery_alloc - GS->nursery_active) + GS->old_bytes_allocated;
+    }
+}
+
+static size_t old_heap_default_size(void);
+
+// Adaptive policy, run after each minor collection: pick the next nursery
+// size from the pause and the mutator time before it, and promote sooner
+// when survivors crowd the to-space (they are only being copied back and
+// forth). The inactive space is resized now; the active one follows after
+// the next minor collection.
+static void adapt_nursery(double start_time, double pause_ms, size_t survivor_bytes) {
+    int goal = gc_get_heap_goal();
+    if (goal == GC_GOAL_FIXED) return;
+    double scale = gc_sizing_scale(goal, pause_ms, start_time - GS->last_minor_end_ms);
+    size_t min_size = GS->configured_nursery_size / NURSERY_SHRINK_LIMIT;
+    if (min_size < GC_SIZING_MIN_BYTES) min_size = GC_SIZING_MIN_BYTES;
+    size_t max_size = GS->configured_nursery_size * NURSERY_GROWTH_LIMIT;
+    size_t old_size = GS->old_heap_start ? GS->old_heap_size : old_heap_default_size();
+    if (max_size > old_size / 4) max_size = old_size / 4;
+    GS->nursery_size = gc_sizing_apply(GS->nursery_size, scale, min_size, max_size);
+    if (survivor_bytes > GS->nursery_active_size / 2 && GS->promote_age > 1) GS->promote_age--;
+    if (GS->nursery_inactive_size != GS->nursery_size) resize_inactive_nursery(GS->nursery_size);
+}
 
 static void minor_collect(void) {
-    if (!generational_initialized || minor_collecting) return;
-    minor_collecting = 1;
+    if (!GS->initialized || GS->minor_collecting) return;
+    GS->minor_collecting = 1;
     
     double start_time = gc_get_time_ms();
-    size_t objects_before = gc_stats.objects_copied + gc_stats.objects_promoted;
+    size_t objects_before = GS->stats.objects_copied + GS->stats.objects_promoted;
     
-    gc_stats.collections++;
+    gen_sync_stats();
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_MINOR, start_time, &GS->stats);
+    GS->stats.collections++;
+    gc_move_epoch++;
     swap_nursery_spaces();
     
     // Reset promotion stack
-    promotion_sp = 0;
+    GS->promotion_sp = 0;
     
     trace_roots_for_minor();
     
     // Interleaved scanning of nursery (survivors) and promotion stack (promoted objects)
-    unsigned char *scan = nursery_active;
+    unsigned char *scan = GS->nursery_active;
     
     while (1) {
         int work_done = 0;
@@ -514,75 +773,103 @@ static void minor_collect(void) {
             void *payload = (void*)(header + 1);
             
             // Tracing survivors: children stay in nursery (unless age > limit)
-            tracing_promoted = 0; 
+            GS->tracing_promoted = 0; 
             if (header->trace) header->trace(payload);
             
             scan += sizeof(NurseryHeader) + header->size;
         }
         
         // Process promotion stack
-        while (promotion_sp > 0) {
+        while (GS->promotion_sp > 0) {
             work_done = 1;
-            void *obj = promotion_stack[--promotion_sp];
+            void *obj = GS->promotion_stack[--GS->promotion_sp];
             OldHeader *header = old_find_header(obj);
             
-            // Tracing promoted objects: children MUST be promoted (Deep Promotion)
-            tracing_promoted = 1;
+            // Tracing promoted objects: children MUST be promoted (Deep Promotion).
+            // A child that was already copied within the nursery stays there,
+            // so the promoted object's card must be dirtied.
+            GS->tracing_promoted = 1;
+            GS->traced_young_child = 0;
             if (header && header->trace) header->trace(obj);
+            if (header && GS->traced_young_child) dirty_card_for(header);
         }
         
         if (!work_done) break;
     }
-    tracing_promoted = 0;
-    
-    scan_nursery(); // Re-scan? No, we already scanned in the loop.
-                    // But scan_nursery function updates stats. Let's extract stats update.
+    GS->tracing_promoted = 0;
+    gc_weak_roots_update(minor_weak_resolve);
+    gc_event_free_range(GS->nursery_inactive, GS->nursery_inactive_size);
     
-    // Update scanned count
-    // We need to count how many objects we scanned.
-    // The loop above scanned everything.
-    // Let's just iterate nursery to count scanned objects for stats.
+    // Count the survivors scanned above for stats.
     size_t scanned = 0;
-    unsigned char *stat_scan = nursery_active;
+    unsigned char *stat_scan = GS->nursery_active;
     while (stat_scan < nursery_alloc) {
         NurseryHeader *header = (NurseryHeader*)stat_scan;
         scanned++;
         stat_scan += sizeof(NurseryHeader) + header->size;
     }
-    gc_stats.objects_scanned += scanned;
-    gc_stats.current_bytes = (nursery_alloc - nursery_active) + old_bytes_allocated;
-
-    remembered_cleanup();
+    GS->stats.objects_scanned += scanned;
+    GS->stats.current_bytes = (nursery_alloc - GS->nursery_active) + GS->old_bytes_allocated;
     
-    size_t objects_after = gc_stats.objects_copied + gc_stats.objects_promoted;
+    size_t objects_after = GS->stats.objects_copied + GS->stats.objects_promoted;
     size_t survived_this_cycle = objects_after - objects_before;
-    if (gc_stats.objects_scanned > 0) {
-        gc_stats.survival_rate = (double)survived_this_cycle / (double)gc_stats.objects_scanned;
+    if (GS->stats.objects_scanned > 0) {
+        GS->stats.survival_rate = (double)survived_this_cycle / (double)GS->stats.objects_scanned;
     }
     
     // Metadata overhead
     size_t nursery_objects = scanned;
-    size_t old_gen_count = 0;
-    for (OldHeader *obj = old_objects; obj; obj = obj->next) old_gen_count++;
-    
-    gc_stats.metadata_bytes = (nursery_objects * sizeof(NurseryHeader)) + 
-                               (old_gen_count * sizeof(OldHeader));
+    GS->stats.metadata_bytes = (nursery_objects * sizeof(NurseryHeader)) + 
+                               (GS->old_object_count * sizeof(OldHeader)) +
+                               (GS->old_object_map.words * sizeof(uint64_t));
     
-    double elapsed = gc_get_time_ms() - start_time;
-    gc_stats.last_gc_pause_ms = elapsed;
-    gc_stats.total_gc_time_ms += elapsed;
-    if (elapsed > gc_stats.max_gc_pause_ms) gc_stats.max_gc_pause_ms = elapsed;
-    gc_stats.avg_gc_pause_ms = gc_stats.total_gc_time_ms / gc_stats.collections;
-    
-    minor_collecting = 0;
+    double elapsed = record_pause(&span);
+    adapt_nursery(start_time, elapsed, (size_t)(nursery_alloc - GS->nursery_active));
+    GS->last_minor_end_ms = gc_get_time_ms();
+
+    GS->minor_collecting = 0;
 }
 
-static void *gen_allocate(size_t size) {
-    if (!generational_initialized) generational_init();
+// Large leaf objects go straight to the LOS and count as old: they hold no
+// references, so no card has to cover them. The old generation is collected
+// once the LOS has grown by half its size since the last mark.
+static void *gen_allocate_large(size_t size, unsigned char tag) {
+    if (!GS->old_heap_start) old_heap_init(old_heap_default_size());
+    if (gc_los_allocated_since_sweep() > GS->old_heap_size / 2) major_collect();
+    void *payload = gc_los_allocate(size, NULL, tag, GS->old_marking);
+    if (!payload) {
+        major_collect();
+        payload = gc_los_allocate(size, NULL, tag, GS->old_marking);
+        if (!payload) {
+            fprintf(stderr, "Generational GC: out of memory allocating %zu bytes\n", size);
+            exit(1);
+        }
+    }
+    GS->old_bytes_allocated += size;
+    GS->stats.allocated_bytes += size;
+    GS->stats.current_bytes = (nursery_alloc - GS->nursery_active) + GS->old_bytes_allocated;
+    return payload;
+}
+
+static void *gen_allocate_typed(size_t size, gc_trace_func trace, unsigned char tag) {
+    if (!GS->initialized) generational_init();
+    if (size >= GC_LARGE_OBJECT_BYTES && !trace) return gen_allocate_large(size, tag);
     size_t payload = align_size(size);
     size_t total = sizeof(NurseryHeader) + payload;
     if (nursery_alloc + total > nursery_end) {
-        minor_collect();
+        // Every nursery survivor may be promoted, so make sure the old
+        // generation can take a full nursery before evacuating it.
+        // Unswept dead blocks still count as in use, so finish the sweep
+        // before deciding the old generation is full.
+        if (GS->old_sweeping && GS->old_heap_size - GS->old_block_bytes < GS->nursery_active_size) {
+            old_finish_sweep();
+        }
+        if (GS->old_heap_start && GS->old_heap_size - GS->old_block_bytes < GS->nursery_active_size) {
+            major_collect();
+        } else {
+            minor_collect();
+            old_collection_step();
+        }
         if (nursery_alloc + total > nursery_end) {
             major_collect();
             if (nursery_alloc + total > nursery_end) {
@@ -594,21 +881,47 @@ static void *gen_allocate(size_t size) {
     NurseryHeader *header = (NurseryHeader*)nursery_alloc;
     nursery_alloc += total;
     header->size = payload;
-    header->trace = NULL;
+    header->trace = trace;
     header->forward = NULL;
     header->age = 0;
-    header->tag = GC_TAG_UNKNOWN;
+    header->tag = tag;
     void *payload_ptr = (void*)(header + 1);
     memset(payload_ptr, 0, payload);
-    gc_stats.allocated_bytes += size;
-    gc_stats.current_bytes = (nursery_alloc - nursery_active) + old_bytes_allocated;
+    gc_event_alloc(payload_ptr, payload, GC_GEN_NURSERY, tag);
+    GS->stats.allocated_bytes += size;
+    GS->stats.current_bytes = (nursery_alloc - GS->nursery_active) + GS->old_bytes_allocated;
     return payload_ptr;
 }
 
+static void *gen_allocate(size_t size) {
+    return gen_allocate_typed(size, NULL, GC_TAG_UNKNOWN);
+}
+
+// Pretenured objects go straight to the old space while it could still
+// absorb a full nursery on top of them, and to the nursery otherwise. Their
+// card starts dirty: the caller initializes them without the write barrier,
+// possibly with young references.
+static void *gen_allocate_old(size_t size, gc_trace_func trace, unsigned char tag) {
+    if (!GS->initialized) generational_init();
+    if (size >= GC_LARGE_OBJECT_BYTES && !trace) return gen_allocate_large(size, tag);
+    if (!GS->old_heap_start) old_heap_init(old_heap_default_size());
+    size_t needed = old_block_size_for(sizeof(OldHeader) + size) + GS->nursery_active_size;
+    if (GS->old_sweeping && GS->old_heap_size - GS->old_block_bytes < needed) old_finish_sweep();
+    if (GS->old_heap_size - GS->old_block_bytes < needed) return gen_allocate_typed(size, trace, tag);
+    void *payload = old_allocate(size, trace);
+    OldHeader *header = old_find_header(payload);
+    header->tag = tag;
+    if (trace) dirty_card_for(header);
+    gc_event_alloc(payload, size, GC_GEN_OLD, tag);
+    GS->stats.allocated_bytes += size;
+    GS->stats.current_bytes = (nursery_alloc - GS->nursery_active) + GS->old_bytes_allocated;
+    return payload;
+}
+
 static void gen_set_trace(void *ptr, gc_trace_func trace) {
     if (!ptr) return;
-    if (!generational_initialized) generational_init();
-    if (pointer_in_space(nursery_active, ptr) || pointer_in_space(nursery_inactive, ptr)) {
+    if (!GS->initialized) generational_init();
+    if (pointer_in_space(GS->nursery_active, ptr) || pointer_in_space(GS->nursery_inactive, ptr)) {
         NurseryHeader *header = nursery_header_for(ptr);
         header->trace = trace;
     } else {
@@ -619,14 +932,17 @@ static void gen_set_trace(void *ptr, gc_trace_func trace) {
 
 static void gen_set_tag(void *ptr, unsigned char tag) {
     if (!ptr) return;
-    if (!generational_initialized) generational_init();
-    if (pointer_in_space(nursery_active, ptr) || pointer_in_space(nursery_inactive, ptr)) {
+    if (!GS->initialized) generational_init();
+    if (pointer_in_space(GS->nursery_active, ptr) || pointer_in_space(GS->nursery_inactive, ptr)) {
         NurseryHeader *header = nursery_header_for(ptr);
         if (header) header->tag = tag;
     } else {
         OldHeader *header = old_find_header(ptr);
+        GcLargeObject *large = header ? NULL : gc_los_find(ptr);
         if (header) header->tag = tag;
+        else if (large) large->tag = tag;
     }
+    gc_event_retag(ptr, tag);
 }
 
 static void ensure_root_slot(void **slot) {
@@ -636,10 +952,10 @@ static void ensure_root_slot(void **slot) {
     root_hash_find(slot, &found);
     if (found) return;
 
-    ensure_root_capacity(root_count + 1);
-    roots[root_count].slot = slot;
-    root_hash_insert(slot, root_count);
-    root_count++;
+    ensure_root_capacity(GS->root_count + 1);
+    GS->roots[GS->root_count].slot = slot;
+    root_hash_insert(slot, GS->root_count);
+    GS->root_count++;
 }
 
 static void remove_root_slot(void **slot) {
@@ -653,104 +969,392 @@ static void remove_root_slot(void **slot) {
     root_hash_delete(slot);
 
     // Swap with last element in array
-    size_t last_index = root_count - 1;
+    size_t last_index = GS->root_count - 1;
     if (index != last_index) {
-        RootSlot last = roots[last_index];
-        roots[index] = last;
+        RootSlot last = GS->roots[last_index];
+        GS->roots[index] = last;
         
         // Update index of moved element in hash
         root_hash_insert(last.slot, index);
     }
     
-    root_count--;
+    GS->root_count--;
 }
 
-static void add_remembered_slot(void **slot) {
-    if (!slot) return;
-    for (size_t i = 0; i < remembered_count; ++i) {
-        if (remembered[i].slot == slot) return;
+static void trace_root_ranges(void) {
+    const GcRootRange *ranges = gc_root_ranges();
+    for (size_t r = 0; r < gc_root_range_count(); ++r) {
+        void **base = ranges[r].base;
+        size_t count = *ranges[r].count;
+        for (size_t i = 0; i < count; ++i) {
+            if (base[i]) base[i] = gen_mark_ptr(base[i]);
+        }
     }
-    ensure_remembered_capacity(remembered_count + 1);
-    remembered[remembered_count++].slot = slot;
 }
 
-static void trace_roots_for_minor(void) {
-    for (size_t i = 0; i < root_count; ++i) {
-        void **slot = roots[i].slot;
-        if (slot && *slot) {
-            *slot = gen_mark_ptr(*slot);
+// Re-trace every old object whose payload starts in a dirty card. A card stays dirty
+// only while one of its objects still points into the nursery afterwards.
+// Promotion may dirty cards meanwhile; those are already accurate.
+static void scan_dirty_cards(void) {
+    if (!GS->old_heap_start) return;
+    size_t card_count = (gc_card_table.size + GC_CARD_SIZE - 1) >> GC_CARD_SHIFT;
+    unsigned char *cards = gc_card_table.cards;
+    unsigned char *card = cards;
+    unsigned char *cards_end = cards + card_count;
+    while ((card = (unsigned char*)memchr(card, 1, (size_t)(cards_end - card))) != NULL) {
+        *card = 0;
+        uint8_t *start = GS->old_heap_start + ((size_t)(card - cards) << GC_CARD_SHIFT);
+        uint8_t *end = start + GC_CARD_SIZE;
+        int young = 0;
+        // Headers sit just before the payloads the card covers.
+        uint8_t *first = start - sizeof(OldHeader);
+        if (first < GS->old_heap_start) first = GS->old_heap_start;
+        uint8_t *last = end - sizeof(OldHeader);
+        for (OldHeader *obj = (OldHeader*)gc_object_map_find_before(&GS->old_object_map, first, last);
+             obj;
+             obj = (OldHeader*)gc_object_map_find_before(&GS->old_object_map, (uint8_t*)obj + GC_OBJECT_MAP_GRANULE, last)) {
+            if (old_unswept_dead(obj)) continue;
+            GS->traced_young_child = 0;
+            if (obj->trace) obj->trace(obj + 1);
+            young |= GS->traced_young_child;
         }
+        if (young) *card = 1;
+        card++;
     }
-    for (size_t i = 0; i < remembered_count; ++i) {
-        void **slot = remembered[i].slot;
+}
+
+static void trace_roots_for_minor(void) {
+    for (size_t i = 0; i < GS->root_count; ++i) {
+        void **slot = GS->roots[i].slot;
         if (slot && *slot) {
             *slot = gen_mark_ptr(*slot);
         }
     }
+    trace_root_ranges();
+    scan_dirty_cards();
 }
 
 static void trace_roots_for_major(void) {
-    for (size_t i = 0; i < root_count; ++i) {
-        void **slot = roots[i].slot;
+    for (size_t i = 0; i < GS->root_count; ++i) {
+        void **slot = GS->roots[i].slot;
         if (slot && *slot) {
             gen_mark_ptr(*slot);
         }
     }
+    trace_root_ranges();
 }
 
-static void scan_nursery(void) {
-    unsigned char *scan = nursery_active;
-    size_t scanned = 0;
-    while (scan < nursery_alloc) {
-        NurseryHeader *header = (NurseryHeader*)scan;
-        void *payload = (void*)(header + 1);
-        scanned++;
-        if (header->trace) header->trace(payload);
-        memcpy(scan, scan, 0); // suppress unused warning
-        scan += sizeof(NurseryHeader) + header->size;
+static void push_old_roots(void);
+static void mark_old_roots(void);
+static void drain_old_marks(void);
+static void begin_sweep_old(void);
+static double old_fragmentation_index(void);
+static void old_compact(void);
+
+// Nursery objects are left to the minor collection.
+static void *old_weak_resolve(void *ptr) {
+    OldHeader *header = old_find_header(ptr);
+    if (header) return header->marked ? ptr : NULL;
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) return large->marked ? ptr : NULL;
+    return ptr;
+}
+
+// Old marking is complete: weak roots to dead old objects are cleared, and
+// dead large objects are unmapped right away.
+static void old_sweep_large_objects(void) {
+    gc_weak_roots_update(old_weak_resolve);
+    size_t freed = gc_los_sweep(&GS->stats.objects_scanned, NULL);
+    GS->old_bytes_allocated -= freed;
+    GS->stats.freed_bytes += freed;
+    GS->old_cycle_freed += freed;
+}
+
+// Release the old space's large free blocks once a cycle has left less than
+// a third of the largest occupancy seen since the last trim, keeping as much
+// free memory as is live.
+static void old_trim_heap(void) {
+    size_t live = GS->old_block_bytes;
+    if (GS->old_trim_peak < live || GS->old_trim_peak - live < 2 * live || GS->old_trim_peak - live < 4 * GC_TRIM_MIN_BYTES) return;
+    GS->old_trim_peak = live;
+    old_release_size_classes();
+    size_t keep = live;
+    for (FreeHeader *block = GS->old_free_list; block; block = block->next) {
+        gc_trim_block(&keep, block + 1, block->size - sizeof(FreeHeader));
     }
-    gc_stats.objects_scanned += scanned;
-    gc_stats.current_bytes = (nursery_alloc - nursery_active) + old_bytes_allocated;
 }
 
-static void mark_old_roots(void);
-static void sweep_old(void);
+static void old_begin_cycle(void) {
+    if (GS->old_block_bytes > GS->old_trim_peak) GS->old_trim_peak = GS->old_block_bytes;
+    GS->old_cycle_start_bytes = GS->old_bytes_allocated;
+    GS->old_cycle_freed = 0;
+}
+
+// The sweep or compaction ending a cycle is done: set the next trigger.
+// Under an adaptive heap goal, a cycle that freed most of the old space
+// means objects were promoted only to die there, so promote later and
+// collect sooner; one that freed little can wait longer for the next.
+static void old_cycle_done(void) {
+    if (gc_get_heap_goal() != GC_GOAL_FIXED && GS->old_cycle_start_bytes > 0) {
+        size_t freed = GS->old_cycle_freed < GS->old_cycle_start_bytes ? GS->old_cycle_freed : GS->old_cycle_start_bytes;
+        double survival = 1.0 - (double)freed / (double)GS->old_cycle_start_bytes;
+        if (survival < 0.3) {
+            if (GS->promote_age < MAX_PROMOTE_AGE) GS->promote_age++;
+            GS->old_growth_factor /= 1.25;
+            if (GS->old_growth_factor < OLD_GROWTH_MIN) GS->old_growth_factor = OLD_GROWTH_MIN;
+        } else if (survival > 0.8) {
+            GS->old_growth_factor *= 1.25;
+            if (GS->old_growth_factor > OLD_GROWTH_MAX) GS->old_growth_factor = OLD_GROWTH_MAX;
+        }
+    }
+    GS->old_next_threshold = (size_t)(GS->old_bytes_allocated * GS->old_growth_factor + 1024);
+    old_trim_heap();
+}
 
+// Mark and sweep the old generation, then evacuate the nursery. Marking
+// runs first so the minor collection promotes into the reclaimed space;
+// it must never run from inside a minor collection. An incremental cycle
+// in progress is finished instead of restarted.
 static void major_collect(void) {
-    if (major_collecting) return;
-    
-    // Note: minor_collect() already updates timing stats
-    // We only need to track that major collection is happening
+    if (GS->major_collecting || GS->minor_collecting) return;
+    if (!GS->old_heap_start) {
+        minor_collect();
+        return;
+    }
+    gen_sync_stats();
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_MAJOR, gc_get_time_ms(), &GS->stats);
+    GS->major_collecting = 1;
+    if (GS->old_marking) {
+        drain_old_marks();
+        GS->old_marking = 0;
+        gc_incremental_marking = 0;
+    } else {
+        // Marks left by the previous cycle must be cleared first.
+        old_finish_sweep();
+        old_begin_cycle();
+        mark_old_roots();
+    }
+    old_sweep_large_objects();
+    if (old_fragmentation_index() > OLD_COMPACT_FRAGMENTATION) {
+        old_compact();
+    } else {
+        begin_sweep_old();
+    }
+    GS->major_collecting = 0;
+    record_pause(&span);
     minor_collect();
-    major_collecting = 1;
-    mark_old_roots();
-    sweep_old();
-    major_collecting = 0;
 }
 
-static void mark_old_roots(void) {
-    trace_roots_for_major();
-    for (size_t i = 0; i < remembered_count; ++i) {
-        void **slot = remembered[i].slot;
-        if (slot && *slot) {
-            gen_mark_ptr(*slot);
+// Run after each automatic minor collection: sweep a few more pages, advance
+// the incremental cycle by one slice, or start one when the old generation is
+// filling up.
+static void old_collection_step(void) {
+    if (!GS->old_heap_start || GS->major_collecting || GS->minor_collecting) return;
+    gen_sync_stats();
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_MARK_SLICE, gc_get_time_ms(), &GS->stats);
+    if (GS->old_sweeping) {
+        span.kind = GC_TRACE_SWEEP_SLICE;
+        for (int i = 0; i < SWEEP_PAGES_PER_MINOR && GS->old_sweeping; ++i) old_sweep_page();
+    } else if (GS->old_marking) {
+        GS->major_collecting = 1;
+        if (gc_mark_stack_drain_until(&GS->mark_stack, span.start_ms + GS->slice_budget_ms)) {
+            drain_old_marks();
+            GS->old_marking = 0;
+            gc_incremental_marking = 0;
+            old_sweep_large_objects();
+            begin_sweep_old();
         }
+        GS->major_collecting = 0;
+    } else {
+        double budget = gc_get_pause_budget_ms();
+        if (budget <= 0.0) return;
+        if (GS->old_bytes_allocated <= GS->old_next_threshold &&
+            GS->old_block_bytes <= (size_t)(GS->old_heap_size * INCREMENTAL_START)) {
+            return;
+        }
+        GS->slice_budget_ms = budget;
+        GS->major_collecting = 1;
+        old_begin_cycle();
+        push_old_roots();
+        GS->major_collecting = 0;
+        GS->old_marking = 1;
+        gc_incremental_marking = 1;
+    }
+    record_pause(&span);
+}
+
+// Trace everything reachable from the pushed old objects, on GC_THREADS
+// workers when configured, re-tracing marked old objects after a mark stack
+// overflow.
+static void drain_old_marks(void) {
+    gc_parallel_mark_drain(&GS->mark_stack);
+    while (GS->mark_stack.overflowed) {
+        GS->mark_stack.overflowed = 0;
+        for (OldHeader *obj = old_next_object(NULL); obj; obj = old_next_object(obj)) {
+            if (obj->marked && obj->trace) {
+                obj->trace(obj + 1);
+                if (GS->mark_stack.top > GC_MARK_STACK_CAPACITY / 2) gc_parallel_mark_drain(&GS->mark_stack);
+            }
+        }
+        gc_parallel_mark_drain(&GS->mark_stack);
+    }
+}
+
+static void push_old_roots(void) {
+    trace_roots_for_major();
+    // Nursery survivors carry no mark bit; the minor collection that
+    // precedes every major one just proved them live, so their references
+    // into the old generation are roots.
+    unsigned char *scan = GS->nursery_active;
+    while (scan < nursery_alloc) {
+        NurseryHeader *header = (NurseryHeader*)scan;
+        if (header->trace) header->trace(header + 1);
+        scan += sizeof(NurseryHeader) + header->size;
     }
 }
 
-static void sweep_old(void) {
-    OldHeader *obj = old_objects;
-    while (obj) {
-        OldHeader *next = obj->next;
+static void mark_old_roots(void) {
+    push_old_roots();
+    drain_old_marks();
+}
+
+static void begin_sweep_old(void) {
+    GS->old_sweep_cursor = GS->old_heap_start;
+    GS->old_sweeping = 1;
+}
+
+static void old_sweep_page(void) {
+    uint8_t *heap_end = GS->old_heap_start + GS->old_heap_size;
+    uint8_t *end = GS->old_sweep_cursor + SWEEP_PAGE_BYTES;
+    if (end > heap_end) end = heap_end;
+    for (OldHeader *obj = (OldHeader*)gc_object_map_find_before(&GS->old_object_map, GS->old_sweep_cursor, end);
+         obj;
+         obj = (OldHeader*)gc_object_map_find_before(&GS->old_object_map, (uint8_t*)obj + GC_OBJECT_MAP_GRANULE, end)) {
         if (!obj->marked) {
             old_remove(obj);
         } else {
             obj->marked = 0;
         }
-        obj = next;
     }
-    old_next_threshold = (size_t)(old_bytes_allocated * OLD_GROWTH_FACTOR + 1024);
-    gc_stats.current_bytes = (nursery_alloc - nursery_active) + old_bytes_allocated;
+    GS->old_sweep_cursor = end;
+    if (GS->old_sweep_cursor >= heap_end) {
+        GS->old_sweeping = 0;
+        old_cycle_done();
+    }
+    GS->stats.current_bytes = (nursery_alloc - GS->nursery_active) + GS->old_bytes_allocated;
+}
+
+static void old_finish_sweep(void) {
+    while (GS->old_sweeping) old_sweep_page();
+}
+
+// Total free bytes in the old generation; also reports the largest block
+// and the number of blocks.
+static size_t old_free_space(size_t *largest, size_t *blocks) {
+    size_t total = 0;
+    *largest = 0;
+    *blocks = 0;
+    for (size_t cls = 0; cls <= SIZE_CLASS_COUNT + 1; ++cls) {
+        FreeHeader *curr = cls <= SIZE_CLASS_COUNT ? GS->old_size_class_free[cls] : GS->old_free_list;
+        while (curr) {
+            total += curr->size;
+            if (curr->size > *largest) *largest = curr->size;
+            (*blocks)++;
+            curr = curr->next;
+        }
+    }
+    return total;
+}
+
+static double old_fragmentation_index(void) {
+    size_t largest, blocks;
+    size_t total = old_free_space(&largest, &blocks);
+    return total > 0 ? 1.0 - (double)largest / (double)total : 0.0;
+}
+
+// Sliding (Lisp-2) compaction of a freshly marked old generation, in place of
+// the sweep. Survivors get forwarding addresses in address order, every
+// reference is rewritten by re-running the trace hooks with gen_mark_ptr
+// answering forwarding addresses, then the survivors slide down. Free space
+// becomes a single block at the top and the cards are rebuilt for the new
+// addresses.
+static void old_compact(void) {
+    uint8_t *heap_end = GS->old_heap_start + GS->old_heap_size;
+    uint8_t *free_ptr = GS->old_heap_start;
+    for (OldHeader *obj = old_next_object(NULL); obj; obj = old_next_object(obj)) {
+        if (!obj->marked) {
+            // Dead blocks are not freed one by one; the free space is
+            // rebuilt once the survivors have moved.
+            gc_event_free(obj + 1);
+            gc_object_map_clear(&GS->old_object_map, obj);
+            GS->old_object_count--;
+            GS->old_bytes_allocated -= obj->size;
+            GS->stats.freed_bytes += obj->size;
+            GS->old_cycle_freed += obj->size;
+            continue;
+        }
+        obj->forward = (OldHeader*)free_ptr + 1;
+        free_ptr += old_block_size_for(sizeof(OldHeader) + obj->size);
+    }
+
+    GS->old_compacting = 1;
+    gc_move_epoch++;
+    memset(gc_card_table.cards, 0, (GS->old_heap_size >> GC_CARD_SHIFT) + 1);
+    for (size_t i = 0; i < GS->root_count; ++i) {
+        void **slot = GS->roots[i].slot;
+        if (slot && *slot) *slot = gen_mark_ptr(*slot);
+    }
+    trace_root_ranges();
+    gc_weak_roots_update(gen_mark_ptr);
+    for (unsigned char *scan = GS->nursery_active; scan < nursery_alloc; ) {
+        NurseryHeader *header = (NurseryHeader*)scan;
+        if (header->trace) header->trace(header + 1);
+        scan += sizeof(NurseryHeader) + header->size;
+    }
+    for (OldHeader *obj = old_next_object(NULL); obj; obj = old_next_object(obj)) {
+        GS->traced_young_child = 0;
+        if (obj->trace) obj->trace(obj + 1);
+        if (GS->traced_young_child) {
+            gc_card_table.cards[((uint8_t*)obj->forward - GS->old_heap_start) >> GC_CARD_SHIFT] = 1;
+        }
+    }
+    GS->old_compacting = 0;
+
+    // Destinations never pass an object's own start, so sliding in address
+    // order cannot overwrite a survivor that has not moved yet.
+    GS->old_block_bytes = 0;
+    OldHeader *last = NULL;
+    for (OldHeader *obj = old_next_object(NULL); obj; obj = old_next_object(obj)) {
+        OldHeader *dest = (OldHeader*)obj->forward - 1;
+        size_t block_size = old_block_size_for(sizeof(OldHeader) + obj->size);
+        gc_object_map_clear(&GS->old_object_map, obj);
+        if (dest != obj) {
+            memmove(dest, obj, sizeof(OldHeader) + obj->size);
+            gc_event_move(obj + 1, dest + 1, GC_GEN_OLD);
+        }
+        gc_object_map_set(&GS->old_object_map, dest);
+        dest->block_size = block_size;
+        dest->marked = 0;
+        GS->old_block_bytes += block_size;
+        last = dest;
+    }
+
+    GS->old_free_list = NULL;
+    memset(GS->old_size_class_free, 0, sizeof(GS->old_size_class_free));
+    size_t tail = (size_t)(heap_end - free_ptr);
+    if (tail >= MIN_BLOCK_SIZE) {
+        GS->old_free_list = (FreeHeader*)free_ptr;
+        GS->old_free_list->size = tail;
+        GS->old_free_list->next = NULL;
+    } else if (tail > 0 && last) {
+        // Too small to list on its own; keep it with the last block.
+        last->block_size += tail;
+        GS->old_block_bytes += tail;
+    }
+    old_cycle_done();
+    GS->stats.current_bytes = (nursery_alloc - GS->nursery_active) + GS->old_bytes_allocated;
 }
 
 static void gen_add_root(void **slot) {
@@ -761,38 +1365,51 @@ static void gen_remove_root(void **slot) {
     remove_root_slot(slot);
 }
 
+// Card marking for minor collections, plus snapshot-at-the-beginning
+// marking of the overwritten old reference while the old space is marked.
 static void gen_write_barrier(void *owner, void **slot, void *child) {
-    (void)owner;
-    if (!slot || !child) return;
-    if (pointer_in_space(nursery_active, child)) {
-        add_remembered_slot(slot);
+    (void)child;
+    gc_card_mark(owner);
+    if (GS->old_marking && slot) {
+        void *previous = *slot;
+        if (previous && !GC_IS_IMMEDIATE(previous)) old_mark(previous);
     }
 }
 
 static void gen_collect(void) {
     minor_collect();
-    if (old_bytes_allocated > old_next_threshold) {
+    if (!GS->old_sweeping && GS->old_bytes_allocated > GS->old_next_threshold) {
         major_collect();
     }
 }
 
 static void gen_free(void *ptr) {
     OldHeader *header = old_find_header(ptr);
-    if (header) old_remove(header);
+    if (header) {
+        old_remove(header);
+        return;
+    }
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) {
+        GS->old_bytes_allocated -= large->size;
+        GS->stats.freed_bytes += large->size;
+        gc_los_free(large);
+    }
 }
 
 static void gen_set_threshold(size_t bytes) {
     if (bytes < 1024) bytes = 1024;
-    old_next_threshold = bytes;
+    GS->old_next_threshold = bytes;
 }
 
 static size_t gen_get_threshold(void) {
-    return old_next_threshold;
+    return GS->old_next_threshold;
 }
 
 static void gen_get_stats(GcStats *out_stats) {
     if (!out_stats) return;
-    *out_stats = gc_stats;
+    gen_sync_stats();
+    *out_stats = GS->stats;
 
     // Calculate nursery fragmentation (External is 0 because it's contiguous)
     size_t nursery_free = 0;
@@ -802,16 +1419,8 @@ static void gen_get_stats(GcStats *out_stats) {
     
     // Calculate old generation fragmentation (Free List)
     size_t old_largest_free = 0;
-    size_t old_total_free = 0;
     size_t old_free_blocks = 0;
-    
-    FreeHeader *curr = old_free_list;
-    while (curr) {
-        old_total_free += curr->size;
-        if (curr->size > old_largest_free) old_largest_free = curr->size;
-        old_free_blocks++;
-        curr = curr->next;
-    }
+    size_t old_total_free = old_free_space(&old_largest_free, &old_free_blocks);
     
     // Combine metrics
     size_t total_free = nursery_free + old_total_free;
@@ -838,8 +1447,8 @@ static void gen_get_stats(GcStats *out_stats) {
     size_t obj_count = 0;
 
     // Walk nursery
-    if (nursery_active && nursery_alloc) {
-        unsigned char *scan = nursery_active;
+    if (GS->nursery_active && nursery_alloc) {
+        unsigned char *scan = GS->nursery_active;
         while (scan < nursery_alloc) {
             NurseryHeader *h = (NurseryHeader*)scan;
             wasted += sizeof(NurseryHeader);
@@ -849,7 +1458,8 @@ static void gen_get_stats(GcStats *out_stats) {
     }
 
     // Walk old generation
-    for (OldHeader *h = old_objects; h; h = h->next) {
+    for (OldHeader *h = old_next_object(NULL); h; h = old_next_object(h)) {
+        if (old_unswept_dead(h)) continue;
         // We need to account for alignment padding in the block
         size_t block_size = ALIGN(sizeof(OldHeader) + h->size);
         wasted += (block_size - h->size);
@@ -875,22 +1485,21 @@ static void gen_get_stats(GcStats *out_stats) {
     }
     
     // Track peak fragmentation
-    static double peak_frag = 0.0;
-    if (out_stats->fragmentation_index > peak_frag) {
-        peak_frag = out_stats->fragmentation_index;
+    if (out_stats->fragmentation_index > GS->peak_fragmentation) {
+        GS->peak_fragmentation = out_stats->fragmentation_index;
     }
-    out_stats->peak_fragmentation_index = peak_frag;
+    out_stats->peak_fragmentation_index = GS->peak_fragmentation;
     out_stats->fragmentation_growth_rate = 0.0;
 }
 
-static double gen_get_collections_count(void) { return (double)gc_stats.collections; }
-static double gen_get_allocated_bytes(void) { return (double)gc_stats.allocated_bytes; }
-static double gen_get_freed_bytes(void) { return (double)gc_stats.freed_bytes; }
-static double gen_get_current_bytes(void) { return (double)gc_stats.current_bytes; }
+static double gen_get_collections_count(void) { return (double)GS->stats.collections; }
+static double gen_get_allocated_bytes(void) { gen_sync_stats(); return (double)GS->stats.allocated_bytes; }
+static double gen_get_freed_bytes(void) { return (double)GS->stats.freed_bytes; }
+static double gen_get_current_bytes(void) { gen_sync_stats(); return (double)GS->stats.current_bytes; }
 
 static size_t gen_heap_snapshot(GcObjectInfo *out, size_t capacity) {
     size_t count = 0;
-    unsigned char *scan = nursery_active;
+    unsigned char *scan = GS->nursery_active;
     while (scan < nursery_alloc && count < capacity) {
         NurseryHeader *header = (NurseryHeader*)scan;
         out[count].addr = (uintptr_t)(header + 1);
@@ -900,36 +1509,62 @@ static size_t gen_heap_snapshot(GcObjectInfo *out, size_t capacity) {
         count++;
         scan += sizeof(NurseryHeader) + header->size;
     }
-    OldHeader *obj = old_objects;
-    while (obj && count < capacity) {
+    for (OldHeader *obj = old_next_object(NULL); obj && count < capacity; obj = old_next_object(obj)) {
+        if (old_unswept_dead(obj)) continue;
         out[count].addr = (uintptr_t)(obj + 1);
         out[count].size = obj->size;
         out[count].generation = GC_GEN_OLD;
         out[count].tag = obj->tag;
         count++;
-        obj = obj->next;
     }
+    count += gc_los_snapshot(out + count, capacity - count);
     return count;
 }
 
 static void old_mark(void *ptr) {
     OldHeader *header = old_find_header(ptr);
-    if (!header || header->marked) return;
-    header->marked = 1;
-    if (header->trace) header->trace(ptr);
+    if (!header) {
+        GcLargeObject *large = gc_los_find(ptr);
+        if (large) gc_mark_claim(&large->marked); // always a leaf
+        return;
+    }
+    if (!gc_mark_claim(&header->marked)) return;
+    if (header->trace) gc_mark_push(&GS->mark_stack, ptr, header->trace);
 }
 
 static void *gen_mark_ptr(void *ptr) {
     if (!ptr) return NULL;
-    if (minor_collecting) {
-        return copy_young_object(ptr);
+    if (GC_IS_IMMEDIATE(ptr)) return ptr;
+    if (GS->old_compacting) {
+        OldHeader *header = old_find_header(ptr);
+        if (header) return header->forward;
+        if (pointer_in_space(GS->nursery_active, ptr)) GS->traced_young_child = 1;
+        return ptr;
     }
-    if (major_collecting) {
+    if (GS->minor_collecting) {
+        void *result = copy_young_object(ptr);
+        if (pointer_in_space(GS->nursery_active, result)) GS->traced_young_child = 1;
+        return result;
+    }
+    if (GS->major_collecting) {
         old_mark(ptr);
     }
     return ptr;
 }
 
+static void gen_destroy(void) {
+    free(GS->nursery_active);
+    free(GS->nursery_inactive);
+    free(GS->old_heap_start);
+    free(GS->old_object_map.bits);
+    free(gc_card_table.cards);
+    free(GS->roots);
+    free(GS->root_hash);
+    free(GS->promotion_stack);
+    memset(&gc_card_table, 0, sizeof(gc_card_table));
+    nursery_alloc = nursery_end = NULL;
+}
+
 const GcBackend *gc_generational_backend(void) {
     static const GcBackend backend = {
         generational_init,
@@ -949,7 +1584,12 @@ const GcBackend *gc_generational_backend(void) {
         gen_get_allocated_bytes,
         gen_get_freed_bytes,
         gen_get_current_bytes,
-        gen_heap_snapshot
+        gen_heap_snapshot,
+        gen_allocate_typed,
+        gen_allocate_old,
+        gen_destroy,
+        sizeof(GenState),
+        "generational"
     };
     return &backend;
 }
@@ -0,0 +1,225 @@
+// large_objects.c - Large object space shared by the backends
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS and madvise under strict ISO C
+#include "gc_backend.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define GC_HAVE_MMAP 1
+#endif
+
+// Every large object gets its own page-aligned mapping with the header at
+// its start, so a payload pointer identifies a candidate header by its page
+// offset alone and the hash set only confirms it. Objects never move; dead
+// ones are unmapped by gc_los_sweep, returning their pages to the OS.
+#define LOS (&gc_heap->los)
+
+static size_t page_size = 0;
+
+#define LOS_PAYLOAD_OFFSET GC_ALIGN_SIZE(sizeof(GcLargeObject))
+
+// Shared by every heap; threads racing to set it store the same value.
+static size_t los_page_size(void) {
+#ifdef GC_HAVE_MMAP
+    size_t size = __atomic_load_n(&page_size, __ATOMIC_RELAXED);
+    if (!size) {
+        long system_size = sysconf(_SC_PAGESIZE);
+        size = system_size > 0 ? (size_t)system_size : 4096;
+        __atomic_store_n(&page_size, size, __ATOMIC_RELAXED);
+    }
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+static void *los_map(size_t size) {
+#ifdef GC_HAVE_MMAP
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return base == MAP_FAILED ? NULL : base;
+#else
+    return aligned_alloc(los_page_size(), size);
+#endif
+}
+
+static void los_unmap(void *base, size_t size) {
+#ifdef GC_HAVE_MMAP
+    munmap(base, size);
+#else
+    (void)size;
+    free(base);
+#endif
+}
+
+static size_t los_hash_slot(const GcLargeObject *obj) {
+    size_t h = (size_t)(uintptr_t)obj / los_page_size();
+    return (h ^ (h >> 16)) & (LOS->hash_capacity - 1);
+}
+
+static void los_hash_insert(GcLargeObject *obj);
+
+static void los_hash_resize(size_t new_capacity) {
+    GcLargeObject **old_hash = LOS->hash;
+    size_t old_capacity = LOS->hash_capacity;
+    LOS->hash = (GcLargeObject**)calloc(new_capacity, sizeof(GcLargeObject*));
+    if (!LOS->hash) {
+        fprintf(stderr, "GC: failed to grow large object table\n");
+        exit(1);
+    }
+    LOS->hash_capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_hash[i]) los_hash_insert(old_hash[i]);
+    }
+    free(old_hash);
+}
+
+static void los_hash_insert(GcLargeObject *obj) {
+    size_t h = los_hash_slot(obj);
+    while (LOS->hash[h]) h = (h + 1) & (LOS->hash_capacity - 1);
+    LOS->hash[h] = obj;
+}
+
+static void los_hash_delete(GcLargeObject *obj) {
+    size_t h = los_hash_slot(obj);
+    while (LOS->hash[h] != obj) h = (h + 1) & (LOS->hash_capacity - 1);
+    LOS->hash[h] = NULL;
+    // Re-insert the rest of the cluster so lookups do not stop early.
+    size_t i = (h + 1) & (LOS->hash_capacity - 1);
+    while (LOS->hash[i]) {
+        GcLargeObject *moved = LOS->hash[i];
+        LOS->hash[i] = NULL;
+        los_hash_insert(moved);
+        i = (i + 1) & (LOS->hash_capacity - 1);
+    }
+}
+
+void *gc_los_allocate(size_t size, gc_trace_func trace, unsigned char tag, int marked) {
+    size_t page = los_page_size();
+    size_t mapped = (LOS_PAYLOAD_OFFSET + size + page - 1) & ~(page - 1);
+    GcLargeObject *obj = (GcLargeObject*)los_map(mapped);
+    if (!obj) return NULL;
+    if ((LOS->count + 1) * 2 > LOS->hash_capacity) {
+        los_hash_resize(LOS->hash_capacity ? LOS->hash_capacity * 2 : 64);
+    }
+    obj->size = size;
+    obj->mapped = mapped;
+    obj->trace = trace;
+    obj->marked = (unsigned char)marked;
+    obj->tag = tag;
+    obj->next = LOS->objects;
+    LOS->objects = obj;
+    los_hash_insert(obj);
+    LOS->count++;
+    LOS->bytes += size;
+    LOS->mapped_bytes += mapped;
+    LOS->allocated_since_sweep += size;
+    void *payload = (uint8_t*)obj + LOS_PAYLOAD_OFFSET;
+#ifndef GC_HAVE_MMAP
+    memset(payload, 0, size); // fresh mappings are already zero
+#endif
+    gc_event_alloc(payload, size, GC_GEN_OLD, tag);
+    return payload;
+}
+
+GcLargeObject *gc_los_find(const void *ptr) {
+    if (!LOS->count || !ptr) return NULL;
+    uintptr_t base = (uintptr_t)ptr - LOS_PAYLOAD_OFFSET;
+    if (base % los_page_size() != 0) return NULL;
+    GcLargeObject *candidate = (GcLargeObject*)base;
+    for (size_t h = los_hash_slot(candidate); LOS->hash[h]; h = (h + 1) & (LOS->hash_capacity - 1)) {
+        if (LOS->hash[h] == candidate) return candidate;
+    }
+    return NULL;
+}
+
+void *gc_los_payload(GcLargeObject *obj) {
+    return (uint8_t*)obj + LOS_PAYLOAD_OFFSET;
+}
+
+static void los_release(GcLargeObject *obj) {
+    gc_event_free(gc_los_payload(obj));
+    los_hash_delete(obj);
+    LOS->count--;
+    LOS->bytes -= obj->size;
+    LOS->mapped_bytes -= obj->mapped;
+    los_unmap(obj, obj->mapped);
+}
+
+size_t gc_los_sweep(size_t *scanned, size_t *survived) {
+    size_t freed = 0;
+    GcLargeObject **link = &LOS->objects;
+    while (*link) {
+        GcLargeObject *obj = *link;
+        if (scanned) (*scanned)++;
+        if (obj->marked) {
+            obj->marked = 0;
+            if (survived) (*survived)++;
+            link = &obj->next;
+            continue;
+        }
+        *link = obj->next;
+        freed += obj->size;
+        los_release(obj);
+    }
+    LOS->allocated_since_sweep = 0;
+    return freed;
+}
+
+void gc_los_free(GcLargeObject *obj) {
+    for (GcLargeObject **link = &LOS->objects; *link; link = &(*link)->next) {
+        if (*link == obj) {
+            *link = obj->next;
+            los_release(obj);
+            return;
+        }
+    }
+}
+
+void gc_los_trace_marked(void) {
+    for (GcLargeObject *obj = LOS->objects; obj; obj = obj->next) {
+        if (obj->marked && obj->trace) obj->trace(gc_los_payload(obj));
+    }
+}
+
+size_t gc_los_bytes(void) { return LOS->bytes; }
+size_t gc_los_mapped_bytes(void) { return LOS->mapped_bytes; }
+size_t gc_los_count(void) { return LOS->count; }
+size_t gc_los_allocated_since_sweep(void) { return LOS->allocated_since_sweep; }
+
+void gc_los_destroy(void) {
+    while (LOS->objects) {
+        GcLargeObject *obj = LOS->objects;
+        LOS->objects = obj->next;
+        los_unmap(obj, obj->mapped);
+    }
+    free(LOS->hash);
+    memset(LOS, 0, sizeof(*LOS));
+}
+
+size_t gc_los_snapshot(GcObjectInfo *out, size_t capacity) {
+    size_t count = 0;
+    for (GcLargeObject *obj = LOS->objects; obj && count < capacity; obj = obj->next) {
+        out[count].addr = (uintptr_t)gc_los_payload(obj);
+        out[count].size = obj->size;
+        out[count].generation = GC_GEN_OLD;
+        out[count].tag = obj->tag;
+        count++;
+    }
+    return count;
+}
+
+void gc_release_pages(void *start, size_t length) {
+#if defined(GC_HAVE_MMAP) && defined(MADV_DONTNEED)
+    size_t page = los_page_size();
+    uintptr_t begin = ((uintptr_t)start + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)start + length) & ~(uintptr_t)(page - 1);
+    if (end > begin) madvise((void*)begin, end - begin, MADV_DONTNEED);
+#else
+    (void)start;
+    (void)length;
+#endif
+}
@@ -10,24 +10,34 @@
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 #define MIN_BLOCK_SIZE (sizeof(FreeHeader))
 
+// Blocks up to SMALL_BLOCK_MAX bytes (header included) are rounded up to a
+// multiple of SIZE_CLASS_GRANULE and served from a per-size free list, so the
+// interpreter's few fixed object sizes allocate and free in O(1). Larger
+// blocks use the address-ordered coalescing list. The classes are the ones
+// gc_allocate_fast serves inline (see gc.h).
+#define SIZE_CLASS_GRANULE GC_SIZE_CLASS_GRANULE
+#define SIZE_CLASS_COUNT GC_SIZE_CLASS_COUNT
+#define SMALL_BLOCK_MAX (SIZE_CLASS_GRANULE * SIZE_CLASS_COUNT)
+#define SIZE_CLASS_INDEX(size) (((size) + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE)
+#define SIZE_CLASS_REFILL_BYTES 4096
+
+// With a pause budget, a collection marks incrementally: one slice of at
+// most the budget runs every MARK_SLICE_BYTES of allocation until the mark
+// stack is empty, then the heap is swept.
+#define MARK_SLICE_BYTES (32 * 1024)
+#define INCREMENTAL_START 0.6
+
+// Lazy sweeping granularity, and how many pages a size class that ran dry
+// may sweep looking for a recycled block before carving a fresh run.
+#define SWEEP_PAGE_BYTES (16 * 1024)
+#define SWEEP_PAGES_PER_REFILL 4
+
 // Header for free blocks in the free list
-typedef struct FreeHeader {
-    size_t size;             // Size of the block (including this header)
-    struct FreeHeader *next; // Next free block
-} FreeHeader;
-
-// Allocation headers are woven into a doubly-linked list so we can sweep
-// without separate metadata structures.
-typedef struct GcHeader
-{
-    struct GcHeader *prev;
-    struct GcHeader *next;
-    size_t size;      // Size of the user payload
-    size_t block_size; // Total size of the block (header + payload + padding)
-    int marked;
-    gc_trace_func trace;
-    unsigned char tag;
-} GcHeader;
+typedef GcFreeBlock FreeHeader;
+
+// Allocated blocks are found through the object-start bitmap, so the header
+// carries no list links. Its layout is published for the inline fast path.
+typedef GcBlockHeader GcHeader;
 
 // Roots are stored as slots (addresses of Value*/Env* pointers)
 typedef struct
@@ -38,12 +48,65 @@ typedef struct
 // Hash table for fast root lookups
 typedef struct {
     void **slot;
-    size_t index; // Index in gc_roots array
+    size_t index; // Index in the roots array
 } RootHashEntry;
 
-static RootHashEntry *root_hash = NULL;
-static size_t root_hash_capacity = 0;
-static size_t root_hash_count = 0;
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#endif
+
+typedef struct {
+    // Hash table for fast root lookups
+    RootHashEntry *root_hash;
+    size_t root_hash_capacity;
+    size_t root_hash_count;
+
+    uint8_t *heap_start;
+    uint8_t *heap_end;
+    size_t heap_size;
+    FreeHeader *free_list;
+
+    GcObjectMap object_map;
+    size_t live_object_count;
+    size_t bytes_allocated;
+    size_t next_threshold;
+    GcRoot *roots;
+    size_t root_count;
+    size_t root_capacity;
+    int initialized;
+    int collecting;
+    GcStats stats;
+    GcMarkStack mark_stack;
+    size_t pause_count;
+    // Incremental cycle state. Objects allocated while marking start out
+    // marked, and the write barrier marks overwritten references, so
+    // everything reachable when the cycle started survives it.
+    int marking;
+    double slice_budget_ms;
+    size_t next_slice_at;
+    // Lazy sweep state: objects below sweep_cursor have been swept.
+    int sweeping;
+    uint8_t *sweep_cursor;
+    size_t sweep_scanned;
+    size_t sweep_survived;
+    int sweep_sets_threshold;
+    size_t trim_peak;
+#ifndef __EMSCRIPTEN__
+    int background_sweep;
+    int sweeper_exit;
+    pthread_t sweeper_thread;
+    pthread_mutex_t heap_lock;
+    pthread_cond_t sweep_wakeup;
+#endif
+} MarkSweepState;
+
+#define MS GC_BACKEND_STATE(MarkSweepState)
+
+// The size classes live in gc_size_classes, where gc_allocate_fast serves
+// them inline; size_class_limit is the end of each class's bump run.
+#define size_class_free (gc_size_classes.free)
+#define size_class_cursor (gc_size_classes.cursor)
+#define size_class_limit (gc_size_classes.limit)
 
 // Hash function
 static size_t hash_ptr(void *ptr) {
@@ -54,12 +117,12 @@ static size_t hash_ptr(void *ptr) {
 static void root_hash_insert(void **slot, size_t index);
 
 static void root_hash_resize(size_t new_capacity) {
-    RootHashEntry *old_hash = root_hash;
-    size_t old_capacity = root_hash_capacity;
+    RootHashEntry *old_hash = MS->root_hash;
+    size_t old_capacity = MS->root_hash_capacity;
 
-    root_hash_capacity = new_capacity;
-    root_hash = (RootHashEntry *)calloc(root_hash_capacity, sizeof(RootHashEntry));
-    root_hash_count = 0;
+    MS->root_hash_capacity = new_capacity;
+    MS->root_hash = (RootHashEntry *)calloc(MS->root_hash_capacity, sizeof(RootHashEntry));
+    MS->root_hash_count = 0;
 
     if (old_hash) {
         for (size_t i = 0; i < old_capacity; ++i) {
@@ -72,82 +135,132 @@ static void root_hash_resize(size_t new_capacity) {
 }
 
 static void root_hash_insert(void **slot, size_t index) {
-    if (root_hash_count * 2 >= root_hash_capacity) {
-        root_hash_resize(root_hash_capacity ? root_hash_capacity * 2 : 1024);
+    if (MS->root_hash_count * 2 >= MS->root_hash_capacity) {
+        root_hash_resize(MS->root_hash_capacity ? MS->root_hash_capacity * 2 : 1024);
     }
     
-    size_t h = hash_ptr(slot) & (root_hash_capacity - 1);
-    while (root_hash[h].slot) {
-        if (root_hash[h].slot == slot) {
-            root_hash[h].index = index; // Update index
+    size_t h = hash_ptr(slot) & (MS->root_hash_capacity - 1);
+    while (MS->root_hash[h].slot) {
+        if (MS->root_hash[h].slot == slot) {
+            MS->root_hash[h].index = index; // Update index
             return;
         }
-        h = (h + 1) & (root_hash_capacity - 1);
+        h = (h + 1) & (MS->root_hash_capacity - 1);
     }
-    root_hash[h].slot = slot;
-    root_hash[h].index = index;
-    root_hash_count++;
+    MS->root_hash[h].slot = slot;
+    MS->root_hash[h].index = index;
+    MS->root_hash_count++;
 }
 
 static size_t root_hash_find(void **slot, int *found) {
-    if (!root_hash) {
+    if (!MS->root_hash) {
         *found = 0;
         return 0;
     }
-    size_t h = hash_ptr(slot) & (root_hash_capacity - 1);
-    while (root_hash[h].slot) {
-        if (root_hash[h].slot == slot) {
+    size_t h = hash_ptr(slot) & (MS->root_hash_capacity - 1);
+    while (MS->root_hash[h].slot) {
+        if (MS->root_hash[h].slot == slot) {
             *found = 1;
-            return root_hash[h].index;
+            return MS->root_hash[h].index;
         }
-        h = (h + 1) & (root_hash_capacity - 1);
+        h = (h + 1) & (MS->root_hash_capacity - 1);
     }
     *found = 0;
     return 0;
 }
 
 static void root_hash_delete(void **slot) {
-    if (!root_hash) return;
-    size_t h = hash_ptr(slot) & (root_hash_capacity - 1);
-    while (root_hash[h].slot) {
-        if (root_hash[h].slot == slot) {
-            root_hash[h].slot = NULL;
-            root_hash_count--;
+    if (!MS->root_hash) return;
+    size_t h = hash_ptr(slot) & (MS->root_hash_capacity - 1);
+    while (MS->root_hash[h].slot) {
+        if (MS->root_hash[h].slot == slot) {
+            MS->root_hash[h].slot = NULL;
+            MS->root_hash_count--;
             
             // Rehash subsequent entries in the cluster
-            size_t i = (h + 1) & (root_hash_capacity - 1);
-            while (root_hash[i].slot) {
-                void **s = root_hash[i].slot;
-                size_t idx = root_hash[i].index;
-                root_hash[i].slot = NULL;
-                root_hash_count--;
+            size_t i = (h + 1) & (MS->root_hash_capacity - 1);
+            while (MS->root_hash[i].slot) {
+                void **s = MS->root_hash[i].slot;
+                size_t idx = MS->root_hash[i].index;
+                MS->root_hash[i].slot = NULL;
+                MS->root_hash_count--;
                 root_hash_insert(s, idx);
-                i = (i + 1) & (root_hash_capacity - 1);
+                i = (i + 1) & (MS->root_hash_capacity - 1);
             }
             return;
         }
-        h = (h + 1) & (root_hash_capacity - 1);
+        h = (h + 1) & (MS->root_hash_capacity - 1);
     }
 }
 
-// Global state
-static uint8_t *heap_start = NULL;
-static uint8_t *heap_end = NULL;
-static size_t heap_size = 0;
-static FreeHeader *free_list = NULL;
-
-static GcHeader *gc_objects = NULL;
-static size_t gc_bytes_allocated = 0;
-static size_t gc_next_threshold = 1024 * 1024;
 static const double GC_GROWTH_FACTOR = 1.5; // Lower growth factor since heap is fixed size
-static GcRoot *gc_roots = NULL;
-static size_t gc_root_count = 0;
-static size_t gc_root_capacity = 0;
-static int gc_initialized = 0;
-static int gc_collecting = 0;
-static GcStats internal_stats = {0, 0, 0, 0};
 
-static void ms_collect(void);
+static void ms_mark_slice(void);
+static void ms_start_cycle(void);
+static void ms_collect_now(int update_threshold);
+static void ms_update_threshold(void);
+static void ms_sweep_page(void);
+static void ms_finish_sweep(void);
+
+// Background sweeping (native builds, GC_BACKGROUND_SWEEP=1): a helper
+// thread sweeps pages while the mutator runs. Every entry point that touches
+// the heap then holds heap_lock; without the thread the lock is a no-op.
+// The thread works on the heap it was started for and is joined when that
+// heap is destroyed.
+#ifndef __EMSCRIPTEN__
+
+static void ms_lock(void) { if (MS->background_sweep) pthread_mutex_lock(&MS->heap_lock); }
+static void ms_unlock(void) { if (MS->background_sweep) pthread_mutex_unlock(&MS->heap_lock); }
+static void ms_wake_sweeper(void) { if (MS->background_sweep) pthread_cond_signal(&MS->sweep_wakeup); }
+
+static void *ms_sweeper_main(void *arg)
+{
+    gc_heap_enter((GcHeap*)arg);
+    pthread_mutex_lock(&MS->heap_lock);
+    for (;;) {
+        while (!MS->sweeping && !MS->sweeper_exit) pthread_cond_wait(&MS->sweep_wakeup, &MS->heap_lock);
+        if (MS->sweeper_exit) break;
+        ms_sweep_page();
+        // Let the mutator in between pages.
+        pthread_mutex_unlock(&MS->heap_lock);
+        pthread_mutex_lock(&MS->heap_lock);
+    }
+    pthread_mutex_unlock(&MS->heap_lock);
+    return NULL;
+}
+
+static void ms_start_sweeper(void)
+{
+    pthread_mutex_init(&MS->heap_lock, NULL);
+    pthread_cond_init(&MS->sweep_wakeup, NULL);
+    const char *env = getenv("GC_BACKGROUND_SWEEP");
+    if (!env || atoi(env) == 0) return;
+    MS->background_sweep = 1;
+    if (pthread_create(&MS->sweeper_thread, NULL, ms_sweeper_main, gc_heap) != 0) {
+        MS->background_sweep = 0;
+    }
+}
+
+static void ms_stop_sweeper(void)
+{
+    if (MS->background_sweep) {
+        pthread_mutex_lock(&MS->heap_lock);
+        MS->sweeper_exit = 1;
+        pthread_cond_signal(&MS->sweep_wakeup);
+        pthread_mutex_unlock(&MS->heap_lock);
+        pthread_join(MS->sweeper_thread, NULL);
+        MS->background_sweep = 0;
+    }
+    pthread_cond_destroy(&MS->sweep_wakeup);
+    pthread_mutex_destroy(&MS->heap_lock);
+}
+#else
+static void ms_lock(void) {}
+static void ms_unlock(void) {}
+static void ms_wake_sweeper(void) {}
+static void ms_start_sweeper(void) {}
+static void ms_stop_sweeper(void) {}
+#endif
 
 // Helper: Get GcHeader from user pointer
 static GcHeader *gc_header_for(void *ptr)
@@ -156,54 +269,62 @@ static GcHeader *gc_header_for(void *ptr)
     return ((GcHeader *)ptr) - 1;
 }
 
-// Helper: Find header in object list (safe check)
+// Helper: Find the header of a managed object, or NULL for pointers that do
+// not start an allocated block of this heap (static/interned values).
 static GcHeader *gc_find_header(void *ptr)
 {
     if (!ptr) return NULL;
-    // In this implementation, we trust the pointer arithmetic if it's within heap bounds
-    if ((uint8_t*)ptr < heap_start || (uint8_t*)ptr >= heap_end) return NULL;
-    return gc_header_for(ptr);
+    GcHeader *header = gc_header_for(ptr);
+    if (!gc_object_map_test(&MS->object_map, header)) return NULL;
+    return header;
+}
+
+static GcHeader *ms_next_object(GcHeader *after)
+{
+    return (GcHeader*)gc_object_map_next(&MS->object_map, after);
 }
 
 // Root management
 static void gc_roots_reserve(size_t capacity)
 {
-    if (gc_root_capacity >= capacity) return;
-    size_t new_cap = gc_root_capacity ? gc_root_capacity * 2 : 32;
+    if (MS->root_capacity >= capacity) return;
+    size_t new_cap = MS->root_capacity ? MS->root_capacity * 2 : 32;
     while (new_cap < capacity) new_cap *= 2;
-    GcRoot *new_roots = (GcRoot *)realloc(gc_roots, new_cap * sizeof(GcRoot));
+    GcRoot *new_roots = (GcRoot *)realloc(MS->roots, new_cap * sizeof(GcRoot));
     if (!new_roots) {
         fprintf(stderr, "GC: failed to grow root set\n");
         exit(1);
     }
-    gc_roots = new_roots;
-    gc_root_capacity = new_cap;
+    MS->roots = new_roots;
+    MS->root_capacity = new_cap;
 }
 
 // Allocator Internals -------------------------------------------------------
 
 static void ms_heap_init_allocator(size_t size) {
-    heap_size = size;
-    heap_start = (uint8_t*)malloc(heap_size);
-    if (!heap_start) {
-        fprintf(stderr, "GC: Failed to allocate heap of size %zu\n", heap_size);
+    MS->heap_size = size;
+    MS->heap_start = (uint8_t*)malloc(MS->heap_size);
+    if (!MS->heap_start) {
+        fprintf(stderr, "GC: Failed to allocate heap of size %zu\n", MS->heap_size);
         exit(1);
     }
-    heap_end = heap_start + heap_size;
+    MS->heap_end = MS->heap_start + MS->heap_size;
+    free(MS->object_map.bits);
+    gc_object_map_init(&MS->object_map, MS->heap_start, MS->heap_size);
 
     // Initialize free list with one large block
-    free_list = (FreeHeader*)heap_start;
-    free_list->size = heap_size;
-    free_list->next = NULL;
+    MS->free_list = (FreeHeader*)MS->heap_start;
+    MS->free_list->size = MS->heap_size;
+    MS->free_list->next = NULL;
+    memset(size_class_free, 0, sizeof(size_class_free));
+    memset(size_class_cursor, 0, sizeof(size_class_cursor));
+    memset(size_class_limit, 0, sizeof(size_class_limit));
 }
 
-// Allocate a block from the free list (First-Fit)
-static void *ms_heap_alloc(size_t size) {
-    size_t needed = ALIGN(size);
-    if (needed < MIN_BLOCK_SIZE) needed = MIN_BLOCK_SIZE;
-
+// Allocate a block from the coalescing free list (First-Fit)
+static void *ms_heap_alloc_fit(size_t needed) {
     FreeHeader *prev = NULL;
-    FreeHeader *curr = free_list;
+    FreeHeader *curr = MS->free_list;
 
     while (curr) {
         if (curr->size >= needed) {
@@ -215,13 +336,13 @@ static void *ms_heap_alloc(size_t size) {
                 remaining->next = curr->next;
                 
                 if (prev) prev->next = remaining;
-                else free_list = remaining;
+                else MS->free_list = remaining;
                 
                 curr->size = needed; // Only the allocated part
             } else {
                 // Use the whole block (remove from list)
                 if (prev) prev->next = curr->next;
-                else free_list = curr->next;
+                else MS->free_list = curr->next;
             }
             return (void*)curr;
         }
@@ -231,15 +352,13 @@ static void *ms_heap_alloc(size_t size) {
     return NULL; // Out of memory
 }
 
-// Free a block and coalesce with neighbors
-static void ms_heap_free(void *ptr, size_t size) {
-    if (!ptr) return;
-    
+// Return a block to the coalescing free list (sorted by address)
+static void ms_heap_free_fit(void *ptr, size_t size) {
     FreeHeader *block = (FreeHeader*)ptr;
     block->size = size;
     
     FreeHeader *prev = NULL;
-    FreeHeader *curr = free_list;
+    FreeHeader *curr = MS->free_list;
     
     // Find insertion point (sorted by address)
     while (curr && curr < block) {
@@ -250,7 +369,7 @@ static void ms_heap_free(void *ptr, size_t size) {
     // Insert 'block' between 'prev' and 'curr'
     block->next = curr;
     if (prev) prev->next = block;
-    else free_list = block;
+    else MS->free_list = block;
     
     // Coalesce with next
     if (curr && (uint8_t*)block + block->size == (uint8_t*)curr) {
@@ -265,47 +384,275 @@ static void ms_heap_free(void *ptr, size_t size) {
     }
 }
 
+// Carve a fresh run for an exhausted size class out of the coalescing list.
+// The run is handed out through the class's bump cursor rather than being
+// split into list nodes up front.
+static int ms_refill_size_class(size_t cls) {
+    size_t block_size = cls * SIZE_CLASS_GRANULE;
+    size_t run = block_size * (SIZE_CLASS_REFILL_BYTES / block_size);
+    uint8_t *chunk = (uint8_t*)ms_heap_alloc_fit(run);
+    if (!chunk) return 0;
+    size_t avail = ((FreeHeader*)chunk)->size;
+    size_t usable = avail - avail % block_size;
+    if (avail - usable >= MIN_BLOCK_SIZE) {
+        ms_heap_free_fit(chunk + usable, avail - usable);
+    } else if (avail > usable) {
+        // Too small to list on its own; return it with the last block.
+        usable -= block_size;
+        ms_heap_free_fit(chunk + usable, avail - usable);
+    }
+    size_class_cursor[cls] = chunk;
+    size_class_limit[cls] = chunk + usable;
+    return usable > 0;
+}
+
+// Allocate a block: small sizes pop their size class, larger ones use First-Fit.
+static void *ms_heap_alloc(size_t size) {
+    size_t needed = ALIGN(size);
+    if (needed < MIN_BLOCK_SIZE) needed = MIN_BLOCK_SIZE;
+
+    if (needed <= SMALL_BLOCK_MAX) {
+        size_t cls = SIZE_CLASS_INDEX(needed);
+        size_t block_size = cls * SIZE_CLASS_GRANULE;
+        FreeHeader *block = size_class_free[cls];
+        if (!block && size_class_cursor[cls] == size_class_limit[cls]) {
+            // Recycle swept blocks before carving fresh memory.
+            for (int i = 0; i < SWEEP_PAGES_PER_REFILL && MS->sweeping && !size_class_free[cls]; ++i) {
+                ms_sweep_page();
+            }
+            block = size_class_free[cls];
+        }
+        if (block) {
+            size_class_free[cls] = block->next;
+            return (void*)block;
+        }
+        if (size_class_cursor[cls] == size_class_limit[cls] && !ms_refill_size_class(cls)) {
+            // No room for a whole run; take a single block directly.
+            return ms_heap_alloc_fit(block_size);
+        }
+        block = (FreeHeader*)size_class_cursor[cls];
+        size_class_cursor[cls] += block_size;
+        block->size = block_size;
+        return (void*)block;
+    }
+    void *block = ms_heap_alloc_fit(needed);
+    while (!block && MS->sweeping) {
+        ms_sweep_page();
+        block = ms_heap_alloc_fit(needed);
+    }
+    return block;
+}
+
+// Free a block: blocks of exactly a size-class size go back to that class,
+// everything else is coalesced with its neighbors.
+static void ms_heap_free(void *ptr, size_t size) {
+    if (!ptr) return;
+    if (size <= SMALL_BLOCK_MAX && size % SIZE_CLASS_GRANULE == 0) {
+        size_t cls = SIZE_CLASS_INDEX(size);
+        FreeHeader *block = (FreeHeader*)ptr;
+        block->size = size;
+        block->next = size_class_free[cls];
+        size_class_free[cls] = block;
+        return;
+    }
+    ms_heap_free_fit(ptr, size);
+}
+
+static int ms_compare_blocks(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(FreeHeader * const *)a;
+    uintptr_t y = (uintptr_t)*(FreeHeader * const *)b;
+    return (x > y) - (x < y);
+}
+
+// Last resort before reporting OOM: move every size-class block back into the
+// coalescing list so memory cached for one size can serve another.
+static void ms_release_size_classes(void) {
+    for (size_t cls = 1; cls <= SIZE_CLASS_COUNT; ++cls) {
+        if (size_class_cursor[cls] != size_class_limit[cls]) {
+            FreeHeader *rest = (FreeHeader*)size_class_cursor[cls];
+            rest->size = (size_t)(size_class_limit[cls] - size_class_cursor[cls]);
+            rest->next = size_class_free[cls];
+            size_class_free[cls] = rest;
+        }
+        size_class_cursor[cls] = size_class_limit[cls] = NULL;
+    }
+    size_t count = 0;
+    for (FreeHeader *b = MS->free_list; b; b = b->next) count++;
+    for (size_t cls = 0; cls <= SIZE_CLASS_COUNT; ++cls) {
+        for (FreeHeader *b = size_class_free[cls]; b; b = b->next) count++;
+    }
+    if (count == 0) return;
+    FreeHeader **blocks = (FreeHeader**)malloc(count * sizeof(FreeHeader*));
+    if (!blocks) return;
+    size_t n = 0;
+    for (FreeHeader *b = MS->free_list; b; b = b->next) blocks[n++] = b;
+    for (size_t cls = 0; cls <= SIZE_CLASS_COUNT; ++cls) {
+        for (FreeHeader *b = size_class_free[cls]; b; b = b->next) blocks[n++] = b;
+        size_class_free[cls] = NULL;
+    }
+    qsort(blocks, n, sizeof(FreeHeader*), ms_compare_blocks);
+    MS->free_list = NULL;
+    FreeHeader *tail = NULL;
+    for (size_t i = 0; i < n; ++i) {
+        FreeHeader *b = blocks[i];
+        if (tail && (uint8_t*)tail + tail->size == (uint8_t*)b) {
+            tail->size += b->size;
+            continue;
+        }
+        b->next = NULL;
+        if (tail) tail->next = b;
+        else MS->free_list = b;
+        tail = b;
+    }
+    free(blocks);
+}
+
+// Inline size-class allocation -----------------------------------------------
+//
+// Between two backend calls gc_allocate_fast allocates small blocks itself.
+// Every entry point that reads or changes the heap first withdraws the size
+// classes, folding what was handed out into the stats; the allocation slow
+// path republishes them on its way out.
+
+// The background sweeper frees into the size classes under heap_lock, so
+// nothing is published while it runs.
+static int ms_has_sweeper(void)
+{
+#ifndef __EMSCRIPTEN__
+    return MS->background_sweep;
+#else
+    return 0;
+#endif
+}
+
+static void ms_take_size_classes(void)
+{
+    GcSizeClasses *classes = &gc_size_classes;
+    if (!classes->enabled) return;
+    classes->enabled = 0;
+    MS->live_object_count += classes->objects;
+    MS->bytes_allocated += classes->allocated_bytes;
+    MS->stats.allocated_bytes += classes->allocated_bytes;
+    MS->stats.current_bytes += classes->allocated_bytes;
+    MS->stats.wasted_bytes += classes->block_bytes - classes->allocated_bytes;
+    classes->objects = classes->allocated_bytes = classes->block_bytes = 0;
+}
+
+static void ms_publish_size_classes(void)
+{
+    // Incremental slices are paced by allocated bytes, so marking allocates
+    // on the slow path.
+    if (ms_has_sweeper() || MS->marking) return;
+    GcSizeClasses *classes = &gc_size_classes;
+    classes->object_bits = MS->object_map.bits;
+    classes->object_base = MS->object_map.base;
+    classes->mark_from = MS->sweeping ? (uintptr_t)MS->sweep_cursor : UINTPTR_MAX;
+    classes->enabled = 1;
+}
+
 // Backend entry points ------------------------------------------------------
 
 static void ms_init(void)
 {
-    if (gc_initialized) return;
-    gc_initialized = 1;
+    if (MS->initialized) return;
+    MS->initialized = 1;
     
     size_t initial_size = gc_get_initial_heap_size();
     if (initial_size == 0) initial_size = 4 * 1024 * 1024; // Default 4MB
     ms_heap_init_allocator(initial_size);
 
-    gc_objects = NULL;
-    gc_roots = NULL;
-    gc_root_count = 0;
-    gc_root_capacity = 0;
-    gc_bytes_allocated = 0;
-    gc_next_threshold = initial_size / 2; // Trigger GC halfway
+    MS->live_object_count = 0;
+    MS->pause_count = 0;
+    MS->marking = 0;
+    MS->sweeping = 0;
+    MS->roots = NULL;
+    MS->root_count = 0;
+    MS->root_capacity = 0;
+    MS->bytes_allocated = 0;
+    MS->next_threshold = initial_size / 2; // Trigger GC halfway
     
-    memset(&internal_stats, 0, sizeof(internal_stats));
-    internal_stats.peak_fragmentation_index = 0.0;
-    internal_stats.fragmentation_growth_rate = 0.0;
+    memset(&MS->stats, 0, sizeof(MS->stats));
+    MS->stats.peak_fragmentation_index = 0.0;
+    MS->stats.fragmentation_growth_rate = 0.0;
 
-    if (root_hash) {
-        free(root_hash);
-        root_hash = NULL;
-        root_hash_capacity = 0;
-        root_hash_count = 0;
+    if (MS->root_hash) {
+        free(MS->root_hash);
+        MS->root_hash = NULL;
+        MS->root_hash_capacity = 0;
+        MS->root_hash_count = 0;
     }
+    ms_start_sweeper();
 }
 
-static void *ms_allocate(size_t size)
+// Large objects bypass the free list. Their bytes count toward the
+// collection threshold like any other allocation; the LOS is also collected
+// once it has grown by a heap's worth since the last sweep.
+static void *ms_allocate_large(size_t size, gc_trace_func trace, unsigned char tag)
+{
+    if (!MS->collecting && !MS->marking && gc_los_allocated_since_sweep() > MS->heap_size) {
+        ms_collect_now(0);
+    }
+    if (MS->sweeping) ms_sweep_page();
+    void *payload = gc_los_allocate(size, trace, tag, MS->marking);
+    if (!payload) {
+        ms_collect_now(0);
+        payload = gc_los_allocate(size, trace, tag, MS->marking);
+        if (!payload) {
+            fprintf(stderr, "GC: Out of memory (large object of %zu bytes)\n", size);
+            exit(1);
+        }
+    }
+    MS->bytes_allocated += size;
+    MS->stats.allocated_bytes += size;
+    MS->stats.current_bytes += size;
+    return payload;
+}
+
+static void *ms_allocate_typed_locked(size_t size, gc_trace_func trace, unsigned char tag)
 {
-    if (!gc_initialized) ms_init();
+
+    // Collect before carving the new block: the fresh object is not yet
+    // reachable from any root and would otherwise be swept immediately.
+    if (!MS->collecting && MS->marking)
+    {
+        if (MS->stats.allocated_bytes >= MS->next_slice_at) ms_mark_slice();
+    }
+    else if (!MS->collecting && !MS->sweeping && gc_get_pause_budget_ms() > 0.0)
+    {
+        // Marking must finish before the heap fills, so a cycle also
+        // starts once the blocks in use (headers included) pass INCREMENTAL_START.
+        size_t in_use = MS->stats.current_bytes + MS->stats.wasted_bytes;
+        if (MS->bytes_allocated > MS->next_threshold ||
+            in_use > (size_t)(MS->heap_size * INCREMENTAL_START)) {
+            ms_start_cycle();
+        }
+    }
+    else if (!MS->collecting && !MS->sweeping && MS->bytes_allocated > MS->next_threshold)
+    {
+        ms_collect_now(1);
+    }
+
+    if (size >= GC_LARGE_OBJECT_BYTES) return ms_allocate_large(size, trace, tag);
 
     size_t total_size = sizeof(GcHeader) + size;
     void *block = ms_heap_alloc(total_size);
     
     if (!block) {
         // Heap full, try collecting
-        ms_collect();
+        int was_marking = MS->marking;
+        ms_collect_now(0);
         block = ms_heap_alloc(total_size);
+        if (!block && was_marking) {
+            // Objects allocated during the cycle survived it; a full
+            // collection reclaims the ones that already died.
+            ms_collect_now(0);
+            block = ms_heap_alloc(total_size);
+        }
+        if (!block) {
+            ms_finish_sweep();
+            ms_release_size_classes();
+            block = ms_heap_alloc(total_size);
+        }
         if (!block) {
             fprintf(stderr, "GC: Out of memory (Mark-Sweep heap exhausted)\n");
             exit(1);
@@ -316,40 +663,50 @@ static void *ms_allocate(size_t size)
     size_t actual_block_size = ((FreeHeader*)block)->size;
 
     GcHeader *header = (GcHeader *)block;
-    header->prev = NULL;
-    header->next = gc_objects;
-    if (gc_objects) gc_objects->prev = header;
-    gc_objects = header;
+    gc_object_map_set(&MS->object_map, header);
+    MS->live_object_count++;
     
     header->size = size;
     header->block_size = actual_block_size; // Store actual block size for freeing
-    header->marked = 0;
-    header->trace = NULL;
-    header->tag = GC_TAG_UNKNOWN;
+    header->marked = (unsigned char)(MS->marking || (MS->sweeping && (uint8_t*)header >= MS->sweep_cursor));
+    header->trace = trace;
+    header->tag = tag;
     
     void *payload = (void *)(header + 1);
     memset(payload, 0, size);
+    gc_event_alloc(payload, size, GC_GEN_OLD, tag);
     
-    gc_bytes_allocated += size;
-    internal_stats.allocated_bytes += size;
-    internal_stats.current_bytes += size;
-    internal_stats.wasted_bytes += (header->block_size - size); // Header + Padding
+    MS->bytes_allocated += size;
+    MS->stats.allocated_bytes += size;
+    MS->stats.current_bytes += size;
+    MS->stats.wasted_bytes += (header->block_size - size); // Header + Padding
+    return payload;
+}
 
-    // Trigger collection if threshold exceeded (though allocator handles OOM)
-    if (!gc_collecting && gc_bytes_allocated > gc_next_threshold)
-    {
-        ms_collect();
-        // Adjust threshold but keep within heap bounds logic
-        size_t next = (size_t)(gc_bytes_allocated * GC_GROWTH_FACTOR);
-        if (next > heap_size) next = heap_size; 
-        gc_next_threshold = next;
-    }
+static void *ms_allocate_typed(size_t size, gc_trace_func trace, unsigned char tag)
+{
+    if (!MS->initialized) ms_init();
+    ms_lock();
+    ms_take_size_classes();
+    void *payload = ms_allocate_typed_locked(size, trace, tag);
+    ms_publish_size_classes();
+    ms_unlock();
     return payload;
 }
 
+static void *ms_allocate(size_t size)
+{
+    return ms_allocate_typed(size, NULL, GC_TAG_UNKNOWN);
+}
+
 static void ms_set_trace(void *ptr, gc_trace_func trace)
 {
     if (!ptr) return;
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) {
+        large->trace = trace;
+        return;
+    }
     GcHeader *header = gc_header_for(ptr);
     header->trace = trace;
 }
@@ -357,23 +714,57 @@ static void ms_set_trace(void *ptr, gc_trace_func trace)
 static void ms_set_tag(void *ptr, unsigned char tag)
 {
     if (!ptr) return;
-    GcHeader *header = gc_header_for(ptr);
-    header->tag = tag;
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) {
+        large->tag = tag;
+    } else {
+        gc_header_for(ptr)->tag = tag;
+    }
+    // The background sweeper appends to the heap channel too.
+    ms_lock();
+    gc_event_retag(ptr, tag);
+    ms_unlock();
 }
 
 static void *ms_mark_ptr(void *ptr)
 {
     if (!ptr) return NULL;
+    if (GC_IS_IMMEDIATE(ptr)) return ptr;
     GcHeader *header = gc_find_header(ptr);
-    if (!header) return NULL;
-    if (!header->marked)
+    if (!header) {
+        GcLargeObject *large = gc_los_find(ptr);
+        if (large && gc_mark_claim(&large->marked) && large->trace) {
+            gc_mark_push(&MS->mark_stack, ptr, large->trace);
+        }
+        return ptr; // Otherwise not managed by this heap (static/interned values)
+    }
+    if (gc_mark_claim(&header->marked))
     {
-        header->marked = 1;
-        if (header->trace) header->trace(ptr);
+        if (header->trace) gc_mark_push(&MS->mark_stack, ptr, header->trace);
     }
     return ptr;
 }
 
+// Trace everything reachable from the pushed objects, on GC_THREADS
+// workers when configured. After an overflow, walk the object list and
+// re-trace marked objects so children that never made it onto the stack are
+// still reached.
+static void ms_drain_mark_stack(void)
+{
+    gc_parallel_mark_drain(&MS->mark_stack);
+    while (MS->mark_stack.overflowed) {
+        MS->mark_stack.overflowed = 0;
+        for (GcHeader *obj = ms_next_object(NULL); obj; obj = ms_next_object(obj)) {
+            if (obj->marked && obj->trace) {
+                obj->trace(obj + 1);
+                if (MS->mark_stack.top > GC_MARK_STACK_CAPACITY / 2) gc_parallel_mark_drain(&MS->mark_stack);
+            }
+        }
+        gc_los_trace_marked();
+        gc_parallel_mark_drain(&MS->mark_stack);
+    }
+}
+
 static void ms_add_root(void **slot)
 {
     if (!slot) return;
@@ -382,10 +773,10 @@ static void ms_add_root(void **slot)
     root_hash_find(slot, &found);
     if (found) return;
 
-    gc_roots_reserve(gc_root_count + 1);
-    gc_roots[gc_root_count].slot = slot;
-    root_hash_insert(slot, gc_root_count);
-    gc_root_count++;
+    gc_roots_reserve(MS->root_count + 1);
+    MS->roots[MS->root_count].slot = slot;
+    root_hash_insert(slot, MS->root_count);
+    MS->root_count++;
 }
 
 static void ms_remove_root(void **slot)
@@ -400,139 +791,321 @@ static void ms_remove_root(void **slot)
     root_hash_delete(slot);
 
     // Swap with last element in array
-    size_t last_index = gc_root_count - 1;
+    size_t last_index = MS->root_count - 1;
     if (index != last_index) {
-        GcRoot last = gc_roots[last_index];
-        gc_roots[index] = last;
+        GcRoot last = MS->roots[last_index];
+        MS->roots[index] = last;
         
         // Update index of moved element in hash
         root_hash_insert(last.slot, index); // This updates the existing entry
     }
     
-    gc_root_count--;
+    MS->root_count--;
 }
 
-static void gc_mark_roots(void)
+static void ms_push_roots(void)
 {
-    for (size_t i = 0; i < gc_root_count; ++i) {
-        void *ptr = *(gc_roots[i].slot);
+    for (size_t i = 0; i < MS->root_count; ++i) {
+        void *ptr = *(MS->roots[i].slot);
         if (ptr) ms_mark_ptr(ptr);
     }
+    const GcRootRange *ranges = gc_root_ranges();
+    for (size_t r = 0; r < gc_root_range_count(); ++r) {
+        size_t count = *ranges[r].count;
+        for (size_t i = 0; i < count; ++i) {
+            void *ptr = ranges[r].base[i];
+            if (ptr) ms_mark_ptr(ptr);
+        }
+    }
 }
 
-static void gc_sweep(void)
+static void gc_mark_roots(void)
 {
-    GcHeader *obj = gc_objects;
-    size_t scanned = 0;
-    size_t survived = 0;
-    
-    while (obj)
+    ms_push_roots();
+    ms_drain_mark_stack();
+}
+
+// Lazy sweeping ---------------------------------------------------------------
+//
+// A collection ends once marking is done. The heap is then swept one
+// SWEEP_PAGE_BYTES page at a time, in address order, when the allocator runs
+// out of free blocks (or by the background sweeper). Blocks handed out at or
+// past the sweep cursor start out marked so the sweeper keeps them.
+
+static void ms_sweep_object(GcHeader *obj)
+{
+    MS->sweep_scanned++;
+    if (!obj->marked)
     {
-        GcHeader *next = obj->next;
-        scanned++;
-        if (!obj->marked)
-        {
-            // Unlink from object list
-            if (obj->prev) obj->prev->next = obj->next;
-            else gc_objects = obj->next;
-            if (obj->next) obj->next->prev = obj->prev;
-
-            // Update stats
-            internal_stats.freed_bytes += obj->size;
-            internal_stats.current_bytes -= obj->size;
-            internal_stats.wasted_bytes -= (obj->block_size - obj->size);
-            
-            // Return to free list
-            ms_heap_free(obj, obj->block_size);
-        }
-        else
-        {
-            obj->marked = 0;
-            survived++;
-        }
-        obj = next;
+        gc_event_free(obj + 1);
+        gc_object_map_clear(&MS->object_map, obj);
+        MS->live_object_count--;
+
+        // Update stats
+        MS->bytes_allocated -= obj->size;
+        MS->stats.freed_bytes += obj->size;
+        MS->stats.current_bytes -= obj->size;
+        MS->stats.wasted_bytes -= (obj->block_size - obj->size);
+        
+        // Return to free list
+        ms_heap_free(obj, obj->block_size);
     }
-    internal_stats.objects_scanned += scanned;
-    if (scanned > 0) {
-        internal_stats.survival_rate = (double)survived / (double)scanned;
+    else
+    {
+        obj->marked = 0;
+        MS->sweep_survived++;
     }
 }
 
+// Blocks in use, headers included; large objects are not part of the heap.
+static size_t ms_heap_in_use(void)
+{
+    return MS->stats.current_bytes - gc_los_bytes() + MS->stats.wasted_bytes;
+}
+
+// Once a sweep has left less than a third of the largest occupancy seen since
+// the last trim, give the pages of large free blocks back to the OS.
+// Size-class blocks are coalesced first so freed small objects form such
+// blocks; as much free memory as is live stays resident.
+static void ms_trim_heap(void)
+{
+    size_t live = ms_heap_in_use();
+    if (MS->trim_peak < live || MS->trim_peak - live < 2 * live || MS->trim_peak - live < 4 * GC_TRIM_MIN_BYTES) return;
+    MS->trim_peak = live;
+    ms_update_threshold(); // a stale threshold would fault the pages back in
+    ms_release_size_classes();
+    size_t keep = live;
+    for (FreeHeader *block = MS->free_list; block; block = block->next) {
+        gc_trim_block(&keep, block + 1, block->size - sizeof(FreeHeader));
+    }
+}
+
+static void ms_end_sweep(void)
+{
+    MS->sweeping = 0;
+    ms_trim_heap();
+    MS->stats.objects_scanned += MS->sweep_scanned;
+    if (MS->sweep_scanned > 0) {
+        MS->stats.survival_rate = (double)MS->sweep_survived / (double)MS->sweep_scanned;
+    }
+    
+    // Update metadata bytes
+    MS->stats.metadata_bytes = MS->live_object_count * sizeof(GcHeader) +
+                                    MS->object_map.words * sizeof(uint64_t);
+    if (MS->sweep_sets_threshold) ms_update_threshold();
+}
+
+static void ms_sweep_page(void)
+{
+    uint8_t *end = MS->sweep_cursor + SWEEP_PAGE_BYTES;
+    if (end > MS->heap_end) end = MS->heap_end;
+    for (GcHeader *obj = (GcHeader*)gc_object_map_find_before(&MS->object_map, MS->sweep_cursor, end);
+         obj;
+         obj = (GcHeader*)gc_object_map_find_before(&MS->object_map, (uint8_t*)obj + GC_OBJECT_MAP_GRANULE, end)) {
+        ms_sweep_object(obj);
+    }
+    MS->sweep_cursor = end;
+    if (MS->sweep_cursor >= MS->heap_end) ms_end_sweep();
+}
+
+static void ms_finish_sweep(void)
+{
+    while (MS->sweeping) ms_sweep_page();
+}
+
+// Nothing moves, so a weak root survives exactly when it was marked.
+static void *ms_weak_resolve(void *ptr)
+{
+    GcHeader *header = gc_find_header(ptr);
+    if (header) return header->marked ? ptr : NULL;
+    GcLargeObject *large = gc_los_find(ptr);
+    if (large) return large->marked ? ptr : NULL;
+    return ptr;
+}
+
+// Marking is complete: hand the heap to the lazy sweeper. The next trigger
+// point is only known once sweeping has dropped the dead bytes.
+static void ms_begin_sweep(int update_threshold)
+{
+    gc_weak_roots_update(ms_weak_resolve);
+    // Large objects are swept right away; unmapping a dead one is cheap.
+    size_t freed = gc_los_sweep(&MS->stats.objects_scanned, NULL);
+    MS->bytes_allocated -= freed;
+    MS->stats.freed_bytes += freed;
+    MS->stats.current_bytes -= freed;
+    if (ms_heap_in_use() > MS->trim_peak) MS->trim_peak = ms_heap_in_use();
+
+    MS->sweep_cursor = MS->heap_start;
+    MS->sweep_scanned = 0;
+    MS->sweep_survived = 0;
+    MS->sweep_sets_threshold = update_threshold;
+    MS->sweeping = 1;
+    ms_wake_sweeper();
+}
+
+// Snapshot-at-the-beginning: while marking, the reference about to be
+// overwritten is marked so it cannot be hidden from the marker.
 static void ms_write_barrier(void *owner, void **slot, void *child)
 {
-    (void)owner; (void)slot; (void)child;
+    (void)owner; (void)child;
+    if (MS->marking && slot) ms_mark_ptr(*slot);
 }
 
-static void ms_collect(void)
+static void ms_record_pause(const GcTraceSpan *span)
+{
+    double end_time = gc_get_time_ms();
+    double elapsed = end_time - span->start_ms;
+    gc_trace_end(span, end_time, &MS->stats);
+    gc_note_pause(elapsed);
+    MS->pause_count++;
+    MS->stats.last_gc_pause_ms = elapsed;
+    MS->stats.total_gc_time_ms += elapsed;
+    if (elapsed > MS->stats.max_gc_pause_ms) MS->stats.max_gc_pause_ms = elapsed;
+    MS->stats.avg_gc_pause_ms = MS->stats.total_gc_time_ms / MS->pause_count;
+}
+
+// Pick the next automatic trigger point after a threshold-driven collection.
+static void ms_update_threshold(void)
+{
+    // Adjust threshold but keep within heap bounds logic
+    size_t next = (size_t)(MS->bytes_allocated * GC_GROWTH_FACTOR);
+    if (next > MS->heap_size) next = MS->heap_size;
+    MS->next_threshold = next;
+}
+
+static void ms_start_cycle(void)
 {
-    if (!gc_initialized || gc_collecting) return;
-    gc_collecting = 1;
+    MS->collecting = 1;
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_MARK_SLICE, gc_get_time_ms(), &MS->stats);
     
-    double start_time = gc_get_time_ms();
+    ms_finish_sweep();
+    MS->stats.collections++;
+    MS->slice_budget_ms = gc_get_pause_budget_ms();
+    ms_push_roots();
+    MS->marking = 1;
+    gc_incremental_marking = 1;
+    MS->next_slice_at = MS->stats.allocated_bytes + MARK_SLICE_BYTES;
     
-    internal_stats.collections++;
-    gc_mark_roots();
-    gc_sweep();
+    ms_record_pause(&span);
+    MS->collecting = 0;
+}
+
+// Mark until the stack is empty or the budget is spent. Any overflow rescan
+// runs as part of the final slice.
+static void ms_mark_slice(void)
+{
+    MS->collecting = 1;
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_MARK_SLICE, gc_get_time_ms(), &MS->stats);
     
-    // Update metadata bytes
-    size_t live_objects = 0;
-    for (GcHeader *obj = gc_objects; obj; obj = obj->next) live_objects++;
-    internal_stats.metadata_bytes = live_objects * sizeof(GcHeader);
+    int done = gc_mark_stack_drain_until(&MS->mark_stack, span.start_ms + MS->slice_budget_ms);
+    if (done) {
+        ms_drain_mark_stack();
+        MS->marking = 0;
+        gc_incremental_marking = 0;
+        ms_begin_sweep(1);
+    }
+    MS->next_slice_at = MS->stats.allocated_bytes + MARK_SLICE_BYTES;
+    
+    ms_record_pause(&span);
+    MS->collecting = 0;
+}
+
+// Collect now; an incremental cycle in progress is run to completion.
+// `update_threshold` is set when the collection was threshold-driven.
+static void ms_collect_now(int update_threshold)
+{
+    if (!MS->initialized || MS->collecting) return;
+    MS->collecting = 1;
+    
+    GcTraceSpan span;
+    gc_trace_begin(&span, GC_TRACE_COLLECT, gc_get_time_ms(), &MS->stats);
     
-    double elapsed = gc_get_time_ms() - start_time;
-    internal_stats.last_gc_pause_ms = elapsed;
-    internal_stats.total_gc_time_ms += elapsed;
-    if (elapsed > internal_stats.max_gc_pause_ms) internal_stats.max_gc_pause_ms = elapsed;
-    internal_stats.avg_gc_pause_ms = internal_stats.total_gc_time_ms / internal_stats.collections;
+    if (MS->marking) {
+        // The cycle was started by the threshold; finish it like a slice would.
+        ms_drain_mark_stack();
+        MS->marking = 0;
+        gc_incremental_marking = 0;
+        ms_begin_sweep(1);
+    } else {
+        ms_finish_sweep();
+        MS->stats.collections++;
+        gc_mark_roots();
+        ms_begin_sweep(update_threshold);
+    }
     
-    gc_collecting = 0;
+    ms_record_pause(&span);
+    MS->collecting = 0;
+}
+
+static void ms_collect(void)
+{
+    ms_lock();
+    ms_take_size_classes();
+    ms_collect_now(0);
+    ms_unlock();
 }
 
 static void ms_free(void *ptr)
 {
     if (!ptr) return;
-    GcHeader *header = gc_header_for(ptr);
-    
-    if (header->prev) header->prev->next = header->next;
-    else gc_objects = header->next;
-    if (header->next) header->next->prev = header->prev;
+    ms_lock();
+    ms_take_size_classes();
+    GcHeader *header = gc_find_header(ptr);
+    if (!header) {
+        GcLargeObject *large = gc_los_find(ptr);
+        if (large) {
+            MS->bytes_allocated -= large->size;
+            MS->stats.freed_bytes += large->size;
+            MS->stats.current_bytes -= large->size;
+            gc_los_free(large);
+        }
+        ms_unlock();
+        return;
+    }
+    gc_event_free(ptr);
+    gc_object_map_clear(&MS->object_map, header);
+    MS->live_object_count--;
 
-    internal_stats.freed_bytes += header->size;
-    internal_stats.current_bytes -= header->size;
-    internal_stats.wasted_bytes -= (header->block_size - header->size);
+    MS->bytes_allocated -= header->size;
+    MS->stats.freed_bytes += header->size;
+    MS->stats.current_bytes -= header->size;
+    MS->stats.wasted_bytes -= (header->block_size - header->size);
     
     ms_heap_free(header, header->block_size);
+    ms_unlock();
 }
 
 static void ms_set_threshold(size_t bytes)
 {
     if (bytes < 1024) bytes = 1024;
-    gc_next_threshold = bytes;
+    MS->next_threshold = bytes;
 }
 
 static size_t ms_get_threshold(void)
 {
-    return gc_next_threshold;
+    return MS->next_threshold;
 }
 
 static void ms_get_stats(GcStats *out_stats)
 {
     if (out_stats)
     {
-        *out_stats = internal_stats;
+        ms_lock();
+        ms_take_size_classes();
+        *out_stats = MS->stats;
         
         // Internal Fragmentation
-        size_t total_allocated = internal_stats.current_bytes + internal_stats.wasted_bytes;
+        size_t total_allocated = MS->stats.current_bytes + MS->stats.wasted_bytes;
         if (total_allocated > 0) {
-            out_stats->internal_fragmentation_ratio = (double)internal_stats.wasted_bytes / (double)total_allocated;
+            out_stats->internal_fragmentation_ratio = (double)MS->stats.wasted_bytes / (double)total_allocated;
         } else {
             out_stats->internal_fragmentation_ratio = 0.0;
         }
         
-        size_t live_objects = 0;
-        for (GcHeader *obj = gc_objects; obj; obj = obj->next) live_objects++;
-        if (live_objects > 0) {
-            out_stats->average_padding_per_object = (double)internal_stats.wasted_bytes / (double)live_objects;
+        if (MS->live_object_count > 0) {
+            out_stats->average_padding_per_object = (double)MS->stats.wasted_bytes / (double)MS->live_object_count;
         } else {
             out_stats->average_padding_per_object = 0.0;
         }
@@ -542,12 +1115,20 @@ static void ms_get_stats(GcStats *out_stats)
         size_t total_free = 0;
         size_t free_blocks = 0;
         
-        FreeHeader *curr = free_list;
-        while (curr) {
-            total_free += curr->size;
-            if (curr->size > largest_free) largest_free = curr->size;
-            free_blocks++;
-            curr = curr->next;
+        for (size_t cls = 0; cls <= SIZE_CLASS_COUNT + 1; ++cls) {
+            FreeHeader *curr = cls <= SIZE_CLASS_COUNT ? size_class_free[cls] : MS->free_list;
+            while (curr) {
+                total_free += curr->size;
+                if (curr->size > largest_free) largest_free = curr->size;
+                free_blocks++;
+                curr = curr->next;
+            }
+            if (cls <= SIZE_CLASS_COUNT && size_class_cursor[cls] != size_class_limit[cls]) {
+                size_t rest = (size_t)(size_class_limit[cls] - size_class_cursor[cls]);
+                total_free += rest;
+                if (rest > largest_free) largest_free = rest;
+                free_blocks++;
+            }
         }
         
         out_stats->largest_free_block = largest_free;
@@ -567,34 +1148,47 @@ static void ms_get_stats(GcStats *out_stats)
         }
         
         // Track peak fragmentation
-        if (out_stats->fragmentation_index > internal_stats.peak_fragmentation_index) {
-            internal_stats.peak_fragmentation_index = out_stats->fragmentation_index;
+        if (out_stats->fragmentation_index > MS->stats.peak_fragmentation_index) {
+            MS->stats.peak_fragmentation_index = out_stats->fragmentation_index;
         }
-        out_stats->peak_fragmentation_index = internal_stats.peak_fragmentation_index;
+        out_stats->peak_fragmentation_index = MS->stats.peak_fragmentation_index;
+        ms_unlock();
     }
 }
 
-static double ms_get_collections_count(void) { return (double)internal_stats.collections; }
-static double ms_get_allocated_bytes(void) { return (double)internal_stats.allocated_bytes; }
-static double ms_get_freed_bytes(void) { return (double)internal_stats.freed_bytes; }
-static double ms_get_current_bytes(void) { return (double)internal_stats.current_bytes; }
+static double ms_get_collections_count(void) { return (double)MS->stats.collections; }
+static double ms_get_allocated_bytes(void) { ms_take_size_classes(); return (double)MS->stats.allocated_bytes; }
+static double ms_get_freed_bytes(void) { return (double)MS->stats.freed_bytes; }
+static double ms_get_current_bytes(void) { ms_take_size_classes(); return (double)MS->stats.current_bytes; }
 
 static size_t ms_heap_snapshot(GcObjectInfo *out, size_t capacity)
 {
     size_t count = 0;
-    GcHeader *obj = gc_objects;
-    while (obj && count < capacity)
+    ms_lock();
+    for (GcHeader *obj = ms_next_object(NULL); obj && count < capacity; obj = ms_next_object(obj))
     {
+        // Unmarked objects the lazy sweeper has not reached yet are dead.
+        if (MS->sweeping && (uint8_t*)obj >= MS->sweep_cursor && !obj->marked) continue;
         out[count].addr = (uintptr_t)(obj + 1);
         out[count].size = obj->size;
         out[count].generation = GC_GEN_OLD;
         out[count].tag = obj->tag;
         count++;
-        obj = obj->next;
     }
+    count += gc_los_snapshot(out + count, capacity - count);
+    ms_unlock();
     return count;
 }
 
+static void ms_destroy(void)
+{
+    ms_stop_sweeper();
+    free(MS->heap_start);
+    free(MS->object_map.bits);
+    free(MS->roots);
+    free(MS->root_hash);
+}
+
 const GcBackend *gc_mark_sweep_backend(void)
 {
     static const GcBackend backend = {
@@ -615,6 +1209,11 @@ const GcBackend *gc_mark_sweep_backend(void)
         ms_get_allocated_bytes,
         ms_get_freed_bytes,
         ms_get_current_bytes,
-        ms_heap_snapshot};
+        ms_heap_snapshot,
+        ms_allocate_typed,
+        NULL,
+        ms_destroy,
+        sizeof(MarkSweepState),
+        "mark-sweep"};
     return &backend;
 }
@@ -0,0 +1,220 @@
+// parallel_mark.c - Work-stealing parallel marker shared by the marking backends
+#include "gc_backend.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local GcMarkStack *gc_mark_local_stack = NULL;
+
+#if defined(__EMSCRIPTEN__) || !(defined(__GNUC__) || defined(__clang__))
+
+size_t gc_mark_thread_count(void) { return 1; }
+void gc_mark_spill(GcMarkStack *local) { (void)local; }
+void gc_parallel_mark_drain(GcMarkStack *seed) { gc_mark_stack_drain(seed); }
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+
+#define GC_MAX_MARK_THREADS 64
+
+// `local` must stay first: gc_mark_spill gets the worker from its stack.
+typedef struct {
+    GcMarkStack local;
+    pthread_mutex_t lock;
+    GcMarkEntry *shared;  // entries [head, tail) are up for grabs
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    size_t available;     // tail - head, readable without the lock
+} MarkWorker;
+
+// One pool serves every heap. A drain holds pool_owner for its duration and
+// the workers enter pool_heap; a drain that finds the pool busy with another
+// heap marks on its own thread instead.
+static MarkWorker *workers = NULL;
+static size_t thread_count = 0;
+static pthread_once_t thread_count_once = PTHREAD_ONCE_INIT;
+static int pool_started = 0;
+static pthread_mutex_t pool_owner = PTHREAD_MUTEX_INITIALIZER;
+static GcHeap *pool_heap = NULL;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned long pool_epoch = 0;
+static size_t pool_finished = 0;
+static size_t idle_workers = 0;
+
+static void read_thread_count(void) {
+    const char *env = getenv("GC_THREADS");
+    long n = env ? atol(env) : 1;
+    if (n < 1) n = 1;
+    if (n > GC_MAX_MARK_THREADS) n = GC_MAX_MARK_THREADS;
+    thread_count = (size_t)n;
+}
+
+size_t gc_mark_thread_count(void) {
+    pthread_once(&thread_count_once, read_thread_count);
+    return thread_count;
+}
+
+// Caller holds w->lock.
+static void shared_append(MarkWorker *w, const GcMarkEntry *entries, size_t count) {
+    if (w->tail + count > w->capacity) {
+        size_t live = w->tail - w->head;
+        if (live) memmove(w->shared, w->shared + w->head, live * sizeof(GcMarkEntry));
+        w->head = 0;
+        w->tail = live;
+        if (live + count > w->capacity) {
+            size_t cap = w->capacity ? w->capacity : GC_MARK_STACK_CAPACITY;
+            while (cap < live + count) cap *= 2;
+            GcMarkEntry *grown = (GcMarkEntry*)realloc(w->shared, cap * sizeof(GcMarkEntry));
+            if (!grown) {
+                fprintf(stderr, "GC: failed to grow parallel mark deque\n");
+                exit(1);
+            }
+            w->shared = grown;
+            w->capacity = cap;
+        }
+    }
+    memcpy(w->shared + w->tail, entries, count * sizeof(GcMarkEntry));
+    w->tail += count;
+    __atomic_store_n(&w->available, w->tail - w->head, __ATOMIC_RELEASE);
+}
+
+void gc_mark_spill(GcMarkStack *local) {
+    MarkWorker *w = (MarkWorker*)local;
+    size_t half = local->top / 2;
+    pthread_mutex_lock(&w->lock);
+    shared_append(w, local->entries, half);
+    pthread_mutex_unlock(&w->lock);
+    memmove(local->entries, local->entries + half, (local->top - half) * sizeof(GcMarkEntry));
+    local->top -= half;
+}
+
+// Move work from `victim`'s deque into `thief`'s empty private stack: all of
+// it (up to half a stack) from its own deque, half of it from another's.
+static int take_work(MarkWorker *thief, MarkWorker *victim) {
+    if (__atomic_load_n(&victim->available, __ATOMIC_ACQUIRE) == 0) return 0;
+    pthread_mutex_lock(&victim->lock);
+    size_t available = victim->tail - victim->head;
+    size_t count = victim == thief ? available : (available + 1) / 2;
+    if (count > GC_MARK_STACK_CAPACITY / 2) count = GC_MARK_STACK_CAPACITY / 2;
+    memcpy(thief->local.entries, victim->shared + victim->head, count * sizeof(GcMarkEntry));
+    victim->head += count;
+    __atomic_store_n(&victim->available, victim->tail - victim->head, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&victim->lock);
+    thief->local.top = count;
+    return count > 0;
+}
+
+static int find_work(MarkWorker *w, size_t self) {
+    if (take_work(w, w)) return 1;
+    for (size_t i = 1; i < thread_count; ++i) {
+        if (take_work(w, &workers[(self + i) % thread_count])) return 1;
+    }
+    return 0;
+}
+
+static int any_shared_work(void) {
+    for (size_t i = 0; i < thread_count; ++i) {
+        if (__atomic_load_n(&workers[i].available, __ATOMIC_ACQUIRE)) return 1;
+    }
+    return 0;
+}
+
+// Mark until every worker is out of work. A worker only goes idle once its
+// own deque is empty and only the owner appends to a deque, so once all
+// workers are idle no work is left anywhere.
+static void run_worker(size_t self) {
+    MarkWorker *w = &workers[self];
+    gc_mark_local_stack = &w->local;
+    for (;;) {
+        gc_mark_stack_drain(&w->local);
+        if (find_work(w, self)) continue;
+        __atomic_add_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            if (__atomic_load_n(&idle_workers, __ATOMIC_SEQ_CST) == thread_count) {
+                gc_mark_local_stack = NULL;
+                return;
+            }
+            if (any_shared_work()) {
+                __atomic_sub_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    size_t self = (size_t)(uintptr_t)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (pool_epoch == seen) pthread_cond_wait(&pool_start, &pool_lock);
+        seen = pool_epoch;
+        gc_heap_enter(pool_heap);
+        pthread_mutex_unlock(&pool_lock);
+        run_worker(self);
+        gc_heap_enter(NULL);
+        pthread_mutex_lock(&pool_lock);
+        pool_finished++;
+        pthread_cond_signal(&pool_done);
+    }
+    return NULL;
+}
+
+// Start the helper threads; falls back to fewer threads if creation fails.
+static void start_pool(void) {
+    pool_started = 1;
+    workers = (MarkWorker*)calloc(thread_count, sizeof(MarkWorker));
+    if (!workers) {
+        thread_count = 1;
+        return;
+    }
+    for (size_t i = 0; i < thread_count; ++i) pthread_mutex_init(&workers[i].lock, NULL);
+    for (size_t i = 1; i < thread_count; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, (void*)(uintptr_t)i) != 0) {
+            thread_count = i;
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+void gc_parallel_mark_drain(GcMarkStack *seed) {
+    if (gc_mark_thread_count() <= 1 || pthread_mutex_trylock(&pool_owner) != 0) {
+        gc_mark_stack_drain(seed);
+        return;
+    }
+    if (!pool_started) start_pool();
+    if (thread_count <= 1) {
+        pthread_mutex_unlock(&pool_owner);
+        gc_mark_stack_drain(seed);
+        return;
+    }
+    // Deal the seeded roots out round-robin; stealing balances the rest.
+    for (size_t i = 0; i < seed->top; ++i) {
+        shared_append(&workers[i % thread_count], &seed->entries[i], 1);
+    }
+    seed->top = 0;
+    idle_workers = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    pool_heap = gc_heap;
+    pool_finished = 0;
+    pool_epoch++;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_lock);
+
+    run_worker(0);
+
+    pthread_mutex_lock(&pool_lock);
+    while (pool_finished < thread_count - 1) pthread_cond_wait(&pool_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+    pthread_mutex_unlock(&pool_owner);
+}
+
+#endif
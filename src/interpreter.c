@@ -1,4 +1,5 @@
 // interpreter.c - Minimal Lisp interpreter with list primitives, quoting, and simple runtime
+#define _DEFAULT_SOURCE // mmap under strict ISO C
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,13 +9,29 @@
 #include <stdarg.h>
 #include <setjmp.h>
 #include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <pthread.h>
+#define HAVE_MMAP_SOURCE 1
+#define HAVE_PROFILE_TIMER 1
+#define HAVE_WORKER_POOL 1
+#endif
 #include "gc.h"
-
-#define MAX_ARGS 64
+#include "minimalisp.h"
 
 typedef struct Value Value;
 typedef struct Env Env;
-typedef struct Binding Binding;
+typedef struct GlobalCell GlobalCell;
+typedef struct Node Node;
+typedef struct ParallelJob ParallelJob;
 typedef Value *(*BuiltinFunc)(Value **args, int argc, Env *env);
 
 typedef enum {
@@ -24,94 +41,344 @@ typedef enum {
     VAL_SYMBOL,
     VAL_STRING,
     VAL_BUILTIN,
-    VAL_LAMBDA
+    VAL_LAMBDA,
+    VAL_VECTOR,
+    VAL_HASHTABLE,
+    VAL_FUTURE
 } ValueType;
 
+// Every boxed value starts with this header and each type gets its own
+// right-sized layout below. Integers that fit in a pointer minus one bit are
+// not allocated at all: a fixnum is the integer shifted left with the low bit
+// set, which the collectors skip via GC_IS_IMMEDIATE. Only non-integral or
+// out-of-range numbers are boxed as flonums.
 struct Value {
     ValueType type;
-    double number;
-    char *symbol;
+};
+
+typedef struct {
+    Value hdr;
     Value *car;
     Value *cdr;
-    BuiltinFunc builtin;
+} Pair;
+
+typedef struct {
+    Value hdr;
+    double number;
+} Flonum;
+
+typedef struct {
+    Value hdr;
+    const char *name;   // stored inline after the struct
+} Symbol;
+
+typedef struct {
+    Value hdr;
+    size_t length;
+    char chars[];
+} String;
+
+typedef struct {
+    Value hdr;
+    BuiltinFunc fn;
+} Builtin;
+
+// Closures keep only their code and environment; the source parameters and
+// body used for printing and procedure-source live on the NODE_LAMBDA. The
+// anchor keeps the code's arena from being freed (see Compilation).
+typedef struct {
+    Value hdr;
+    Node *code;
     Env *env;
-    Value *params;
-    Value *body;
-};
+    Value *anchor;
+} Lambda;
 
-struct Binding {
-    const char *name;
+// Vectors hold their elements inline, so indexing is a single load and the
+// collectors trace one object instead of a chain of pairs.
+typedef struct {
+    Value hdr;
+    size_t length;
+    Value *items[];
+} Vector;
+
+#define MAX_VECTOR_LENGTH (SIZE_MAX / sizeof(Value*) / 4)
+
+// Hash tables probe linearly through a separate bucket vector of key/value
+// slot pairs, a power of two of them; a NULL key marks an empty bucket.
+// Keys that hash by address (heap objects compared by identity) are counted,
+// and a table holding any is rehashed in place on its first use after a
+// moving collection.
+typedef struct {
+    Value hdr;
+    int test;             // HASH_TEST_EQ or HASH_TEST_EQUAL
+    size_t count;
+    size_t address_keys;
+    size_t epoch;         // gc_move_epoch the bucket layout was built under
+    Value *buckets;
+} Hashtable;
+
+// A future runs its thunk on a worker runtime (see Parallel evaluation);
+// `job` is set until the first touch, which stores the value. A future
+// collected untouched has its job cancelled by the next future.
+typedef struct {
+    Value hdr;
+    ParallelJob *job;
+    Value *thunk;
     Value *value;
-    Binding *next;
-};
+    int resolved;
+} Future;
 
+#define FIXNUM_MIN (INTPTR_MIN >> 1)
+#define IS_FIXNUM(v) GC_IS_IMMEDIATE(v)
+#define MAKE_FIXNUM(n) ((Value*)(((uintptr_t)(intptr_t)(n) << 1) | 1u))
+#define FIXNUM_VALUE(v) ((intptr_t)(v) >> 1)
+
+#define VALUE_TYPE(v) (IS_FIXNUM(v) ? VAL_NUMBER : (v)->type)
+#define NUMBER_VALUE(v) (IS_FIXNUM(v) ? (double)FIXNUM_VALUE(v) : ((Flonum*)(v))->number)
+#define CAR(v) (((Pair*)(v))->car)
+#define CDR(v) (((Pair*)(v))->cdr)
+#define SYMBOL_NAME(v) (((Symbol*)(v))->name)
+#define STRING_CHARS(v) (((String*)(v))->chars)
+#define BUILTIN_FN(v) (((Builtin*)(v))->fn)
+#define LAMBDA_CODE(v) (((Lambda*)(v))->code)
+#define LAMBDA_ENV(v) (((Lambda*)(v))->env)
+#define LAMBDA_ANCHOR(v) (((Lambda*)(v))->anchor)
+#define VECTOR_LENGTH(v) (((Vector*)(v))->length)
+#define VECTOR_ITEMS(v) (((Vector*)(v))->items)
+
+// Local environments are single allocations holding one slot per parameter
+// and internal define of the lambda that created them; compiled code reaches
+// a variable by (depth, index) instead of searching by name.
 struct Env {
     Env *parent;
-    Binding *bindings;
+    int count;
+    Value *slots[];
+};
+
+// Top-level bindings live in a hashed table outside the GC heap. Each cell's
+// value slot is registered as a GC root, and compiled code holds the cell
+// directly so global references never search at run time.
+struct GlobalCell {
+    Value *name;
+    Value *value;   // NULL while unbound
 };
 
-static Value NIL_VALUE = {VAL_NIL, 0.0, NULL, NULL, NULL, NULL, NULL, NULL};
-static Value TRUE_VALUE = {VAL_SYMBOL, 0.0, "t", NULL, NULL, NULL, NULL, NULL};
+typedef struct {
+    GlobalCell **cells;
+    size_t capacity;
+    size_t count;
+} GlobalTable;
+
+// Compiled code tree produced from s-expressions before evaluation.
+typedef enum {
+    NODE_CONST,   // literal or quoted datum (value)
+    NODE_LOCAL,   // frame slot at (depth, index); value = symbol
+    NODE_GLOBAL,  // global cell; value = symbol
+    NODE_DEFINE_LOCAL,  // define into slot `index` of the current frame
+    NODE_DEFINE_GLOBAL, // define into `cell`; children[0] = initializer
+    NODE_LAMBDA,  // value/body = source params/body, names = frame slots, children[0] = code
+    NODE_IF,      // children = test, then, else
+    NODE_SEQ,     // children evaluated in order
+    NODE_CALL     // children[0] = operator, rest = arguments
+} NodeKind;
+
+struct Node {
+    NodeKind kind;
+    int count;
+    int depth;
+    int index;
+    int param_count;  // NODE_LAMBDA: leading names that are parameters
+    int frame_size;   // NODE_LAMBDA: parameters + internal defines
+    Value *value;
+    Value *body;
+    Value **names;
+    GlobalCell *cell;
+    Node **children;
+    struct CodeArena *arena;  // the arena holding this node
+};
+
+// Compile-time view of a lambda frame, used to resolve variable references.
+typedef struct Scope {
+    struct Scope *parent;
+    Value **names;
+    int count;
+} Scope;
+
+#define CODE_CHUNK_SIZE 4096
+
+typedef struct CodeChunk {
+    struct CodeChunk *next;
+    size_t used;
+    size_t capacity;
+    unsigned char data[];
+} CodeChunk;
+
+typedef struct CodeArena {
+    struct CodeArena *outer;
+    CodeChunk *chunks;
+    Value ***roots;
+    size_t root_count;
+    size_t root_capacity;
+    Value *anchor;   // held by every closure over this code; NULL until one exists
+} CodeArena;
+
+static Value NIL_VALUE = {VAL_NIL};
+static Symbol TRUE_VALUE = {{VAL_SYMBOL}, "t"};
 static Value *const NIL = &NIL_VALUE;
-static Value *const TRUE = &TRUE_VALUE;
+static Value *const TRUE = &TRUE_VALUE.hdr;
+
+// Symbols are interned: every distinct name maps to exactly one immortal
+// Value allocated outside the GC heap, so evaluator comparisons are pointer
+// equality and the collector never has to trace or move them.
+typedef struct {
+    Value **entries;
+    size_t capacity;
+    size_t count;
+} SymbolTable;
 
 // Simple token types
 enum {TOK_LPAREN, TOK_RPAREN, TOK_NUMBER, TOK_SYMBOL, TOK_QUOTE, TOK_STRING, TOK_EOF};
 
 typedef struct {
     int type;
-    char *text;
+    const char *text;       // into the source text; not NUL-terminated
+    size_t length;
+    size_t decoded_length;  // TOK_STRING: characters once escapes are decoded
 } Token;
 
-static const char *input_ptr;
-static Token cur_token;
-static jmp_buf *eval_jmp_env = NULL;
+typedef struct StrBuf {
+    char *data;
+    size_t length;
+    size_t capacity;
+    void (*sink)(const char *text, size_t length);  // NULL: keep everything
+} StrBuf;
+
+// Profiler call stack entries (see Profiling below).
+typedef struct {
+    GlobalCell *global;   // lambda's name; NULL for anonymous lambdas and builtins
+    BuiltinFunc builtin;
+} CallFrame;
+
+// Interned call stacks (see Profiling below).
+typedef struct {
+    size_t offset;        // first frame in frames, outermost first
+    uint32_t depth;
+    uint32_t hash;
+    size_t calls;         // evaluator profile: calls of a one-frame entry
+    double ms;            // evaluator profile: sampled time in this stack
+} StackEntry;
 
-static Env *global_env = NULL;
-static int runtime_initialized = 0;
+typedef struct {
+    CallFrame *frames;
+    size_t frames_count;
+    size_t frames_capacity;
+    StackEntry *entries;
+    size_t count;
+    size_t capacity;
+    uint32_t *index;      // entry id + 1, 0 = empty
+    size_t index_capacity; // power of two
+} StackTable;
 
 #define MAX_TEMP_ROOTS 65536
-static Value *temp_roots[MAX_TEMP_ROOTS];
-static int temp_root_sp = 0;
+
+// Everything one interpreter instance owns. Each thread runs the runtime it
+// has entered, on that runtime's own GC heap; threads that never enter one
+// get a default runtime of their own on first use.
+struct Runtime {
+    GcHeap *heap;
+    int initialized;
+    int library_loaded;
+    CodeArena *code_arena_top;
+    CodeArena *kept_arenas;      // popped arenas closures still use
+    double kept_arenas_checked;  // collection count when they were last checked
+    int owns_heap;
+    SymbolTable symbol_table;
+    Value *sym_quote;
+    Value *sym_define;
+    Value *sym_lambda;
+    Value *sym_if;
+    Value *sym_begin;
+    const char *input_ptr;
+    Token cur_token;
+    jmp_buf *eval_jmp_env;
+    GlobalTable globals;
+    int reader_tenured;
+    int eval_depth;              // eval_source nesting; only the outermost call is an eval boundary
+    CallFrame *call_stack;
+    size_t call_stack_depth;
+    size_t call_stack_capacity;
+    int call_stack_enabled;
+    StackTable alloc_sites;
+    StackTable eval_stacks;      // sampled stacks, weighted by entry ms
+    StackTable eval_functions;   // one-frame entries, counted by entry calls
+    int eval_profiling;
+    double eval_profile_last_ms;
+    unsigned eval_profile_countdown;
+    const char *alloc_profile_path;
+    const char *eval_profile_path;
+    StrBuf eval_output;
+    ParallelJob *futures;        // jobs of futures not yet touched
+    size_t future_count;         // length of futures
+    size_t futures_survived;     // future_count after the last check
+    double futures_checked;      // collection count when they were last checked
+    size_t temp_root_sp;
+    Value *temp_roots[MAX_TEMP_ROOTS];
+};
+
+static _Thread_local Runtime *rt = NULL;
+
+static void runtime_error(const char *fmt, ...);
 
 static void push_root(Value *v) {
-    if (temp_root_sp >= MAX_TEMP_ROOTS) {
-        fprintf(stderr, "Error: Stack overflow (temp roots)\n");
+    if (rt->temp_root_sp >= MAX_TEMP_ROOTS) {
+        // Unwinds to the enclosing eval_source, which resets the stack.
+        runtime_error("Stack overflow (temp roots)");
         exit(1);
     }
-    temp_roots[temp_root_sp++] = v;
+    rt->temp_roots[rt->temp_root_sp++] = v;
 }
 
 static void pop_root(void) {
-    if (temp_root_sp > 0) temp_root_sp--;
+    if (rt->temp_root_sp > 0) rt->temp_root_sp--;
 }
 
-static void runtime_error(const char *fmt, ...);
 static void print_value(Value *value);
-static void print_pair(Value *value);
 static void trace_value(void *obj);
 static void trace_env(void *obj);
-static void trace_binding(void *obj);
-static char *gc_alloc_buffer(size_t size);
-static char *gc_copy_cstring(const char *text);
-static char *read_file(const char *path);
-static char *read_file_internal(const char *path, int warn_on_error);
+// The text of a source file, NUL-terminated. Where possible the file is
+// mapped instead of read, so the reader's token slices point straight into
+// the page cache; a file whose size is a whole number of pages has no zero
+// byte after it in the mapping and is read into memory instead.
+typedef struct {
+    char *text;
+    size_t size;
+    int mapped;
+} SourceFile;
+
+static int source_open(SourceFile *file, const char *path, int warn_on_error);
+static void source_close(SourceFile *file);
+static Value *eval_source_file(const SourceFile *file, int *out_error);
 static void load_standard_library(void);
+static int load_heap_image(void);
 static Value *builtin_load(Value **args, int argc, Env *env);
+static Value *builtin_pmap(Value **args, int argc, Env *env);
+static Value *builtin_future(Value **args, int argc, Env *env);
+static Value *builtin_touch(Value **args, int argc, Env *env);
+static void parallel_runtime_destroy(void);
 
 static int is_digit(char c) {
     return c >= '0' && c <= '9';
 }
 
 static void skip_whitespace(void) {
-    while (*input_ptr) {
-        if (*input_ptr == ' ' || *input_ptr == '\t' || *input_ptr == '\n' || *input_ptr == '\r') {
-            input_ptr++;
+    while (*rt->input_ptr) {
+        if (*rt->input_ptr == ' ' || *rt->input_ptr == '\t' || *rt->input_ptr == '\n' || *rt->input_ptr == '\r') {
+            rt->input_ptr++;
             continue;
         }
-        if (*input_ptr == ';') {
-            while (*input_ptr && *input_ptr != '\n' && *input_ptr != '\r') {
-                input_ptr++;
+        if (*rt->input_ptr == ';') {
+            while (*rt->input_ptr && *rt->input_ptr != '\n' && *rt->input_ptr != '\r') {
+                rt->input_ptr++;
             }
             continue;
         }
@@ -119,17 +386,22 @@ static void skip_whitespace(void) {
     }
 }
 
+// Tokens are slices of the source text, so reading copies nothing until
+// read_form builds the value.
 static Token next_token(void) {
     skip_whitespace();
     Token t;
-    if (!*input_ptr) { t.type = TOK_EOF; t.text = NULL; return t; }
-    char c = *input_ptr;
-    if (c == '(') { t.type = TOK_LPAREN; t.text = "("; input_ptr++; return t; }
-    if (c == ')') { t.type = TOK_RPAREN; t.text = ")"; input_ptr++; return t; }
-    if (c == '\'') { t.type = TOK_QUOTE; t.text = "'"; input_ptr++; return t; }
+    t.text = rt->input_ptr;
+    t.length = 1;
+    t.decoded_length = 0;
+    if (!*rt->input_ptr) { t.type = TOK_EOF; t.text = NULL; t.length = 0; return t; }
+    char c = *rt->input_ptr;
+    if (c == '(') { t.type = TOK_LPAREN; rt->input_ptr++; return t; }
+    if (c == ')') { t.type = TOK_RPAREN; rt->input_ptr++; return t; }
+    if (c == '\'') { t.type = TOK_QUOTE; rt->input_ptr++; return t; }
     if (c == '"') {
-        input_ptr++;
-        const char *scan = input_ptr;
+        // The slice excludes the quotes; escapes are decoded by read_form.
+        const char *scan = ++rt->input_ptr;
         size_t len = 0;
         int escaping = 0;
         int terminated = 0;
@@ -154,67 +426,36 @@ static Token next_token(void) {
             runtime_error("Unterminated string literal");
             t.type = TOK_EOF;
             t.text = NULL;
+            t.length = 0;
             return t;
         }
-        char *buf = gc_alloc_buffer(len + 1);
-        size_t idx = 0;
-        escaping = 0;
-        const char *copy = input_ptr;
-        while (*copy) {
-            char ch = *copy++;
-            if (escaping) {
-                switch (ch) {
-                    case 'n': buf[idx++] = '\n'; break;
-                    case 't': buf[idx++] = '\t'; break;
-                    case '\\': buf[idx++] = '\\'; break;
-                    case '"': buf[idx++] = '"'; break;
-                    default: buf[idx++] = ch; break;
-                }
-                escaping = 0;
-                continue;
-            }
-            if (ch == '\\') {
-                escaping = 1;
-                continue;
-            }
-            if (ch == '"') {
-                break;
-            }
-            buf[idx++] = ch;
-        }
-        buf[idx] = '\0';
-        input_ptr = copy;
         t.type = TOK_STRING;
-        t.text = buf;
+        t.text = rt->input_ptr;
+        t.length = (size_t)(scan - 1 - rt->input_ptr);
+        t.decoded_length = len;
+        rt->input_ptr = scan;
         return t;
     }
-    if (is_digit(c) || (c == '-' && is_digit(*(input_ptr + 1)))) {
-        const char *start = input_ptr;
-        input_ptr++;
-        while (is_digit(*input_ptr) || *input_ptr == '.') input_ptr++;
-        size_t len = input_ptr - start;
-        char *num = gc_alloc_buffer(len + 1);
-        memcpy(num, start, len);
-        num[len] = '\0';
-        t.type = TOK_NUMBER; t.text = num;
-        return t;
+    const char *start = rt->input_ptr;
+    if (is_digit(c) || (c == '-' && is_digit(*(rt->input_ptr + 1)))) {
+        rt->input_ptr++;
+        while (is_digit(*rt->input_ptr) || *rt->input_ptr == '.') rt->input_ptr++;
+        t.type = TOK_NUMBER;
+    } else {
+        while (*rt->input_ptr && *rt->input_ptr != ' ' && *rt->input_ptr != '\t' && *rt->input_ptr != '\n' && *rt->input_ptr != '(' && *rt->input_ptr != ')' && *rt->input_ptr != '\'') rt->input_ptr++;
+        t.type = TOK_SYMBOL;
     }
-    const char *start = input_ptr;
-    while (*input_ptr && *input_ptr != ' ' && *input_ptr != '\t' && *input_ptr != '\n' && *input_ptr != '(' && *input_ptr != ')' && *input_ptr != '\'') input_ptr++;
-    size_t len = input_ptr - start;
-    char *sym = gc_alloc_buffer(len + 1);
-    memcpy(sym, start, len);
-    sym[len] = '\0';
-    t.type = TOK_SYMBOL; t.text = sym;
+    t.length = (size_t)(rt->input_ptr - start);
     return t;
 }
 
 static void consume(int expected) {
-    if (cur_token.type != expected) {
-        runtime_error("Unexpected token: %s", cur_token.text ? cur_token.text : "EOF");
+    if (rt->cur_token.type != expected) {
+        if (rt->cur_token.text) runtime_error("Unexpected token: %.*s", (int)rt->cur_token.length, rt->cur_token.text);
+        else runtime_error("Unexpected token: EOF");
         return;
     }
-    cur_token = next_token();
+    rt->cur_token = next_token();
 }
 
 static void runtime_error(const char *fmt, ...) {
@@ -224,321 +465,566 @@ static void runtime_error(const char *fmt, ...) {
     vfprintf(stderr, fmt, args);
     va_end(args);
     fprintf(stderr, "\n");
-    if (eval_jmp_env) {
-        longjmp(*eval_jmp_env, 1);
+    if (rt->eval_jmp_env) {
+        longjmp(*rt->eval_jmp_env, 1);
     }
 }
 
-static char *gc_alloc_buffer(size_t size) {
-    char *buf = (char*)gc_allocate(size);
-    gc_set_trace(buf, NULL);
-    gc_set_tag(buf, GC_TAG_STRING);
-    return buf;
+// Allocate a boxed value of `size` bytes. Leaf types pass a NULL trace so the
+// collectors never visit them.
+static Value *alloc_value(ValueType type, size_t size, gc_trace_func trace, unsigned char tag) {
+    Value *v = (Value*)gc_allocate_fast(size, trace, tag);
+    v->type = type;
+    return v;
 }
 
-static char *gc_copy_cstring(const char *text) {
-    size_t len = strlen(text);
-    char *copy = gc_alloc_buffer(len + 1);
-    memcpy(copy, text, len + 1);
-    return copy;
+// The fixnum for `num`, or NULL when it has to be boxed.
+static Value *number_fixnum(double num) {
+    // FIXNUM_MIN is a power of two, so both bounds are exact as doubles.
+    if (num >= (double)FIXNUM_MIN && num < -(double)FIXNUM_MIN) {
+        intptr_t n = (intptr_t)num;
+        // -0.0 stays boxed so it keeps its sign.
+        if ((double)n == num && (n != 0 || !signbit(num))) return MAKE_FIXNUM(n);
+    }
+    return NULL;
 }
 
-static Value *alloc_value(ValueType type) {
-    Value *v = (Value*)gc_allocate(sizeof(Value));
-    gc_set_trace(v, trace_value);
-    v->type = type;
-    v->number = 0.0;
-    v->symbol = NULL;
-    v->car = NULL;
-    v->cdr = NULL;
-    v->builtin = NULL;
-    v->env = NULL;
-    v->params = NULL;
-    v->body = NULL;
+static Value *make_number(double num) {
+    Value *fixnum = number_fixnum(num);
+    if (fixnum) return fixnum;
+    Value *v = alloc_value(VAL_NUMBER, sizeof(Flonum), NULL, GC_TAG_VALUE_NUMBER);
+    ((Flonum*)v)->number = num;
     return v;
 }
 
-static Value *make_number(double num) {
-    Value *v = alloc_value(VAL_NUMBER);
-    gc_set_tag(v, GC_TAG_VALUE_NUMBER);
-    v->number = num;
-    return v;
+static size_t symbol_hash(const char *text, size_t len) {
+    // FNV-1a; symbol names are short so this stays cheap.
+    size_t h = (size_t)2166136261u;
+    for (const unsigned char *p = (const unsigned char*)text; len > 0; ++p, --len) {
+        h ^= *p;
+        h *= (size_t)16777619u;
+    }
+    return h;
 }
 
-static Value *make_symbol_copy(const char *text) {
-    Value *v = alloc_value(VAL_SYMBOL);
-    gc_set_tag(v, GC_TAG_VALUE_SYMBOL);
-    v->symbol = gc_copy_cstring(text);
-    return v;
+static void symbol_table_insert(Value *sym) {
+    size_t mask = rt->symbol_table.capacity - 1;
+    size_t h = symbol_hash(SYMBOL_NAME(sym), strlen(SYMBOL_NAME(sym))) & mask;
+    while (rt->symbol_table.entries[h]) h = (h + 1) & mask;
+    rt->symbol_table.entries[h] = sym;
+    rt->symbol_table.count++;
+}
+
+static void symbol_table_grow(void) {
+    Value **old_entries = rt->symbol_table.entries;
+    size_t old_capacity = rt->symbol_table.capacity;
+    rt->symbol_table.capacity = old_capacity ? old_capacity * 2 : 256;
+    rt->symbol_table.entries = (Value**)calloc(rt->symbol_table.capacity, sizeof(Value*));
+    if (!rt->symbol_table.entries) {
+        fprintf(stderr, "Out of memory while growing symbol table\n");
+        exit(1);
+    }
+    rt->symbol_table.count = 0;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_entries[i]) symbol_table_insert(old_entries[i]);
+    }
+    free(old_entries);
+}
+
+// Intern the `len` characters at `text`, which need not be NUL-terminated
+// (the reader passes slices of the source).
+static Value *intern_symbol_n(const char *text, size_t len) {
+    if ((rt->symbol_table.count + 1) * 2 > rt->symbol_table.capacity) symbol_table_grow();
+    size_t mask = rt->symbol_table.capacity - 1;
+    size_t h = symbol_hash(text, len) & mask;
+    while (rt->symbol_table.entries[h]) {
+        Value *sym = rt->symbol_table.entries[h];
+        const char *name = SYMBOL_NAME(sym);
+        if (strncmp(name, text, len) == 0 && name[len] == '\0') return sym;
+        h = (h + 1) & mask;
+    }
+    Symbol *sym = (Symbol*)malloc(sizeof(Symbol) + len + 1);
+    if (!sym) {
+        fprintf(stderr, "Out of memory while interning symbol\n");
+        exit(1);
+    }
+    char *name = (char*)(sym + 1);
+    memcpy(name, text, len);
+    name[len] = '\0';
+    sym->hdr.type = VAL_SYMBOL;
+    sym->name = name;
+    rt->symbol_table.entries[h] = &sym->hdr;
+    rt->symbol_table.count++;
+    return &sym->hdr;
 }
 
-static Value *make_string_copy(const char *text) {
-    Value *v = alloc_value(VAL_STRING);
-    gc_set_tag(v, GC_TAG_VALUE_STRING);
-    v->symbol = gc_copy_cstring(text);
+static Value *intern_symbol(const char *text) {
+    return intern_symbol_n(text, strlen(text));
+}
+
+static void init_symbols(void) {
+    if (rt->symbol_table.entries) return;
+    symbol_table_grow();
+    symbol_table_insert(TRUE);
+    rt->sym_quote = intern_symbol("quote");
+    rt->sym_define = intern_symbol("define");
+    rt->sym_lambda = intern_symbol("lambda");
+    rt->sym_if = intern_symbol("if");
+    rt->sym_begin = intern_symbol("begin");
+}
+
+// Strings keep their characters inline, so each is a single leaf object.
+// The caller fills in the `len` characters (the terminator is already set).
+static Value *make_string(size_t len) {
+    Value *v = alloc_value(VAL_STRING, sizeof(String) + len + 1, NULL, GC_TAG_VALUE_STRING);
+    ((String*)v)->length = len;
+    STRING_CHARS(v)[len] = '\0';
     return v;
 }
 
 static Value *make_pair(Value *car, Value *cdr) {
-    Value *v = alloc_value(VAL_PAIR);
-    gc_set_tag(v, GC_TAG_VALUE_PAIR);
-    v->car = car;
-    v->cdr = cdr;
+    // Moving collectors may relocate car/cdr during the allocation.
+    push_root(car);
+    push_root(cdr);
+    Value *v = alloc_value(VAL_PAIR, sizeof(Pair), trace_value, GC_TAG_VALUE_PAIR);
+    CAR(v) = rt->temp_roots[rt->temp_root_sp - 2];
+    CDR(v) = rt->temp_roots[rt->temp_root_sp - 1];
+    rt->temp_root_sp -= 2;
     return v;
 }
 
 static Value *make_builtin(BuiltinFunc fn) {
-    Value *v = alloc_value(VAL_BUILTIN);
-    gc_set_tag(v, GC_TAG_VALUE_BUILTIN);
-    v->builtin = fn;
+    Value *v = alloc_value(VAL_BUILTIN, sizeof(Builtin), NULL, GC_TAG_VALUE_BUILTIN);
+    BUILTIN_FN(v) = fn;
     return v;
 }
 
-static Value *make_lambda(Value *params, Value *body, Env *env) {
-    Value *v = alloc_value(VAL_LAMBDA);
-    gc_set_tag(v, GC_TAG_VALUE_LAMBDA);
-    v->params = params;
-    v->body = body;
-    v->env = env;
+static Value *code_arena_anchor(CodeArena *arena);
+
+// Build a closure for a compiled lambda node, keeping `env` rooted (and up to
+// date) across the allocation.
+static Value *make_lambda(Node *lambda, Env *env) {
+    push_root((Value*)env);
+    code_arena_anchor(lambda->arena);
+    Value *v = alloc_value(VAL_LAMBDA, sizeof(Lambda), trace_value, GC_TAG_VALUE_LAMBDA);
+    LAMBDA_CODE(v) = lambda;
+    LAMBDA_ENV(v) = (Env*)rt->temp_roots[rt->temp_root_sp - 1];
+    LAMBDA_ANCHOR(v) = lambda->arena->anchor;
+    pop_root();
     return v;
 }
 
 static int is_nil(Value *value) {
-    return value == NULL || value->type == VAL_NIL;
+    return value == NULL || value == NIL;
 }
 
 static int is_truthy(Value *value) {
     return !is_nil(value);
 }
 
-static Env *env_new(Env *parent) {
-    Env *env = (Env*)gc_allocate(sizeof(Env));
-    gc_set_trace(env, trace_env);
-    gc_set_tag(env, GC_TAG_ENV);
-    env->parent = parent;
-    env->bindings = NULL;
+static int is_pair(Value *value) {
+    return value && VALUE_TYPE(value) == VAL_PAIR;
+}
+
+static Env *env_new(int count, Env *parent) {
+    // Keep the parent reachable (and up to date) across the allocation.
+    push_root((Value*)parent);
+    Env *env = (Env*)gc_allocate_fast(sizeof(Env) + sizeof(Value*) * (size_t)count,
+                                      trace_env, GC_TAG_ENV);
+    env->parent = (Env*)rt->temp_roots[rt->temp_root_sp - 1];
+    env->count = count;
+    pop_root();
     return env;
 }
 
-static void binding_set_value(Binding *binding, Value *value) {
-    gc_write_barrier(binding, (void**)&binding->value, value);
-    binding->value = value;
+// Stores into existing objects go through the card-marking barrier; stores
+// that initialize a freshly allocated object do not need it.
+static void env_set_slot(Env *env, int index, Value *value) {
+    gc_write_barrier_fast(env, (void**)&env->slots[index], value);
+    env->slots[index] = value;
 }
 
-static void binding_set_next(Binding *binding, Binding *next) {
-    gc_write_barrier(binding, (void**)&binding->next, next);
-    binding->next = next;
+static void pair_set_car(Value *pair, Value *value) {
+    gc_write_barrier_fast(pair, (void**)&CAR(pair), value);
+    CAR(pair) = value;
 }
 
-static void env_set_bindings(Env *env, Binding *bindings) {
-    gc_write_barrier(env, (void**)&env->bindings, bindings);
-    env->bindings = bindings;
+static void pair_set_cdr(Value *pair, Value *value) {
+    gc_write_barrier_fast(pair, (void**)&CDR(pair), value);
+    CDR(pair) = value;
 }
 
-static void append_to_buffer(char *buffer, size_t size, const char *text) {
-    size_t len = strlen(buffer);
-    if (len >= size - 1) return;
-    strncat(buffer, text, size - len - 1);
+// Output ----------------------------------------------------------------------
+//
+// Printed representations are built in a StrBuf, which tracks its length
+// and grows geometrically, so appends are amortized O(1) however large the
+// output gets. A buffer with a sink streams its contents there each time it
+// passes STRBUF_FLUSH_BYTES instead of ever holding the whole text.
+
+#define STRBUF_FLUSH_BYTES 65536
+
+static void sb_init(StrBuf *sb, void (*sink)(const char *text, size_t length)) {
+    sb->data = NULL;
+    sb->length = 0;
+    sb->capacity = 0;
+    sb->sink = sink;
 }
 
-static void append_char_to_buffer(char *buffer, size_t size, char ch) {
-    size_t len = strlen(buffer);
-    if (len + 1 >= size) return;
-    buffer[len] = ch;
-    buffer[len + 1] = '\0';
+static void sb_free(StrBuf *sb) {
+    free(sb->data);
+    sb_init(sb, sb->sink);
 }
 
-static void append_value_to_buffer(char *buffer, size_t size, Value *value);
+static void sb_reserve(StrBuf *sb, size_t extra) {
+    if (sb->length + extra < sb->capacity) return;
+    size_t capacity = sb->capacity ? sb->capacity : 256;
+    while (capacity <= sb->length + extra) capacity *= 2;
+    char *data = (char*)realloc(sb->data, capacity);
+    if (!data) {
+        fprintf(stderr, "Out of memory while printing\n");
+        exit(1);
+    }
+    sb->data = data;
+    sb->capacity = capacity;
+}
 
-static void append_pair_to_buffer(char *buffer, size_t size, Value *value) {
-    append_to_buffer(buffer, size, "(");
-    while (1) {
-        append_value_to_buffer(buffer, size, value->car);
-        if (value->cdr && value->cdr->type == VAL_PAIR) {
-            append_to_buffer(buffer, size, " ");
-            value = value->cdr;
-            continue;
-        }
-        if (value->cdr && value->cdr->type != VAL_NIL) {
-            append_to_buffer(buffer, size, " . ");
-            append_value_to_buffer(buffer, size, value->cdr);
-        }
-        break;
+// Hand everything buffered to the sink. A partial flush holds back a
+// trailing UTF-8 sequence so the sink never sees half a character.
+static void sb_flush_to_sink(StrBuf *sb, int partial) {
+    if (!sb->sink || sb->length == 0) return;
+    size_t cut = sb->length;
+    if (partial && ((unsigned char)sb->data[cut - 1] & 0x80)) {
+        while (cut > 0 && ((unsigned char)sb->data[cut - 1] & 0xC0) == 0x80) cut--;
+        if (cut > 0) cut--;
     }
-    append_to_buffer(buffer, size, ")");
+    if (cut == 0) return;
+    sb->sink(sb->data, cut);
+    memmove(sb->data, sb->data + cut, sb->length - cut);
+    sb->length -= cut;
+}
+
+static void sb_append_n(StrBuf *sb, const char *text, size_t length) {
+    sb_reserve(sb, length);
+    memcpy(sb->data + sb->length, text, length);
+    sb->length += length;
+    sb->data[sb->length] = '\0';
+    if (sb->length >= STRBUF_FLUSH_BYTES) sb_flush_to_sink(sb, 1);
+}
+
+static void sb_append(StrBuf *sb, const char *text) {
+    sb_append_n(sb, text, strlen(text));
+}
+
+static void sb_append_char(StrBuf *sb, char ch) {
+    sb_append_n(sb, &ch, 1);
+}
+
+// The NUL-terminated contents of a sink-less buffer.
+static const char *sb_text(StrBuf *sb) {
+    if (!sb->data) sb_append_n(sb, "", 0);
+    return sb->data;
 }
 
-static void append_value_to_buffer(char *buffer, size_t size, Value *value) {
-    if (!value || size == 0) return;
+static void sb_append_pair(StrBuf *sb, Value *value, int readably);
+
+// Append the printed form of `value`. With `readably` set strings are
+// quoted and escaped (print); otherwise their characters are copied (princ).
+static void sb_append_value(StrBuf *sb, Value *value, int readably) {
     char tmp[64];
-    switch (value->type) {
+    if (is_nil(value)) {
+        sb_append(sb, "()");
+        return;
+    }
+    switch (VALUE_TYPE(value)) {
         case VAL_NUMBER:
-            snprintf(tmp, sizeof(tmp), "%g", value->number);
-            append_to_buffer(buffer, size, tmp);
+            snprintf(tmp, sizeof(tmp), "%g", NUMBER_VALUE(value));
+            sb_append(sb, tmp);
             break;
         case VAL_SYMBOL:
-            append_to_buffer(buffer, size, value->symbol ? value->symbol : "#<symbol>");
+            sb_append(sb, SYMBOL_NAME(value));
             break;
-        case VAL_STRING:
-            append_char_to_buffer(buffer, size, '"');
-            if (value->symbol) {
-                for (const char *p = value->symbol; *p; ++p) {
-                    switch (*p) {
-                        case '\\':
-                            append_to_buffer(buffer, size, "\\\\");
-                            break;
-                        case '"':
-                            append_to_buffer(buffer, size, "\\\"");
-                            break;
-                        case '\n':
-                            append_to_buffer(buffer, size, "\\n");
-                            break;
-                        case '\t':
-                            append_to_buffer(buffer, size, "\\t");
-                            break;
-                        default:
-                            append_char_to_buffer(buffer, size, *p);
-                            break;
-                    }
+        case VAL_STRING: {
+            const char *chars = STRING_CHARS(value);
+            size_t length = ((String*)value)->length;
+            if (!readably) {
+                sb_append_n(sb, chars, length);
+                break;
+            }
+            sb_append_char(sb, '"');
+            size_t run = 0;   // characters copied in one append between escapes
+            for (size_t i = 0; i < length; ++i) {
+                const char *escape = NULL;
+                switch (chars[i]) {
+                    case '\\': escape = "\\\\"; break;
+                    case '"': escape = "\\\""; break;
+                    case '\n': escape = "\\n"; break;
+                    case '\t': escape = "\\t"; break;
+                    default: break;
                 }
+                if (!escape) continue;
+                sb_append_n(sb, chars + run, i - run);
+                sb_append(sb, escape);
+                run = i + 1;
             }
-            append_char_to_buffer(buffer, size, '"');
+            sb_append_n(sb, chars + run, length - run);
+            sb_append_char(sb, '"');
             break;
+        }
         case VAL_PAIR:
-            append_pair_to_buffer(buffer, size, value);
-            break;
-        case VAL_NIL:
-            append_to_buffer(buffer, size, "()");
+            sb_append_pair(sb, value, readably);
             break;
         case VAL_BUILTIN:
-            append_to_buffer(buffer, size, "#<builtin>");
+            sb_append(sb, "#<builtin>");
             break;
-        case VAL_LAMBDA:
-            append_to_buffer(buffer, size, "(lambda ");
-            append_value_to_buffer(buffer, size, value->params);
-            if (value->body && !is_nil(value->body)) {
-                append_to_buffer(buffer, size, " ");
-                Value *b = value->body;
-                while (b && b->type == VAL_PAIR) {
-                    append_value_to_buffer(buffer, size, b->car);
-                    b = b->cdr;
-                    if (b && !is_nil(b)) append_to_buffer(buffer, size, " ");
-                }
-                if (b && !is_nil(b)) {
-                    append_to_buffer(buffer, size, " . ");
-                    append_value_to_buffer(buffer, size, b);
-                }
+        case VAL_VECTOR:
+            sb_append(sb, "#(");
+            for (size_t i = 0; i < VECTOR_LENGTH(value); ++i) {
+                if (i > 0) sb_append_char(sb, ' ');
+                sb_append_value(sb, VECTOR_ITEMS(value)[i], readably);
+            }
+            sb_append_char(sb, ')');
+            break;
+        case VAL_HASHTABLE:
+            snprintf(tmp, sizeof(tmp), "#<hash-table %zu>", ((Hashtable*)value)->count);
+            sb_append(sb, tmp);
+            break;
+        case VAL_FUTURE:
+            sb_append(sb, "#<future>");
+            break;
+        case VAL_LAMBDA: {
+            sb_append(sb, "(lambda ");
+            sb_append_value(sb, LAMBDA_CODE(value)->value, readably);
+            Value *b = LAMBDA_CODE(value)->body;
+            for (; is_pair(b); b = CDR(b)) {
+                sb_append_char(sb, ' ');
+                sb_append_value(sb, CAR(b), readably);
             }
-            append_to_buffer(buffer, size, ")");
+            if (!is_nil(b)) {
+                sb_append(sb, " . ");
+                sb_append_value(sb, b, readably);
+            }
+            sb_append_char(sb, ')');
             break;
+        }
         default:
-            append_to_buffer(buffer, size, "#<unknown>");
+            sb_append(sb, "#<unknown>");
             break;
     }
 }
 
+static void sb_append_pair(StrBuf *sb, Value *value, int readably) {
+    sb_append_char(sb, '(');
+    for (;;) {
+        sb_append_value(sb, CAR(value), readably);
+        Value *rest = CDR(value);
+        if (is_pair(rest)) {
+            sb_append_char(sb, ' ');
+            value = rest;
+            continue;
+        }
+        if (!is_nil(rest)) {
+            sb_append(sb, " . ");
+            sb_append_value(sb, rest, readably);
+        }
+        break;
+    }
+    sb_append_char(sb, ')');
+}
+
+static void stdout_sink(const char *text, size_t length) {
+    fwrite(text, 1, length, stdout);
+}
+
 #ifdef __EMSCRIPTEN__
-static void wasm_emit_line(const char *line) {
-    EM_ASM({ Module.print(UTF8ToString($0)); }, line);
+// The web console takes whole lines, so partial text collects on the JS side
+// until the line ends.
+static void wasm_emit_text(const char *text, size_t length) {
+    EM_ASM({ Module.pendingLine = (Module.pendingLine || '') + UTF8ToString($0, $1); }, text, length);
+}
+
+static void wasm_emit_newline(void) {
+    EM_ASM({ Module.print(Module.pendingLine || ''); Module.pendingLine = ''; });
 }
 #else
-static void wasm_emit_line(const char *line) {
-    (void)line;
+static void wasm_emit_text(const char *text, size_t length) {
+    (void)text;
+    (void)length;
+}
+
+static void wasm_emit_newline(void) {
 }
 #endif
 
-static void emit_console_line(const char *line) {
-    printf("%s\n", line);
+// Sink for console lines: standard output plus the web console.
+static void console_sink(const char *text, size_t length) {
+    fwrite(text, 1, length, stdout);
+    wasm_emit_text(text, length);
+}
+
+// Flush the rest of `sb` to the console and end the line.
+static void emit_console_line(StrBuf *sb) {
+    sb_flush_to_sink(sb, 0);
+    fputc('\n', stdout);
     fflush(stdout);
-    wasm_emit_line(line);
+    wasm_emit_newline();
 }
 
-static void env_define(Env *env, const char *name, Value *value) {
-    Binding *b = env->bindings;
-    while (b) {
-        if (strcmp(b->name, name) == 0) {
-            binding_set_value(b, value);
-            return;
-        }
-        b = b->next;
-    }
-    Binding *binding = (Binding*)gc_allocate(sizeof(Binding));
-    gc_set_trace(binding, trace_binding);
-    gc_set_tag(binding, GC_TAG_BINDING);
-    binding->name = gc_copy_cstring(name);
-    binding_set_value(binding, value);
-    binding_set_next(binding, env->bindings);
-    env_set_bindings(env, binding);
+static GlobalCell *global_cell_slot(Value *name, size_t *out_index) {
+    size_t mask = rt->globals.capacity - 1;
+    size_t h = ((size_t)name >> 4) & mask;
+    while (rt->globals.cells[h] && rt->globals.cells[h]->name != name) h = (h + 1) & mask;
+    *out_index = h;
+    return rt->globals.cells[h];
 }
 
-static int env_set(Env *env, const char *name, Value *value) {
-    for (Env *e = env; e; e = e->parent) {
-        Binding *b = e->bindings;
-        while (b) {
-            if (strcmp(b->name, name) == 0) {
-                binding_set_value(b, value);
-                return 1;
-            }
-            b = b->next;
-        }
+static void global_table_grow(void) {
+    GlobalCell **old_cells = rt->globals.cells;
+    size_t old_capacity = rt->globals.capacity;
+    rt->globals.capacity = old_capacity ? old_capacity * 2 : 256;
+    rt->globals.cells = (GlobalCell**)calloc(rt->globals.capacity, sizeof(GlobalCell*));
+    if (!rt->globals.cells) {
+        fprintf(stderr, "Out of memory while growing global table\n");
+        exit(1);
     }
-    return 0;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (!old_cells[i]) continue;
+        size_t index;
+        global_cell_slot(old_cells[i]->name, &index);
+        rt->globals.cells[index] = old_cells[i];
+    }
+    free(old_cells);
 }
 
-static Value *env_lookup(Env *env, const char *name) {
-    for (Env *e = env; e; e = e->parent) {
-        Binding *b = e->bindings;
-        while (b) {
-            if (b->name && strcmp(b->name, name) == 0) {
-                return b->value;
-            }
-            b = b->next;
-        }
+// Find the global cell for `name`, creating an unbound one if needed.
+static GlobalCell *global_cell(Value *name) {
+    if ((rt->globals.count + 1) * 2 > rt->globals.capacity) global_table_grow();
+    size_t index;
+    GlobalCell *cell = global_cell_slot(name, &index);
+    if (cell) return cell;
+    cell = (GlobalCell*)malloc(sizeof(GlobalCell));
+    if (!cell) {
+        fprintf(stderr, "Out of memory while defining global\n");
+        exit(1);
     }
-    runtime_error("Undefined symbol: %s", name);
-    return NIL;
+    cell->name = name;
+    cell->value = NULL;
+    gc_add_root((void**)&cell->value);
+    rt->globals.cells[index] = cell;
+    rt->globals.count++;
+    return cell;
+}
+
+static void define_global(Value *name, Value *value) {
+    global_cell(name)->value = value;
 }
 
 static Value *read_form(void);
-static Value *eval_value(Value *expr, Env *env);
-static Value *eval_sequence(Value *exprs, Env *env);
+static Value *eval_value(Value *expr);
 static Value *eval_source(const char *src, int *out_error);
 
+// Forms read from files are mostly code and quoted data that live as long
+// as the program, so while one is read they are allocated straight into
+// the old generation (where the backend has one), skipping the nursery
+// copies they would otherwise survive.
+
+static Value *alloc_read_value(ValueType type, size_t size, gc_trace_func trace, unsigned char tag) {
+    if (!rt->reader_tenured) return alloc_value(type, size, trace, tag);
+    Value *v = (Value*)gc_allocate_old(size, trace, tag);
+    v->type = type;
+    return v;
+}
+
+static Value *read_number(double num) {
+    Value *fixnum = number_fixnum(num);
+    if (fixnum) return fixnum;
+    Value *v = alloc_read_value(VAL_NUMBER, sizeof(Flonum), NULL, GC_TAG_VALUE_NUMBER);
+    ((Flonum*)v)->number = num;
+    return v;
+}
+
+static Value *read_string(size_t len) {
+    Value *v = alloc_read_value(VAL_STRING, sizeof(String) + len + 1, NULL, GC_TAG_VALUE_STRING);
+    ((String*)v)->length = len;
+    STRING_CHARS(v)[len] = '\0';
+    return v;
+}
+
+static Value *read_pair(Value *car, Value *cdr) {
+    push_root(car);
+    push_root(cdr);
+    Value *v = alloc_read_value(VAL_PAIR, sizeof(Pair), trace_value, GC_TAG_VALUE_PAIR);
+    CAR(v) = rt->temp_roots[rt->temp_root_sp - 2];
+    CDR(v) = rt->temp_roots[rt->temp_root_sp - 1];
+    rt->temp_root_sp -= 2;
+    return v;
+}
+
+// The list head and last pair are kept on the temp root stack while the
+// remaining elements are allocated.
 static Value *read_list(void) {
-    Value *head = NIL;
-    Value **tail = &head;
-    while (cur_token.type != TOK_RPAREN && cur_token.type != TOK_EOF) {
+    size_t base = rt->temp_root_sp;
+    push_root(NIL);
+    push_root(NIL);
+    while (rt->cur_token.type != TOK_RPAREN && rt->cur_token.type != TOK_EOF) {
         Value *element = read_form();
-        Value *node = make_pair(element, NIL);
-        *tail = node;
-        tail = &node->cdr;
+        Value *node = read_pair(element, NIL);
+        Value *last = rt->temp_roots[base + 1];
+        if (last == NIL) {
+            rt->temp_roots[base] = node;
+        } else {
+            pair_set_cdr(last, node);
+        }
+        rt->temp_roots[base + 1] = node;
     }
     consume(TOK_RPAREN);
+    Value *head = rt->temp_roots[base];
+    rt->temp_root_sp = base;
     return head;
 }
 
 static Value *read_form(void) {
-    if (cur_token.type == TOK_NUMBER) {
-        double val = atof(cur_token.text);
+    if (rt->cur_token.type == TOK_NUMBER) {
+        char digits[64];
+        char *text = rt->cur_token.length < sizeof(digits) ? digits : (char*)malloc(rt->cur_token.length + 1);
+        if (!text) {
+            fprintf(stderr, "Out of memory while reading a number\n");
+            exit(1);
+        }
+        memcpy(text, rt->cur_token.text, rt->cur_token.length);
+        text[rt->cur_token.length] = '\0';
+        double val = atof(text);
+        if (text != digits) free(text);
         consume(TOK_NUMBER);
-        return make_number(val);
-    } else if (cur_token.type == TOK_SYMBOL) {
-        char *sym = cur_token.text;
+        return read_number(val);
+    } else if (rt->cur_token.type == TOK_SYMBOL) {
+        Value *sym = rt->cur_token.length == 3 && memcmp(rt->cur_token.text, "nil", 3) == 0
+            ? NIL : intern_symbol_n(rt->cur_token.text, rt->cur_token.length);
         consume(TOK_SYMBOL);
-        if (strcmp(sym, "nil") == 0) return NIL;
-        return make_symbol_copy(sym);
-    } else if (cur_token.type == TOK_STRING) {
-        char *str = cur_token.text;
+        return sym;
+    } else if (rt->cur_token.type == TOK_STRING) {
+        Value *str = read_string(rt->cur_token.decoded_length);
+        char *out = STRING_CHARS(str);
+        const char *end = rt->cur_token.text + rt->cur_token.length;
+        for (const char *p = rt->cur_token.text; p < end; ++p) {
+            if (*p != '\\') {
+                *out++ = *p;
+                continue;
+            }
+            switch (*++p) {
+                case 'n': *out++ = '\n'; break;
+                case 't': *out++ = '\t'; break;
+                default: *out++ = *p; break;
+            }
+        }
         consume(TOK_STRING);
-        return make_string_copy(str);
-    } else if (cur_token.type == TOK_LPAREN) {
+        return str;
+    } else if (rt->cur_token.type == TOK_LPAREN) {
         consume(TOK_LPAREN);
         return read_list();
-    } else if (cur_token.type == TOK_QUOTE) {
+    } else if (rt->cur_token.type == TOK_QUOTE) {
         consume(TOK_QUOTE);
         Value *inner = read_form();
-        Value *quote_sym = make_symbol_copy("quote");
-        return make_pair(quote_sym, make_pair(inner, NIL));
+        return read_pair(rt->sym_quote, read_pair(inner, NIL));
     } else {
         runtime_error("Unexpected token while reading");
         return NIL;
@@ -549,8 +1035,8 @@ static Value *builtin_add(Value **args, int argc, Env *env) {
     (void)env;
     double sum = 0;
     for (int i = 0; i < argc; ++i) {
-        if (!args[i] || args[i]->type != VAL_NUMBER) runtime_error("+ expects numbers");
-        sum += args[i]->number;
+        if (!args[i] || VALUE_TYPE(args[i]) != VAL_NUMBER) runtime_error("+ expects numbers");
+        sum += NUMBER_VALUE(args[i]);
     }
     return make_number(sum);
 }
@@ -558,14 +1044,14 @@ static Value *builtin_add(Value **args, int argc, Env *env) {
 static Value *builtin_sub(Value **args, int argc, Env *env) {
     (void)env;
     if (argc == 0) runtime_error("- expects at least one argument");
-    if (!args[0] || args[0]->type != VAL_NUMBER) runtime_error("- expects numbers");
-    double result = args[0]->number;
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_NUMBER) runtime_error("- expects numbers");
+    double result = NUMBER_VALUE(args[0]);
     if (argc == 1) {
         result = -result;
     } else {
         for (int i = 1; i < argc; ++i) {
-            if (!args[i] || args[i]->type != VAL_NUMBER) runtime_error("- expects numbers");
-            result -= args[i]->number;
+            if (!args[i] || VALUE_TYPE(args[i]) != VAL_NUMBER) runtime_error("- expects numbers");
+            result -= NUMBER_VALUE(args[i]);
         }
     }
     return make_number(result);
@@ -575,8 +1061,8 @@ static Value *builtin_mul(Value **args, int argc, Env *env) {
     (void)env;
     double product = 1;
     for (int i = 0; i < argc; ++i) {
-        if (!args[i] || args[i]->type != VAL_NUMBER) runtime_error("* expects numbers");
-        product *= args[i]->number;
+        if (!args[i] || VALUE_TYPE(args[i]) != VAL_NUMBER) runtime_error("* expects numbers");
+        product *= NUMBER_VALUE(args[i]);
     }
     return make_number(product);
 }
@@ -584,11 +1070,11 @@ static Value *builtin_mul(Value **args, int argc, Env *env) {
 static Value *builtin_div(Value **args, int argc, Env *env) {
     (void)env;
     if (argc == 0) runtime_error("/ expects at least one argument");
-    if (!args[0] || args[0]->type != VAL_NUMBER) runtime_error("/ expects numbers");
-    double result = args[0]->number;
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_NUMBER) runtime_error("/ expects numbers");
+    double result = NUMBER_VALUE(args[0]);
     for (int i = 1; i < argc; ++i) {
-        if (!args[i] || args[i]->type != VAL_NUMBER) runtime_error("/ expects numbers");
-        result /= args[i]->number;
+        if (!args[i] || VALUE_TYPE(args[i]) != VAL_NUMBER) runtime_error("/ expects numbers");
+        result /= NUMBER_VALUE(args[i]);
     }
     return make_number(result);
 }
@@ -598,6 +1084,8 @@ static Value *builtin_princ(Value **args, int argc, Env *env);
 static Value *builtin_cons(Value **args, int argc, Env *env);
 static Value *builtin_car(Value **args, int argc, Env *env);
 static Value *builtin_cdr(Value **args, int argc, Env *env);
+static Value *builtin_set_car(Value **args, int argc, Env *env);
+static Value *builtin_set_cdr(Value **args, int argc, Env *env);
 static Value *builtin_list(Value **args, int argc, Env *env);
 static Value *builtin_eq(Value **args, int argc, Env *env);
 static Value *builtin_lt(Value **args, int argc, Env *env);
@@ -607,86 +1095,101 @@ static Value *builtin_gte(Value **args, int argc, Env *env);
 static Value *builtin_gc(Value **args, int argc, Env *env);
 static Value *builtin_gc_threshold(Value **args, int argc, Env *env);
 static Value *builtin_gc_stats(Value **args, int argc, Env *env);
+static Value *builtin_gc_profile(Value **args, int argc, Env *env);
+static Value *builtin_gc_trace(Value **args, int argc, Env *env);
+static Value *builtin_profile(Value **args, int argc, Env *env);
 static Value *builtin_atom(Value **args, int argc, Env *env);
 static Value *builtin_format(Value **args, int argc, Env *env);
+static Value *apply_procedure(Value *fn, Value **args, int argc, Env *env);
 
-static void princ_emit_value(Value *value) {
-    if (!value) {
-        print_value(NIL);
-        return;
-    }
-    if (value->type == VAL_STRING) {
-        if (value->symbol) fputs(value->symbol, stdout);
-    } else {
-        print_value(value);
-    }
+// Only a top-level string is written raw; anything else prints as print does.
+static void princ_emit_value(StrBuf *sb, Value *value) {
+    sb_append_value(sb, value, value && VALUE_TYPE(value) != VAL_STRING);
 }
 
 static Value *builtin_print(Value **args, int argc, Env *env) {
     (void)env;
-    char line[512];
-    line[0] = '\0';
+    StrBuf line;
+    sb_init(&line, console_sink);
     for (int i = 0; i < argc; ++i) {
-        if (i) append_to_buffer(line, sizeof(line), " ");
-        append_value_to_buffer(line, sizeof(line), args[i]);
+        if (i) sb_append_char(&line, ' ');
+        sb_append_value(&line, args[i], 1);
     }
-    emit_console_line(line);
+    emit_console_line(&line);
+    sb_free(&line);
     return NIL;
 }
 
 static Value *builtin_princ(Value **args, int argc, Env *env) {
     (void)env;
     Value *result = NIL;
+    StrBuf out;
+    sb_init(&out, stdout_sink);
     for (int i = 0; i < argc; ++i) {
-        princ_emit_value(args[i]);
+        princ_emit_value(&out, args[i]);
         result = args[i] ? args[i] : NIL;
     }
+    sb_flush_to_sink(&out, 0);
+    sb_free(&out);
     fflush(stdout);
     return result;
 }
 
+// Drop buffered format output before reporting an error, so a malformed
+// control string prints nothing.
+static void format_error(StrBuf *out, const char *message) {
+    sb_free(out);
+    runtime_error("%s", message);
+}
+
 static Value *builtin_format(Value **args, int argc, Env *env) {
     (void)env;
     if (argc < 2) runtime_error("format expects a destination and control string");
     Value *dest = args[0];
     Value *control = args[1];
-    if (!control || control->type != VAL_STRING) runtime_error("format control must be a string");
-    if (!dest || dest->type != VAL_SYMBOL || !dest->symbol || strcmp(dest->symbol, "t") != 0) {
+    if (!control || VALUE_TYPE(control) != VAL_STRING) runtime_error("format control must be a string");
+    if (dest != TRUE) {
         runtime_error("format currently only supports destination t");
     }
-    const char *fmt = control->symbol ? control->symbol : "";
+    const char *fmt = STRING_CHARS(control);
     int arg_index = 2;
+    StrBuf out;
+    sb_init(&out, stdout_sink);
     for (const char *p = fmt; *p;) {
-        char ch = *p++;
-        if (ch != '~') {
-            fputc(ch, stdout);
-            continue;
-        }
-        if (!*p) runtime_error("format directive missing specifier");
+        // Copy the literal run up to the next directive in one append.
+        const char *tilde = strchr(p, '~');
+        size_t run = tilde ? (size_t)(tilde - p) : strlen(p);
+        sb_append_n(&out, p, run);
+        p += run;
+        if (!*p) break;
+        p++;
+        if (!*p) format_error(&out, "format directive missing specifier");
         char directive = *p++;
         if (directive == '%') {
-            fputc('\n', stdout);
+            sb_append_char(&out, '\n');
             continue;
         }
         if (directive == '~') {
-            fputc('~', stdout);
+            sb_append_char(&out, '~');
             continue;
         }
         if (directive == 'v') {
             if (!*p || !*(p + 1) || *p != '@' || *(p + 1) != 't') {
-                runtime_error("format only supports ~v@t");
+                format_error(&out, "format only supports ~v@t");
             }
             p += 2;
-            if (arg_index >= argc) runtime_error("format missing argument for ~v@t");
+            if (arg_index >= argc) format_error(&out, "format missing argument for ~v@t");
             Value *width_val = args[arg_index++];
-            if (!width_val || width_val->type != VAL_NUMBER) runtime_error("format ~v@t expects a number");
-            int width = (int)width_val->number;
-            if (width < 0) width = 0;
-            for (int i = 0; i < width; ++i) fputc(' ', stdout);
+            if (!width_val || VALUE_TYPE(width_val) != VAL_NUMBER) format_error(&out, "format ~v@t expects a number");
+            int width = (int)NUMBER_VALUE(width_val);
+            for (int i = 0; i < width; ++i) sb_append_char(&out, ' ');
             continue;
         }
+        sb_free(&out);
         runtime_error("Unsupported format directive: ~%c", directive);
     }
+    sb_flush_to_sink(&out, 0);
+    sb_free(&out);
     fflush(stdout);
     return NIL;
 }
@@ -700,27 +1203,41 @@ static Value *builtin_cons(Value **args, int argc, Env *env) {
 static Value *builtin_car(Value **args, int argc, Env *env) {
     (void)env;
     if (argc != 1) runtime_error("car expects one argument");
-    if (!args[0] || args[0]->type != VAL_PAIR) runtime_error("car expects a list");
-    return args[0]->car ? args[0]->car : NIL;
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_PAIR) runtime_error("car expects a list");
+    return CAR(args[0]) ? CAR(args[0]) : NIL;
 }
 
 static Value *builtin_cdr(Value **args, int argc, Env *env) {
     (void)env;
     if (argc != 1) runtime_error("cdr expects one argument");
-    if (!args[0] || args[0]->type != VAL_PAIR) runtime_error("cdr expects a list");
-    return args[0]->cdr ? args[0]->cdr : NIL;
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_PAIR) runtime_error("cdr expects a list");
+    return CDR(args[0]) ? CDR(args[0]) : NIL;
+}
+
+static Value *builtin_set_car(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("set-car! expects two arguments");
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_PAIR) runtime_error("set-car! expects a list");
+    pair_set_car(args[0], args[1]);
+    return args[1];
+}
+
+static Value *builtin_set_cdr(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("set-cdr! expects two arguments");
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_PAIR) runtime_error("set-cdr! expects a list");
+    pair_set_cdr(args[0], args[1]);
+    return args[1];
 }
 
 static Value *builtin_list(Value **args, int argc, Env *env) {
     (void)env;
-    Value *head = NIL;
-    Value **tail = &head;
-    for (int i = 0; i < argc; ++i) {
-        Value *node = make_pair(args[i], NIL);
-        *tail = node;
-        tail = &node->cdr;
+    // Built back to front so each make_pair roots the partial list.
+    Value *list = NIL;
+    for (int i = argc - 1; i >= 0; --i) {
+        list = make_pair(args[i], list);
     }
-    return head;
+    return list;
 }
 
 static Value *builtin_atom(Value **args, int argc, Env *env) {
@@ -728,17 +1245,17 @@ static Value *builtin_atom(Value **args, int argc, Env *env) {
     if (argc != 1) runtime_error("atom expects one argument");
     Value *arg = args[0];
     if (!arg || is_nil(arg)) return TRUE;
-    if (arg->type == VAL_PAIR) return NIL;
+    if (VALUE_TYPE(arg) == VAL_PAIR) return NIL;
     return TRUE;
 }
 
 static Value *compare_chain(Value **args, int argc, int (*cmp)(double, double), const char *name) {
     if (argc < 2) runtime_error("%s expects at least two numbers", name);
     for (int i = 0; i < argc; ++i) {
-        if (!args[i] || args[i]->type != VAL_NUMBER) runtime_error("%s expects numbers", name);
+        if (!args[i] || VALUE_TYPE(args[i]) != VAL_NUMBER) runtime_error("%s expects numbers", name);
     }
     for (int i = 0; i < argc - 1; ++i) {
-        if (!cmp(args[i]->number, args[i + 1]->number)) {
+        if (!cmp(NUMBER_VALUE(args[i]), NUMBER_VALUE(args[i + 1]))) {
             return NIL;
         }
     }
@@ -763,17 +1280,27 @@ static Value *builtin_gc_threshold(Value **args, int argc, Env *env) {
         return make_number((double)gc_get_threshold());
     }
     if (argc == 1) {
-        if (!args[0] || args[0]->type != VAL_NUMBER) {
+        if (!args[0] || VALUE_TYPE(args[0]) != VAL_NUMBER) {
             runtime_error("gc-threshold expects a numeric byte value");
         }
-        if (args[0]->number < 0) runtime_error("gc-threshold cannot be negative");
-        gc_set_threshold((size_t)args[0]->number);
+        if (NUMBER_VALUE(args[0]) < 0) runtime_error("gc-threshold cannot be negative");
+        gc_set_threshold((size_t)NUMBER_VALUE(args[0]));
         return make_number((double)gc_get_threshold());
     }
     runtime_error("gc-threshold accepts zero or one argument");
     return NIL;
 }
 
+// Prepend (key . value) to `list`, which make_pair keeps rooted while the
+// number and the entry are allocated.
+static Value *stats_entry(Value *list, const char *key, double value) {
+    push_root(list);
+    Value *entry = make_pair(intern_symbol(key), make_number(value));
+    list = make_pair(entry, rt->temp_roots[rt->temp_root_sp - 1]);
+    pop_root();
+    return list;
+}
+
 static Value *builtin_gc_stats(Value **args, int argc, Env *env) {
     (void)args; (void)argc; (void)env;
     GcStats stats;
@@ -781,76 +1308,32 @@ static Value *builtin_gc_stats(Value **args, int argc, Env *env) {
 
     // Construct association list with all metrics
     // Build in reverse order for easier construction
-    
-    Value *metadata_pair = make_pair(make_symbol_copy("metadata-bytes"), make_number((double)stats.metadata_bytes));
-    Value *list = make_pair(metadata_pair, NIL);
-    
-    Value *survival_pair = make_pair(make_symbol_copy("survival-rate"), make_number(stats.survival_rate));
-    list = make_pair(survival_pair, list);
-    
-    Value *promoted_pair = make_pair(make_symbol_copy("objects-promoted"), make_number((double)stats.objects_promoted));
-    list = make_pair(promoted_pair, list);
-    
-    Value *copied_pair = make_pair(make_symbol_copy("objects-copied"), make_number((double)stats.objects_copied));
-    list = make_pair(copied_pair, list);
-    
-    Value *scanned_pair = make_pair(make_symbol_copy("objects-scanned"), make_number((double)stats.objects_scanned));
-    list = make_pair(scanned_pair, list);
-    
-    Value *last_pause_pair = make_pair(make_symbol_copy("last-pause-ms"), make_number(stats.last_gc_pause_ms));
-    list = make_pair(last_pause_pair, list);
-    
-    Value *avg_pause_pair = make_pair(make_symbol_copy("avg-pause-ms"), make_number(stats.avg_gc_pause_ms));
-    list = make_pair(avg_pause_pair, list);
-    
-    Value *max_pause_pair = make_pair(make_symbol_copy("max-pause-ms"), make_number(stats.max_gc_pause_ms));
-    list = make_pair(max_pause_pair, list);
-    
-    Value *total_time_pair = make_pair(make_symbol_copy("total-gc-time-ms"), make_number(stats.total_gc_time_ms));
-    list = make_pair(total_time_pair, list);
+    Value *list = NIL;
+    list = stats_entry(list, "metadata-bytes", (double)stats.metadata_bytes);
+    list = stats_entry(list, "survival-rate", stats.survival_rate);
+    list = stats_entry(list, "objects-promoted", (double)stats.objects_promoted);
+    list = stats_entry(list, "objects-copied", (double)stats.objects_copied);
+    list = stats_entry(list, "objects-scanned", (double)stats.objects_scanned);
+    list = stats_entry(list, "last-pause-ms", stats.last_gc_pause_ms);
+    list = stats_entry(list, "avg-pause-ms", stats.avg_gc_pause_ms);
+    list = stats_entry(list, "max-pause-ms", stats.max_gc_pause_ms);
+    list = stats_entry(list, "total-gc-time-ms", stats.total_gc_time_ms);
 
     // Fragmentation metrics
-    Value *frag_growth_pair = make_pair(make_symbol_copy("fragmentation-growth-rate"), make_number(stats.fragmentation_growth_rate));
-    list = make_pair(frag_growth_pair, list);
-
-    Value *peak_frag_pair = make_pair(make_symbol_copy("peak-fragmentation-index"), make_number(stats.peak_fragmentation_index));
-    list = make_pair(peak_frag_pair, list);
-
-    Value *avg_padding_pair = make_pair(make_symbol_copy("average-padding-per-object"), make_number(stats.average_padding_per_object));
-    list = make_pair(avg_padding_pair, list);
-
-    Value *internal_frag_pair = make_pair(make_symbol_copy("internal-fragmentation-ratio"), make_number(stats.internal_fragmentation_ratio));
-    list = make_pair(internal_frag_pair, list);
-
-    Value *wasted_pair = make_pair(make_symbol_copy("wasted-bytes"), make_number((double)stats.wasted_bytes));
-    list = make_pair(wasted_pair, list);
-
-    Value *frag_index_pair = make_pair(make_symbol_copy("fragmentation-index"), make_number(stats.fragmentation_index));
-    list = make_pair(frag_index_pair, list);
-
-    Value *avg_free_pair = make_pair(make_symbol_copy("average-free-block-size"), make_number(stats.average_free_block_size));
-    list = make_pair(avg_free_pair, list);
-
-    Value *free_blocks_pair = make_pair(make_symbol_copy("free-blocks-count"), make_number((double)stats.free_blocks_count));
-    list = make_pair(free_blocks_pair, list);
-
-    Value *total_free_pair = make_pair(make_symbol_copy("total-free-memory"), make_number((double)stats.total_free_memory));
-    list = make_pair(total_free_pair, list);
-
-    Value *largest_free_pair = make_pair(make_symbol_copy("largest-free-block"), make_number((double)stats.largest_free_block));
-    list = make_pair(largest_free_pair, list);
-
-    Value *current_pair = make_pair(make_symbol_copy("current"), make_number((double)stats.current_bytes));
-    list = make_pair(current_pair, list);
-
-    Value *freed_pair = make_pair(make_symbol_copy("freed"), make_number((double)stats.freed_bytes));
-    list = make_pair(freed_pair, list);
-
-    Value *allocated_pair = make_pair(make_symbol_copy("allocated"), make_number((double)stats.allocated_bytes));
-    list = make_pair(allocated_pair, list);
-
-    Value *collections_pair = make_pair(make_symbol_copy("collections"), make_number((double)stats.collections));
-    list = make_pair(collections_pair, list);
+    list = stats_entry(list, "fragmentation-growth-rate", stats.fragmentation_growth_rate);
+    list = stats_entry(list, "peak-fragmentation-index", stats.peak_fragmentation_index);
+    list = stats_entry(list, "average-padding-per-object", stats.average_padding_per_object);
+    list = stats_entry(list, "internal-fragmentation-ratio", stats.internal_fragmentation_ratio);
+    list = stats_entry(list, "wasted-bytes", (double)stats.wasted_bytes);
+    list = stats_entry(list, "fragmentation-index", stats.fragmentation_index);
+    list = stats_entry(list, "average-free-block-size", stats.average_free_block_size);
+    list = stats_entry(list, "free-blocks-count", (double)stats.free_blocks_count);
+    list = stats_entry(list, "total-free-memory", (double)stats.total_free_memory);
+    list = stats_entry(list, "largest-free-block", (double)stats.largest_free_block);
+    list = stats_entry(list, "current", (double)stats.current_bytes);
+    list = stats_entry(list, "freed", (double)stats.freed_bytes);
+    list = stats_entry(list, "allocated", (double)stats.allocated_bytes);
+    list = stats_entry(list, "collections", (double)stats.collections);
 
     return list;
 }
@@ -859,597 +1342,3630 @@ static Value *builtin_procedure_source(Value **args, int argc, Env *env) {
     (void)env;
     if (argc != 1) runtime_error("procedure-source expects one argument");
     Value *proc = args[0];
-    if (!proc || proc->type != VAL_LAMBDA) return NIL;
+    if (!proc || VALUE_TYPE(proc) != VAL_LAMBDA) return NIL;
     
-    Value *sym_lambda = make_symbol_copy("lambda");
-    return make_pair(sym_lambda, make_pair(proc->params, proc->body));
+    Node *lambda = LAMBDA_CODE(proc);
+    return make_pair(rt->sym_lambda, make_pair(lambda->value, lambda->body));
 }
 
 static Value *builtin_load(Value **args, int argc, Env *env) {
     (void)env;
     if (argc != 1) runtime_error("load expects one argument");
     Value *arg = args[0];
-    if (!arg || arg->type != VAL_SYMBOL || !arg->symbol) {
+    if (!arg || VALUE_TYPE(arg) != VAL_SYMBOL) {
         runtime_error("load expects a symbol filename");
     }
-    char *contents = read_file(arg->symbol);
-    if (!contents) {
-        runtime_error("Failed to load %s", arg->symbol);
+    SourceFile file;
+    if (!source_open(&file, SYMBOL_NAME(arg), 1)) {
+        runtime_error("Failed to load %s", SYMBOL_NAME(arg));
     }
     int had_error = 0;
-    Value *result = eval_source(contents, &had_error);
-    free(contents);
+    Value *result = eval_source_file(&file, &had_error);
+    source_close(&file);
     if (had_error) {
-        runtime_error("Error while loading %s", arg->symbol);
+        runtime_error("Error while loading %s", SYMBOL_NAME(arg));
     }
     return result ? result : NIL;
 }
 
+// Like Common Lisp's eval, the form is evaluated in the top-level (null
+// lexical) environment.
 static Value *builtin_eval(Value **args, int argc, Env *env) {
+    (void)env;
     if (argc != 1) runtime_error("eval expects one argument");
-    return eval_value(args[0], env);
-}
-
-static void install_builtin(Env *env, const char *name, BuiltinFunc fn) {
-    env_define(env, name, make_builtin(fn));
-}
-
-static void init_builtins(Env *env) {
-    env_define(env, "nil", NIL);
-    env_define(env, "t", TRUE);
-    install_builtin(env, "+", builtin_add);
-    install_builtin(env, "-", builtin_sub);
-    install_builtin(env, "*", builtin_mul);
-    install_builtin(env, "/", builtin_div);
-    install_builtin(env, "print", builtin_print);
-    install_builtin(env, "princ", builtin_princ);
-    install_builtin(env, "format", builtin_format);
-    install_builtin(env, "cons", builtin_cons);
-    install_builtin(env, "car", builtin_car);
-    install_builtin(env, "cdr", builtin_cdr);
-    install_builtin(env, "list", builtin_list);
-    install_builtin(env, "atom", builtin_atom);
-    install_builtin(env, "=", builtin_eq);
-    install_builtin(env, "<", builtin_lt);
-    install_builtin(env, ">", builtin_gt);
-    install_builtin(env, "<=", builtin_lte);
-    install_builtin(env, ">=", builtin_gte);
-    install_builtin(env, "gc", builtin_gc);
-    install_builtin(env, "gc-threshold", builtin_gc_threshold);
-    install_builtin(env, "gc-stats", builtin_gc_stats);
-    install_builtin(env, "procedure-source", builtin_procedure_source);
-    install_builtin(env, "load", builtin_load);
-    install_builtin(env, "eval", builtin_eval);
+    return eval_value(args[0]);
 }
 
-static void runtime_init(void) {
-    if (runtime_initialized) return;
-    gc_init();
-    global_env = env_new(NULL);
-    gc_add_root((void**)&global_env);
-    
-    // Register temporary roots
-    for (int i = 0; i < MAX_TEMP_ROOTS; ++i) {
-        temp_roots[i] = NIL;
-        gc_add_root((void**)&temp_roots[i]);
+// Native list primitives ----------------------------------------------------
+//
+// These replace the recursive definitions of the same names in
+// standard-lib.lisp once it has loaded. Results are built front to back in a
+// single pass: the head and last pair of the list under construction, the
+// input cursor and the callback argument all live on the temp root stack,
+// and are re-read after anything that may allocate.
+
+// Append `value` to the list whose head and last pair are rooted at
+// temp_roots[base] and temp_roots[base + 1].
+static void list_builder_add(size_t base, Value *value) {
+    Value *pair = make_pair(value, NIL);
+    Value *last = rt->temp_roots[base + 1];
+    if (last == NIL) {
+        rt->temp_roots[base] = pair;
+    } else {
+        pair_set_cdr(last, pair);
     }
-    
-    init_builtins(global_env);
-    runtime_initialized = 1;
-    load_standard_library();
+    rt->temp_roots[base + 1] = pair;
 }
 
-static Value *eval_value(Value *expr, Env *env) {
-    if (!expr) return NIL;
-    switch (expr->type) {
-        case VAL_NUMBER:
-        case VAL_NIL:
-        case VAL_STRING:
-        case VAL_LAMBDA:
-        case VAL_BUILTIN:
-            return expr;
-        case VAL_SYMBOL:
-            return env_lookup(env, expr->symbol);
-        case VAL_PAIR: {
-            Value *op = expr->car;
-            if (!op) return NIL;
-            if (op->type == VAL_SYMBOL) {
-                const char *name = op->symbol;
-                if (!name) {
-                    runtime_error("Symbol name is NULL");
-                    return NIL;
-                }
-                Value *args = expr->cdr;
-                if (name && strcmp(name, "quote") == 0) {
-                    if (is_nil(args)) runtime_error("quote expects an argument");
-                    return args->car;
-                } else if (name && strcmp(name, "define") == 0) {
-                    if (is_nil(args)) runtime_error("define expects a symbol or list");
-                    Value *target = args->car;
-                    Value *value_exprs = args->cdr;
-                    if (is_nil(value_exprs)) runtime_error("define missing value");
-                    if (target->type == VAL_SYMBOL) {
-                        Value *val = eval_value(value_exprs->car, env);
-                        env_define(env, target->symbol, val);
-                        return target;
-                    } else if (target->type == VAL_PAIR) {
-                        Value *fn_name = target->car;
-                        if (!fn_name || fn_name->type != VAL_SYMBOL) {
-                            runtime_error("define function requires a name");
-                        }
-                        Value *lambda_params = target->cdr;
-                        Value *lambda_body = value_exprs;
-                        Value *lambda_value = make_lambda(lambda_params, lambda_body, env);
-                        env_define(env, fn_name->symbol, lambda_value);
-                        return fn_name;
-                    } else {
-                        runtime_error("define expects a symbol or (name args)");
-                    }
-                } else if (name && strcmp(name, "lambda") == 0) {
-                    if (is_nil(args)) runtime_error("lambda expects parameters");
-                    Value *params = args->car;
-                    Value *body = args->cdr;
-                    if (is_nil(body)) runtime_error("lambda body cannot be empty");
-                    return make_lambda(params, body, env);
-                } else if (name && strcmp(name, "if") == 0) {
-                    Value *test_expr = args ? args->car : NIL;
-                    Value *rest = args ? args->cdr : NIL;
-                    Value *then_expr = rest ? rest->car : NIL;
-                    Value *else_expr = (rest && rest->cdr) ? rest->cdr->car : NIL;
-                    Value *test_val = eval_value(test_expr, env);
-                    if (is_truthy(test_val)) {
-                        return eval_value(then_expr, env);
-                    } else {
-                        if (!is_nil(else_expr)) return eval_value(else_expr, env);
-                        return NIL;
-                    }
-                } else if (name && strcmp(name, "begin") == 0) {
-                    return eval_sequence(args, env);
-                }
-            }
-            // General application
-            int sp_start = temp_root_sp;
-            Value *operator = eval_value(op, env);
-            push_root(operator);
-            
-            Value *arg_values[MAX_ARGS];
-            int argc = 0;
-            Value *arg_list = expr->cdr;
-            while (!is_nil(arg_list)) {
-                if (arg_list->type != VAL_PAIR) runtime_error("Malformed argument list");
-                if (argc >= MAX_ARGS) runtime_error("Too many arguments");
-                Value *val = eval_value(arg_list->car, env);
-                arg_values[argc++] = val;
-                push_root(val);
-                arg_list = arg_list->cdr;
-            }
-            
-            Value *result = NIL;
-            if (!operator) runtime_error("Attempt to call nil");
-            if (operator->type == VAL_BUILTIN) {
-                result = operator->builtin(arg_values, argc, env);
-            } else if (operator->type == VAL_LAMBDA) {
-                Env *call_env = env_new(operator->env ? operator->env : env);
-                push_root((Value*)call_env);
-                Value *param_list = operator->params;
-                int index = 0;
-                while (!is_nil(param_list)) {
-                    if (param_list->type != VAL_PAIR) runtime_error("Malformed parameter list");
-                    Value *param = param_list->car;
-                    if (!param || param->type != VAL_SYMBOL) runtime_error("Parameters must be symbols");
-                    if (index >= argc) runtime_error("Too few arguments supplied");
-                    env_define(call_env, param->symbol, arg_values[index++]);
-                    param_list = param_list->cdr;
-                }
-                if (index != argc) runtime_error("Too many arguments supplied");
-                result = eval_sequence(operator->body, call_env);
-                pop_root();
-            } else {
-                runtime_error("Attempt to call non-procedure");
-            }
-            
-            temp_root_sp = sp_start;
-            return result;
-        }
+static void list_builder_begin(size_t *base) {
+    *base = rt->temp_root_sp;
+    push_root(NIL);
+    push_root(NIL);
+}
+
+static Value *list_builder_end(size_t base) {
+    Value *head = rt->temp_roots[base];
+    rt->temp_root_sp = base;
+    return head;
+}
+
+static void expect_list_end(Value *tail, const char *error) {
+    if (!is_nil(tail)) runtime_error("%s", error);
+}
+
+static Value *builtin_length(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("length expects one argument");
+    intptr_t count = 0;
+    Value *cursor = args[0];
+    for (; is_pair(cursor); cursor = CDR(cursor)) count++;
+    expect_list_end(cursor, "length expects a list");
+    return MAKE_FIXNUM(count);
+}
+
+static Value *builtin_reverse(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("reverse expects one argument");
+    size_t base = rt->temp_root_sp;
+    push_root(args[0]);
+    push_root(NIL);
+    while (is_pair(rt->temp_roots[base])) {
+        Value *pair = make_pair(CAR(rt->temp_roots[base]), rt->temp_roots[base + 1]);
+        rt->temp_roots[base + 1] = pair;
+        rt->temp_roots[base] = CDR(rt->temp_roots[base]);
+    }
+    expect_list_end(rt->temp_roots[base], "reverse expects a list");
+    Value *result = rt->temp_roots[base + 1];
+    rt->temp_root_sp = base;
+    return result;
+}
+
+// Copies every list but the last, which the result shares.
+static Value *builtin_append(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc == 0) return NIL;
+    size_t base;
+    list_builder_begin(&base);
+    push_root(NIL);
+    for (int i = 0; i < argc - 1; ++i) {
+        rt->temp_roots[base + 2] = args[i];
+        while (is_pair(rt->temp_roots[base + 2])) {
+            list_builder_add(base, CAR(rt->temp_roots[base + 2]));
+            rt->temp_roots[base + 2] = CDR(rt->temp_roots[base + 2]);
+        }
+        expect_list_end(rt->temp_roots[base + 2], "append expects lists");
+    }
+    if (rt->temp_roots[base + 1] == NIL) {
+        rt->temp_root_sp = base;
+        return args[argc - 1];
+    }
+    pair_set_cdr(rt->temp_roots[base + 1], args[argc - 1]);
+    return list_builder_end(base);
+}
+
+static double list_count_arg(Value *value, const char *error) {
+    if (!value || VALUE_TYPE(value) != VAL_NUMBER) runtime_error("%s", error);
+    return NUMBER_VALUE(value);
+}
+
+// Like the Lisp definitions, the count stops only on reaching exactly zero,
+// so a negative count takes or drops the whole list.
+static Value *builtin_take(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("take expects two arguments");
+    double n = list_count_arg(args[1], "take expects a number");
+    size_t base;
+    list_builder_begin(&base);
+    push_root(args[0]);
+    for (; n != 0 && is_pair(rt->temp_roots[base + 2]); n -= 1) {
+        list_builder_add(base, CAR(rt->temp_roots[base + 2]));
+        rt->temp_roots[base + 2] = CDR(rt->temp_roots[base + 2]);
+    }
+    return list_builder_end(base);
+}
+
+static Value *builtin_drop(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("drop expects two arguments");
+    double n = list_count_arg(args[1], "drop expects a number");
+    Value *cursor = args[0];
+    for (; n != 0 && is_pair(cursor); n -= 1) cursor = CDR(cursor);
+    return is_pair(cursor) ? cursor : NIL;
+}
+
+static Value *builtin_map(Value **args, int argc, Env *env) {
+    if (argc != 2) runtime_error("map expects two arguments");
+    size_t base;
+    list_builder_begin(&base);
+    push_root(args[1]);
+    push_root(NIL);
+    while (is_pair(rt->temp_roots[base + 2])) {
+        rt->temp_roots[base + 3] = CAR(rt->temp_roots[base + 2]);
+        Value *mapped = apply_procedure(args[0], &rt->temp_roots[base + 3], 1, env);
+        list_builder_add(base, mapped);
+        rt->temp_roots[base + 2] = CDR(rt->temp_roots[base + 2]);
+    }
+    expect_list_end(rt->temp_roots[base + 2], "map expects a list");
+    return list_builder_end(base);
+}
+
+static Value *builtin_filter(Value **args, int argc, Env *env) {
+    if (argc != 2) runtime_error("filter expects two arguments");
+    size_t base;
+    list_builder_begin(&base);
+    push_root(args[1]);
+    push_root(NIL);
+    while (is_pair(rt->temp_roots[base + 2])) {
+        rt->temp_roots[base + 3] = CAR(rt->temp_roots[base + 2]);
+        if (is_truthy(apply_procedure(args[0], &rt->temp_roots[base + 3], 1, env))) {
+            list_builder_add(base, CAR(rt->temp_roots[base + 2]));
+        }
+        rt->temp_roots[base + 2] = CDR(rt->temp_roots[base + 2]);
+    }
+    expect_list_end(rt->temp_roots[base + 2], "filter expects a list");
+    return list_builder_end(base);
+}
+
+static Value *builtin_foldl(Value **args, int argc, Env *env) {
+    if (argc != 3) runtime_error("foldl expects three arguments");
+    size_t base = rt->temp_root_sp;
+    push_root(args[2]);
+    push_root(args[1]);   // accumulator, then element: the call arguments
+    push_root(NIL);
+    while (is_pair(rt->temp_roots[base])) {
+        rt->temp_roots[base + 2] = CAR(rt->temp_roots[base]);
+        Value *acc = apply_procedure(args[0], &rt->temp_roots[base + 1], 2, env);
+        rt->temp_roots[base + 1] = acc;
+        rt->temp_roots[base] = CDR(rt->temp_roots[base]);
+    }
+    expect_list_end(rt->temp_roots[base], "foldl expects a list");
+    Value *result = rt->temp_roots[base + 1];
+    rt->temp_root_sp = base;
+    return result;
+}
+
+// Folds from the right by walking a reversed copy, so long lists do not
+// need a C stack frame per element.
+static Value *builtin_foldr(Value **args, int argc, Env *env) {
+    if (argc != 3) runtime_error("foldr expects three arguments");
+    size_t base = rt->temp_root_sp;
+    push_root(builtin_reverse(&args[2], 1, env));
+    push_root(NIL);       // element, then accumulator: the call arguments
+    push_root(args[1]);
+    while (is_pair(rt->temp_roots[base])) {
+        rt->temp_roots[base + 1] = CAR(rt->temp_roots[base]);
+        Value *acc = apply_procedure(args[0], &rt->temp_roots[base + 1], 2, env);
+        rt->temp_roots[base + 2] = acc;
+        rt->temp_roots[base] = CDR(rt->temp_roots[base]);
+    }
+    Value *result = rt->temp_roots[base + 2];
+    rt->temp_root_sp = base;
+    return result;
+}
+
+// Vectors and hash tables ---------------------------------------------------
+
+enum {
+    HASH_TEST_EQ,
+    HASH_TEST_EQUAL
+};
+
+#define HASH_INITIAL_CAPACITY 8
+#define HASH_EQUAL_BUDGET 16   // elements of a structured key that are hashed
+
+static Value *make_vector(size_t length, Value *fill, unsigned char tag) {
+    push_root(fill);
+    Value *v = alloc_value(VAL_VECTOR, sizeof(Vector) + sizeof(Value*) * length, trace_value, tag);
+    VECTOR_LENGTH(v) = length;
+    fill = rt->temp_roots[rt->temp_root_sp - 1];
+    for (size_t i = 0; i < length; ++i) VECTOR_ITEMS(v)[i] = fill;
+    pop_root();
+    return v;
+}
+
+static void vector_set(Value *vector, size_t index, Value *value) {
+    gc_write_barrier_fast(vector, (void**)&VECTOR_ITEMS(vector)[index], value);
+    VECTOR_ITEMS(vector)[index] = value;
+}
+
+static int values_eq(Value *a, Value *b) {
+    return a == b || (is_nil(a) && is_nil(b));
+}
+
+static int values_equal(Value *a, Value *b) {
+    while (!values_eq(a, b)) {
+        if (!a || !b || VALUE_TYPE(a) != VALUE_TYPE(b)) return 0;
+        switch (VALUE_TYPE(a)) {
+            case VAL_NUMBER:
+                return NUMBER_VALUE(a) == NUMBER_VALUE(b);
+            case VAL_STRING:
+                return ((String*)a)->length == ((String*)b)->length &&
+                       memcmp(STRING_CHARS(a), STRING_CHARS(b), ((String*)a)->length) == 0;
+            case VAL_VECTOR:
+                if (VECTOR_LENGTH(a) != VECTOR_LENGTH(b)) return 0;
+                for (size_t i = 0; i < VECTOR_LENGTH(a); ++i) {
+                    if (!values_equal(VECTOR_ITEMS(a)[i], VECTOR_ITEMS(b)[i])) return 0;
+                }
+                return 1;
+            case VAL_PAIR:
+                if (!values_equal(CAR(a), CAR(b))) return 0;
+                a = CDR(a);
+                b = CDR(b);
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static size_t hash_mix(size_t h) {
+    h ^= h >> 15;
+    h *= (size_t)0x2c1b3c6dU;
+    h ^= h >> 12;
+    h *= (size_t)0x297a2d39U;
+    h ^= h >> 15;
+    return h;
+}
+
+static size_t hash_number(double number) {
+    if (number == 0) number = 0;   // -0.0 is equal to 0
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    return hash_mix((size_t)(bits ^ (bits >> 32)));
+}
+
+// Hash consistently with eq? or, when `equal` is set, equal?. Symbols hash
+// by name and numbers by value; other objects compared by identity hash by
+// address, which sets *by_address. Structured keys are hashed only as far
+// as `budget` elements.
+static size_t value_hash(Value *value, int equal, int *budget, int *by_address) {
+    if (is_nil(value)) return 0;
+    switch (VALUE_TYPE(value)) {
+        case VAL_NUMBER:
+            if (IS_FIXNUM(value) || equal) return hash_number(NUMBER_VALUE(value));
+            break;
+        case VAL_SYMBOL:
+            return symbol_hash(SYMBOL_NAME(value), strlen(SYMBOL_NAME(value)));
+        case VAL_STRING:
+            if (equal) return symbol_hash(STRING_CHARS(value), ((String*)value)->length);
+            break;
+        case VAL_PAIR:
+            if (equal) {
+                size_t h = VAL_PAIR;
+                for (; is_pair(value) && (*budget)-- > 0; value = CDR(value)) {
+                    h = hash_mix(h + value_hash(CAR(value), equal, budget, by_address));
+                }
+                return is_pair(value) ? h : hash_mix(h + value_hash(value, equal, budget, by_address));
+            }
+            break;
+        case VAL_VECTOR:
+            if (equal) {
+                size_t h = hash_mix(VECTOR_LENGTH(value));
+                for (size_t i = 0; i < VECTOR_LENGTH(value) && (*budget)-- > 0; ++i) {
+                    h = hash_mix(h + value_hash(VECTOR_ITEMS(value)[i], equal, budget, by_address));
+                }
+                return h;
+            }
+            break;
+        default:
+            break;
+    }
+    *by_address = 1;
+    return hash_mix((size_t)(uintptr_t)value);
+}
+
+static Hashtable *as_hashtable(Value *value, const char *name) {
+    if (!value || VALUE_TYPE(value) != VAL_HASHTABLE) runtime_error("%s expects a hash table", name);
+    return (Hashtable*)value;
+}
+
+static size_t hash_capacity(Value *buckets) {
+    return VECTOR_LENGTH(buckets) / 2;
+}
+
+// Find the bucket holding `key` in `buckets`, or the empty bucket where it
+// belongs; *found tells which.
+static size_t hash_probe(int test, Value *buckets, Value *key, int *found, int *by_address) {
+    int budget = HASH_EQUAL_BUDGET;
+    size_t mask = hash_capacity(buckets) - 1;
+    size_t i = value_hash(key, test == HASH_TEST_EQUAL, &budget, by_address) & mask;
+    Value **items = VECTOR_ITEMS(buckets);
+    while (items[2 * i]) {
+        Value *candidate = items[2 * i];
+        if (test == HASH_TEST_EQUAL ? values_equal(candidate, key) : values_eq(candidate, key)) {
+            *found = 1;
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    *found = 0;
+    return i;
+}
+
+static void hash_bucket_set(Value *buckets, size_t i, Value *key, Value *value) {
+    vector_set(buckets, 2 * i, key);
+    vector_set(buckets, 2 * i + 1, value);
+}
+
+// Insert an entry known to be absent, keeping the address-key count.
+static void hash_insert_new(Hashtable *table, Value *buckets, Value *key, Value *value) {
+    int found, by_address = 0;
+    size_t i = hash_probe(table->test, buckets, key, &found, &by_address);
+    hash_bucket_set(buckets, i, key, value);
+    table->address_keys += (size_t)by_address;
+}
+
+// Rebuild the bucket layout in place after objects may have moved. Nothing
+// is allocated in the GC heap, so the addresses hashed here stay put.
+static void hash_refresh(Hashtable *table) {
+    if (table->epoch == gc_move_epoch) return;
+    table->epoch = gc_move_epoch;
+    if (!table->address_keys) return;
+    Value *buckets = table->buckets;
+    size_t capacity = hash_capacity(buckets);
+    Value **entries = (Value**)malloc(sizeof(Value*) * 2 * capacity);
+    if (!entries) {
+        fprintf(stderr, "Out of memory while rehashing\n");
+        exit(1);
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < capacity; ++i) {
+        if (!VECTOR_ITEMS(buckets)[2 * i]) continue;
+        entries[n++] = VECTOR_ITEMS(buckets)[2 * i];
+        entries[n++] = VECTOR_ITEMS(buckets)[2 * i + 1];
+        hash_bucket_set(buckets, i, NULL, NULL);
+    }
+    table->address_keys = 0;
+    table->count = n / 2;
+    for (size_t i = 0; i < n; i += 2) hash_insert_new(table, buckets, entries[i], entries[i + 1]);
+    free(entries);
+}
+
+// Double the capacity of the table rooted at *slot.
+static void hash_grow(Value **slot) {
+    size_t capacity = hash_capacity(((Hashtable*)*slot)->buckets) * 2;
+    Value *buckets = make_vector(2 * capacity, NULL, GC_TAG_HASH_BUCKETS);
+    Hashtable *table = (Hashtable*)*slot;
+    Value *old = table->buckets;
+    table->address_keys = 0;
+    for (size_t i = 0; i < hash_capacity(old); ++i) {
+        Value *key = VECTOR_ITEMS(old)[2 * i];
+        if (key) hash_insert_new(table, buckets, key, VECTOR_ITEMS(old)[2 * i + 1]);
+    }
+    gc_write_barrier_fast(table, (void**)&table->buckets, buckets);
+    table->buckets = buckets;
+    table->epoch = gc_move_epoch;
+}
+
+static size_t vector_index_arg(Value *vector, Value *index, const char *name) {
+    if (!vector || VALUE_TYPE(vector) != VAL_VECTOR) runtime_error("%s expects a vector", name);
+    if (!index || VALUE_TYPE(index) != VAL_NUMBER) runtime_error("%s expects a numeric index", name);
+    double i = NUMBER_VALUE(index);
+    if (!(i >= 0 && i < (double)VECTOR_LENGTH(vector)) || i != floor(i)) {
+        runtime_error("%s index out of range", name);
+    }
+    return (size_t)i;
+}
+
+static Value *builtin_vector(Value **args, int argc, Env *env) {
+    (void)env;
+    Value *v = make_vector((size_t)argc, NIL, GC_TAG_VALUE_VECTOR);
+    for (int i = 0; i < argc; ++i) VECTOR_ITEMS(v)[i] = args[i];
+    return v;
+}
+
+static Value *builtin_make_vector(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc < 1 || argc > 2) runtime_error("make-vector expects a length and an optional fill");
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_NUMBER) runtime_error("make-vector expects a length");
+    double length = NUMBER_VALUE(args[0]);
+    if (!(length >= 0 && length <= (double)(MAX_VECTOR_LENGTH)) || length != floor(length)) {
+        runtime_error("make-vector length out of range");
+    }
+    return make_vector((size_t)length, argc == 2 ? args[1] : NIL, GC_TAG_VALUE_VECTOR);
+}
+
+static Value *builtin_vector_ref(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("vector-ref expects two arguments");
+    return VECTOR_ITEMS(args[0])[vector_index_arg(args[0], args[1], "vector-ref")];
+}
+
+static Value *builtin_vector_set(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 3) runtime_error("vector-set! expects three arguments");
+    vector_set(args[0], vector_index_arg(args[0], args[1], "vector-set!"), args[2]);
+    return args[2];
+}
+
+static Value *builtin_vector_length(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("vector-length expects one argument");
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_VECTOR) runtime_error("vector-length expects a vector");
+    return MAKE_FIXNUM((intptr_t)VECTOR_LENGTH(args[0]));
+}
+
+static Value *builtin_vector_to_list(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("vector->list expects one argument");
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_VECTOR) runtime_error("vector->list expects a vector");
+    // Built back to front so each make_pair roots the partial list.
+    Value *list = NIL;
+    for (size_t i = VECTOR_LENGTH(args[0]); i > 0; --i) {
+        list = make_pair(VECTOR_ITEMS(args[0])[i - 1], list);
+    }
+    return list;
+}
+
+static Value *builtin_list_to_vector(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("list->vector expects one argument");
+    size_t length = 0;
+    Value *cursor = args[0];
+    for (; is_pair(cursor); cursor = CDR(cursor)) length++;
+    expect_list_end(cursor, "list->vector expects a list");
+    Value *v = make_vector(length, NIL, GC_TAG_VALUE_VECTOR);
+    cursor = args[0];
+    for (size_t i = 0; i < length; ++i, cursor = CDR(cursor)) VECTOR_ITEMS(v)[i] = CAR(cursor);
+    return v;
+}
+
+static Value *builtin_eq_p(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("eq? expects two arguments");
+    return values_eq(args[0], args[1]) ? TRUE : NIL;
+}
+
+static Value *builtin_equal_p(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("equal? expects two arguments");
+    return values_equal(args[0], args[1]) ? TRUE : NIL;
+}
+
+// (make-hash-table) compares keys with eq?, (make-hash-table 'equal) with
+// equal?.
+static Value *builtin_make_hash_table(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc > 1) runtime_error("make-hash-table expects an optional test");
+    int test = HASH_TEST_EQ;
+    if (argc == 1 && args[0] != intern_symbol("eq")) {
+        if (args[0] != intern_symbol("equal")) runtime_error("make-hash-table test must be eq or equal");
+        test = HASH_TEST_EQUAL;
+    }
+    push_root(make_vector(2 * HASH_INITIAL_CAPACITY, NULL, GC_TAG_HASH_BUCKETS));
+    Value *v = alloc_value(VAL_HASHTABLE, sizeof(Hashtable), trace_value, GC_TAG_VALUE_HASHTABLE);
+    Hashtable *table = (Hashtable*)v;
+    table->test = test;
+    table->epoch = gc_move_epoch;
+    table->buckets = rt->temp_roots[rt->temp_root_sp - 1];
+    pop_root();
+    return v;
+}
+
+static Value *builtin_hash_ref(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc < 2 || argc > 3) runtime_error("hash-ref expects a table, a key and an optional default");
+    Hashtable *table = as_hashtable(args[0], "hash-ref");
+    hash_refresh(table);
+    int found, by_address = 0;
+    size_t i = hash_probe(table->test, table->buckets, is_nil(args[1]) ? NIL : args[1], &found, &by_address);
+    if (found) return VECTOR_ITEMS(table->buckets)[2 * i + 1];
+    return argc == 3 ? args[2] : NIL;
+}
+
+static Value *builtin_hash_set(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 3) runtime_error("hash-set! expects three arguments");
+    Hashtable *table = as_hashtable(args[0], "hash-set!");
+    if ((table->count + 1) * 2 > hash_capacity(table->buckets)) {
+        hash_grow(&args[0]);
+        table = (Hashtable*)args[0];
+    }
+    hash_refresh(table);
+    Value *key = is_nil(args[1]) ? NIL : args[1];
+    int found, by_address = 0;
+    size_t i = hash_probe(table->test, table->buckets, key, &found, &by_address);
+    if (found) {
+        vector_set(table->buckets, 2 * i + 1, args[2]);
+    } else {
+        hash_bucket_set(table->buckets, i, key, args[2]);
+        table->count++;
+        table->address_keys += (size_t)by_address;
+    }
+    return args[2];
+}
+
+// Removal re-inserts the rest of the probe cluster instead of leaving
+// tombstones, so lookups never stop early.
+static Value *builtin_hash_remove(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 2) runtime_error("hash-remove! expects two arguments");
+    Hashtable *table = as_hashtable(args[0], "hash-remove!");
+    hash_refresh(table);
+    Value *buckets = table->buckets;
+    int found, by_address = 0;
+    size_t i = hash_probe(table->test, buckets, is_nil(args[1]) ? NIL : args[1], &found, &by_address);
+    if (!found) return NIL;
+    hash_bucket_set(buckets, i, NULL, NULL);
+    table->count--;
+    table->address_keys -= (size_t)by_address;
+    size_t mask = hash_capacity(buckets) - 1;
+    for (i = (i + 1) & mask; VECTOR_ITEMS(buckets)[2 * i]; i = (i + 1) & mask) {
+        Value *key = VECTOR_ITEMS(buckets)[2 * i];
+        Value *value = VECTOR_ITEMS(buckets)[2 * i + 1];
+        by_address = 0;
+        int budget = HASH_EQUAL_BUDGET;
+        value_hash(key, table->test == HASH_TEST_EQUAL, &budget, &by_address);
+        table->address_keys -= (size_t)by_address;
+        hash_bucket_set(buckets, i, NULL, NULL);
+        hash_insert_new(table, buckets, key, value);
+    }
+    return TRUE;
+}
+
+static Value *builtin_hash_count(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("hash-count expects one argument");
+    return MAKE_FIXNUM((intptr_t)as_hashtable(args[0], "hash-count")->count);
+}
+
+static Value *builtin_hash_keys(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("hash-keys expects one argument");
+    as_hashtable(args[0], "hash-keys");
+    // Bucket positions do not change while the list is built, even if the
+    // table moves.
+    Value *list = NIL;
+    for (size_t i = hash_capacity(((Hashtable*)args[0])->buckets); i > 0; --i) {
+        Value *key = VECTOR_ITEMS(((Hashtable*)args[0])->buckets)[2 * (i - 1)];
+        if (key) list = make_pair(key, list);
+    }
+    return list;
+}
+
+static void install_builtin(const char *name, BuiltinFunc fn) {
+    define_global(intern_symbol(name), make_builtin(fn));
+}
+
+// Builtins are installed from this table; heap images refer to them by name.
+// Entries marked `replaces_library` take over a standard-lib.lisp definition
+// and are installed after the library has loaded.
+typedef struct {
+    const char *name;
+    BuiltinFunc fn;
+    int replaces_library;
+} BuiltinEntry;
+
+static const BuiltinEntry builtin_table[] = {
+    {"+", builtin_add, 0},
+    {"-", builtin_sub, 0},
+    {"*", builtin_mul, 0},
+    {"/", builtin_div, 0},
+    {"print", builtin_print, 0},
+    {"princ", builtin_princ, 0},
+    {"format", builtin_format, 0},
+    {"cons", builtin_cons, 0},
+    {"car", builtin_car, 0},
+    {"cdr", builtin_cdr, 0},
+    {"set-car!", builtin_set_car, 0},
+    {"set-cdr!", builtin_set_cdr, 0},
+    {"list", builtin_list, 0},
+    {"atom", builtin_atom, 0},
+    {"=", builtin_eq, 0},
+    {"<", builtin_lt, 0},
+    {">", builtin_gt, 0},
+    {"<=", builtin_lte, 0},
+    {">=", builtin_gte, 0},
+    {"gc", builtin_gc, 0},
+    {"gc-threshold", builtin_gc_threshold, 0},
+    {"gc-stats", builtin_gc_stats, 0},
+    {"gc-profile", builtin_gc_profile, 0},
+    {"gc-trace", builtin_gc_trace, 0},
+    {"profile", builtin_profile, 0},
+    {"procedure-source", builtin_procedure_source, 0},
+    {"load", builtin_load, 0},
+    {"eval", builtin_eval, 0},
+    {"eq?", builtin_eq_p, 0},
+    {"equal?", builtin_equal_p, 0},
+    {"vector", builtin_vector, 0},
+    {"make-vector", builtin_make_vector, 0},
+    {"vector-ref", builtin_vector_ref, 0},
+    {"vector-set!", builtin_vector_set, 0},
+    {"vector-length", builtin_vector_length, 0},
+    {"vector->list", builtin_vector_to_list, 0},
+    {"list->vector", builtin_list_to_vector, 0},
+    {"make-hash-table", builtin_make_hash_table, 0},
+    {"hash-ref", builtin_hash_ref, 0},
+    {"hash-set!", builtin_hash_set, 0},
+    {"hash-remove!", builtin_hash_remove, 0},
+    {"hash-count", builtin_hash_count, 0},
+    {"hash-keys", builtin_hash_keys, 0},
+    {"pmap", builtin_pmap, 0},
+    {"future", builtin_future, 0},
+    {"touch", builtin_touch, 0},
+    {"length", builtin_length, 1},
+    {"reverse", builtin_reverse, 1},
+    {"append", builtin_append, 1},
+    {"take", builtin_take, 1},
+    {"drop", builtin_drop, 1},
+    {"map", builtin_map, 1},
+    {"filter", builtin_filter, 1},
+    {"foldl", builtin_foldl, 1},
+    {"foldr", builtin_foldr, 1},
+    {NULL, NULL, 0}
+};
+
+static void init_builtins(void) {
+    define_global(intern_symbol("nil"), NIL);
+    define_global(TRUE, TRUE);
+    for (const BuiltinEntry *entry = builtin_table; entry->name; ++entry) {
+        if (!entry->replaces_library) install_builtin(entry->name, entry->fn);
+    }
+}
+
+// MINIMALISP_NATIVE_LISTS=0 keeps the Lisp definitions of the list helpers.
+static void install_library_builtins(void) {
+    const char *env = getenv("MINIMALISP_NATIVE_LISTS");
+    if (env && strcmp(env, "0") == 0) return;
+    for (const BuiltinEntry *entry = builtin_table; entry->name; ++entry) {
+        if (entry->replaces_library) install_builtin(entry->name, entry->fn);
+    }
+}
+
+static void profile_from_env(void);
+
+// A thread that never entered a runtime gets one on the heap it already
+// runs, which gc_init creates if there is none.
+static void runtime_init(void) {
+    if (!rt) {
+        rt = (Runtime*)calloc(1, sizeof(Runtime));
+        if (!rt) {
+            fprintf(stderr, "Out of memory while creating runtime\n");
+            exit(1);
+        }
+        gc_init();
+        rt->heap = gc_heap_current();
+    }
+    if (rt->initialized) return;
+    gc_init();
+    init_symbols();
+    
+    // The temp root stack is scanned as a shadow stack: only live entries.
+    gc_add_root_range((void**)rt->temp_roots, &rt->temp_root_sp);
+    
+    init_builtins();
+    rt->initialized = 1;
+    if (!rt->library_loaded && !load_heap_image()) load_standard_library();
+    install_library_builtins();
+    // Environment-driven profiling covers the default runtime only.
+    if (!rt->owns_heap) profile_from_env();
+}
+
+// Profiling -----------------------------------------------------------------
+//
+// While a profiler is on, the evaluator keeps a shadow stack of the
+// procedures being called: one frame per eval_node activation, which a tail
+// call replaces rather than grows, plus one per builtin call. Lambdas take
+// their names from the global they were first defined as.
+
+static const char *call_frame_name(const CallFrame *frame) {
+    if (frame->builtin) {
+        for (const BuiltinEntry *entry = builtin_table; entry->name; ++entry) {
+            if (entry->fn == frame->builtin) return entry->name;
+        }
+        return "builtin";
+    }
+    if (frame->global) return SYMBOL_NAME(frame->global->name);
+    return "lambda";
+}
+
+// Profiles are keyed by call stacks, truncated to the innermost
+// PROFILE_MAX_FRAMES frames and interned to dense ids. Interning may run
+// inside the allocator, so a table only uses malloc. Id 0 is always the
+// empty stack and doubles as the answer when memory runs out.
+#define PROFILE_MAX_FRAMES 64
+
+static uint32_t stack_hash(const CallFrame *frames, size_t depth) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < depth; ++i) {
+        h = (h ^ (uint64_t)(uintptr_t)frames[i].global) * 1099511628211ULL;
+        h = (h ^ (uint64_t)(uintptr_t)frames[i].builtin) * 1099511628211ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static int stack_matches(const StackTable *table, const StackEntry *entry,
+                         const CallFrame *frames, size_t depth, uint32_t hash) {
+    if (entry->hash != hash || entry->depth != depth) return 0;
+    const CallFrame *stored = table->frames + entry->offset;
+    for (size_t i = 0; i < depth; ++i) {
+        if (stored[i].global != frames[i].global || stored[i].builtin != frames[i].builtin) return 0;
+    }
+    return 1;
+}
+
+static int stack_index_grow(StackTable *table) {
+    size_t capacity = table->index_capacity ? table->index_capacity * 2 : 256;
+    uint32_t *index = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    if (!index) return 0;
+    for (size_t id = 0; id < table->count; ++id) {
+        size_t slot = table->entries[id].hash & (capacity - 1);
+        while (index[slot]) slot = (slot + 1) & (capacity - 1);
+        index[slot] = (uint32_t)id + 1;
+    }
+    free(table->index);
+    table->index = index;
+    table->index_capacity = capacity;
+    return 1;
+}
+
+static uint32_t stack_table_intern(StackTable *table, const CallFrame *frames, size_t depth) {
+    uint32_t hash = stack_hash(frames, depth);
+    if (table->index_capacity) {
+        for (size_t slot = hash & (table->index_capacity - 1); table->index[slot];
+             slot = (slot + 1) & (table->index_capacity - 1)) {
+            uint32_t id = table->index[slot] - 1;
+            if (stack_matches(table, &table->entries[id], frames, depth, hash)) return id;
+        }
+    }
+    if ((table->count + 1) * 2 > table->index_capacity && !stack_index_grow(table)) return 0;
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 64;
+        StackEntry *grown = (StackEntry*)realloc(table->entries, capacity * sizeof(StackEntry));
+        if (!grown) return 0;
+        table->entries = grown;
+        table->capacity = capacity;
+    }
+    if (table->frames_count + depth > table->frames_capacity) {
+        size_t capacity = table->frames_capacity ? table->frames_capacity : 256;
+        while (capacity < table->frames_count + depth) capacity *= 2;
+        CallFrame *grown = (CallFrame*)realloc(table->frames, capacity * sizeof(CallFrame));
+        if (!grown) return 0;
+        table->frames = grown;
+        table->frames_capacity = capacity;
+    }
+    if (depth) memcpy(table->frames + table->frames_count, frames, depth * sizeof(CallFrame));
+    uint32_t id = (uint32_t)table->count++;
+    StackEntry *entry = &table->entries[id];
+    entry->offset = table->frames_count;
+    entry->depth = (uint32_t)depth;
+    entry->hash = hash;
+    entry->calls = 0;
+    entry->ms = 0.0;
+    table->frames_count += depth;
+    size_t slot = hash & (table->index_capacity - 1);
+    while (table->index[slot]) slot = (slot + 1) & (table->index_capacity - 1);
+    table->index[slot] = id + 1;
+    return id;
+}
+
+static void stack_table_reset(StackTable *table) {
+    table->count = 0;
+    table->frames_count = 0;
+    if (table->index) memset(table->index, 0, table->index_capacity * sizeof(uint32_t));
+    stack_table_intern(table, NULL, 0);
+}
+
+static void stack_table_free(StackTable *table) {
+    free(table->frames);
+    free(table->entries);
+    free(table->index);
+    memset(table, 0, sizeof(*table));
+}
+
+static uint32_t stack_table_intern_current(StackTable *table) {
+    size_t depth = rt->call_stack_depth;
+    size_t start = depth > PROFILE_MAX_FRAMES ? depth - PROFILE_MAX_FRAMES : 0;
+    return stack_table_intern(table, rt->call_stack + start, depth - start);
+}
+
+// Folded stacks: one "outer;inner value" line per stack, the input format of
+// flamegraph.pl and speedscope.
+static void stack_table_name(const StackTable *table, uint32_t id, StrBuf *sb) {
+    const StackEntry *entry = &table->entries[id];
+    if (entry->depth == 0) {
+        sb_append(sb, "(toplevel)");
+        return;
+    }
+    for (uint32_t i = 0; i < entry->depth; ++i) {
+        if (i) sb_append_char(sb, ';');
+        sb_append(sb, call_frame_name(&table->frames[entry->offset + i]));
+    }
+}
+
+// Evaluator profiling: calls are counted as frames are pushed, and the
+// current stack is sampled at safe points, namely calls and returns. Native
+// builds have a SIGPROF timer request a sample once per interval of CPU time;
+// elsewhere a sample is taken every PROFILE_CALLS_PER_SAMPLE calls. Either
+// way a sample is weighted by the time measured since the previous one, as
+// the kernel may deliver timer signals less often than asked.
+#define PROFILE_DEFAULT_INTERVAL_US 1000
+#define PROFILE_CALLS_PER_SAMPLE 1000
+
+// Set from the SIGPROF handler, which may run on a GC helper thread.
+static volatile int eval_profile_ticks = 0;
+#define EVAL_PROFILE_TICK_PENDING() __atomic_load_n(&eval_profile_ticks, __ATOMIC_RELAXED)
+#define EVAL_PROFILE_SET_TICK(value) __atomic_store_n(&eval_profile_ticks, (value), __ATOMIC_RELAXED)
+
+#ifdef HAVE_PROFILE_TIMER
+static struct sigaction eval_profile_saved_action;
+
+static void eval_profile_on_timer(int signo) {
+    (void)signo;
+    EVAL_PROFILE_SET_TICK(1);
+}
+#endif
+
+// Process CPU time natively, wall time elsewhere.
+static double profile_now_ms(void) {
+#if defined(HAVE_PROFILE_TIMER)
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+#elif defined(__EMSCRIPTEN__)
+    return emscripten_get_now();
+#else
+    return (double)clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif
+}
+
+static void eval_profile_sample(void) {
+    double now = profile_now_ms();
+    double ms = now - rt->eval_profile_last_ms;
+    rt->eval_profile_last_ms = now;
+    EVAL_PROFILE_SET_TICK(0);
+    if (!rt->eval_profiling || !rt->eval_stacks.count) return;
+    rt->eval_stacks.entries[stack_table_intern_current(&rt->eval_stacks)].ms += ms;
+}
+
+static void eval_profile_enter(const CallFrame *frame) {
+#ifndef HAVE_PROFILE_TIMER
+    if (--rt->eval_profile_countdown == 0) {
+        rt->eval_profile_countdown = PROFILE_CALLS_PER_SAMPLE;
+        EVAL_PROFILE_SET_TICK(1);
+    }
+#endif
+    // A pending sample belongs to the caller, so take it before pushing.
+    if (EVAL_PROFILE_TICK_PENDING()) eval_profile_sample();
+    if (!rt->eval_functions.count) return;
+    rt->eval_functions.entries[stack_table_intern(&rt->eval_functions, frame, 1)].calls++;
+}
+
+// Frames record the global a lambda is named after rather than its code, so
+// profiles stay readable after the code's arena has been freed.
+static void call_stack_push(Node *lambda, BuiltinFunc builtin) {
+    CallFrame frame = {lambda ? lambda->cell : NULL, builtin};
+    if (rt->eval_profiling) eval_profile_enter(&frame);
+    if (rt->call_stack_depth == rt->call_stack_capacity) {
+        size_t capacity = rt->call_stack_capacity ? rt->call_stack_capacity * 2 : 256;
+        CallFrame *grown = (CallFrame*)realloc(rt->call_stack, capacity * sizeof(CallFrame));
+        if (!grown) runtime_error("Out of memory for the call stack");
+        rt->call_stack = grown;
+        rt->call_stack_capacity = capacity;
+    }
+    rt->call_stack[rt->call_stack_depth++] = frame;
+}
+
+// Drop the frames above `depth`, first charging any pending sample to them.
+static void call_stack_pop_to(size_t depth) {
+    if (EVAL_PROFILE_TICK_PENDING()) eval_profile_sample();
+    rt->call_stack_depth = depth;
+}
+
+static void call_stack_update(void) {
+    rt->call_stack_enabled = rt->eval_profiling || gc_alloc_profile_active();
+}
+
+// Allocation sites for the GC's allocation profiler.
+#define PROFILE_DEFAULT_SAMPLE_BYTES 65536
+
+static uint32_t alloc_profile_current_site(void) {
+    return stack_table_intern_current(&rt->alloc_sites);
+}
+
+static void alloc_profile_start(size_t sample_bytes) {
+    stack_table_reset(&rt->alloc_sites);
+    gc_alloc_profile_start(sample_bytes, alloc_profile_current_site);
+    call_stack_update();
+}
+
+static void alloc_profile_stop(void) {
+    gc_alloc_profile_stop();
+    call_stack_update();
+}
+
+typedef enum {
+    PROFILE_ALLOCATED,
+    PROFILE_LIVE,
+    PROFILE_PROMOTED
+} ProfileMetric;
+
+static size_t profile_metric(const GcAllocSiteStats *stats, ProfileMetric metric) {
+    switch (metric) {
+        case PROFILE_LIVE: return stats->live_bytes;
+        case PROFILE_PROMOTED: return stats->promoted_bytes;
+        default: return stats->allocated_bytes;
+    }
+}
+
+static int alloc_profile_write_folded(const char *path, ProfileMetric metric) {
+    FILE *out = fopen(path, "w");
+    if (!out) return 0;
+    StrBuf name;
+    sb_init(&name, NULL);
+    size_t count = gc_alloc_profile_site_count();
+    for (uint32_t id = 0; id < count && id < rt->alloc_sites.count; ++id) {
+        GcAllocSiteStats stats;
+        gc_alloc_profile_site_stats(id, &stats);
+        size_t value = profile_metric(&stats, metric);
+        if (!value) continue;
+        name.length = 0;
+        stack_table_name(&rt->alloc_sites, id, &name);
+        fprintf(out, "%s %zu\n", sb_text(&name), value);
+    }
+    sb_free(&name);
+    return fclose(out) == 0;
+}
+
+static void alloc_profile_write_at_exit(void) {
+    char path[4096];
+    if (!alloc_profile_write_folded(rt->alloc_profile_path, PROFILE_ALLOCATED)) {
+        fprintf(stderr, "Failed to write allocation profile %s\n", rt->alloc_profile_path);
+        return;
+    }
+    snprintf(path, sizeof(path), "%s.live", rt->alloc_profile_path);
+    alloc_profile_write_folded(path, PROFILE_LIVE);
+    snprintf(path, sizeof(path), "%s.promoted", rt->alloc_profile_path);
+    alloc_profile_write_folded(path, PROFILE_PROMOTED);
+}
+
+typedef struct {
+    GcAllocSiteStats stats;
+    uint32_t id;
+} AllocProfileRow;
+
+static int compare_alloc_rows(const void *a, const void *b) {
+    size_t left = ((const AllocProfileRow*)a)->stats.allocated_bytes;
+    size_t right = ((const AllocProfileRow*)b)->stats.allocated_bytes;
+    return left < right ? -1 : left > right;
+}
+
+// Push a fresh report row (name value...) built from `count` numbers, then
+// cons it onto the list in temp_roots[list_slot].
+static void profile_report_row(size_t list_slot, StrBuf *name, const double *values, int count) {
+    Value *text = make_string(name->length);
+    memcpy(STRING_CHARS(text), sb_text(name), name->length);
+    push_root(text);
+    push_root(NIL);
+    for (int v = count - 1; v >= 0; --v) {
+        Value *number = make_number(values[v]);
+        rt->temp_roots[rt->temp_root_sp - 1] = make_pair(number, rt->temp_roots[rt->temp_root_sp - 1]);
+    }
+    Value *row = make_pair(rt->temp_roots[rt->temp_root_sp - 2], rt->temp_roots[rt->temp_root_sp - 1]);
+    pop_root();
+    pop_root();
+    rt->temp_roots[list_slot] = make_pair(row, rt->temp_roots[list_slot]);
+}
+
+// A list of (stack allocated-bytes live-bytes promoted-bytes), largest
+// allocator first.
+static Value *alloc_profile_report(void) {
+    size_t count = gc_alloc_profile_site_count();
+    if (count > rt->alloc_sites.count) count = rt->alloc_sites.count;
+    AllocProfileRow *rows = (AllocProfileRow*)malloc((count ? count : 1) * sizeof(AllocProfileRow));
+    if (!rows) runtime_error("Out of memory for the profile report");
+    size_t used = 0;
+    for (uint32_t id = 0; id < count; ++id) {
+        gc_alloc_profile_site_stats(id, &rows[used].stats);
+        rows[used].id = id;
+        if (rows[used].stats.samples) used++;
+    }
+    qsort(rows, used, sizeof(AllocProfileRow), compare_alloc_rows);
+
+    StrBuf name;
+    sb_init(&name, NULL);
+    size_t list_slot = rt->temp_root_sp;
+    push_root(NIL);
+    for (size_t i = 0; i < used; ++i) {
+        name.length = 0;
+        stack_table_name(&rt->alloc_sites, rows[i].id, &name);
+        double values[3] = {(double)rows[i].stats.allocated_bytes, (double)rows[i].stats.live_bytes,
+                            (double)rows[i].stats.promoted_bytes};
+        profile_report_row(list_slot, &name, values, 3);
+    }
+    sb_free(&name);
+    free(rows);
+    Value *list = rt->temp_roots[list_slot];
+    pop_root();
+    return list;
+}
+
+static void eval_profile_start(double interval_us) {
+    stack_table_reset(&rt->eval_stacks);
+    stack_table_reset(&rt->eval_functions);
+    EVAL_PROFILE_SET_TICK(0);
+    rt->eval_profile_last_ms = profile_now_ms();
+#ifdef HAVE_PROFILE_TIMER
+    if (!rt->eval_profiling) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = eval_profile_on_timer;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &eval_profile_saved_action);
+    }
+    struct itimerval timer;
+    timer.it_interval.tv_sec = (time_t)(interval_us / 1e6);
+    timer.it_interval.tv_usec = (suseconds_t)fmod(interval_us, 1e6);
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+#else
+    (void)interval_us;
+    rt->eval_profile_countdown = PROFILE_CALLS_PER_SAMPLE;
+#endif
+    rt->eval_profiling = 1;
+    call_stack_update();
+}
+
+static void eval_profile_stop(void) {
+    if (!rt->eval_profiling) return;
+#ifdef HAVE_PROFILE_TIMER
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &eval_profile_saved_action, NULL);
+#endif
+    rt->eval_profiling = 0;
+    EVAL_PROFILE_SET_TICK(0);
+    call_stack_update();
+}
+
+typedef struct {
+    size_t calls;
+    double inclusive_ms;
+    double exclusive_ms;
+    uint32_t id;
+} FunctionProfileRow;
+
+// Attribute every sampled stack to its functions: all of its time is
+// inclusive time of each distinct function on it and exclusive time of the
+// innermost one. Returns one row per eval_functions entry, the empty stack
+// excluded, in `*out_rows`.
+static size_t eval_profile_functions(FunctionProfileRow **out_rows) {
+    // Sampled stacks may add functions (frames pushed before profiling).
+    for (size_t id = 0; id < rt->eval_stacks.count; ++id) {
+        const StackEntry *entry = &rt->eval_stacks.entries[id];
+        for (uint32_t i = 0; i < entry->depth; ++i) {
+            stack_table_intern(&rt->eval_functions, &rt->eval_stacks.frames[entry->offset + i], 1);
+        }
+    }
+    size_t count = rt->eval_functions.count;
+    FunctionProfileRow *rows = (FunctionProfileRow*)calloc(count ? count : 1, sizeof(FunctionProfileRow));
+    uint32_t *seen = (uint32_t*)malloc(PROFILE_MAX_FRAMES * sizeof(uint32_t));
+    if (!rows || !seen) runtime_error("Out of memory for the profile report");
+    for (size_t id = 0; id < count; ++id) {
+        rows[id].id = (uint32_t)id;
+        rows[id].calls = rt->eval_functions.entries[id].calls;
+    }
+    for (size_t id = 0; id < rt->eval_stacks.count; ++id) {
+        const StackEntry *entry = &rt->eval_stacks.entries[id];
+        if (entry->depth == 0 || entry->ms == 0.0) continue;
+        uint32_t distinct = 0;
+        for (uint32_t i = 0; i < entry->depth; ++i) {
+            uint32_t fn = stack_table_intern(&rt->eval_functions, &rt->eval_stacks.frames[entry->offset + i], 1);
+            uint32_t k = 0;
+            while (k < distinct && seen[k] != fn) k++;
+            if (k == distinct) {
+                seen[distinct++] = fn;
+                rows[fn].inclusive_ms += entry->ms;
+            }
+            if (i == entry->depth - 1) rows[fn].exclusive_ms += entry->ms;
+        }
+    }
+    free(seen);
+    // Drop the empty stack (id 0).
+    memmove(rows, rows + 1, (count ? count - 1 : 0) * sizeof(FunctionProfileRow));
+    *out_rows = rows;
+    return count ? count - 1 : 0;
+}
+
+static int compare_function_rows(const void *a, const void *b) {
+    const FunctionProfileRow *left = (const FunctionProfileRow*)a;
+    const FunctionProfileRow *right = (const FunctionProfileRow*)b;
+    if (left->exclusive_ms != right->exclusive_ms) return left->exclusive_ms < right->exclusive_ms ? -1 : 1;
+    if (left->inclusive_ms != right->inclusive_ms) return left->inclusive_ms < right->inclusive_ms ? -1 : 1;
+    return left->calls < right->calls ? -1 : left->calls > right->calls;
+}
+
+// A list of (function calls inclusive-ms exclusive-ms), most exclusive time
+// first.
+static Value *eval_profile_report(void) {
+    FunctionProfileRow *rows;
+    size_t count = eval_profile_functions(&rows);
+    qsort(rows, count, sizeof(FunctionProfileRow), compare_function_rows);
+    StrBuf name;
+    sb_init(&name, NULL);
+    size_t list_slot = rt->temp_root_sp;
+    push_root(NIL);
+    for (size_t i = 0; i < count; ++i) {
+        name.length = 0;
+        stack_table_name(&rt->eval_functions, rows[i].id, &name);
+        double values[3] = {(double)rows[i].calls, rows[i].inclusive_ms, rows[i].exclusive_ms};
+        profile_report_row(list_slot, &name, values, 3);
+    }
+    sb_free(&name);
+    free(rows);
+    Value *list = rt->temp_roots[list_slot];
+    pop_root();
+    return list;
+}
+
+// Sampled stacks as folded stacks weighted in microseconds.
+static int eval_profile_write_stacks(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return 0;
+    StrBuf name;
+    sb_init(&name, NULL);
+    for (uint32_t id = 0; id < rt->eval_stacks.count; ++id) {
+        long us = lround(rt->eval_stacks.entries[id].ms * 1000.0);
+        if (us <= 0) continue;
+        name.length = 0;
+        stack_table_name(&rt->eval_stacks, id, &name);
+        fprintf(out, "%s %ld\n", sb_text(&name), us);
+    }
+    sb_free(&name);
+    return fclose(out) == 0;
+}
+
+static int eval_profile_write_functions(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return 0;
+    FunctionProfileRow *rows;
+    size_t count = eval_profile_functions(&rows);
+    qsort(rows, count, sizeof(FunctionProfileRow), compare_function_rows);
+    StrBuf name;
+    sb_init(&name, NULL);
+    fprintf(out, "%12s %14s %14s  %s\n", "calls", "inclusive-ms", "exclusive-ms", "function");
+    for (size_t i = count; i > 0; --i) {
+        const FunctionProfileRow *row = &rows[i - 1];
+        name.length = 0;
+        stack_table_name(&rt->eval_functions, row->id, &name);
+        fprintf(out, "%12zu %14.3f %14.3f  %s\n", row->calls, row->inclusive_ms, row->exclusive_ms, sb_text(&name));
+    }
+    sb_free(&name);
+    free(rows);
+    return fclose(out) == 0;
+}
+
+static void eval_profile_write_at_exit(void) {
+    char path[4096];
+    eval_profile_stop();
+    snprintf(path, sizeof(path), "%s.functions", rt->eval_profile_path);
+    if (!eval_profile_write_stacks(rt->eval_profile_path) || !eval_profile_write_functions(path)) {
+        fprintf(stderr, "Failed to write evaluator profile %s\n", rt->eval_profile_path);
+    }
+}
+
+// MINIMALISP_ALLOC_PROFILE=path profiles the whole run and writes folded
+// stacks of allocated, live-at-exit and promoted bytes to path, path.live and
+// path.promoted. MINIMALISP_ALLOC_PROFILE_BYTES sets the sampling interval.
+// MINIMALISP_PROFILE=path does the same for evaluator time, writing folded
+// stacks to path and a per-function table to path.functions;
+// MINIMALISP_PROFILE_US sets its sampling interval.
+static void profile_from_env(void) {
+    const char *path = getenv("MINIMALISP_ALLOC_PROFILE");
+    if (path && *path) {
+        const char *bytes = getenv("MINIMALISP_ALLOC_PROFILE_BYTES");
+        long interval = bytes ? atol(bytes) : 0;
+        rt->alloc_profile_path = path;
+        alloc_profile_start(interval > 0 ? (size_t)interval : PROFILE_DEFAULT_SAMPLE_BYTES);
+        atexit(alloc_profile_write_at_exit);
+    }
+    path = getenv("MINIMALISP_PROFILE");
+    if (path && *path) {
+        const char *us = getenv("MINIMALISP_PROFILE_US");
+        double interval = us ? atof(us) : 0.0;
+        rt->eval_profile_path = path;
+        eval_profile_start(interval > 0.0 ? interval : PROFILE_DEFAULT_INTERVAL_US);
+        atexit(eval_profile_write_at_exit);
+    }
+}
+
+static const char *profile_path_arg(Value **args, int argc, const char *error) {
+    if (argc < 2 || !args[1] || (VALUE_TYPE(args[1]) != VAL_STRING && VALUE_TYPE(args[1]) != VAL_SYMBOL)) {
+        runtime_error("%s", error);
+    }
+    return VALUE_TYPE(args[1]) == VAL_STRING ? STRING_CHARS(args[1]) : SYMBOL_NAME(args[1]);
+}
+
+static Value *builtin_gc_profile(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc < 1 || !args[0] || VALUE_TYPE(args[0]) != VAL_SYMBOL) {
+        runtime_error("gc-profile expects start, stop, report or dump");
+    }
+    const char *command = SYMBOL_NAME(args[0]);
+    if (strcmp(command, "start") == 0) {
+        size_t interval = PROFILE_DEFAULT_SAMPLE_BYTES;
+        if (argc > 1) {
+            if (!args[1] || VALUE_TYPE(args[1]) != VAL_NUMBER || NUMBER_VALUE(args[1]) < 1) {
+                runtime_error("gc-profile start expects a positive sampling interval in bytes");
+            }
+            interval = (size_t)NUMBER_VALUE(args[1]);
+        }
+        alloc_profile_start(interval);
+        return TRUE;
+    }
+    if (strcmp(command, "stop") == 0) {
+        alloc_profile_stop();
+        return TRUE;
+    }
+    if (strcmp(command, "report") == 0) return alloc_profile_report();
+    if (strcmp(command, "dump") == 0) {
+        const char *path = profile_path_arg(args, argc, "gc-profile dump expects a file name");
+        ProfileMetric metric = PROFILE_ALLOCATED;
+        if (argc > 2) {
+            const char *which = args[2] && VALUE_TYPE(args[2]) == VAL_SYMBOL ? SYMBOL_NAME(args[2]) : "";
+            if (strcmp(which, "live") == 0) metric = PROFILE_LIVE;
+            else if (strcmp(which, "promoted") == 0) metric = PROFILE_PROMOTED;
+            else if (strcmp(which, "allocated") != 0) {
+                runtime_error("gc-profile dump expects allocated, live or promoted");
+            }
+        }
+        if (!alloc_profile_write_folded(path, metric)) runtime_error("Failed to write %s", path);
+        return TRUE;
+    }
+    runtime_error("gc-profile expects start, stop, report or dump");
+    return NIL;
+}
+
+// (gc-trace) counts the pauses traced so far; (gc-trace 'dump "file")
+// writes the retained ones as a Chrome trace.
+static Value *builtin_gc_trace(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc == 0) return make_number((double)gc_trace_total());
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_SYMBOL) runtime_error("gc-trace expects clear or dump");
+    const char *command = SYMBOL_NAME(args[0]);
+    if (strcmp(command, "clear") == 0) {
+        gc_trace_clear();
+        return TRUE;
+    }
+    if (strcmp(command, "dump") == 0) {
+        const char *path = profile_path_arg(args, argc, "gc-trace dump expects a file name");
+        const char *json = gc_trace_json();
+        FILE *out = json ? fopen(path, "w") : NULL;
+        if (!out) runtime_error("Failed to write %s", path);
+        fputs(json, out);
+        if (fclose(out) != 0) runtime_error("Failed to write %s", path);
+        return TRUE;
+    }
+    runtime_error("gc-trace expects clear or dump");
+    return NIL;
+}
+
+static Value *builtin_profile(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc < 1 || !args[0] || VALUE_TYPE(args[0]) != VAL_SYMBOL) {
+        runtime_error("profile expects start, stop, report or dump");
+    }
+    const char *command = SYMBOL_NAME(args[0]);
+    if (strcmp(command, "start") == 0) {
+        double interval = PROFILE_DEFAULT_INTERVAL_US;
+        if (argc > 1) {
+            if (!args[1] || VALUE_TYPE(args[1]) != VAL_NUMBER || NUMBER_VALUE(args[1]) < 1) {
+                runtime_error("profile start expects a positive sampling interval in microseconds");
+            }
+            interval = NUMBER_VALUE(args[1]);
+        }
+        eval_profile_start(interval);
+        return TRUE;
+    }
+    if (strcmp(command, "stop") == 0) {
+        eval_profile_stop();
+        return TRUE;
+    }
+    if (strcmp(command, "report") == 0) return eval_profile_report();
+    if (strcmp(command, "dump") == 0) {
+        const char *path = profile_path_arg(args, argc, "profile dump expects a file name");
+        int functions = 0;
+        if (argc > 2) {
+            const char *which = args[2] && VALUE_TYPE(args[2]) == VAL_SYMBOL ? SYMBOL_NAME(args[2]) : "";
+            if (strcmp(which, "functions") == 0) functions = 1;
+            else if (strcmp(which, "stacks") != 0) runtime_error("profile dump expects stacks or functions");
+        }
+        int ok = functions ? eval_profile_write_functions(path) : eval_profile_write_stacks(path);
+        if (!ok) runtime_error("Failed to write %s", path);
+        return TRUE;
+    }
+    runtime_error("profile expects start, stop, report or dump");
+    return NIL;
+}
+
+// Compilation ---------------------------------------------------------------
+//
+// Forms are compiled once into a tree of pre-decoded nodes before they run, so
+// the evaluator never re-inspects special-form symbols or re-walks argument
+// lists. Nodes live in malloc'd arenas outside the GC heap; any GC value a
+// node holds (literal constants, lambda source) is registered as a root slot.
+// An arena is freed after its top-level form runs unless a closure was made
+// from its code. Every such closure holds the arena's anchor, a small GC
+// object that is a root while the arena is in use and a weak root once it
+// has been popped; the arena is freed after a collection finds the anchor
+// dead. Running code is reachable throughout: a lambda body's closure stays
+// on the temp root stack while it runs.
+
+static void code_arena_add_root(Value **slot);
+
+static int value_is_static(Value *value) {
+    return is_nil(value) || IS_FIXNUM(value) || value->type == VAL_SYMBOL;
+}
+
+static void *code_alloc(size_t size) {
+    CodeArena *arena = rt->code_arena_top;
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    CodeChunk *chunk = arena->chunks;
+    if (!chunk || chunk->used + size > chunk->capacity) {
+        size_t capacity = size > CODE_CHUNK_SIZE ? size : CODE_CHUNK_SIZE;
+        chunk = (CodeChunk*)malloc(sizeof(CodeChunk) + capacity);
+        if (!chunk) {
+            fprintf(stderr, "Out of memory while compiling\n");
+            exit(1);
+        }
+        chunk->next = arena->chunks;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        arena->chunks = chunk;
+    }
+    void *mem = chunk->data + chunk->used;
+    chunk->used += size;
+    return mem;
+}
+
+static Node *node_new(NodeKind kind, int count) {
+    Node *node = (Node*)code_alloc(sizeof(Node));
+    node->kind = kind;
+    node->value = NIL;
+    node->body = NIL;
+    node->count = count;
+    node->depth = 0;
+    node->index = 0;
+    node->param_count = 0;
+    node->frame_size = 0;
+    node->names = NULL;
+    node->cell = NULL;
+    node->arena = rt->code_arena_top;
+    node->children = count > 0 ? (Node**)code_alloc(sizeof(Node*) * (size_t)count) : NULL;
+    return node;
+}
+
+static Node *node_const(Value *value) {
+    Node *node = node_new(NODE_CONST, 0);
+    node->value = value ? value : NIL;
+    if (!value_is_static(node->value)) code_arena_add_root(&node->value);
+    return node;
+}
+
+static void code_arena_add_root(Value **slot) {
+    CodeArena *arena = rt->code_arena_top;
+    if (arena->root_count >= arena->root_capacity) {
+        size_t new_cap = arena->root_capacity ? arena->root_capacity * 2 : 16;
+        Value ***roots = (Value***)realloc(arena->roots, new_cap * sizeof(Value**));
+        if (!roots) {
+            fprintf(stderr, "Out of memory while compiling\n");
+            exit(1);
+        }
+        arena->roots = roots;
+        arena->root_capacity = new_cap;
+    }
+    arena->roots[arena->root_count++] = slot;
+    gc_add_root((void**)slot);
+}
+
+static void code_arena_push(void) {
+    CodeArena *arena = (CodeArena*)calloc(1, sizeof(CodeArena));
+    if (!arena) {
+        fprintf(stderr, "Out of memory while compiling\n");
+        exit(1);
+    }
+    arena->outer = rt->code_arena_top;
+    rt->code_arena_top = arena;
+}
+
+static void code_arena_free(CodeArena *arena) {
+    free(arena->roots);
+    CodeChunk *chunk = arena->chunks;
+    while (chunk) {
+        CodeChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+static void code_arena_release(CodeArena *arena) {
+    for (size_t i = 0; i < arena->root_count; ++i) {
+        gc_remove_root((void**)arena->roots[i]);
+    }
+    code_arena_free(arena);
+}
+
+// The arena's anchor, allocated by the first closure over its code. May
+// collect.
+static Value *code_arena_anchor(CodeArena *arena) {
+    if (!arena->anchor) {
+        arena->anchor = (Value*)gc_allocate_fast(sizeof(void*), NULL, GC_TAG_CODE);
+        gc_add_root((void**)&arena->anchor);
+    }
+    return arena->anchor;
+}
+
+// Free the popped arenas whose anchor a collection has cleared.
+static void code_arena_release_dead(void) {
+    double collections = gc_get_collections_count();
+    if (collections == rt->kept_arenas_checked) return;
+    rt->kept_arenas_checked = collections;
+    CodeArena **link = &rt->kept_arenas;
+    while (*link) {
+        CodeArena *arena = *link;
+        if (arena->anchor) {
+            link = &arena->outer;
+            continue;
+        }
+        *link = arena->outer;
+        code_arena_release(arena);
+    }
+}
+
+// Pop the innermost arena, freeing it unless closures still reference it.
+static void code_arena_pop(void) {
+    CodeArena *arena = rt->code_arena_top;
+    if (!arena) return;
+    rt->code_arena_top = arena->outer;
+    if (arena->anchor) {
+        gc_remove_root((void**)&arena->anchor);
+        gc_add_weak_root((void**)&arena->anchor);
+        arena->outer = rt->kept_arenas;
+        rt->kept_arenas = arena;
+    } else {
+        code_arena_release(arena);
+    }
+    code_arena_release_dead();
+}
+
+static Node *compile_expr(Value *expr, Scope *scope);
+
+static int list_length(Value *list, const char *error) {
+    int count = 0;
+    while (!is_nil(list)) {
+        if (VALUE_TYPE(list) != VAL_PAIR) runtime_error("%s", error);
+        count++;
+        list = CDR(list);
+    }
+    return count;
+}
+
+static Node *compile_sequence(Value *exprs, Scope *scope) {
+    int count = list_length(exprs, "Malformed expression list");
+    if (count == 1) return compile_expr(CAR(exprs), scope);
+    Node *node = node_new(NODE_SEQ, count);
+    for (int i = 0; i < count; ++i) {
+        node->children[i] = compile_expr(CAR(exprs), scope);
+        exprs = CDR(exprs);
+    }
+    return node;
+}
+
+static int scope_index(Scope *scope, Value *name) {
+    for (int i = 0; i < scope->count; ++i) {
+        if (scope->names[i] == name) return i;
+    }
+    return -1;
+}
+
+typedef struct {
+    Value **names;
+    int count;
+    int capacity;
+} NameList;
+
+static void name_list_add(NameList *list, Value *name) {
+    for (int i = 0; i < list->count; ++i) {
+        if (list->names[i] == name) return;
+    }
+    if (list->count >= list->capacity) {
+        int new_cap = list->capacity ? list->capacity * 2 : 8;
+        Value **names = (Value**)realloc(list->names, sizeof(Value*) * (size_t)new_cap);
+        if (!names) {
+            fprintf(stderr, "Out of memory while compiling\n");
+            exit(1);
+        }
+        list->names = names;
+        list->capacity = new_cap;
+    }
+    list->names[list->count++] = name;
+}
+
+// Collect names introduced by `define` anywhere in a lambda body (but not in
+// nested lambdas or quoted data) so each gets a slot in the lambda's frame.
+static void collect_defines(Value *expr, NameList *list) {
+    if (!expr || VALUE_TYPE(expr) != VAL_PAIR) return;
+    Value *op = CAR(expr);
+    if (op == rt->sym_quote || op == rt->sym_lambda) return;
+    if (op == rt->sym_define && CDR(expr) && VALUE_TYPE(CDR(expr)) == VAL_PAIR) {
+        Value *target = CAR(CDR(expr));
+        if (target && VALUE_TYPE(target) == VAL_SYMBOL) {
+            name_list_add(list, target);
+            for (Value *e = CDR(CDR(expr)); e && VALUE_TYPE(e) == VAL_PAIR; e = CDR(e)) {
+                collect_defines(CAR(e), list);
+            }
+        } else if (target && VALUE_TYPE(target) == VAL_PAIR && CAR(target) && VALUE_TYPE(CAR(target)) == VAL_SYMBOL) {
+            name_list_add(list, CAR(target));
+        }
+        return;
+    }
+    for (Value *e = expr; e && VALUE_TYPE(e) == VAL_PAIR; e = CDR(e)) {
+        collect_defines(CAR(e), list);
+    }
+}
+
+static Node *compile_lambda(Value *params, Value *body, Scope *scope) {
+    int param_count = list_length(params, "Malformed parameter list");
+    NameList names = {NULL, 0, 0};
+    Value *p = params;
+    for (int i = 0; i < param_count; ++i) {
+        if (!CAR(p) || VALUE_TYPE(CAR(p)) != VAL_SYMBOL) {
+            free(names.names);
+            runtime_error("Parameters must be symbols");
+        }
+        name_list_add(&names, CAR(p));
+        p = CDR(p);
+    }
+    if (names.count != param_count) {
+        free(names.names);
+        runtime_error("Duplicate parameter name");
+    }
+    for (Value *b = body; b && VALUE_TYPE(b) == VAL_PAIR; b = CDR(b)) {
+        collect_defines(CAR(b), &names);
+    }
+
+    Node *node = node_new(NODE_LAMBDA, 1);
+    node->param_count = param_count;
+    node->frame_size = names.count;
+    node->names = names.count > 0 ? (Value**)code_alloc(sizeof(Value*) * (size_t)names.count) : NULL;
+    if (names.count > 0) memcpy(node->names, names.names, sizeof(Value*) * (size_t)names.count);
+    free(names.names);
+    node->value = params ? params : NIL;
+    node->body = body ? body : NIL;
+    if (!value_is_static(node->value)) code_arena_add_root(&node->value);
+    if (!value_is_static(node->body)) code_arena_add_root(&node->body);
+
+    Scope inner = {scope, node->names, node->frame_size};
+    node->children[0] = compile_sequence(body, &inner);
+    return node;
+}
+
+static Node *compile_variable(Value *name, Scope *scope) {
+    int depth = 0;
+    for (Scope *s = scope; s; s = s->parent, depth++) {
+        int index = scope_index(s, name);
+        if (index >= 0) {
+            Node *node = node_new(NODE_LOCAL, 0);
+            node->value = name;
+            node->depth = depth;
+            node->index = index;
+            return node;
+        }
+    }
+    Node *node = node_new(NODE_GLOBAL, 0);
+    node->value = name;
+    node->cell = global_cell(name);
+    return node;
+}
+
+static Node *compile_define(Value *name, Node *init, Scope *scope) {
+    Node *node;
+    if (scope) {
+        node = node_new(NODE_DEFINE_LOCAL, 1);
+        node->index = scope_index(scope, name);
+    } else {
+        node = node_new(NODE_DEFINE_GLOBAL, 1);
+        node->cell = global_cell(name);
+        // Name the procedure after its global for profiles.
+        if (init->kind == NODE_LAMBDA && !init->cell) init->cell = node->cell;
+    }
+    node->value = name;
+    node->children[0] = init;
+    return node;
+}
+
+static Node *compile_expr(Value *expr, Scope *scope) {
+    if (!expr) return node_const(NIL);
+    if (VALUE_TYPE(expr) == VAL_SYMBOL) return compile_variable(expr, scope);
+    if (VALUE_TYPE(expr) != VAL_PAIR) return node_const(expr);
+    Value *op = CAR(expr);
+    if (!op) return node_const(NIL);
+    Value *args = CDR(expr);
+    if (op == rt->sym_quote) {
+        if (!is_pair(args)) runtime_error("quote expects an argument");
+        return node_const(CAR(args));
+    }
+    if (op == rt->sym_define) {
+        if (!is_pair(args)) runtime_error("define expects a symbol or list");
+        Value *target = CAR(args);
+        Value *value_exprs = CDR(args);
+        if (!is_pair(value_exprs)) runtime_error("define missing value");
+        if (target && VALUE_TYPE(target) == VAL_SYMBOL) {
+            return compile_define(target, compile_expr(CAR(value_exprs), scope), scope);
+        }
+        if (target && VALUE_TYPE(target) == VAL_PAIR) {
+            Value *fn_name = CAR(target);
+            if (!fn_name || VALUE_TYPE(fn_name) != VAL_SYMBOL) {
+                runtime_error("define function requires a name");
+            }
+            return compile_define(fn_name, compile_lambda(CDR(target), value_exprs, scope), scope);
+        }
+        runtime_error("define expects a symbol or (name args)");
+    }
+    if (op == rt->sym_lambda) {
+        if (!is_pair(args)) runtime_error("lambda expects parameters");
+        if (!is_pair(CDR(args))) runtime_error("lambda body cannot be empty");
+        return compile_lambda(CAR(args), CDR(args), scope);
+    }
+    if (op == rt->sym_if) {
+        Value *test_expr = is_pair(args) ? CAR(args) : NIL;
+        Value *rest = is_pair(args) ? CDR(args) : NIL;
+        Value *then_expr = is_pair(rest) ? CAR(rest) : NIL;
+        Value *else_expr = (is_pair(rest) && is_pair(CDR(rest))) ? CAR(CDR(rest)) : NIL;
+        Node *node = node_new(NODE_IF, 3);
+        node->children[0] = compile_expr(test_expr, scope);
+        node->children[1] = compile_expr(then_expr, scope);
+        node->children[2] = compile_expr(else_expr, scope);
+        return node;
+    }
+    if (op == rt->sym_begin) {
+        if (is_nil(args)) return node_const(NIL);
+        return compile_sequence(args, scope);
+    }
+    int argc = list_length(args, "Malformed argument list");
+    Node *node = node_new(NODE_CALL, argc + 1);
+    node->children[0] = compile_expr(op, scope);
+    for (int i = 1; i <= argc; ++i) {
+        node->children[i] = compile_expr(CAR(args), scope);
+        args = CDR(args);
+    }
+    return node;
+}
+
+// Compile top-level `expr` into a fresh arena pushed on the arena stack;
+// callers pop it once the returned code has finished running.
+static Node *compile_toplevel(Value *expr) {
+    code_arena_push();
+    return compile_expr(expr, NULL);
+}
+
+// Evaluation ----------------------------------------------------------------
+
+// Build the frame for calling the closure `operator` with `argc` arguments.
+// One allocation per call: the frame holds every parameter and internal
+// define of the lambda. `args` must be rooted, as the allocation may move it.
+static Env *lambda_frame(Value *operator, Value **args, int argc) {
+    Node *lambda = LAMBDA_CODE(operator);
+    if (argc < lambda->param_count) runtime_error("Too few arguments supplied");
+    if (argc > lambda->param_count) runtime_error("Too many arguments supplied");
+    Env *frame = env_new(lambda->frame_size, LAMBDA_ENV(operator));
+    for (int i = 0; i < argc; ++i) frame->slots[i] = args[i];
+    for (int i = argc; i < lambda->frame_size; ++i) frame->slots[i] = NULL;
+    return frame;
+}
+
+static Value *eval_node(Node *node, Env *env);
+
+// Call `fn` on rooted arguments from C, outside any tail position. Natives
+// that take procedures use this instead of building a call expression.
+static Value *apply_procedure(Value *fn, Value **args, int argc, Env *env) {
+    if (!fn) runtime_error("Attempt to call nil");
+    size_t frame_base = rt->call_stack_depth;
+    Value *result;
+    if (VALUE_TYPE(fn) == VAL_BUILTIN) {
+        if (rt->call_stack_enabled) call_stack_push(NULL, BUILTIN_FN(fn));
+        result = BUILTIN_FN(fn)(args, argc, env);
+    } else {
+        if (VALUE_TYPE(fn) != VAL_LAMBDA) runtime_error("Attempt to call non-procedure");
+        Node *lambda = LAMBDA_CODE(fn);
+        if (rt->call_stack_enabled) call_stack_push(lambda, NULL);
+        result = eval_node(lambda->children[0], lambda_frame(fn, args, argc));
+    }
+    if (rt->call_stack_depth != frame_base) call_stack_pop_to(frame_base);
+    return result;
+}
+
+// Trampolined evaluator: expressions in tail position (if branches, the last
+// form of a sequence, lambda bodies) replace `node`/`env` and loop instead of
+// recursing, so tail-recursive Lisp loops run in constant C and root stack.
+// The current environment lives in temp_roots[base] and is re-read after
+// anything that may allocate, because moving collectors update that slot.
+static Value *eval_node(Node *node, Env *env) {
+    size_t base = rt->temp_root_sp;
+    size_t frame_base = rt->call_stack_depth;
+    push_root((Value*)env);
+    Value *result = NIL;
+#define CURRENT_ENV ((Env*)rt->temp_roots[base])
+    for (;;) {
+        switch (node->kind) {
+            case NODE_CONST:
+                result = node->value;
+                goto done;
+            case NODE_LOCAL: {
+                Env *frame = CURRENT_ENV;
+                for (int d = node->depth; d > 0; --d) frame = frame->parent;
+                result = frame->slots[node->index];
+                if (!result) runtime_error("Undefined symbol: %s", SYMBOL_NAME(node->value));
+                goto done;
+            }
+            case NODE_GLOBAL:
+                result = node->cell->value;
+                if (!result) runtime_error("Undefined symbol: %s", SYMBOL_NAME(node->value));
+                goto done;
+            case NODE_DEFINE_LOCAL: {
+                Value *val = eval_node(node->children[0], CURRENT_ENV);
+                env_set_slot(CURRENT_ENV, node->index, val);
+                result = node->value;
+                goto done;
+            }
+            case NODE_DEFINE_GLOBAL:
+                node->cell->value = eval_node(node->children[0], CURRENT_ENV);
+                result = node->value;
+                goto done;
+            case NODE_LAMBDA:
+                result = make_lambda(node, CURRENT_ENV);
+                goto done;
+            case NODE_IF: {
+                Value *test_val = eval_node(node->children[0], CURRENT_ENV);
+                node = node->children[is_truthy(test_val) ? 1 : 2];
+                continue;
+            }
+            case NODE_SEQ:
+                for (int i = 0; i < node->count - 1; ++i) {
+                    eval_node(node->children[i], CURRENT_ENV);
+                }
+                node = node->children[node->count - 1];
+                continue;
+            case NODE_CALL: {
+                // Operator and arguments live on the temp root stack so the
+                // argument vector handed to builtins stays valid across moves.
+                size_t sp_start = rt->temp_root_sp;
+                int argc = node->count - 1;
+                for (int i = 0; i <= argc; ++i) {
+                    push_root(eval_node(node->children[i], CURRENT_ENV));
+                }
+                Value *operator = rt->temp_roots[sp_start];
+                Value **arg_values = &rt->temp_roots[sp_start + 1];
+                if (!operator) runtime_error("Attempt to call nil");
+                if (VALUE_TYPE(operator) == VAL_BUILTIN) {
+                    if (rt->call_stack_enabled) call_stack_push(NULL, BUILTIN_FN(operator));
+                    result = BUILTIN_FN(operator)(arg_values, argc, CURRENT_ENV);
+                    goto done;
+                }
+                if (VALUE_TYPE(operator) != VAL_LAMBDA) runtime_error("Attempt to call non-procedure");
+                Node *lambda = LAMBDA_CODE(operator);
+                if (rt->call_stack_enabled) {
+                    // This activation's frame, if any, is replaced.
+                    call_stack_pop_to(frame_base);
+                    call_stack_push(lambda, NULL);
+                }
+                Env *call_env = lambda_frame(operator, arg_values, argc);
+                // Tail call: the new frame replaces ours and the arguments are
+                // dropped before the body runs. The closure stays rooted so
+                // its code cannot be freed while it runs.
+                rt->temp_roots[base] = (Value*)call_env;
+                rt->temp_roots[base + 1] = rt->temp_roots[sp_start];
+                rt->temp_root_sp = base + 2;
+                node = lambda->children[0];
+                continue;
+            }
+        }
+        runtime_error("Cannot evaluate expression");
+    }
+#undef CURRENT_ENV
+done:
+    rt->temp_root_sp = base;
+    if (rt->call_stack_depth != frame_base) call_stack_pop_to(frame_base);
+    return result;
+}
+
+// Compile and run `expr` at top level, releasing the compiled code afterwards.
+static Value *eval_value(Value *expr) {
+    Node *code = compile_toplevel(expr);
+    Value *result = eval_node(code, NULL);
+    code_arena_pop();
+    return result;
+}
+
+static Value *eval_source(const char *src, int *out_error) {
+    runtime_init();
+    Value *result = NIL;
+    rt->eval_depth++;
+    
+    // Save state for re-entrancy
+    const char *saved_input = rt->input_ptr;
+    Token saved_token = rt->cur_token;
+    jmp_buf *saved_jmp_env = rt->eval_jmp_env;
+    size_t saved_sp = rt->temp_root_sp;
+    size_t saved_call_depth = rt->call_stack_depth;
+    CodeArena *saved_arena = rt->code_arena_top;
+    
+    jmp_buf local_jmp_buf;
+    rt->eval_jmp_env = &local_jmp_buf;
+    
+    if (setjmp(local_jmp_buf) == 0) {
+        rt->input_ptr = src;
+        rt->cur_token = next_token();
+        // temp_root_sp = 0; // Don't reset, preserve caller's roots
+        while (rt->cur_token.type != TOK_EOF) {
+            Value *form = read_form();
+            push_root(form);
+            Node *code = compile_toplevel(form);
+            pop_root();
+            result = eval_node(code, NULL);
+            code_arena_pop();
+        }
+        if (out_error) *out_error = 0;
+    } else {
+        rt->temp_root_sp = saved_sp; // Restore stack on error
+        rt->call_stack_depth = saved_call_depth;
+        while (rt->code_arena_top != saved_arena) code_arena_pop();
+        if (out_error) *out_error = 1;
+    }
+    
+    // Restore state
+    rt->input_ptr = saved_input;
+    rt->cur_token = saved_token;
+    rt->eval_jmp_env = saved_jmp_env;
+    if (--rt->eval_depth == 0) {
+        gc_add_root((void**)&result);
+        gc_eval_boundary();
+        gc_remove_root((void**)&result);
+    }
+    return result;
+}
+
+static void trace_env(void *obj) {
+    Env *env = (Env*)obj;
+    if (env->parent) env->parent = (Env*)gc_mark_ptr(env->parent);
+    for (int i = 0; i < env->count; ++i) {
+        if (env->slots[i]) env->slots[i] = gc_mark_ptr(env->slots[i]);
+    }
+}
+
+static void trace_value(void *obj) {
+    Value *value = (Value*)obj;
+    switch (VALUE_TYPE(value)) {
+        case VAL_PAIR:
+            if (CAR(value)) CAR(value) = gc_mark_ptr(CAR(value));
+            if (CDR(value)) CDR(value) = gc_mark_ptr(CDR(value));
+            break;
+        case VAL_LAMBDA:
+            // The code tree's source values are rooted by its arena.
+            if (LAMBDA_ENV(value)) LAMBDA_ENV(value) = (Env*)gc_mark_ptr(LAMBDA_ENV(value));
+            if (LAMBDA_ANCHOR(value)) LAMBDA_ANCHOR(value) = gc_mark_ptr(LAMBDA_ANCHOR(value));
+            break;
+        case VAL_VECTOR: {
+            Value **items = VECTOR_ITEMS(value);
+            for (size_t i = 0; i < VECTOR_LENGTH(value); ++i) {
+                if (items[i]) items[i] = gc_mark_ptr(items[i]);
+            }
+            break;
+        }
+        case VAL_HASHTABLE:
+            ((Hashtable*)value)->buckets = gc_mark_ptr(((Hashtable*)value)->buckets);
+            break;
+        case VAL_FUTURE:
+            if (((Future*)value)->thunk) ((Future*)value)->thunk = gc_mark_ptr(((Future*)value)->thunk);
+            if (((Future*)value)->value) ((Future*)value)->value = gc_mark_ptr(((Future*)value)->value);
+            break;
+        case VAL_STRING:
+        case VAL_SYMBOL:
+        case VAL_BUILTIN:
+        case VAL_NUMBER:
+        case VAL_NIL:
         default:
-            runtime_error("Cannot evaluate expression");
-            return NIL;
+            break;
+    }
+}
+
+void print_value(Value *value) {
+    StrBuf sb;
+    sb_init(&sb, stdout_sink);
+    sb_append_value(&sb, value, 1);
+    sb_flush_to_sink(&sb, 0);
+    sb_free(&sb);
+}
+
+static char *read_line(void) {
+    size_t capacity = 128;
+    size_t len = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer) return NULL;
+    int ch;
+    while ((ch = getchar()) != EOF) {
+        if (ch == '\n') break;
+        if (len + 1 >= capacity) {
+            capacity *= 2;
+            char *tmp = realloc(buffer, capacity);
+            if (!tmp) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = tmp;
+        }
+        buffer[len++] = (char)ch;
+    }
+    if (ch == EOF && len == 0) {
+        free(buffer);
+        return NULL;
+    }
+    buffer[len] = '\0';
+    return buffer;
+}
+
+static void append_line(char **buffer, size_t *len, size_t *capacity, const char *line) {
+    size_t line_len = strlen(line);
+    size_t needed = *len + line_len + 2;
+    if (needed > *capacity) {
+        size_t new_cap = *capacity ? *capacity : 128;
+        while (new_cap < needed) new_cap *= 2;
+        char *tmp = realloc(*buffer, new_cap);
+        if (!tmp) {
+            fprintf(stderr, "Out of memory while reading input\n");
+            exit(1);
+        }
+        *buffer = tmp;
+        *capacity = new_cap;
+    }
+    memcpy(*buffer + *len, line, line_len);
+    *len += line_len;
+    (*buffer)[(*len)++] = '\n';
+    (*buffer)[*len] = '\0';
+}
+
+static int buffer_has_content(const char *buffer) {
+    if (!buffer) return 0;
+    for (const char *p = buffer; *p; ++p) {
+        if (!isspace((unsigned char)*p)) return 1;
+    }
+    return 0;
+}
+
+#ifdef __EMSCRIPTEN__
+EMSCRIPTEN_KEEPALIVE
+#endif
+int form_needs_more_input(const char *buffer) {
+    if (!buffer) return 0;
+    int depth = 0;
+    int in_string = 0;
+    int escaping = 0;
+    for (const char *p = buffer; *p; ++p) {
+        char c = *p;
+        if (in_string) {
+            if (escaping) {
+                escaping = 0;
+            } else if (c == '\\') {
+                escaping = 1;
+            } else if (c == '"') {
+                in_string = 0;
+            }
+            continue;
+        }
+        if (c == '"') {
+            in_string = 1;
+            continue;
+        }
+        if (c == ';') {
+            while (*p && *p != '\n') p++;
+            if (!*p) break;
+            continue;
+        }
+        if (c == '(') depth++;
+        else if (c == ')') {
+            if (depth > 0) depth--;
+        }
+    }
+    return depth > 0 || in_string;
+}
+
+static void repl(void) {
+    printf("Minimalisp REPL. Press Ctrl-D to exit.\n");
+    char *form_buffer = NULL;
+    size_t buf_len = 0;
+    size_t buf_capacity = 0;
+    while (1) {
+        printf(buf_len ? "...> " : "ml> ");
+        fflush(stdout);
+        char *line = read_line();
+        if (!line) {
+            printf("\n");
+            break;
+        }
+        if (line[0] == '\0' && buf_len == 0) {
+            free(line);
+            continue;
+        }
+        append_line(&form_buffer, &buf_len, &buf_capacity, line);
+        free(line);
+        if (!buffer_has_content(form_buffer)) {
+            buf_len = 0;
+            if (form_buffer) form_buffer[0] = '\0';
+            continue;
+        }
+        if (form_needs_more_input(form_buffer)) {
+            continue;
+        }
+        int had_error = 0;
+        Value *value = eval_source(form_buffer, &had_error);
+        if (!had_error) {
+            print_value(value);
+            printf("\n");
+        }
+        buf_len = 0;
+        if (form_buffer) form_buffer[0] = '\0';
+    }
+    free(form_buffer);
+}
+
+static int source_read(SourceFile *file, FILE *f) {
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    if (size < 0) return 0;
+    file->text = (char*)malloc((size_t)size + 1);
+    if (!file->text) return 0;
+    if (fread(file->text, 1, (size_t)size, f) != (size_t)size) {
+        free(file->text);
+        return 0;
+    }
+    file->text[size] = '\0';
+    file->size = (size_t)size;
+    file->mapped = 0;
+    return 1;
+}
+
+static int source_open(SourceFile *file, const char *path, int warn_on_error) {
+#ifdef HAVE_MMAP_SOURCE
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        long page = sysconf(_SC_PAGESIZE);
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+            page > 0 && st.st_size % page != 0) {
+            void *text = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (text != MAP_FAILED) {
+                madvise(text, (size_t)st.st_size, MADV_SEQUENTIAL);
+                close(fd);
+                file->text = (char*)text;
+                file->size = (size_t)st.st_size;
+                file->mapped = 1;
+                return 1;
+            }
+        }
+        close(fd);
+    }
+#endif
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        if (warn_on_error) fprintf(stderr, "Failed to open %s\n", path);
+        return 0;
     }
+    int ok = source_read(file, f);
+    fclose(f);
+    return ok;
 }
 
-static Value *eval_sequence(Value *exprs, Env *env) {
-    Value *result = NIL;
-    Value *current = exprs;
-    while (!is_nil(current)) {
-        if (current->type != VAL_PAIR) runtime_error("Malformed expression list");
-        result = eval_value(current->car, env);
-        current = current->cdr;
+static void source_close(SourceFile *file) {
+#ifdef HAVE_MMAP_SOURCE
+    if (file->mapped) {
+        munmap(file->text, file->size);
+        return;
     }
-    return result;
+#endif
+    free(file->text);
 }
 
-static Value *eval_source(const char *src, int *out_error) {
+// Evaluate a whole file, reading its forms into the old generation.
+static Value *eval_source_file(const SourceFile *file, int *out_error) {
     runtime_init();
-    Value *result = NIL;
-    
-    // Save state for re-entrancy
-    const char *saved_input = input_ptr;
-    Token saved_token = cur_token;
-    jmp_buf *saved_jmp_env = eval_jmp_env;
-    int saved_sp = temp_root_sp;
-    
-    jmp_buf local_jmp_buf;
-    eval_jmp_env = &local_jmp_buf;
-    
-    if (setjmp(local_jmp_buf) == 0) {
-        input_ptr = src;
-        cur_token = next_token();
-        // temp_root_sp = 0; // Don't reset, preserve caller's roots
-        while (cur_token.type != TOK_EOF) {
-            Value *form = read_form();
-            push_root(form);
-            result = eval_value(form, global_env);
-            pop_root();
+    int saved_tenured = rt->reader_tenured;
+    rt->reader_tenured = 1;
+    Value *result = eval_source(file->text, out_error);
+    rt->reader_tenured = saved_tenured;
+    return result;
+}
+
+static void load_standard_library(void) {
+    if (rt->library_loaded) return;
+    rt->library_loaded = 1;
+    const char *paths[] = {
+        "standard-lib.lisp",
+#ifdef __EMSCRIPTEN__
+        "/standard-lib.lisp",
+#endif
+        NULL
+    };
+    SourceFile file;
+    int found = 0;
+    for (int i = 0; paths[i] && !found; ++i) {
+        found = source_open(&file, paths[i], 0);
+    }
+    if (!found) {
+        fprintf(stderr, "Warning: standard-lib.lisp not found; continuing without standard library\n");
+        return;
+    }
+    int had_error = 0;
+    Value *value = eval_source_file(&file, &had_error);
+    (void)value;
+    if (had_error) {
+        fprintf(stderr, "Warning: Failed to load standard-lib.lisp\n");
+    }
+    source_close(&file);
+}
+
+// Heap images ---------------------------------------------------------------
+//
+// An image is the global environment after start-up, serialized so a new
+// process can rebuild it without reading, compiling and running
+// standard-lib.lisp. Symbols, values, environments and code nodes are
+// numbered per kind and refer to each other by index, and integers are
+// stored little-endian, so an image does not depend on load addresses or
+// pointer size. Loading maps the file, allocates every object directly in
+// the old generation and links them. Builtins are recorded by name.
+// Parallel evaluation uses in-memory images to copy values between
+// runtimes: a list of root values, optionally with only the globals the
+// roots' code refers to. Futures cannot be copied; globals holding one are
+// left out of a full image, and any other reference fails the write.
+
+#define IMAGE_MAGIC "MLIMAGE"
+#define IMAGE_MAGIC_SIZE 8
+#define IMAGE_VERSION 2u
+
+enum {
+    IMAGE_REF_NULL,
+    IMAGE_REF_NIL,
+    IMAGE_REF_FIXNUM,   // followed by an i64
+    IMAGE_REF_SYMBOL,   // followed by a u32 symbol index
+    IMAGE_REF_VALUE     // followed by a u32 value index
+};
+
+// Pointer -> index map for one kind of object, plus the objects in index
+// order. The writer walks `items` while appending to it, so numbering is a
+// breadth-first traversal with no recursion.
+typedef struct {
+    const void **keys;
+    uint32_t *slots;
+    size_t capacity;
+    const void **items;
+    size_t count;
+    size_t items_capacity;
+} ImageTable;
+
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} ImageBuffer;
+
+typedef struct {
+    ImageTable symbols;
+    ImageTable values;
+    ImageTable envs;
+    ImageTable nodes;
+    ImageTable cells;     // with `referenced_globals`: the globals found so far
+    int all_globals;      // write every bound global
+    int referenced_globals; // write the bound globals the code refers to
+    GlobalCell **bound;   // globals to bind, sorted by name
+    size_t bound_count;
+    Value **roots;
+    size_t root_count;
+    ImageBuffer out;
+} ImageWriter;
+
+static void *image_xrealloc(void *ptr, size_t size) {
+    void *mem = realloc(ptr, size);
+    if (!mem) {
+        fprintf(stderr, "Out of memory while writing heap image\n");
+        exit(1);
+    }
+    return mem;
+}
+
+static size_t image_hash(const void *ptr, size_t mask) {
+    size_t h = (size_t)(uintptr_t)ptr;
+    return (h ^ (h >> 4) ^ (h >> 16)) & mask;
+}
+
+static void image_table_grow(ImageTable *table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 256;
+    const void **keys = (const void**)calloc(capacity, sizeof(void*));
+    uint32_t *slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    if (!keys || !slots) {
+        fprintf(stderr, "Out of memory while writing heap image\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < table->capacity; ++i) {
+        if (!table->keys[i]) continue;
+        size_t h = image_hash(table->keys[i], capacity - 1);
+        while (keys[h]) h = (h + 1) & (capacity - 1);
+        keys[h] = table->keys[i];
+        slots[h] = table->slots[i];
+    }
+    free(table->keys);
+    free(table->slots);
+    table->keys = keys;
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+// The index of `ptr`, numbering it if this is the first sighting.
+static uint32_t image_table_index(ImageTable *table, const void *ptr) {
+    if ((table->count + 1) * 2 > table->capacity) image_table_grow(table);
+    size_t mask = table->capacity - 1;
+    size_t h = image_hash(ptr, mask);
+    while (table->keys[h]) {
+        if (table->keys[h] == ptr) return table->slots[h];
+        h = (h + 1) & mask;
+    }
+    if (table->count == table->items_capacity) {
+        table->items_capacity = table->items_capacity ? table->items_capacity * 2 : 256;
+        table->items = (const void**)image_xrealloc(table->items, table->items_capacity * sizeof(void*));
+    }
+    table->keys[h] = ptr;
+    table->slots[h] = (uint32_t)table->count;
+    table->items[table->count] = ptr;
+    return (uint32_t)table->count++;
+}
+
+static void image_table_free(ImageTable *table) {
+    free(table->keys);
+    free(table->slots);
+    free(table->items);
+}
+
+static void image_put_bytes(ImageBuffer *out, const void *bytes, size_t length) {
+    if (out->length + length > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : 4096;
+        while (capacity < out->length + length) capacity *= 2;
+        out->data = (unsigned char*)image_xrealloc(out->data, capacity);
+        out->capacity = capacity;
+    }
+    memcpy(out->data + out->length, bytes, length);
+    out->length += length;
+}
+
+static void image_put_u8(ImageBuffer *out, unsigned value) {
+    unsigned char byte = (unsigned char)value;
+    image_put_bytes(out, &byte, 1);
+}
+
+static void image_put_u32(ImageBuffer *out, uint32_t value) {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; ++i) bytes[i] = (unsigned char)(value >> (8 * i));
+    image_put_bytes(out, bytes, sizeof(bytes));
+}
+
+static void image_put_u64(ImageBuffer *out, uint64_t value) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; ++i) bytes[i] = (unsigned char)(value >> (8 * i));
+    image_put_bytes(out, bytes, sizeof(bytes));
+}
+
+static void image_put_f64(ImageBuffer *out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    image_put_u64(out, bits);
+}
+
+static const BuiltinEntry *builtin_entry_for(BuiltinFunc fn) {
+    for (const BuiltinEntry *entry = builtin_table; entry->name; ++entry) {
+        if (entry->fn == fn) return entry;
+    }
+    return NULL;
+}
+
+static const BuiltinEntry *builtin_entry_named(const char *name) {
+    for (const BuiltinEntry *entry = builtin_table; entry->name; ++entry) {
+        if (strcmp(entry->name, name) == 0) return entry;
+    }
+    return NULL;
+}
+
+static void image_note_value(ImageWriter *w, Value *value) {
+    if (is_nil(value) || IS_FIXNUM(value)) return;
+    if (value->type == VAL_SYMBOL) {
+        image_table_index(&w->symbols, value);
+    } else {
+        image_table_index(&w->values, value);
+    }
+}
+
+static int image_compare_cells(const void *a, const void *b) {
+    return strcmp(SYMBOL_NAME((*(GlobalCell *const *)a)->name), SYMBOL_NAME((*(GlobalCell *const *)b)->name));
+}
+
+static int image_cell_bound(const GlobalCell *cell) {
+    return cell->value && (IS_FIXNUM(cell->value) || cell->value->type != VAL_FUTURE);
+}
+
+// Number everything reachable from the roots and the bound globals. The
+// globals are taken in name order so the same library always produces the
+// same image.
+static int image_collect(ImageWriter *w) {
+    if (w->all_globals) {
+        w->bound = (GlobalCell**)image_xrealloc(NULL, sizeof(GlobalCell*) * (rt->globals.count + 1));
+        for (size_t i = 0; i < rt->globals.capacity; ++i) {
+            if (rt->globals.cells[i] && image_cell_bound(rt->globals.cells[i])) {
+                w->bound[w->bound_count++] = rt->globals.cells[i];
+            }
         }
-        if (out_error) *out_error = 0;
+        qsort(w->bound, w->bound_count, sizeof(GlobalCell*), image_compare_cells);
+    }
+    for (size_t i = 0; i < w->bound_count; ++i) {
+        GlobalCell *cell = w->bound[i];
+        image_table_index(&w->symbols, cell->name);
+        image_note_value(w, cell->value);
+    }
+    for (size_t i = 0; i < w->root_count; ++i) image_note_value(w, w->roots[i]);
+    size_t values_done = 0, envs_done = 0, nodes_done = 0;
+    while (values_done < w->values.count || envs_done < w->envs.count || nodes_done < w->nodes.count) {
+        while (values_done < w->values.count) {
+            Value *value = (Value*)w->values.items[values_done++];
+            if (value->type == VAL_PAIR) {
+                image_note_value(w, CAR(value));
+                image_note_value(w, CDR(value));
+            } else if (value->type == VAL_LAMBDA) {
+                image_table_index(&w->nodes, LAMBDA_CODE(value));
+                if (LAMBDA_ENV(value)) image_table_index(&w->envs, LAMBDA_ENV(value));
+            } else if (value->type == VAL_BUILTIN) {
+                const BuiltinEntry *entry = builtin_entry_for(BUILTIN_FN(value));
+                if (!entry) {
+                    fprintf(stderr, "Heap image: unknown builtin\n");
+                    return 0;
+                }
+                image_table_index(&w->symbols, intern_symbol(entry->name));
+            } else if (value->type == VAL_VECTOR) {
+                for (size_t i = 0; i < VECTOR_LENGTH(value); ++i) image_note_value(w, VECTOR_ITEMS(value)[i]);
+            } else if (value->type == VAL_HASHTABLE) {
+                image_note_value(w, ((Hashtable*)value)->buckets);
+            } else if (value->type == VAL_FUTURE) {
+                return 0;
+            }
+        }
+        while (envs_done < w->envs.count) {
+            Env *env = (Env*)w->envs.items[envs_done++];
+            if (env->parent) image_table_index(&w->envs, env->parent);
+            for (int i = 0; i < env->count; ++i) image_note_value(w, env->slots[i]);
+        }
+        while (nodes_done < w->nodes.count) {
+            Node *node = (Node*)w->nodes.items[nodes_done++];
+            image_note_value(w, node->value);
+            image_note_value(w, node->body);
+            if (node->cell) {
+                image_table_index(&w->symbols, node->cell->name);
+                size_t known = w->cells.count;
+                if (w->referenced_globals && node->cell->value &&
+                    image_table_index(&w->cells, node->cell) == known) {
+                    image_note_value(w, node->cell->value);
+                }
+            }
+            if (node->names) {
+                for (int i = 0; i < node->frame_size; ++i) image_note_value(w, node->names[i]);
+            }
+            for (int i = 0; i < node->count; ++i) {
+                if (node->children[i]) image_table_index(&w->nodes, node->children[i]);
+            }
+        }
+    }
+    if (w->referenced_globals && w->cells.count) {
+        w->bound = (GlobalCell**)image_xrealloc(NULL, sizeof(GlobalCell*) * w->cells.count);
+        memcpy(w->bound, w->cells.items, sizeof(GlobalCell*) * w->cells.count);
+        w->bound_count = w->cells.count;
+        qsort(w->bound, w->bound_count, sizeof(GlobalCell*), image_compare_cells);
+    }
+    return 1;
+}
+
+static uint32_t image_index_of(ImageTable *table, const void *ptr) {
+    return ptr ? image_table_index(table, ptr) + 1 : 0;
+}
+
+static void image_put_ref(ImageWriter *w, Value *value) {
+    if (!value) {
+        image_put_u8(&w->out, IMAGE_REF_NULL);
+    } else if (value == NIL) {
+        image_put_u8(&w->out, IMAGE_REF_NIL);
+    } else if (IS_FIXNUM(value)) {
+        image_put_u8(&w->out, IMAGE_REF_FIXNUM);
+        image_put_u64(&w->out, (uint64_t)(int64_t)FIXNUM_VALUE(value));
+    } else if (value->type == VAL_SYMBOL) {
+        image_put_u8(&w->out, IMAGE_REF_SYMBOL);
+        image_put_u32(&w->out, image_table_index(&w->symbols, value));
     } else {
-        temp_root_sp = saved_sp; // Restore stack on error
-        if (out_error) *out_error = 1;
+        image_put_u8(&w->out, IMAGE_REF_VALUE);
+        image_put_u32(&w->out, image_table_index(&w->values, value));
     }
-    
-    // Restore state
-    input_ptr = saved_input;
-    cur_token = saved_token;
-    eval_jmp_env = saved_jmp_env;
-    if (!out_error || !*out_error) {
-        gc_add_root((void**)&result);
-        gc_collect();
-        gc_remove_root((void**)&result);
+}
+
+static void image_write_sections(ImageWriter *w) {
+    ImageBuffer *out = &w->out;
+    image_put_bytes(out, IMAGE_MAGIC, IMAGE_MAGIC_SIZE);
+    image_put_u32(out, IMAGE_VERSION);
+    image_put_u32(out, (uint32_t)w->symbols.count);
+    image_put_u32(out, (uint32_t)w->values.count);
+    image_put_u32(out, (uint32_t)w->envs.count);
+    image_put_u32(out, (uint32_t)w->nodes.count);
+    image_put_u32(out, (uint32_t)w->bound_count);
+    image_put_u32(out, (uint32_t)w->root_count);
+
+    for (size_t i = 0; i < w->symbols.count; ++i) {
+        const char *name = SYMBOL_NAME((Value*)w->symbols.items[i]);
+        size_t length = strlen(name);
+        image_put_u32(out, (uint32_t)length);
+        image_put_bytes(out, name, length);
+    }
+    for (size_t i = 0; i < w->values.count; ++i) {
+        Value *value = (Value*)w->values.items[i];
+        image_put_u8(out, (unsigned)value->type);
+        switch (value->type) {
+            case VAL_PAIR:
+                image_put_ref(w, CAR(value));
+                image_put_ref(w, CDR(value));
+                break;
+            case VAL_NUMBER:
+                image_put_f64(out, ((Flonum*)value)->number);
+                break;
+            case VAL_STRING:
+                image_put_u32(out, (uint32_t)((String*)value)->length);
+                image_put_bytes(out, STRING_CHARS(value), ((String*)value)->length);
+                break;
+            case VAL_BUILTIN:
+                image_put_u32(out, image_table_index(&w->symbols,
+                                                     intern_symbol(builtin_entry_for(BUILTIN_FN(value))->name)));
+                break;
+            case VAL_LAMBDA:
+                image_put_u32(out, image_index_of(&w->nodes, LAMBDA_CODE(value)));
+                image_put_u32(out, image_index_of(&w->envs, LAMBDA_ENV(value)));
+                break;
+            case VAL_VECTOR:
+                image_put_u32(out, (uint32_t)VECTOR_LENGTH(value));
+                for (size_t j = 0; j < VECTOR_LENGTH(value); ++j) image_put_ref(w, VECTOR_ITEMS(value)[j]);
+                break;
+            case VAL_HASHTABLE:
+                image_put_u8(out, (unsigned)((Hashtable*)value)->test);
+                image_put_u32(out, (uint32_t)((Hashtable*)value)->count);
+                image_put_ref(w, ((Hashtable*)value)->buckets);
+                break;
+            default:
+                break;
+        }
+    }
+    for (size_t i = 0; i < w->envs.count; ++i) {
+        Env *env = (Env*)w->envs.items[i];
+        image_put_u32(out, image_index_of(&w->envs, env->parent));
+        image_put_u32(out, (uint32_t)env->count);
+        for (int j = 0; j < env->count; ++j) image_put_ref(w, env->slots[j]);
+    }
+    for (size_t i = 0; i < w->nodes.count; ++i) {
+        Node *node = (Node*)w->nodes.items[i];
+        image_put_u8(out, (unsigned)node->kind);
+        image_put_u32(out, (uint32_t)node->count);
+        image_put_u32(out, (uint32_t)node->depth);
+        image_put_u32(out, (uint32_t)node->index);
+        image_put_u32(out, (uint32_t)node->param_count);
+        image_put_u32(out, (uint32_t)node->frame_size);
+        image_put_u8(out, node->names != NULL);
+        image_put_ref(w, node->value);
+        image_put_ref(w, node->body);
+        image_put_u32(out, node->cell ? image_index_of(&w->symbols, node->cell->name) : 0);
+        if (node->names) {
+            for (int j = 0; j < node->frame_size; ++j) image_put_ref(w, node->names[j]);
+        }
+        for (int j = 0; j < node->count; ++j) {
+            image_put_u32(out, image_index_of(&w->nodes, node->children[j]));
+        }
+    }
+    for (size_t i = 0; i < w->bound_count; ++i) {
+        GlobalCell *cell = w->bound[i];
+        image_put_u32(out, image_table_index(&w->symbols, cell->name));
+        image_put_ref(w, cell->value);
+    }
+    for (size_t i = 0; i < w->root_count; ++i) image_put_ref(w, w->roots[i]);
+}
+
+// Serialize `roots` into `out` (which the caller frees), along with every
+// bound global or, with `globals` unset, the globals their code refers to.
+// Nothing is allocated on the GC heap.
+static int image_encode(ImageBuffer *out, int globals, Value **roots, size_t root_count) {
+    ImageWriter w;
+    memset(&w, 0, sizeof(w));
+    w.all_globals = globals;
+    w.referenced_globals = !globals;
+    w.roots = roots;
+    w.root_count = root_count;
+    int ok = image_collect(&w);
+    if (ok) image_write_sections(&w);
+    image_table_free(&w.symbols);
+    image_table_free(&w.values);
+    image_table_free(&w.envs);
+    image_table_free(&w.nodes);
+    image_table_free(&w.cells);
+    free(w.bound);
+    if (ok) {
+        *out = w.out;
     } else {
-        gc_collect();
+        free(w.out.data);
     }
-    return result;
+    return ok;
+}
+
+// Write the current global environment to `path`.
+static int dump_heap_image(const char *path) {
+    ImageBuffer out;
+    int ok = image_encode(&out, 1, NULL, 0);
+    if (ok) {
+        FILE *f = fopen(path, "wb");
+        ok = f && fwrite(out.data, 1, out.length, f) == out.length;
+        if (f && fclose(f) != 0) ok = 0;
+        if (!ok) fprintf(stderr, "Failed to write heap image %s\n", path);
+        free(out.data);
+    }
+    return ok;
+}
+
+typedef struct {
+    const unsigned char *pos;
+    const unsigned char *end;
+    int ok;
+} ImageReader;
+
+// Every read is bounds-checked; a short or malformed image clears `ok` and
+// yields zeros, and the caller checks `ok` once per section.
+static const unsigned char *image_get_bytes(ImageReader *r, size_t length) {
+    if (!r->ok || (size_t)(r->end - r->pos) < length) {
+        r->ok = 0;
+        return NULL;
+    }
+    const unsigned char *bytes = r->pos;
+    r->pos += length;
+    return bytes;
+}
+
+static unsigned image_get_u8(ImageReader *r) {
+    const unsigned char *bytes = image_get_bytes(r, 1);
+    return bytes ? bytes[0] : 0;
+}
+
+static uint32_t image_get_u32(ImageReader *r) {
+    const unsigned char *bytes = image_get_bytes(r, 4);
+    uint32_t value = 0;
+    if (bytes) {
+        for (int i = 0; i < 4; ++i) value |= (uint32_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t image_get_u64(ImageReader *r) {
+    const unsigned char *bytes = image_get_bytes(r, 8);
+    uint64_t value = 0;
+    if (bytes) {
+        for (int i = 0; i < 8; ++i) value |= (uint64_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+static double image_get_f64(ImageReader *r) {
+    uint64_t bits = image_get_u64(r);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// An int32 field that must lie in [0, limit].
+static int image_get_count(ImageReader *r, uint32_t limit) {
+    uint32_t value = image_get_u32(r);
+    if (value > limit) r->ok = 0;
+    return r->ok ? (int)value : 0;
+}
+
+typedef struct {
+    ImageReader reader;
+    uint32_t symbol_count;
+    uint32_t value_count;
+    uint32_t env_count;
+    uint32_t node_count;
+    uint32_t global_count;
+    uint32_t root_count;
+    Value **symbols;
+    void **objects;        // values, then environments; a GC root range
+    size_t object_count;   // entries of `objects` allocated so far
+    int objects_rooted;
+    Node **nodes;
+} ImageLoader;
+
+// Read a reference. With `resolve` unset the reference is only validated,
+// which never allocates; resolving a fixnum too wide for this build boxes it.
+static Value *image_get_ref(ImageLoader *ld, int resolve) {
+    ImageReader *r = &ld->reader;
+    switch (image_get_u8(r)) {
+        case IMAGE_REF_NULL:
+            return NULL;
+        case IMAGE_REF_NIL:
+            return NIL;
+        case IMAGE_REF_FIXNUM: {
+            int64_t n = (int64_t)image_get_u64(r);
+            if (!resolve) return NIL;
+            if (n >= (int64_t)FIXNUM_MIN && n <= -((int64_t)FIXNUM_MIN + 1)) return MAKE_FIXNUM((intptr_t)n);
+            return make_number((double)n);
+        }
+        case IMAGE_REF_SYMBOL: {
+            uint32_t index = image_get_u32(r);
+            if (index >= ld->symbol_count) break;
+            return ld->symbols[index];
+        }
+        case IMAGE_REF_VALUE: {
+            uint32_t index = image_get_u32(r);
+            if (index >= ld->value_count) break;
+            return resolve ? (Value*)ld->objects[index] : NIL;
+        }
+        default:
+            break;
+    }
+    r->ok = 0;
+    return NIL;
+}
+
+static Env *image_get_env(ImageLoader *ld) {
+    uint32_t index = image_get_u32(&ld->reader);
+    if (index > ld->env_count) ld->reader.ok = 0;
+    if (!ld->reader.ok || index == 0) return NULL;
+    return (Env*)ld->objects[ld->value_count + index - 1];
+}
+
+static Node *image_get_node(ImageLoader *ld) {
+    uint32_t index = image_get_u32(&ld->reader);
+    if (index > ld->node_count) ld->reader.ok = 0;
+    if (!ld->reader.ok || index == 0) return NULL;
+    return ld->nodes[index - 1];
+}
+
+static Value *image_alloc_value(ValueType type, size_t size, gc_trace_func trace, unsigned char tag) {
+    Value *v = (Value*)gc_allocate_old(size, trace, tag);
+    v->type = type;
+    return v;
+}
+
+// Allocate every value and environment with its leaf contents; pointer
+// fields stay empty until image_link_objects.
+static void image_allocate_objects(ImageLoader *ld) {
+    ImageReader *r = &ld->reader;
+    for (uint32_t i = 0; i < ld->value_count && r->ok; ++i) {
+        Value *value = NULL;
+        switch (image_get_u8(r)) {
+            case VAL_PAIR:
+                image_get_ref(ld, 0);
+                image_get_ref(ld, 0);
+                value = image_alloc_value(VAL_PAIR, sizeof(Pair), trace_value, GC_TAG_VALUE_PAIR);
+                CAR(value) = NIL;
+                CDR(value) = NIL;
+                break;
+            case VAL_NUMBER: {
+                double number = image_get_f64(r);
+                value = image_alloc_value(VAL_NUMBER, sizeof(Flonum), NULL, GC_TAG_VALUE_NUMBER);
+                ((Flonum*)value)->number = number;
+                break;
+            }
+            case VAL_STRING: {
+                uint32_t length = image_get_u32(r);
+                const unsigned char *chars = image_get_bytes(r, length);
+                if (!chars) break;
+                value = image_alloc_value(VAL_STRING, sizeof(String) + length + 1, NULL, GC_TAG_VALUE_STRING);
+                ((String*)value)->length = length;
+                memcpy(STRING_CHARS(value), chars, length);
+                STRING_CHARS(value)[length] = '\0';
+                break;
+            }
+            case VAL_BUILTIN: {
+                uint32_t name = image_get_u32(r);
+                const BuiltinEntry *entry = name < ld->symbol_count
+                    ? builtin_entry_named(SYMBOL_NAME(ld->symbols[name])) : NULL;
+                if (!entry) break;
+                value = make_builtin(entry->fn);
+                break;
+            }
+            case VAL_LAMBDA:
+                if (image_get_u32(r) - 1u >= ld->node_count) r->ok = 0;
+                if (image_get_u32(r) > ld->env_count) r->ok = 0;
+                value = image_alloc_value(VAL_LAMBDA, sizeof(Lambda), trace_value, GC_TAG_VALUE_LAMBDA);
+                break;
+            case VAL_VECTOR: {
+                uint32_t length = (uint32_t)image_get_count(r, (uint32_t)(r->end - r->pos));
+                for (uint32_t j = 0; j < length && r->ok; ++j) image_get_ref(ld, 0);
+                if (!r->ok) break;
+                value = image_alloc_value(VAL_VECTOR, sizeof(Vector) + sizeof(Value*) * length,
+                                          trace_value, GC_TAG_VALUE_VECTOR);
+                VECTOR_LENGTH(value) = length;
+                break;
+            }
+            case VAL_HASHTABLE: {
+                unsigned test = image_get_u8(r);
+                uint32_t count = image_get_u32(r);
+                image_get_ref(ld, 0);
+                if (test > HASH_TEST_EQUAL || !r->ok) break;
+                value = image_alloc_value(VAL_HASHTABLE, sizeof(Hashtable), trace_value, GC_TAG_VALUE_HASHTABLE);
+                ((Hashtable*)value)->test = (int)test;
+                ((Hashtable*)value)->count = count;
+                break;
+            }
+            default:
+                break;
+        }
+        if (!value) {
+            r->ok = 0;
+            break;
+        }
+        ld->objects[ld->object_count++] = value;
+    }
+    for (uint32_t i = 0; i < ld->env_count && r->ok; ++i) {
+        if (image_get_u32(r) > ld->env_count) r->ok = 0;
+        int count = image_get_count(r, (uint32_t)(r->end - r->pos));
+        for (int j = 0; j < count && r->ok; ++j) image_get_ref(ld, 0);
+        if (!r->ok) break;
+        ld->objects[ld->object_count++] = gc_allocate_old(sizeof(Env) + sizeof(Value*) * (size_t)count,
+                                                          trace_env, GC_TAG_ENV);
+        ((Env*)ld->objects[ld->object_count - 1])->count = count;
+    }
+}
+
+// Create the code nodes with their scalar fields and child arrays.
+static void image_allocate_nodes(ImageLoader *ld) {
+    ImageReader *r = &ld->reader;
+    for (uint32_t i = 0; i < ld->node_count && r->ok; ++i) {
+        unsigned kind = image_get_u8(r);
+        int count = image_get_count(r, (uint32_t)(r->end - r->pos));
+        int depth = image_get_count(r, INT32_MAX);
+        int index = image_get_count(r, INT32_MAX);
+        int param_count = image_get_count(r, INT32_MAX);
+        int frame_size = image_get_count(r, (uint32_t)(r->end - r->pos));
+        int has_names = (int)image_get_u8(r);
+        image_get_ref(ld, 0);
+        image_get_ref(ld, 0);
+        if (image_get_u32(r) > ld->symbol_count) r->ok = 0;
+        if (has_names) {
+            for (int j = 0; j < frame_size && r->ok; ++j) image_get_ref(ld, 0);
+        }
+        for (int j = 0; j < count && r->ok; ++j) {
+            if (image_get_u32(r) > ld->node_count) r->ok = 0;
+        }
+        if (kind > NODE_CALL || !r->ok) {
+            r->ok = 0;
+            break;
+        }
+        Node *node = node_new((NodeKind)kind, count);
+        node->depth = depth;
+        node->index = index;
+        node->param_count = param_count;
+        node->frame_size = frame_size;
+        if (has_names && frame_size > 0) node->names = (Value**)code_alloc(sizeof(Value*) * (size_t)frame_size);
+        ld->nodes[i] = node;
+    }
+}
+
+// Fill in node references; every index was validated by image_allocate_nodes.
+static void image_link_nodes(ImageLoader *ld) {
+    ImageReader *r = &ld->reader;
+    for (uint32_t i = 0; i < ld->node_count; ++i) {
+        Node *node = ld->nodes[i];
+        image_get_bytes(r, 1 + 5 * 4 + 1);
+        node->value = image_get_ref(ld, 1);
+        if (!value_is_static(node->value)) code_arena_add_root(&node->value);
+        node->body = image_get_ref(ld, 1);
+        if (!value_is_static(node->body)) code_arena_add_root(&node->body);
+        uint32_t cell = image_get_u32(r);
+        if (cell) node->cell = global_cell(ld->symbols[cell - 1]);
+        if (node->names) {
+            for (int j = 0; j < node->frame_size; ++j) node->names[j] = image_get_ref(ld, 1);
+        }
+        for (int j = 0; j < node->count; ++j) node->children[j] = image_get_node(ld);
+    }
+}
+
+// Fill in value and environment references. Resolving a reference may
+// allocate, so each object is re-read from the rooted table per store.
+static void image_link_objects(ImageLoader *ld) {
+    ImageReader *r = &ld->reader;
+    for (uint32_t i = 0; i < ld->value_count; ++i) {
+        unsigned type = image_get_u8(r);
+        Value *ref;
+        switch (type) {
+            case VAL_PAIR:
+                ref = image_get_ref(ld, 1);
+                pair_set_car((Value*)ld->objects[i], ref);
+                ref = image_get_ref(ld, 1);
+                pair_set_cdr((Value*)ld->objects[i], ref);
+                break;
+            case VAL_NUMBER:
+                image_get_bytes(r, 8);
+                break;
+            case VAL_STRING:
+                image_get_bytes(r, image_get_u32(r));
+                break;
+            case VAL_BUILTIN:
+                image_get_bytes(r, 4);
+                break;
+            case VAL_LAMBDA: {
+                Value *anchor = code_arena_anchor(rt->code_arena_top);
+                Value *lambda = (Value*)ld->objects[i];
+                LAMBDA_CODE(lambda) = image_get_node(ld);
+                Env *env = image_get_env(ld);
+                gc_write_barrier_fast(lambda, (void**)&LAMBDA_ENV(lambda), env);
+                LAMBDA_ENV(lambda) = env;
+                gc_write_barrier_fast(lambda, (void**)&LAMBDA_ANCHOR(lambda), anchor);
+                LAMBDA_ANCHOR(lambda) = anchor;
+                break;
+            }
+            case VAL_VECTOR: {
+                uint32_t length = image_get_u32(r);
+                for (uint32_t j = 0; j < length; ++j) {
+                    ref = image_get_ref(ld, 1);
+                    vector_set((Value*)ld->objects[i], j, ref);
+                }
+                break;
+            }
+            case VAL_HASHTABLE: {
+                image_get_bytes(r, 1 + 4);
+                Value *buckets = image_get_ref(ld, 1);
+                Hashtable *table = (Hashtable*)ld->objects[i];
+                size_t capacity = buckets && VALUE_TYPE(buckets) == VAL_VECTOR ? hash_capacity(buckets) : 0;
+                if (capacity == 0 || (capacity & (capacity - 1)) != 0 || table->count >= capacity) {
+                    r->ok = 0;
+                    break;
+                }
+                gc_set_tag(buckets, GC_TAG_HASH_BUCKETS);
+                gc_write_barrier_fast(table, (void**)&table->buckets, buckets);
+                table->buckets = buckets;
+                // Keys now live at new addresses; rehash (and recount) on first use.
+                table->address_keys = table->count;
+                table->epoch = gc_move_epoch - 1;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    for (uint32_t i = 0; i < ld->env_count; ++i) {
+        Env *parent = image_get_env(ld);
+        Env *env = (Env*)ld->objects[ld->value_count + i];
+        gc_write_barrier_fast(env, (void**)&env->parent, parent);
+        env->parent = parent;
+        int count = (int)image_get_u32(r);
+        for (int j = 0; j < count; ++j) {
+            Value *ref = image_get_ref(ld, 1);
+            env_set_slot((Env*)ld->objects[ld->value_count + i], j, ref);
+        }
+    }
+}
+
+static int image_read(ImageLoader *ld) {
+    ImageReader *r = &ld->reader;
+    const unsigned char *magic = image_get_bytes(r, IMAGE_MAGIC_SIZE);
+    if (!magic || memcmp(magic, IMAGE_MAGIC, IMAGE_MAGIC_SIZE) != 0 || image_get_u32(r) != IMAGE_VERSION) return 0;
+    ld->symbol_count = image_get_u32(r);
+    ld->value_count = image_get_u32(r);
+    ld->env_count = image_get_u32(r);
+    ld->node_count = image_get_u32(r);
+    ld->global_count = image_get_u32(r);
+    ld->root_count = image_get_u32(r);
+    // Every record takes at least a byte, which bounds the table sizes.
+    size_t remaining = (size_t)(r->end - r->pos);
+    if (!r->ok || ld->symbol_count > remaining || ld->value_count > remaining ||
+        ld->env_count > remaining || ld->node_count > remaining || ld->global_count > remaining ||
+        ld->root_count > remaining || rt->temp_root_sp + ld->root_count > MAX_TEMP_ROOTS) {
+        return 0;
+    }
+    ld->symbols = (Value**)malloc(sizeof(Value*) * ((size_t)ld->symbol_count + 1));
+    ld->objects = (void**)malloc(sizeof(void*) * ((size_t)ld->value_count + ld->env_count + 1));
+    ld->nodes = (Node**)malloc(sizeof(Node*) * ((size_t)ld->node_count + 1));
+    if (!ld->symbols || !ld->objects || !ld->nodes) return 0;
+    // Moving collectors may run while the objects are allocated.
+    gc_add_root_range(ld->objects, &ld->object_count);
+    ld->objects_rooted = 1;
+    for (uint32_t i = 0; i < ld->symbol_count && r->ok; ++i) {
+        uint32_t length = image_get_u32(r);
+        const unsigned char *name = image_get_bytes(r, length);
+        if (name) ld->symbols[i] = intern_symbol_n((const char*)name, length);
+    }
+    if (!r->ok) return 0;
+
+    const unsigned char *objects_start = r->pos;
+    image_allocate_objects(ld);
+    const unsigned char *nodes_start = r->pos;
+    image_allocate_nodes(ld);
+    const unsigned char *globals_start = r->pos;
+    for (uint32_t i = 0; i < ld->global_count && r->ok; ++i) {
+        if (image_get_u32(r) >= ld->symbol_count) r->ok = 0;
+        image_get_ref(ld, 0);
+    }
+    for (uint32_t i = 0; i < ld->root_count && r->ok; ++i) image_get_ref(ld, 0);
+    if (!r->ok) return 0;
+
+    // The image is well formed; link it, bind the globals and push the roots
+    // onto the temp root stack.
+    r->pos = nodes_start;
+    image_link_nodes(ld);
+    r->pos = objects_start;
+    image_link_objects(ld);
+    if (!r->ok) return 0;
+    r->pos = globals_start;
+    for (uint32_t i = 0; i < ld->global_count; ++i) {
+        Value *name = ld->symbols[image_get_u32(r)];
+        define_global(name, image_get_ref(ld, 1));
+    }
+    for (uint32_t i = 0; i < ld->root_count; ++i) push_root(image_get_ref(ld, 1));
+    return r->ok;
+}
+
+// Load the image of `size` bytes at `data` into the current runtime. On
+// success its roots are left on the temp root stack, in order.
+static int image_decode(const unsigned char *data, size_t size) {
+    ImageLoader ld;
+    memset(&ld, 0, sizeof(ld));
+    ld.reader.pos = data;
+    ld.reader.end = data + size;
+    ld.reader.ok = 1;
+    code_arena_push();
+    int ok = image_read(&ld);
+    // The code's closures keep it alive from here on.
+    code_arena_pop();
+    if (ld.objects_rooted) gc_remove_root_range(ld.objects);
+    free(ld.symbols);
+    free(ld.objects);
+    free(ld.nodes);
+    return ok;
+}
+
+// Rebuild the global environment from the startup image, if there is one.
+// Returns 0 when no usable image was found and the library must be loaded
+// from source instead.
+static int load_heap_image(void) {
+#ifdef __EMSCRIPTEN__
+    const char *path = "/standard-lib.image";
+#else
+    const char *path = getenv("MINIMALISP_IMAGE");
+    if (!path || !*path) return 0;
+#endif
+    SourceFile file;
+    if (!source_open(&file, path, 0)) {
+#ifndef __EMSCRIPTEN__
+        fprintf(stderr, "Warning: heap image %s not found; loading standard library from source\n", path);
+#endif
+        return 0;
+    }
+    int ok = image_decode((const unsigned char*)file.text, file.size);
+    source_close(&file);
+    if (!ok) fprintf(stderr, "Warning: heap image %s is invalid; loading standard library from source\n", path);
+    return ok;
+}
+
+// Parallel evaluation --------------------------------------------------------
+//
+// pmap and future run pure work on a pool of worker threads, each of which
+// evaluates in an isolate runtime with its own heap. A job is an in-memory
+// heap image of the procedure, its arguments and the globals the procedure
+// refers to; a worker that joins a job loads it into a fresh runtime, and
+// every result it computes travels back the same way, to be loaded straight
+// into the caller's old generation. Side effects on globals stay in the
+// worker's copy.
+//
+// The elements of a job are split into one contiguous range per participant:
+// the calling thread, which runs its share on its own heap without copying,
+// and each worker. A participant takes elements from the front of its own
+// range and, once that is empty, steals the back half of the largest share
+// left with another participant, so uneven per-element costs even out.
+//
+// MINIMALISP_WORKERS sets the number of worker threads (default: one per
+// online CPU beyond the first). With none, and in the WASM build, pmap is
+// map and a future is evaluated by its first touch.
+
+#define MAX_WORKERS 64
+// Untouched futures that force a collection once they have doubled, so
+// dropped futures are found even when their small objects never fill the heap.
+#define FUTURE_COLLECT_MIN 256
+
+#ifdef HAVE_WORKER_POOL
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} WorkRange;
+
+struct ParallelJob {
+    unsigned char *image;        // roots: procedure, argument vector
+    size_t image_size;
+    const char *backend;
+    int with_item;               // call the procedure on each element, or on nothing
+    size_t count;
+    unsigned char **results;     // result images of the elements workers ran
+    size_t *result_sizes;
+    int failed;                  // atomic
+    size_t remaining;            // elements not finished; worker_lock
+    int refs;                    // worker_lock
+    int queued;                  // worker_lock
+    ParallelJob *next;           // worker_queue
+    ParallelJob *future_prev;    // rt->futures
+    ParallelJob *future_next;
+    Value *future;               // weak root; NULL once the future is collected
+    size_t range_count;
+    WorkRange ranges[];          // [0] is the caller's
+};
+
+static pthread_once_t worker_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t worker_done = PTHREAD_COND_INITIALIZER;
+static ParallelJob *worker_queue = NULL;   // jobs that may have unclaimed elements, oldest first
+static size_t worker_count = 0;
+
+static int job_failed(ParallelJob *job) {
+    return __atomic_load_n(&job->failed, __ATOMIC_RELAXED);
 }
 
-static void trace_binding(void *obj) {
-    Binding *binding = (Binding*)obj;
-    if (binding->name) {
-        void *marked = gc_mark_ptr((void*)binding->name);
-        if (marked) binding->name = (const char*)marked;
+static void job_fail(ParallelJob *job) {
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+}
+
+// Claim an element for participant `slot`, stealing when its range is empty.
+static int job_claim(ParallelJob *job, size_t slot, size_t *index) {
+    WorkRange *own = &job->ranges[slot];
+    pthread_mutex_lock(&own->lock);
+    int claimed = own->next < own->end;
+    if (claimed) {
+        *index = own->next;
+        __atomic_store_n(&own->next, own->next + 1, __ATOMIC_RELAXED);
     }
-    if (binding->value) {
-        void *marked = gc_mark_ptr(binding->value);
-        if (marked) binding->value = marked;
+    pthread_mutex_unlock(&own->lock);
+    if (claimed) return 1;
+
+    WorkRange *victim = NULL;
+    size_t best = 0;
+    for (size_t i = 1; i < job->range_count; ++i) {
+        WorkRange *range = &job->ranges[(slot + i) % job->range_count];
+        size_t left = __atomic_load_n(&range->end, __ATOMIC_RELAXED) - __atomic_load_n(&range->next, __ATOMIC_RELAXED);
+        if (left > best && left <= job->count) {
+            best = left;
+            victim = range;
+        }
     }
-    if (binding->next) {
-        void *marked = gc_mark_ptr(binding->next);
-        if (marked) binding->next = (Binding*)marked;
+    if (!victim) return 0;
+    size_t start = 0, stop = 0;
+    pthread_mutex_lock(&victim->lock);
+    if (victim->next < victim->end) {
+        stop = victim->end;
+        start = victim->end - (victim->end - victim->next + 1) / 2;
+        __atomic_store_n(&victim->end, start, __ATOMIC_RELAXED);
     }
+    pthread_mutex_unlock(&victim->lock);
+    // Lost a race for the last elements; look again.
+    if (start == stop) return job_claim(job, slot, index);
+    pthread_mutex_lock(&own->lock);
+    __atomic_store_n(&own->next, start + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&own->end, stop, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&own->lock);
+    *index = start;
+    return 1;
 }
 
-static void trace_env(void *obj) {
-    Env *env = (Env*)obj;
-    if (env->parent) {
-        void *marked = gc_mark_ptr(env->parent);
-        if (marked) env->parent = (Env*)marked;
-    }
-    if (env->bindings) {
-        void *marked = gc_mark_ptr(env->bindings);
-        if (marked) env->bindings = (Binding*)marked;
+static int job_has_work(ParallelJob *job) {
+    for (size_t i = 0; i < job->range_count; ++i) {
+        WorkRange *range = &job->ranges[i];
+        if (__atomic_load_n(&range->next, __ATOMIC_RELAXED) < __atomic_load_n(&range->end, __ATOMIC_RELAXED)) {
+            return 1;
+        }
     }
+    return 0;
 }
 
-static void trace_value(void *obj) {
-    Value *value = (Value*)obj;
-    switch (value->type) {
-        case VAL_PAIR:
-            if (value->car) value->car = gc_mark_ptr(value->car);
-            if (value->cdr) value->cdr = gc_mark_ptr(value->cdr);
-            break;
-        case VAL_SYMBOL:
-        case VAL_STRING:
-            if (value->symbol) {
-                void *marked = gc_mark_ptr(value->symbol);
-                if (marked) value->symbol = (char*)marked;
-            }
-            break;
-        case VAL_LAMBDA:
-            if (value->params) value->params = gc_mark_ptr(value->params);
-            if (value->body) value->body = gc_mark_ptr(value->body);
-            if (value->env) value->env = (Env*)gc_mark_ptr(value->env);
-            break;
-        case VAL_BUILTIN:
-        case VAL_NUMBER:
-        case VAL_NIL:
-        default:
-            break;
+static void job_finish(ParallelJob *job) {
+    pthread_mutex_lock(&worker_lock);
+    if (--job->remaining == 0) pthread_cond_broadcast(&worker_done);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+// Caller holds worker_lock.
+static void job_dequeue(ParallelJob *job) {
+    if (!job->queued) return;
+    ParallelJob **link = &worker_queue;
+    while (*link != job) link = &(*link)->next;
+    *link = job->next;
+    job->queued = 0;
+}
+
+// Caller holds worker_lock.
+static void job_release(ParallelJob *job) {
+    if (--job->refs > 0) return;
+    for (size_t i = 0; i < job->count; ++i) free(job->results[i]);
+    for (size_t i = 0; i < job->range_count; ++i) pthread_mutex_destroy(&job->ranges[i].lock);
+    free(job->results);
+    free(job->result_sizes);
+    free(job->image);
+    free(job);
+}
+#endif
+
+// Call the procedure at temp_roots[base] on element `index` of the vector at
+// temp_roots[base + 1] (or on no arguments), catching errors here instead of
+// unwinding to the enclosing eval.
+static int parallel_call(size_t base, size_t index, int with_item, Value **result) {
+    jmp_buf *saved_jmp_env = rt->eval_jmp_env;
+    size_t saved_sp = rt->temp_root_sp;
+    size_t saved_call_depth = rt->call_stack_depth;
+    CodeArena *saved_arena = rt->code_arena_top;
+    jmp_buf local_jmp_buf;
+    int ok;
+    rt->eval_jmp_env = &local_jmp_buf;
+    if (setjmp(local_jmp_buf) == 0) {
+        push_root(with_item ? VECTOR_ITEMS(rt->temp_roots[base + 1])[index] : NIL);
+        *result = apply_procedure(rt->temp_roots[base], &rt->temp_roots[saved_sp], with_item, NULL);
+        ok = 1;
+    } else {
+        rt->call_stack_depth = saved_call_depth;
+        while (rt->code_arena_top != saved_arena) code_arena_pop();
+        ok = 0;
     }
+    rt->temp_root_sp = saved_sp;
+    rt->eval_jmp_env = saved_jmp_env;
+    return ok;
 }
 
-static void print_pair(Value *value);
-void print_value(Value *value) {
-    if (is_nil(value)) {
-        printf("()");
-    } else if (value->type == VAL_NUMBER) {
-        printf("%g", value->number);
-    } else if (value->type == VAL_SYMBOL) {
-        printf("%s", value->symbol);
-    } else if (value->type == VAL_STRING) {
-        printf("\"");
-        if (value->symbol) {
-            for (const char *p = value->symbol; *p; ++p) {
-                switch (*p) {
-                    case '\\': printf("\\\\"); break;
-                    case '"': printf("\\\""); break;
-                    case '\n': printf("\\n"); break;
-                    case '\t': printf("\\t"); break;
-                    default: putchar(*p); break;
-                }
-            }
-        }
-        printf("\"");
-    } else if (value->type == VAL_PAIR) {
-        print_pair(value);
-    } else if (value->type == VAL_BUILTIN) {
-        printf("#<builtin>");
-    } else if (value->type == VAL_LAMBDA) {
-        printf("(lambda ");
-        print_value(value->params);
-        if (value->body && !is_nil(value->body)) {
-            printf(" ");
-            Value *b = value->body;
-            while (b && b->type == VAL_PAIR) {
-                print_value(b->car);
-                b = b->cdr;
-                if (b && !is_nil(b)) printf(" ");
-            }
-            if (b && !is_nil(b)) {
-                printf(" . ");
-                print_value(b);
+#ifdef HAVE_WORKER_POOL
+static Runtime *runtime_new(const char *backend, int library);
+
+// Take part in `job` as participant `slot` until nothing is left to claim.
+static void worker_run(ParallelJob *job, size_t slot) {
+    if (!job_has_work(job)) return;
+    Runtime *runtime = runtime_new(job->backend, 0);
+    if (runtime) {
+        gc_heap_enter(runtime->heap);
+        rt = runtime;
+    }
+    int loaded = runtime && image_decode(job->image, job->image_size);
+    if (!loaded) job_fail(job);
+    size_t base = loaded ? rt->temp_root_sp - 2 : 0;
+    size_t index;
+    while (job_claim(job, slot, &index)) {
+        Value *result;
+        ImageBuffer image;
+        if (!job_failed(job)) {
+            if (!parallel_call(base, index, job->with_item, &result)) {
+                job_fail(job);
+            } else if (!image_encode(&image, 0, &result, 1)) {
+                fprintf(stderr, "Error: a parallel result cannot hold a future\n");
+                job_fail(job);
+            } else {
+                job->results[index] = image.data;
+                job->result_sizes[index] = image.length;
             }
         }
-        printf(")");
-    } else {
-        printf("<unknown>");
+        job_finish(job);
     }
+    if (runtime) runtime_destroy(runtime);
 }
 
-static void print_pair(Value *value) {
-    printf("(");
-    while (1) {
-        print_value(value->car ? value->car : NIL);
-        if (value->cdr && value->cdr->type == VAL_PAIR) {
-            printf(" ");
-            value = value->cdr;
+static void *worker_main(void *arg) {
+    size_t slot = (size_t)(uintptr_t)arg;
+    pthread_mutex_lock(&worker_lock);
+    for (;;) {
+        ParallelJob *job = worker_queue;
+        if (!job) {
+            pthread_cond_wait(&worker_wakeup, &worker_lock);
             continue;
-        } else if (is_nil(value->cdr)) {
-            break;
-        } else {
-            printf(" . ");
-            print_value(value->cdr);
-            break;
         }
+        job->refs++;
+        pthread_mutex_unlock(&worker_lock);
+        worker_run(job, slot);
+        pthread_mutex_lock(&worker_lock);
+        job_dequeue(job);
+        job_release(job);
     }
-    printf(")");
+    return NULL;
 }
 
-static char *read_line(void) {
-    size_t capacity = 128;
-    size_t len = 0;
-    char *buffer = malloc(capacity);
-    if (!buffer) return NULL;
-    int ch;
-    while ((ch = getchar()) != EOF) {
-        if (ch == '\n') break;
-        if (len + 1 >= capacity) {
-            capacity *= 2;
-            char *tmp = realloc(buffer, capacity);
-            if (!tmp) {
-                free(buffer);
-                return NULL;
-            }
-            buffer = tmp;
-        }
-        buffer[len++] = (char)ch;
+static void worker_pool_start(void) {
+    const char *env = getenv("MINIMALISP_WORKERS");
+    long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (n < 0) n = 0;
+    if (n > MAX_WORKERS) n = MAX_WORKERS;
+    for (long i = 0; i < n; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, (void*)(uintptr_t)(worker_count + 1)) != 0) break;
+        pthread_detach(thread);
+        worker_count++;
     }
-    if (ch == EOF && len == 0) {
-        free(buffer);
+}
+
+// Queue the procedure and argument vector at temp_roots[base] and [base + 1]
+// as a job of `count` elements, the first `caller_share` of which the caller
+// keeps. Returns NULL when there are no workers to run it or it refers to a
+// future; the caller then runs all of it.
+static ParallelJob *job_submit(size_t base, size_t count, int with_item, int caller_share) {
+    pthread_once(&worker_once, worker_pool_start);
+    if (worker_count == 0) return NULL;
+    ImageBuffer image;
+    if (!image_encode(&image, 0, &rt->temp_roots[base], 2)) return NULL;
+    size_t range_count = worker_count + 1;
+    ParallelJob *job = (ParallelJob*)calloc(1, sizeof(ParallelJob) + range_count * sizeof(WorkRange));
+    if (job) {
+        job->results = (unsigned char**)calloc(count, sizeof(unsigned char*));
+        job->result_sizes = (size_t*)calloc(count, sizeof(size_t));
+    }
+    if (!job || !job->results || !job->result_sizes) {
+        if (job) {
+            free(job->results);
+            free(job->result_sizes);
+        }
+        free(job);
+        free(image.data);
         return NULL;
     }
-    buffer[len] = '\0';
-    return buffer;
+    job->image = image.data;
+    job->image_size = image.length;
+    job->backend = gc_heap_backend_name(rt->heap);
+    job->with_item = with_item;
+    job->count = count;
+    job->remaining = count;
+    job->refs = 1;
+    job->range_count = range_count;
+    size_t shared = count - caller_share, workers = range_count - 1;
+    for (size_t i = 0; i < range_count; ++i) {
+        pthread_mutex_init(&job->ranges[i].lock, NULL);
+        if (i == 0) {
+            job->ranges[i].end = caller_share;
+        } else {
+            job->ranges[i].next = caller_share + shared * (i - 1) / workers;
+            job->ranges[i].end = caller_share + shared * i / workers;
+        }
+    }
+    pthread_mutex_lock(&worker_lock);
+    ParallelJob **link = &worker_queue;
+    while (*link) link = &(*link)->next;
+    *link = job;
+    job->queued = 1;
+    pthread_cond_broadcast(&worker_wakeup);
+    pthread_mutex_unlock(&worker_lock);
+    return job;
 }
 
-static void append_line(char **buffer, size_t *len, size_t *capacity, const char *line) {
-    size_t line_len = strlen(line);
-    size_t needed = *len + line_len + 2;
-    if (needed > *capacity) {
-        size_t new_cap = *capacity ? *capacity : 128;
-        while (new_cap < needed) new_cap *= 2;
-        char *tmp = realloc(*buffer, new_cap);
-        if (!tmp) {
-            fprintf(stderr, "Out of memory while reading input\n");
-            exit(1);
+// Wait for the workers to finish the claimed elements of `job`, after the
+// caller has claimed the rest.
+static void job_wait(ParallelJob *job) {
+    pthread_mutex_lock(&worker_lock);
+    job_dequeue(job);
+    while (job->remaining) pthread_cond_wait(&worker_done, &worker_lock);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+static void job_drop(ParallelJob *job) {
+    pthread_mutex_lock(&worker_lock);
+    job_release(job);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+// Stop a job nobody will collect and wait for its running elements.
+static void job_abandon(ParallelJob *job) {
+    size_t index;
+    job_fail(job);
+    while (job_claim(job, 0, &index)) job_finish(job);
+    job_wait(job);
+    job_drop(job);
+}
+
+// Stop a job nobody will collect without waiting for its running elements;
+// the workers running them release it when they finish.
+static void job_cancel(ParallelJob *job) {
+    size_t index;
+    job_fail(job);
+    while (job_claim(job, 0, &index)) job_finish(job);
+    pthread_mutex_lock(&worker_lock);
+    job_dequeue(job);
+    job_release(job);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+static void future_unlink(ParallelJob *job) {
+    if (job->future_prev) job->future_prev->future_next = job->future_next;
+    else rt->futures = job->future_next;
+    if (job->future_next) job->future_next->future_prev = job->future_prev;
+    gc_remove_weak_root((void**)&job->future);
+    rt->future_count--;
+}
+
+static void future_link(ParallelJob *job, Value *future) {
+    job->future_next = rt->futures;
+    if (rt->futures) rt->futures->future_prev = job;
+    rt->futures = job;
+    rt->future_count++;
+    job->future = future;
+    gc_add_weak_root((void**)&job->future);
+}
+
+// Cancel the jobs of the futures collected since the last check, collecting
+// first once the jobs have doubled since then. May collect.
+static void futures_release_dead(void) {
+    if (rt->future_count >= FUTURE_COLLECT_MIN && rt->future_count >= 2 * rt->futures_survived) gc_collect();
+    double collections = gc_get_collections_count();
+    if (collections == rt->futures_checked) return;
+    rt->futures_checked = collections;
+    ParallelJob *job = rt->futures;
+    while (job) {
+        ParallelJob *next = job->future_next;
+        if (!job->future) {
+            future_unlink(job);
+            job_cancel(job);
         }
-        *buffer = tmp;
-        *capacity = new_cap;
+        job = next;
     }
-    memcpy(*buffer + *len, line, line_len);
-    *len += line_len;
-    (*buffer)[(*len)++] = '\n';
-    (*buffer)[*len] = '\0';
+    rt->futures_survived = rt->future_count;
 }
+#endif
 
-static int buffer_has_content(const char *buffer) {
-    if (!buffer) return 0;
-    for (const char *p = buffer; *p; ++p) {
-        if (!isspace((unsigned char)*p)) return 1;
+static void parallel_runtime_destroy(void) {
+#ifdef HAVE_WORKER_POOL
+    while (rt->futures) {
+        ParallelJob *job = rt->futures;
+        future_unlink(job);
+        job_abandon(job);
     }
-    return 0;
+#endif
 }
 
-#ifdef __EMSCRIPTEN__
-EMSCRIPTEN_KEEPALIVE
+// (pmap f list) is (map f list) with the calls spread over the worker pool.
+// f must be pure: it sees a copy of the globals it refers to and its
+// results are copied back.
+static Value *builtin_pmap(Value **args, int argc, Env *env) {
+    if (argc != 2) runtime_error("pmap expects two arguments");
+    if (!args[0] || (VALUE_TYPE(args[0]) != VAL_LAMBDA && VALUE_TYPE(args[0]) != VAL_BUILTIN)) {
+        runtime_error("pmap expects a procedure");
+    }
+    Value *cursor = args[1];
+    for (; is_pair(cursor); cursor = CDR(cursor)) {}
+    expect_list_end(cursor, "pmap expects a list");
+    size_t base = rt->temp_root_sp;
+    push_root(args[0]);
+    push_root(builtin_list_to_vector(&args[1], 1, env));
+    size_t count = VECTOR_LENGTH(rt->temp_roots[base + 1]);
+    push_root(make_vector(count, NIL, GC_TAG_VALUE_VECTOR));
+#ifdef HAVE_WORKER_POOL
+    ParallelJob *job = NULL;
+    if (count > 1) {
+        size_t participants = worker_count + 1;
+        job = job_submit(base, count, 1, (count + participants - 1) / participants);
+    }
 #endif
-int form_needs_more_input(const char *buffer) {
-    if (!buffer) return 0;
-    int depth = 0;
-    int in_string = 0;
-    int escaping = 0;
-    for (const char *p = buffer; *p; ++p) {
-        char c = *p;
-        if (in_string) {
-            if (escaping) {
-                escaping = 0;
-            } else if (c == '\\') {
-                escaping = 1;
-            } else if (c == '"') {
-                in_string = 0;
+    int failed = 0;
+    size_t index = 0;
+    Value *result;
+    for (;;) {
+#ifdef HAVE_WORKER_POOL
+        if (job) {
+            if (!job_claim(job, 0, &index)) break;
+            if (!job_failed(job)) {
+                if (parallel_call(base, index, 1, &result)) vector_set(rt->temp_roots[base + 2], index, result);
+                else job_fail(job);
             }
+            job_finish(job);
             continue;
         }
-        if (c == '"') {
-            in_string = 1;
-            continue;
-        }
-        if (c == ';') {
-            while (*p && *p != '\n') p++;
-            if (!*p) break;
-            continue;
-        }
-        if (c == '(') depth++;
-        else if (c == ')') {
-            if (depth > 0) depth--;
-        }
-    }
-    return depth > 0 || in_string;
-}
-
-static void repl(void) {
-    printf("Minimalisp REPL. Press Ctrl-D to exit.\n");
-    char *form_buffer = NULL;
-    size_t buf_len = 0;
-    size_t buf_capacity = 0;
-    while (1) {
-        printf(buf_len ? "...> " : "ml> ");
-        fflush(stdout);
-        char *line = read_line();
-        if (!line) {
-            printf("\n");
+#endif
+        if (index == count) break;
+        if (!parallel_call(base, index, 1, &result)) {
+            failed = 1;
             break;
         }
-        if (line[0] == '\0' && buf_len == 0) {
-            free(line);
-            continue;
-        }
-        append_line(&form_buffer, &buf_len, &buf_capacity, line);
-        free(line);
-        if (!buffer_has_content(form_buffer)) {
-            buf_len = 0;
-            if (form_buffer) form_buffer[0] = '\0';
-            continue;
-        }
-        if (form_needs_more_input(form_buffer)) {
-            continue;
-        }
-        int had_error = 0;
-        Value *value = eval_source(form_buffer, &had_error);
-        if (!had_error) {
-            print_value(value);
-            printf("\n");
+        vector_set(rt->temp_roots[base + 2], index++, result);
+    }
+#ifdef HAVE_WORKER_POOL
+    if (job) {
+        job_wait(job);
+        failed = job_failed(job);
+        for (size_t i = 0; i < count && !failed; ++i) {
+            if (!job->results[i]) continue;
+            if (!image_decode(job->results[i], job->result_sizes[i])) {
+                failed = 1;
+                break;
+            }
+            vector_set(rt->temp_roots[base + 2], i, rt->temp_roots[rt->temp_root_sp - 1]);
+            pop_root();
         }
-        buf_len = 0;
-        if (form_buffer) form_buffer[0] = '\0';
+        job_drop(job);
     }
-    free(form_buffer);
+#endif
+    if (failed) runtime_error("pmap: the procedure failed");
+    Value *list = builtin_vector_to_list(&rt->temp_roots[base + 2], 1, env);
+    rt->temp_root_sp = base;
+    return list;
 }
 
-static char *read_file_internal(const char *path, int warn_on_error) {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        if (warn_on_error) fprintf(stderr, "Failed to open %s\n", path);
-        return NULL;
-    }
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    rewind(f);
-    char *buffer = (char*)malloc(size + 1);
-    if (!buffer) {
-        fclose(f);
-        return NULL;
+// (future thunk) starts (thunk) on a worker; (touch f) waits for its value.
+static Value *builtin_future(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("future expects one argument");
+    if (!args[0] || (VALUE_TYPE(args[0]) != VAL_LAMBDA && VALUE_TYPE(args[0]) != VAL_BUILTIN)) {
+        runtime_error("future expects a procedure");
     }
-    if (fread(buffer, 1, size, f) != (size_t)size) {
-        fclose(f);
-        free(buffer);
-        return NULL;
+    Value *v = alloc_value(VAL_FUTURE, sizeof(Future), trace_value, GC_TAG_VALUE_FUTURE);
+    Future *future = (Future*)v;
+    future->job = NULL;
+    future->thunk = args[0];
+    future->value = NIL;
+    future->resolved = 0;
+#ifdef HAVE_WORKER_POOL
+    size_t base = rt->temp_root_sp;
+    push_root(args[0]);
+    push_root(NIL);
+    push_root(v);
+    futures_release_dead();
+    ParallelJob *job = job_submit(base, 1, 0, 0);
+    v = rt->temp_roots[base + 2];
+    rt->temp_root_sp = base;
+    if (job) {
+        future_link(job, v);
+        ((Future*)v)->job = job;
     }
-    buffer[size] = '\0';
-    fclose(f);
-    return buffer;
-}
-
-static char *read_file(const char *path) {
-    return read_file_internal(path, 1);
-}
-
-static void load_standard_library(void) {
-    static int loaded = 0;
-    if (loaded) return;
-    loaded = 1;
-    const char *paths[] = {
-        "standard-lib.lisp",
-#ifdef __EMSCRIPTEN__
-        "/standard-lib.lisp",
 #endif
-        NULL
-    };
-    char *contents = NULL;
-    for (int i = 0; paths[i]; ++i) {
-        contents = read_file_internal(paths[i], 0);
-        if (contents) break;
-    }
-    if (!contents) {
-        fprintf(stderr, "Warning: standard-lib.lisp not found; continuing without standard library\n");
-        return;
-    }
-    int had_error = 0;
-    Value *value = eval_source(contents, &had_error);
-    (void)value;
-    if (had_error) {
-        fprintf(stderr, "Warning: Failed to load standard-lib.lisp\n");
-    }
-    free(contents);
+    return v;
 }
 
-static void print_value_to_buffer(char *buffer, size_t size, Value *value) {
-    if (size == 0) return;
-    buffer[0] = '\0';
-    append_value_to_buffer(buffer, size, value);
+// Touching anything but a future returns it unchanged. A future no worker
+// has started yet is evaluated by the caller.
+static Value *builtin_touch(Value **args, int argc, Env *env) {
+    (void)env;
+    if (argc != 1) runtime_error("touch expects one argument");
+    if (!args[0] || VALUE_TYPE(args[0]) != VAL_FUTURE) return args[0];
+    if (((Future*)args[0])->resolved) return ((Future*)args[0])->value;
+    size_t base = rt->temp_root_sp;
+    push_root(((Future*)args[0])->thunk);
+    push_root(NIL);
+    int ok = 1;
+    Value *result = NIL;
+    ParallelJob *job = ((Future*)args[0])->job;
+#ifdef HAVE_WORKER_POOL
+    if (job) {
+        size_t index;
+        if (job_claim(job, 0, &index)) {
+            if (!parallel_call(base, 0, 0, &result)) job_fail(job);
+            job_finish(job);
+        }
+        job_wait(job);
+        ok = !job_failed(job);
+        if (ok && job->results[0]) {
+            ok = image_decode(job->results[0], job->result_sizes[0]);
+            if (ok) result = rt->temp_roots[--rt->temp_root_sp];
+        }
+        future_unlink(job);
+        job_drop(job);
+        ((Future*)args[0])->job = NULL;
+    }
+#endif
+    if (!job) ok = parallel_call(base, 0, 0, &result);
+    rt->temp_root_sp = base;
+    if (!ok) runtime_error("touch: the future failed");
+    Future *future = (Future*)args[0];
+    gc_write_barrier_fast(future, (void**)&future->value, result);
+    future->value = result;
+    future->thunk = NULL;
+    future->resolved = 1;
+    return result;
 }
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 EMSCRIPTEN_KEEPALIVE
 #endif
+// The returned text stays valid until the next call.
 const char* eval(const char *src) {
-    static char output_buffer[1024];
-    output_buffer[0] = '\0';
+    runtime_init();
+    rt->eval_output.length = 0;
     
     int had_error = 0;
     Value *value = eval_source(src, &had_error);
     
     if (had_error) {
-        snprintf(output_buffer, sizeof(output_buffer), "Error");
-        return output_buffer;
+        sb_append(&rt->eval_output, "Error");
+    } else if (!value) {
+        sb_append(&rt->eval_output, "nil");
+    } else {
+        sb_append_value(&rt->eval_output, value, 1);
     }
-    
-    if (!value) {
-        snprintf(output_buffer, sizeof(output_buffer), "nil");
-        return output_buffer;
+    return sb_text(&rt->eval_output);
+}
+
+// A runtime created without the library starts with only the builtins.
+static Runtime *runtime_new(const char *backend, int library) {
+    Runtime *runtime = (Runtime*)calloc(1, sizeof(Runtime));
+    if (!runtime) return NULL;
+    runtime->library_loaded = !library;
+    runtime->heap = gc_heap_create(backend);
+    if (!runtime->heap) {
+        free(runtime);
+        return NULL;
     }
-    
-    print_value_to_buffer(output_buffer, sizeof(output_buffer), value);
-    return output_buffer;
+    runtime->owns_heap = 1;
+    Runtime *saved = rt;
+    GcHeap *saved_heap = gc_heap_enter(runtime->heap);
+    rt = runtime;
+    runtime_init();
+    rt = saved;
+    gc_heap_enter(saved_heap);
+    return runtime;
+}
+
+Runtime *runtime_create(const char *backend) {
+    return runtime_new(backend, 1);
+}
+
+void runtime_destroy(Runtime *runtime) {
+    if (!runtime) return;
+    Runtime *saved = rt;
+    GcHeap *saved_heap = gc_heap_enter(runtime->heap);
+    rt = runtime;
+    eval_profile_stop();
+    parallel_runtime_destroy();
+    while (rt->code_arena_top) code_arena_pop();
+    while (rt->kept_arenas) {
+        CodeArena *arena = rt->kept_arenas;
+        rt->kept_arenas = arena->outer;
+        code_arena_free(arena);
+    }
+    for (size_t i = 0; i < rt->symbol_table.capacity; ++i) {
+        if (rt->symbol_table.entries[i] != TRUE) free(rt->symbol_table.entries[i]);
+    }
+    free(rt->symbol_table.entries);
+    for (size_t i = 0; i < rt->globals.capacity; ++i) free(rt->globals.cells[i]);
+    free(rt->globals.cells);
+    free(rt->call_stack);
+    stack_table_free(&rt->alloc_sites);
+    stack_table_free(&rt->eval_stacks);
+    stack_table_free(&rt->eval_functions);
+    free(rt->eval_output.data);
+    gc_heap_destroy(runtime->heap);
+    rt = saved == runtime ? NULL : saved;
+    gc_heap_enter(saved_heap == runtime->heap ? NULL : saved_heap);
+    free(runtime);
+}
+
+const char *runtime_eval(Runtime *runtime, const char *src) {
+    Runtime *saved = rt;
+    GcHeap *saved_heap = gc_heap_enter(runtime->heap);
+    rt = runtime;
+    const char *text = eval(src);
+    rt = saved;
+    gc_heap_enter(saved_heap);
+    return text;
 }
 
 #ifndef __EMSCRIPTEN__
@@ -1458,12 +4974,18 @@ int main(int argc, char **argv) {
         repl();
         return 0;
     }
-    if (argc == 3 && strcmp(argv[1], "-f") == 0) {
-        char *contents = read_file(argv[2]);
-        if (!contents) return 1;
+    if (argc == 3 && strcmp(argv[1], "--dump-image") == 0) {
+        runtime_init();
+        return dump_heap_image(argv[2]) ? 0 : 1;
+    }
+    // -f FILE [EXPR]: evaluate FILE, then EXPR in the globals it defined.
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "-f") == 0) {
+        SourceFile file;
+        if (!source_open(&file, argv[2], 1)) return 1;
         int had_error = 0;
-        Value *value = eval_source(contents, &had_error);
-        free(contents);
+        Value *value = eval_source_file(&file, &had_error);
+        source_close(&file);
+        if (!had_error && argc == 4) value = eval_source(argv[3], &had_error);
         if (had_error) return 1;
         printf("Result: ");
         print_value(value);
@@ -0,0 +1,17 @@
+; List builders shared by the test-native GC cases:
+;   ./interpreter -f tests/lists.lisp "(car (build 10 nil))"
+
+; (n ... 1) consed onto acc, one pair per step.
+(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))
+
+; Allocate i short-lived lists of 200 pairs.
+(define (churn i) (if (= i 0) 'done (begin (build 200 nil) (churn (- i 1)))))
+
+; Unlink every other pair of l in place, leaving holes between survivors.
+(define (thin l) (if (null? l) 'ok (if (null? (cdr l)) 'ok (begin (set-cdr! l (cdr (cdr l))) (thin (cdr l))))))
+
+; Keep i thinned 8000-pair lists, consed onto keep: a fragmented old space.
+(define (thinned-rounds i keep) (if (= i 0) keep (begin (define more (build 8000 nil)) (thin more) (thinned-rounds (- i 1) (cons more keep)))))
+
+; A list nested n levels deep in its car, ((((...)))), for C-stack depth tests.
+(define (nest n) (if (= n 0) nil (list (nest (- n 1)))))